@@ -1,65 +1,114 @@
-(function() {
-  function clickButton(selector) {
-    const button = document.querySelector(selector);
-    if (button) {
-      button.click();
-      return true;
-    }
-    return false;
-  }
-
-  function executeMediaCommand(command) {
-    try {
-      switch (command) {
-        case 'playpause':
-          return clickButton('ytmusic-player-bar #play-pause-button button');
-        
-        case 'next':
-          return clickButton('ytmusic-player-bar .next-button button');
-        
-        case 'previous':
-          return clickButton('ytmusic-player-bar .previous-button button');
-        
-        case 'stop':
-          const video = document.querySelector('video');
-          if (video) {
-            video.pause();
-            video.currentTime = 0;
-            return true;
-          }
-          return false;
-        
-        default:
-          console.warn('Unknown media command:', command);
-          return false;
-      }
-    } catch (error) {
-      console.error('Media command error:', error);
-      return false;
-    }
-  }
-
-  window.executeMediaCommand = executeMediaCommand;
-
-  if ('mediaSession' in navigator) {
-    navigator.mediaSession.setActionHandler('play', () => {
-      executeMediaCommand('play');
-    });
-
-    navigator.mediaSession.setActionHandler('pause', () => {
-      executeMediaCommand('pause');
-    });
-
-    navigator.mediaSession.setActionHandler('previoustrack', () => {
-      executeMediaCommand('previous');
-    });
-
-    navigator.mediaSession.setActionHandler('nexttrack', () => {
-      executeMediaCommand('next');
-    });
-
-    navigator.mediaSession.setActionHandler('stop', () => {
-      executeMediaCommand('stop');
-    });
-  }
-})();
+(function() {
+  const PLAY_PAUSE_SELECTOR = 'ytmusic-player-bar #play-pause-button button';
+
+  function clickButton(selector) {
+    const button = document.querySelector(selector);
+    if (button) {
+      button.click();
+      return true;
+    }
+    return false;
+  }
+
+  function setPaused(paused) {
+    const video = document.querySelector('video');
+    if (video && video.paused === paused) {
+      return true;
+    }
+    return clickButton(PLAY_PAUSE_SELECTOR);
+  }
+
+  function withVideo(action) {
+    const video = document.querySelector('video');
+    if (!video) {
+      return false;
+    }
+    action(video);
+    return true;
+  }
+
+  function executeMediaCommand(command, params) {
+    params = params || {};
+    try {
+      switch (command) {
+        case 'play':
+          return setPaused(false);
+
+        case 'pause':
+          return setPaused(true);
+
+        case 'playpause':
+          return clickButton(PLAY_PAUSE_SELECTOR);
+        
+        case 'next':
+          return clickButton('ytmusic-player-bar .next-button button');
+        
+        case 'previous':
+          return clickButton('ytmusic-player-bar .previous-button button');
+        
+        case 'stop':
+          return withVideo(video => {
+            video.pause();
+            video.currentTime = 0;
+          });
+
+        // Times arrive in microseconds, as used by MPRIS.
+        case 'seek':
+          return withVideo(video => {
+            video.currentTime = Math.max(
+              0, video.currentTime + (params.offset || 0) / 1e6);
+          });
+
+        case 'setposition':
+          return withVideo(video => {
+            video.currentTime = (params.position || 0) / 1e6;
+          });
+
+        case 'setvolume':
+          return withVideo(video => {
+            video.volume = Math.min(1, Math.max(0, params.volume));
+          });
+
+        case 'setrate':
+          return withVideo(video => {
+            video.playbackRate = params.rate;
+          });
+        
+        default:
+          console.warn('Unknown media command:', command);
+          return false;
+      }
+    } catch (error) {
+      console.error('Media command error:', error);
+      return false;
+    }
+  }
+
+  window.executeMediaCommand = executeMediaCommand;
+
+  if ('mediaSession' in navigator) {
+    navigator.mediaSession.setActionHandler('play', () => {
+      executeMediaCommand('play');
+    });
+
+    navigator.mediaSession.setActionHandler('pause', () => {
+      executeMediaCommand('pause');
+    });
+
+    navigator.mediaSession.setActionHandler('previoustrack', () => {
+      executeMediaCommand('previous');
+    });
+
+    navigator.mediaSession.setActionHandler('nexttrack', () => {
+      executeMediaCommand('next');
+    });
+
+    navigator.mediaSession.setActionHandler('stop', () => {
+      executeMediaCommand('stop');
+    });
+
+    navigator.mediaSession.setActionHandler('seekto', (details) => {
+      executeMediaCommand('setposition', {position: details.seekTime * 1e6});
+    });
+  }
+})();
@@ -1,8 +1,20 @@
-enum MediaCommand { play, pause, playPause, next, previous, stop }
-
-class PlaybackCommand {
-  final MediaCommand command;
-  final Map<String, dynamic>? params;
-
-  const PlaybackCommand({required this.command, this.params});
-}
+enum MediaCommand {
+  play,
+  pause,
+  playPause,
+  next,
+  previous,
+  stop,
+  seek,
+  setPosition,
+  setVolume,
+  setRate,
+  openUri,
+}
+
+class PlaybackCommand {
+  final MediaCommand command;
+  final Map<String, dynamic>? params;
+
+  const PlaybackCommand({required this.command, this.params});
+}
@@ -1 +1 @@
-enum PlaybackState { playing, paused, stopped, buffering }
+enum PlaybackState { playing, paused, stopped, buffering }
@@ -0,0 +1,437 @@
+import 'dart:collection';
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'native_buffer.dart';
+
+/// Mirrors AssetCacheStats in linux/runner/asset_cache.h.
+final class _Stats extends Struct {
+  @Uint64()
+  external int hits;
+
+  @Uint64()
+  external int misses;
+
+  @Uint64()
+  external int stores;
+
+  @Uint64()
+  external int evictions;
+
+  @Uint64()
+  external int compactions;
+
+  @Uint32()
+  external int entries;
+
+  @Uint32()
+  external int bodies;
+
+  @Uint64()
+  external int liveBytes;
+
+  @Uint64()
+  external int fileBytes;
+}
+
+typedef _New = Pointer<Void> Function(Pointer<Uint8>, Uint64);
+typedef _NewDart = Pointer<Void> Function(Pointer<Uint8>, int);
+typedef _Free = Void Function(Pointer<Void>);
+typedef _FreeDart = void Function(Pointer<Void>);
+typedef _Lookup = Pointer<Void> Function(Pointer<Void>, Pointer<Uint8>, Size);
+typedef _LookupDart = Pointer<Void> Function(Pointer<Void>, Pointer<Uint8>, int);
+typedef _HitBody = Pointer<Uint8> Function(Pointer<Void>);
+typedef _HitLength = Size Function(Pointer<Void>);
+typedef _HitLengthDart = int Function(Pointer<Void>);
+typedef _Put =
+    Void Function(
+      Pointer<Void>,
+      Pointer<Uint8>,
+      Size,
+      Pointer<Uint8>,
+      Size,
+      Pointer<Uint8>,
+      Size,
+    );
+typedef _PutDart =
+    void Function(
+      Pointer<Void>,
+      Pointer<Uint8>,
+      int,
+      Pointer<Uint8>,
+      int,
+      Pointer<Uint8>,
+      int,
+    );
+typedef _GetStats = Void Function(Pointer<Void>, Pointer<_Stats>);
+typedef _GetStatsDart = void Function(Pointer<Void>, Pointer<_Stats>);
+
+/// A static asset served from the cache.
+class CachedAsset {
+  final Uint8List body;
+
+  /// The stored response headers, by lower-case name.
+  final Map<String, String> headers;
+
+  const CachedAsset(this.body, this.headers);
+
+  String? get contentType => headers['content-type']?.split(';').first.trim();
+
+  String? get charset {
+    final match = RegExp(
+      r'charset=([^;\s]+)',
+    ).firstMatch(headers['content-type'] ?? '');
+    return match?.group(1);
+  }
+}
+
+/// Where [AssetCache] keeps response bodies by URL.
+abstract class AssetStore {
+  /// Returns the stored asset for [url], or null.
+  CachedAsset? lookup(String url);
+
+  /// Stores [body] and [headers] for [url], replacing what was there.
+  void put(String url, Map<String, String> headers, Uint8List body);
+
+  /// Hits and misses since the store was opened.
+  ({int hits, int misses}) get stats;
+
+  /// Finishes pending stores and closes the store.
+  void dispose();
+}
+
+/// The runner's asset cache (linux/runner/asset_cache.h).
+class _NativeAssetStore implements AssetStore {
+  final Pointer<Void> _cache;
+  final _FreeDart _free;
+  final _LookupDart _lookup;
+  final _HitBody _hitBody;
+  final _HitLengthDart _hitBodyLength;
+  final _HitBody _hitHeaders;
+  final _FreeDart _hitFree;
+  final _PutDart _put;
+  final _GetStatsDart _getStats;
+  final NativeBuffer _url;
+  final NativeBuffer _headers;
+  final NativeBuffer _body;
+  final NativeBuffer _stats;
+
+  _NativeAssetStore._(
+    this._cache,
+    this._free,
+    this._lookup,
+    this._hitBody,
+    this._hitBodyLength,
+    this._hitHeaders,
+    this._hitFree,
+    this._put,
+    this._getStats,
+    DynamicLibrary process,
+  ) : _url = NativeBuffer(process),
+      _headers = NativeBuffer(process),
+      _body = NativeBuffer(process),
+      _stats = NativeBuffer(process);
+
+  /// Opens the cache in the user's cache directory, or returns null where
+  /// the runner does not export one or the directory cannot be used.
+  static _NativeAssetStore? open() {
+    if (!Platform.isLinux) return null;
+    try {
+      final process = DynamicLibrary.process();
+      final create = process.lookupFunction<_New, _NewDart>('asset_cache_new');
+      final cache = create(nullptr, 0);
+      if (cache == nullptr) return null;
+      return _NativeAssetStore._(
+        cache,
+        process.lookupFunction<_Free, _FreeDart>('asset_cache_free'),
+        process.lookupFunction<_Lookup, _LookupDart>(
+          'asset_cache_lookup',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_HitBody, _HitBody>(
+          'asset_cache_hit_body',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_HitLength, _HitLengthDart>(
+          'asset_cache_hit_body_length',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_HitBody, _HitBody>(
+          'asset_cache_hit_headers',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_Free, _FreeDart>(
+          'asset_cache_hit_free',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_Put, _PutDart>('asset_cache_put', isLeaf: true),
+        process.lookupFunction<_GetStats, _GetStatsDart>(
+          'asset_cache_get_stats',
+          isLeaf: true,
+        ),
+        process,
+      );
+    } catch (_) {
+      return null;
+    }
+  }
+
+  @override
+  CachedAsset? lookup(String url) {
+    final bytes = utf8.encode(url);
+    final hit = _lookup(_cache, _url.copy(bytes), bytes.length);
+    if (hit == nullptr) return null;
+    try {
+      final body = Uint8List.fromList(
+        _hitBody(hit).asTypedList(_hitBodyLength(hit)),
+      );
+      final headersPointer = _hitHeaders(hit);
+      final headers = AssetCache.parseHeaders(
+        utf8.decode(
+          headersPointer.asTypedList(cStringLength(headersPointer)),
+          allowMalformed: true,
+        ),
+      );
+      return CachedAsset(body, headers);
+    } finally {
+      _hitFree(hit);
+    }
+  }
+
+  @override
+  void put(String url, Map<String, String> headers, Uint8List body) {
+    final urlBytes = utf8.encode(url);
+    final headerBytes = utf8.encode(AssetCache.formatHeaders(headers));
+    _put(
+      _cache,
+      _url.copy(urlBytes),
+      urlBytes.length,
+      _headers.copy(headerBytes),
+      headerBytes.length,
+      _body.copy(body),
+      body.length,
+    );
+  }
+
+  @override
+  ({int hits, int misses}) get stats {
+    final stats = _stats.copy(Uint8List(sizeOf<_Stats>())).cast<_Stats>();
+    _getStats(_cache, stats);
+    return (hits: stats.ref.hits, misses: stats.ref.misses);
+  }
+
+  @override
+  void dispose() {
+    _free(_cache);
+    _url.dispose();
+    _headers.dispose();
+    _body.dispose();
+    _stats.dispose();
+  }
+}
+
+/// Keeps the page's immutable static assets — its versioned script and
+/// style bundles, fonts and icons — on disk with the runner's asset cache,
+/// so a launch serves them from request interception instead of waiting
+/// on the network. Only hits are intercepted: a miss is left to the
+/// WebView and queued with [queueFill], to be downloaded and stored once
+/// [startFilling] says the page has loaded, so neither the page's requests
+/// nor its bandwidth during launch ever wait on a download of ours.
+class AssetCache {
+  /// Headers kept with a stored body; the rest describe the transfer, not
+  /// the asset.
+  static const List<String> storedHeaders = [
+    'content-type',
+    'access-control-allow-origin',
+    'cross-origin-resource-policy',
+    'timing-allow-origin',
+  ];
+
+  /// Bodies above this are passed through rather than stored.
+  static const int maxBodySize = 8 * 1024 * 1024;
+
+  /// Static assets live under versioned paths, so what is stored never goes
+  /// stale; the WebView is told the same.
+  static const String cacheControl = 'public, max-age=31536000, immutable';
+
+  /// Queued misses downloaded at once after [startFilling].
+  static const int fillConcurrency = 2;
+
+  static const Duration _fetchTimeout = Duration(seconds: 30);
+
+  final AssetStore _store;
+  final HttpClient _client = HttpClient()..autoUncompress = true;
+
+  /// URLs [fill] or [queueFill] has been given, so each is downloaded at
+  /// most once a session however often the page requests it.
+  final Set<String> _filled = {};
+  final Queue<(String, Map<String, String>?)> _queued = Queue();
+  int _active = 0;
+  bool _filling = false;
+  bool _disposed = false;
+
+  AssetCache(this._store);
+
+  /// Opens the runner's cache in the user's cache directory, or returns
+  /// null where the runner does not export one or the directory cannot be
+  /// used.
+  static AssetCache? open() {
+    final store = _NativeAssetStore.open();
+    return store == null ? null : AssetCache(store);
+  }
+
+  /// Whether a request for [url] is for a static asset worth caching:
+  /// a GET from the YouTube hosts' versioned /s/ paths, or from gstatic.
+  static bool isCacheable(Uri url, {String method = 'GET'}) {
+    if (method.toUpperCase() != 'GET' || url.scheme != 'https') return false;
+    final host = url.host.toLowerCase();
+    if (host == 'gstatic.com' || host.endsWith('.gstatic.com')) return true;
+    return (host == 'music.youtube.com' || host == 'www.youtube.com') &&
+        url.path.startsWith('/s/');
+  }
+
+  /// Whether a response may be stored: a complete, public response that
+  /// sets no cookie and is meant to be cached for at least a day.
+  static bool isStorable(
+    int statusCode, {
+    String? cacheControl,
+    bool setsCookie = false,
+  }) {
+    if (statusCode != HttpStatus.ok || setsCookie) return false;
+    final directives = cacheControl?.toLowerCase() ?? '';
+    if (directives.contains('no-store') ||
+        directives.contains('no-cache') ||
+        directives.contains('private')) {
+      return false;
+    }
+    final maxAge = RegExp(r'max-age=(\d+)').firstMatch(directives);
+    return maxAge != null && int.parse(maxAge.group(1)!) >= 86400;
+  }
+
+  /// Returns the stored asset for [url], or null.
+  CachedAsset? lookup(String url) => _store.lookup(url);
+
+  /// Queues a miss for [url], requested with [requestHeaders], to be
+  /// filled after [startFilling].
+  void queueFill(String url, {Map<String, String>? requestHeaders}) {
+    if (_disposed || !_filled.add(url)) return;
+    _queued.add((url, requestHeaders));
+    _fillQueued();
+  }
+
+  /// Starts filling queued misses, [fillConcurrency] at a time, and any
+  /// queued from now on.
+  void startFilling() {
+    _filling = true;
+    _fillQueued();
+  }
+
+  void _fillQueued() {
+    while (_filling &&
+        !_disposed &&
+        _active < fillConcurrency &&
+        _queued.isNotEmpty) {
+      final (url, requestHeaders) = _queued.removeFirst();
+      _active++;
+      _download(url, requestHeaders).whenComplete(() {
+        _active--;
+        _fillQueued();
+      });
+    }
+  }
+
+  /// Downloads [url] with [requestHeaders] and stores it if it may be
+  /// stored, returning what was stored. Returns null without fetching for
+  /// a URL already filled or queued this session, and for anything it
+  /// does not store it drops the connection rather than reading the rest
+  /// of the body.
+  Future<CachedAsset?> fill(
+    String url, {
+    Map<String, String>? requestHeaders,
+  }) async {
+    if (_disposed || !_filled.add(url)) return null;
+    return _download(url, requestHeaders);
+  }
+
+  Future<CachedAsset?> _download(
+    String url,
+    Map<String, String>? requestHeaders,
+  ) async {
+    try {
+      final request = await _client
+          .getUrl(Uri.parse(url))
+          .timeout(_fetchTimeout);
+      requestHeaders?.forEach((name, value) {
+        final lower = name.toLowerCase();
+        // The client negotiates its own encoding and decodes the body.
+        if (lower != 'cookie' &&
+            lower != 'host' &&
+            lower != 'range' &&
+            lower != 'accept-encoding') {
+          request.headers.set(name, value);
+        }
+      });
+      final response = await request.close().timeout(_fetchTimeout);
+      if (!isStorable(
+            response.statusCode,
+            cacheControl: response.headers.value('cache-control'),
+            setsCookie: response.headers['set-cookie'] != null,
+          ) ||
+          response.contentLength > maxBodySize) {
+        await response.listen(null).cancel();
+        return null;
+      }
+
+      final builder = BytesBuilder(copy: false);
+      await for (final chunk in response.timeout(_fetchTimeout)) {
+        builder.add(chunk);
+        if (builder.length > maxBodySize) return null;
+      }
+      // The store is closed once the app starts exiting.
+      if (_disposed) return null;
+      final body = builder.takeBytes();
+      final headers = <String, String>{
+        for (final name in storedHeaders)
+          if (response.headers.value(name) != null)
+            name: response.headers.value(name)!,
+      };
+      _store.put(url, headers, body);
+      return CachedAsset(body, headers);
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Hits and misses since the cache was opened.
+  ({int hits, int misses}) get stats => _store.stats;
+
+  /// Formats [headers] as the "Name: value" lines the runner stores.
+  static String formatHeaders(Map<String, String> headers) {
+    return headers.entries
+        .map((header) => '${header.key}: ${header.value}\n')
+        .join();
+  }
+
+  /// Parses "Name: value" lines, keyed by lower-case name.
+  static Map<String, String> parseHeaders(String text) {
+    final headers = <String, String>{};
+    for (final line in const LineSplitter().convert(text)) {
+      final colon = line.indexOf(':');
+      if (colon <= 0) continue;
+      headers[line.substring(0, colon).trim().toLowerCase()] = line
+          .substring(colon + 1)
+          .trim();
+    }
+    return headers;
+  }
+
+  /// Abandons pending fills, finishes pending stores and closes the cache.
+  void dispose() {
+    _disposed = true;
+    _queued.clear();
+    _client.close(force: true);
+    _store.dispose();
+  }
+}
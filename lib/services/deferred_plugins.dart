@@ -0,0 +1,25 @@
+import 'dart:io' show Platform;
+
+import 'package:flutter/services.dart';
+
+/// Waits for the plugins the Linux runner registers only once the first
+/// frame is on screen (linux/runner/my_application.cc): window_manager,
+/// the tray and the rest of the generated registrant. A call to one of
+/// them before then fails with a MissingPluginException.
+class DeferredPlugins {
+  static const _channel = MethodChannel('youtube_music_unbound/plugins');
+
+  static Future<void>? _ready;
+
+  /// Completes once the plugins are registered, at once off Linux.
+  static Future<void> get ready => _ready ??= _waitUntilReady();
+
+  static Future<void> _waitUntilReady() async {
+    if (!Platform.isLinux) return;
+    try {
+      await _channel.invokeMethod<void>('waitUntilReady');
+    } on MissingPluginException {
+      // A runner that registers everything before the first frame.
+    }
+  }
+}
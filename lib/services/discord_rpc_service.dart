@@ -1,158 +1,210 @@
-import 'dart:async';
-import 'package:dart_discord_rpc/dart_discord_rpc.dart';
-import '../models/track_metadata.dart';
-import '../models/playback_state.dart';
-
-class DiscordRpcService {
-  static const String _applicationId = '1234567890123456789';
-  static const int _maxRetryDelay = 30;
-  static const Duration _updateInterval = Duration(seconds: 15);
-
-  DiscordRPC? _rpc;
-  bool _isConnected = false;
-  bool _isConnecting = false;
-  int _retryDelay = 1;
-  Timer? _reconnectTimer;
-  Timer? _updateTimer;
-
-  TrackMetadata? _currentMetadata;
-  PlaybackState _currentState = PlaybackState.stopped;
-  DateTime? _playbackStartTime;
-
-  Future<void> initialize() async {
-    if (_isConnecting || _isConnected) return;
-
-    _isConnecting = true;
-
-    try {
-      _rpc = DiscordRPC(applicationId: _applicationId);
-      _rpc!.start(autoRegister: true);
-      _isConnected = true;
-      _isConnecting = false;
-      _retryDelay = 1;
-
-      if (_currentMetadata != null && _currentState == PlaybackState.playing) {
-        _updatePresence();
-      }
-
-      _startPeriodicUpdates();
-    } catch (e) {
-      _isConnected = false;
-      _isConnecting = false;
-      _scheduleReconnect();
-    }
-  }
-
-  void _scheduleReconnect() {
-    _reconnectTimer?.cancel();
-    _reconnectTimer = Timer(Duration(seconds: _retryDelay), () {
-      _retryDelay = (_retryDelay * 2).clamp(1, _maxRetryDelay);
-      initialize();
-    });
-  }
-
-  void _startPeriodicUpdates() {
-    _updateTimer?.cancel();
-    _updateTimer = Timer.periodic(_updateInterval, (_) {
-      if (_isConnected &&
-          _currentMetadata != null &&
-          _currentState == PlaybackState.playing) {
-        _updatePresence();
-      }
-    });
-  }
-
-  Future<void> updateMetadata(
-    TrackMetadata metadata,
-    PlaybackState state,
-  ) async {
-    _currentMetadata = metadata;
-    _currentState = state;
-
-    if (state == PlaybackState.playing && _playbackStartTime == null) {
-      _playbackStartTime = DateTime.now();
-    } else if (state != PlaybackState.playing) {
-      _playbackStartTime = null;
-    }
-
-    if (!_isConnected) {
-      if (!_isConnecting) initialize();
-      return;
-    }
-
-    if (state == PlaybackState.stopped || state == PlaybackState.paused) {
-      clearPresence();
-    } else {
-      _updatePresence();
-    }
-  }
-
-  void _updatePresence() {
-    if (!_isConnected || _rpc == null || _currentMetadata == null) {
-      return;
-    }
-
-    try {
-      final metadata = _currentMetadata!;
-      final now = DateTime.now();
-
-      int? startTimestamp;
-      int? endTimestamp;
-
-      if (_playbackStartTime != null && metadata.duration != null) {
-        final elapsed = metadata.position ?? Duration.zero;
-        final remaining = metadata.duration! - elapsed;
-
-        startTimestamp = _playbackStartTime!.millisecondsSinceEpoch;
-        endTimestamp = now.add(remaining).millisecondsSinceEpoch;
-      }
-
-      _rpc!.updatePresence(
-        DiscordPresence(
-          details: metadata.title,
-          state: 'by ${metadata.artist}',
-          largeImageKey: metadata.artworkUrl ?? 'default',
-          largeImageText: metadata.album ?? metadata.title,
-          startTimeStamp: startTimestamp,
-          endTimeStamp: endTimestamp,
-        ),
-      );
-    } catch (e) {
-      _handleConnectionError();
-    }
-  }
-
-  void clearPresence() {
-    if (!_isConnected || _rpc == null) return;
-
-    try {
-      _rpc!.clearPresence();
-      _playbackStartTime = null;
-    } catch (e) {
-      _handleConnectionError();
-    }
-  }
-
-  void _handleConnectionError() {
-    _isConnected = false;
-    _updateTimer?.cancel();
-    _scheduleReconnect();
-  }
-
-  void dispose() {
-    _reconnectTimer?.cancel();
-    _updateTimer?.cancel();
-
-    if (_isConnected && _rpc != null) {
-      try {
-        _rpc!.shutDown();
-      } catch (e) {
-        // Ignore shutdown errors
-      }
-    }
-
-    _rpc = null;
-    _isConnected = false;
-    _isConnecting = false;
-  }
-}
+import 'dart:async';
+import 'dart:io';
+
+import 'package:dart_discord_rpc/dart_discord_rpc.dart';
+import 'package:flutter/services.dart';
+import '../models/track_metadata.dart';
+import '../models/playback_state.dart';
+
+/// The runner's Discord IPC client (linux/runner/discord_ipc.h). It
+/// publishes the now-playing block the media session controller writes,
+/// sending an update only when the track, the playing state or the
+/// position really changes, and finds Discord on its own when it starts.
+/// The runner creates and frees it on its main thread when asked over its
+/// plugins channel.
+class _NativePresence {
+  static const _channel = MethodChannel('youtube_music_unbound/plugins');
+
+  /// Starts the runner's client, returning false where the runner has none.
+  static Future<bool> start(String applicationId) async {
+    if (!Platform.isLinux) return false;
+    try {
+      return await _channel.invokeMethod<bool>(
+            'setDiscordPresence',
+            applicationId,
+          ) ??
+          false;
+    } on MissingPluginException {
+      return false;
+    } on PlatformException {
+      return false;
+    }
+  }
+
+  static Future<void> stop() async {
+    try {
+      await _channel.invokeMethod<bool>('setDiscordPresence');
+    } on MissingPluginException {
+      // Nothing was started.
+    } on PlatformException {
+      // Nothing was started.
+    }
+  }
+}
+
+/// Keeps Discord Rich Presence in step with playback. On Linux the runner's
+/// IPC client does this from the now-playing block, and the calls below
+/// have nothing to do; elsewhere presence goes through dart_discord_rpc.
+class DiscordRpcService {
+  static const String _applicationId = '1234567890123456789';
+  static const int _maxRetryDelay = 30;
+  static const Duration _updateInterval = Duration(seconds: 15);
+
+  bool _native = false;
+  DiscordRPC? _rpc;
+  bool _isConnected = false;
+  bool _isConnecting = false;
+  int _retryDelay = 1;
+  Timer? _reconnectTimer;
+  Timer? _updateTimer;
+
+  TrackMetadata? _currentMetadata;
+  PlaybackState _currentState = PlaybackState.stopped;
+  DateTime? _playbackStartTime;
+
+  Future<void> initialize() async {
+    if (_native || _isConnecting || _isConnected) return;
+
+    _isConnecting = true;
+    if (await _NativePresence.start(_applicationId)) {
+      _native = true;
+      _isConnecting = false;
+      return;
+    }
+
+    try {
+      _rpc = DiscordRPC(applicationId: _applicationId);
+      _rpc!.start(autoRegister: true);
+      _isConnected = true;
+      _isConnecting = false;
+      _retryDelay = 1;
+
+      if (_currentMetadata != null && _currentState == PlaybackState.playing) {
+        _updatePresence();
+      }
+
+      _startPeriodicUpdates();
+    } catch (e) {
+      _isConnected = false;
+      _isConnecting = false;
+      _scheduleReconnect();
+    }
+  }
+
+  void _scheduleReconnect() {
+    _reconnectTimer?.cancel();
+    _reconnectTimer = Timer(Duration(seconds: _retryDelay), () {
+      _retryDelay = (_retryDelay * 2).clamp(1, _maxRetryDelay);
+      initialize();
+    });
+  }
+
+  void _startPeriodicUpdates() {
+    _updateTimer?.cancel();
+    _updateTimer = Timer.periodic(_updateInterval, (_) {
+      if (_isConnected &&
+          _currentMetadata != null &&
+          _currentState == PlaybackState.playing) {
+        _updatePresence();
+      }
+    });
+  }
+
+  Future<void> updateMetadata(
+    TrackMetadata metadata,
+    PlaybackState state,
+  ) async {
+    if (_native) return;
+
+    _currentMetadata = metadata;
+    _currentState = state;
+
+    if (state == PlaybackState.playing && _playbackStartTime == null) {
+      _playbackStartTime = DateTime.now();
+    } else if (state != PlaybackState.playing) {
+      _playbackStartTime = null;
+    }
+
+    if (!_isConnected) {
+      if (!_isConnecting) initialize();
+      return;
+    }
+
+    if (state == PlaybackState.stopped || state == PlaybackState.paused) {
+      clearPresence();
+    } else {
+      _updatePresence();
+    }
+  }
+
+  void _updatePresence() {
+    if (!_isConnected || _rpc == null || _currentMetadata == null) {
+      return;
+    }
+
+    try {
+      final metadata = _currentMetadata!;
+      final now = DateTime.now();
+
+      int? startTimestamp;
+      int? endTimestamp;
+
+      if (_playbackStartTime != null && metadata.duration != null) {
+        final elapsed = metadata.position ?? Duration.zero;
+        final remaining = metadata.duration! - elapsed;
+
+        startTimestamp = _playbackStartTime!.millisecondsSinceEpoch;
+        endTimestamp = now.add(remaining).millisecondsSinceEpoch;
+      }
+
+      _rpc!.updatePresence(
+        DiscordPresence(
+          details: metadata.title,
+          state: 'by ${metadata.artist}',
+          largeImageKey: metadata.artworkUrl ?? 'default',
+          largeImageText: metadata.album ?? metadata.title,
+          startTimeStamp: startTimestamp,
+          endTimeStamp: endTimestamp,
+        ),
+      );
+    } catch (e) {
+      _handleConnectionError();
+    }
+  }
+
+  void clearPresence() {
+    if (_native || !_isConnected || _rpc == null) return;
+
+    try {
+      _rpc!.clearPresence();
+      _playbackStartTime = null;
+    } catch (e) {
+      _handleConnectionError();
+    }
+  }
+
+  void _handleConnectionError() {
+    _isConnected = false;
+    _updateTimer?.cancel();
+    _scheduleReconnect();
+  }
+
+  void dispose() {
+    _reconnectTimer?.cancel();
+    _updateTimer?.cancel();
+    if (_native) unawaited(_NativePresence.stop());
+    _native = false;
+
+    if (_isConnected && _rpc != null) {
+      try {
+        _rpc!.shutDown();
+      } catch (e) {
+        // Ignore shutdown errors
+      }
+    }
+
+    _rpc = null;
+    _isConnected = false;
+    _isConnecting = false;
+  }
+}
@@ -0,0 +1,154 @@
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:io';
+
+import 'native_buffer.dart';
+
+typedef _Match = Int32 Function(Pointer<Uint8>, Size, Pointer<Uint8>, Uint32);
+typedef _MatchDart = int Function(Pointer<Uint8>, int, Pointer<Uint8>, int);
+typedef _Selectors = Pointer<Uint8> Function(Pointer<Uint8>);
+typedef _FreeString = Void Function(Pointer<Uint8>);
+typedef _FreeStringDart = void Function(Pointer<Uint8>);
+typedef _Generation = Uint64 Function();
+typedef _GenerationDart = int Function();
+
+/// Mirrors FilterRequestType in linux/runner/filter_engine.h.
+abstract final class FilterRequestType {
+  static const int document = 1 << 0;
+  static const int subdocument = 1 << 1;
+  static const int script = 1 << 2;
+  static const int stylesheet = 1 << 3;
+  static const int image = 1 << 4;
+  static const int media = 1 << 5;
+  static const int font = 1 << 6;
+  static const int xhr = 1 << 7;
+  static const int websocket = 1 << 8;
+  static const int ping = 1 << 9;
+  static const int other = 1 << 10;
+
+  static final RegExp _extension = RegExp(r'\.([a-z0-9]{1,5})$');
+
+  /// Guesses the type of a request for [url] from its scheme and file
+  /// extension, since the WebView does not report it.
+  static int infer(String url, {bool isForMainFrame = false}) {
+    if (isForMainFrame) return document;
+    final uri = Uri.tryParse(url);
+    if (uri == null) return other;
+    if (uri.scheme == 'ws' || uri.scheme == 'wss') return websocket;
+    if (uri.path.endsWith('/videoplayback')) return media;
+
+    final extension = _extension.firstMatch(uri.path.toLowerCase())?.group(1);
+    switch (extension) {
+      case 'js' || 'mjs':
+        return script;
+      case 'css':
+        return stylesheet;
+      case 'png' || 'jpg' || 'jpeg' || 'gif' || 'webp' || 'svg' || 'ico':
+        return image;
+      case 'woff' || 'woff2' || 'ttf' || 'otf':
+        return font;
+      case 'mp3' || 'mp4' || 'm4a' || 'webm' || 'ogg' || 'opus':
+        return media;
+      case 'json':
+        return xhr;
+    }
+    return other;
+  }
+}
+
+/// What the user's filter lists say about a request.
+enum FilterDecision { none, block, allow }
+
+/// The user's ABP / uBlock Origin filter lists, compiled into a
+/// memory-mapped index by the Linux runner (linux/runner/filter_engine.h)
+/// and recompiled there whenever a list changes.
+class FilterLists {
+  final _MatchDart _match;
+  final _Selectors _selectors;
+  final _FreeStringDart _freeString;
+  final _GenerationDart _generation;
+  final NativeBuffer _url;
+  final NativeBuffer _host;
+
+  FilterLists._(
+    this._match,
+    this._selectors,
+    this._freeString,
+    this._generation,
+    this._url,
+    this._host,
+  );
+
+  /// Returns the runner's filter engine, or null where the runner does not
+  /// export one.
+  static FilterLists? open() {
+    if (!Platform.isLinux) return null;
+    try {
+      final process = DynamicLibrary.process();
+      return FilterLists._(
+        process.lookupFunction<_Match, _MatchDart>(
+          'filter_engine_match',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_Selectors, _Selectors>(
+          'filter_engine_cosmetic_selectors',
+        ),
+        process.lookupFunction<_FreeString, _FreeStringDart>(
+          'filter_engine_free_string',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_Generation, _GenerationDart>(
+          'filter_engine_generation',
+          isLeaf: true,
+        ),
+        NativeBuffer(process),
+        NativeBuffer(process),
+      );
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Changes each time the runner installs a recompiled index.
+  int get generation => _generation();
+
+  /// Decides a request for [url] of [type], made by a page on
+  /// [documentHost].
+  FilterDecision decide(
+    String url, {
+    required int type,
+    required String documentHost,
+  }) {
+    final bytes = utf8.encode(url);
+    final result = _match(
+      _url.copy(bytes),
+      bytes.length,
+      _host.copy(utf8.encode(documentHost)),
+      type,
+    );
+    return result > 0
+        ? FilterDecision.block
+        : result < 0
+        ? FilterDecision.allow
+        : FilterDecision.none;
+  }
+
+  /// Returns the element hiding selectors for pages on [host].
+  List<String> cosmeticSelectors(String host) {
+    final selectors = _selectors(_host.copy(utf8.encode(host)));
+    try {
+      final length = cStringLength(selectors);
+      if (length == 0) return const [];
+      return utf8
+          .decode(selectors.asTypedList(length), allowMalformed: true)
+          .split('\n');
+    } finally {
+      _freeString(selectors);
+    }
+  }
+
+  void dispose() {
+    _url.dispose();
+    _host.dispose();
+  }
+}
@@ -1,396 +1,512 @@
-import 'dart:async';
-import 'dart:io';
-import 'package:flutter/services.dart';
-import 'package:audio_service/audio_service.dart';
-import '../models/track_metadata.dart';
-import '../models/playback_state.dart' as app;
-import '../models/media_command.dart';
-
-abstract class MediaSessionController {
-  void updateMetadata(TrackMetadata metadata);
-  void updatePlaybackState(app.PlaybackState state);
-  void setPlaybackPosition(Duration position, Duration duration);
-  Stream<MediaCommand> get commandStream;
-  Future<void> dispose();
-}
-
-MediaSessionController createMediaSessionController() {
-  if (Platform.isAndroid) {
-    return _AndroidController();
-  } else if (Platform.isLinux) {
-    return _LinuxController();
-  } else if (Platform.isWindows || Platform.isMacOS) {
-    return _DesktopController();
-  }
-  throw UnsupportedError('Platform not supported');
-}
-
-class _AndroidController implements MediaSessionController {
-  final _commands = StreamController<MediaCommand>.broadcast();
-  AudioHandler? _handler;
-  bool _initialized = false;
-  Completer<void>? _initCompleter;
-
-  @override
-  Stream<MediaCommand> get commandStream => _commands.stream;
-
-  _AndroidController() {
-    _init();
-  }
-
-  Future<void> _init() async {
-    if (_initialized) return;
-    if (_initCompleter != null) {
-      await _initCompleter!.future;
-      return;
-    }
-    _initCompleter = Completer<void>();
-    try {
-      _handler = await AudioService.init(
-        builder: () => _AudioHandler(_commands),
-        config: const AudioServiceConfig(
-          androidNotificationChannelId: 'com.youtube_music_unbound.channel',
-          androidNotificationChannelName: 'YouTube Music Unbound',
-          androidNotificationOngoing: false,
-          androidShowNotificationBadge: true,
-          androidStopForegroundOnPause: false,
-          androidNotificationClickStartsActivity: true,
-          androidResumeOnClick: true,
-        ),
-      );
-      _initialized = true;
-      _initCompleter!.complete();
-    } catch (e) {
-      _initCompleter!.completeError(e);
-      _initCompleter = null;
-    }
-  }
-
-  @override
-  void updateMetadata(TrackMetadata metadata) async {
-    try {
-      await _init();
-      final item = MediaItem(
-        id: metadata.artworkUrl ?? metadata.title,
-        title: metadata.title,
-        artist: metadata.artist,
-        album: metadata.album,
-        artUri: metadata.artworkUrl != null
-            ? Uri.parse(metadata.artworkUrl!)
-            : null,
-        duration: metadata.duration,
-        playable: true,
-      );
-      if (_handler is _AudioHandler) {
-        (_handler as _AudioHandler).setMediaItem(item);
-      }
-    } catch (_) {}
-  }
-
-  @override
-  void updatePlaybackState(app.PlaybackState state) async {
-    try {
-      await _init();
-      final pbState = PlaybackState(
-        controls: [
-          MediaControl.skipToPrevious,
-          state == app.PlaybackState.playing
-              ? MediaControl.pause
-              : MediaControl.play,
-          MediaControl.skipToNext,
-        ],
-        systemActions: const {
-          MediaAction.seek,
-          MediaAction.seekForward,
-          MediaAction.seekBackward,
-          MediaAction.play,
-          MediaAction.pause,
-          MediaAction.skipToNext,
-          MediaAction.skipToPrevious,
-        },
-        androidCompactActionIndices: const [0, 1, 2],
-        processingState: _toProcessingState(state),
-        playing: state == app.PlaybackState.playing,
-      );
-      if (_handler is _AudioHandler) {
-        (_handler as _AudioHandler).setState(pbState);
-      }
-    } catch (_) {}
-  }
-
-  @override
-  void setPlaybackPosition(Duration position, Duration duration) async {
-    try {
-      await _init();
-      final current = _handler?.playbackState.value;
-      if (current != null && _handler is _AudioHandler) {
-        (_handler as _AudioHandler).setState(
-          current.copyWith(updatePosition: position),
-        );
-      }
-    } catch (_) {}
-  }
-
-  AudioProcessingState _toProcessingState(app.PlaybackState state) {
-    switch (state) {
-      case app.PlaybackState.playing:
-      case app.PlaybackState.paused:
-        return AudioProcessingState.ready;
-      case app.PlaybackState.stopped:
-        return AudioProcessingState.idle;
-      case app.PlaybackState.buffering:
-        return AudioProcessingState.buffering;
-    }
-  }
-
-  @override
-  Future<void> dispose() async {
-    await _commands.close();
-    await _handler?.stop();
-    _handler = null;
-  }
-}
-
-class _AudioHandler extends BaseAudioHandler {
-  final StreamController<MediaCommand> _commands;
-  bool _wasPlaying = false;
-
-  _AudioHandler(this._commands);
-
-  void setMediaItem(MediaItem item) => mediaItem.add(item);
-  void setState(PlaybackState state) => playbackState.add(state);
-
-  @override
-  Future<void> play() async => _commands.add(MediaCommand.play);
-
-  @override
-  Future<void> pause() async => _commands.add(MediaCommand.pause);
-
-  @override
-  Future<void> skipToNext() async => _commands.add(MediaCommand.next);
-
-  @override
-  Future<void> skipToPrevious() async => _commands.add(MediaCommand.previous);
-
-  @override
-  Future<void> stop() async => _commands.add(MediaCommand.stop);
-
-  @override
-  Future<void> onTaskRemoved() async {
-    await stop();
-    await super.onTaskRemoved();
-  }
-
-  @override
-  Future<void> customAction(String name, [Map<String, dynamic>? extras]) async {
-    if (name == 'audioFocusLoss') {
-      final permanent = extras?['permanent'] as bool? ?? false;
-      _wasPlaying = playbackState.value.playing;
-      if (_wasPlaying) await pause();
-      if (permanent) _wasPlaying = false;
-    } else if (name == 'audioFocusGain') {
-      if (_wasPlaying) {
-        await play();
-        _wasPlaying = false;
-      }
-    }
-    await super.customAction(name, extras);
-  }
-}
-
-class _DesktopController implements MediaSessionController {
-  final _commands = StreamController<MediaCommand>.broadcast();
-  static const _channel = MethodChannel('youtube_music_unbound/smtc');
-  bool _initialized = false;
-
-  @override
-  Stream<MediaCommand> get commandStream => _commands.stream;
-
-  _DesktopController() {
-    if (Platform.isWindows || Platform.isMacOS) {
-      _channel.setMethodCallHandler(_handleCall);
-    }
-  }
-
-  Future<void> _init() async {
-    if (_initialized || (!Platform.isWindows && !Platform.isMacOS)) {
-      return;
-    }
-    try {
-      await _channel.invokeMethod('initialize');
-      _initialized = true;
-    } catch (_) {}
-  }
-
-  Future<void> _handleCall(MethodCall call) async {
-    if (call.method == 'onMediaCommand') {
-      final args = call.arguments as Map<dynamic, dynamic>;
-      final cmd = _parseCommand(args['command'] as String);
-      if (cmd != null) _commands.add(cmd);
-    }
-  }
-
-  MediaCommand? _parseCommand(String cmd) {
-    switch (cmd) {
-      case 'play':
-        return MediaCommand.play;
-      case 'pause':
-        return MediaCommand.pause;
-      case 'next':
-        return MediaCommand.next;
-      case 'previous':
-        return MediaCommand.previous;
-      case 'stop':
-        return MediaCommand.stop;
-      default:
-        return null;
-    }
-  }
-
-  @override
-  void updateMetadata(TrackMetadata metadata) async {
-    if (!Platform.isWindows && !Platform.isMacOS) return;
-    await _init();
-    try {
-      await _channel.invokeMethod('updateMetadata', {
-        'title': metadata.title,
-        'artist': metadata.artist,
-        'album': metadata.album ?? '',
-        'artworkUrl': metadata.artworkUrl ?? '',
-      });
-    } catch (_) {}
-  }
-
-  @override
-  void updatePlaybackState(app.PlaybackState state) async {
-    if (!Platform.isWindows && !Platform.isMacOS) return;
-    await _init();
-    try {
-      await _channel.invokeMethod('updatePlaybackState', {
-        'state': _stateToString(state),
-      });
-    } catch (_) {}
-  }
-
-  @override
-  void setPlaybackPosition(Duration position, Duration duration) async {
-    if (!Platform.isWindows && !Platform.isMacOS) return;
-    await _init();
-    try {
-      await _channel.invokeMethod('setPlaybackPosition', {
-        'position': position.inMilliseconds,
-        'duration': duration.inMilliseconds,
-      });
-    } catch (_) {}
-  }
-
-  String _stateToString(app.PlaybackState state) {
-    switch (state) {
-      case app.PlaybackState.playing:
-        return 'playing';
-      case app.PlaybackState.paused:
-      case app.PlaybackState.buffering:
-        return 'paused';
-      case app.PlaybackState.stopped:
-        return 'stopped';
-    }
-  }
-
-  @override
-  Future<void> dispose() async => await _commands.close();
-}
-
-class _LinuxController implements MediaSessionController {
-  final _commands = StreamController<MediaCommand>.broadcast();
-  static const _channel = MethodChannel('youtube_music_unbound/mpris');
-  bool _initialized = false;
-
-  @override
-  Stream<MediaCommand> get commandStream => _commands.stream;
-
-  _LinuxController() {
-    _channel.setMethodCallHandler(_handleCall);
-  }
-
-  Future<void> _init() async {
-    if (_initialized) return;
-    try {
-      await _channel.invokeMethod('initialize');
-      _initialized = true;
-    } catch (_) {}
-  }
-
-  Future<void> _handleCall(MethodCall call) async {
-    if (call.method == 'onMediaCommand') {
-      final args = call.arguments as Map<dynamic, dynamic>;
-      final cmd = _parseCommand(args['command'] as String);
-      if (cmd != null) _commands.add(cmd);
-    }
-  }
-
-  MediaCommand? _parseCommand(String cmd) {
-    switch (cmd) {
-      case 'play':
-        return MediaCommand.play;
-      case 'pause':
-        return MediaCommand.pause;
-      case 'next':
-        return MediaCommand.next;
-      case 'previous':
-        return MediaCommand.previous;
-      case 'stop':
-        return MediaCommand.stop;
-      default:
-        return null;
-    }
-  }
-
-  @override
-  void updateMetadata(TrackMetadata metadata) async {
-    await _init();
-    try {
-      await _channel.invokeMethod('updateMetadata', {
-        'title': metadata.title,
-        'artist': metadata.artist,
-        'album': metadata.album ?? '',
-        'artworkUrl': metadata.artworkUrl ?? '',
-      });
-    } catch (_) {}
-  }
-
-  @override
-  void updatePlaybackState(app.PlaybackState state) async {
-    await _init();
-    try {
-      await _channel.invokeMethod('updatePlaybackState', {
-        'state': _stateToString(state),
-      });
-    } catch (_) {}
-  }
-
-  @override
-  void setPlaybackPosition(Duration position, Duration duration) async {
-    await _init();
-    try {
-      await _channel.invokeMethod('setPlaybackPosition', {
-        'position': position.inMicroseconds,
-        'duration': duration.inMicroseconds,
-      });
-    } catch (_) {}
-  }
-
-  String _stateToString(app.PlaybackState state) {
-    switch (state) {
-      case app.PlaybackState.playing:
-        return 'playing';
-      case app.PlaybackState.paused:
-      case app.PlaybackState.buffering:
-        return 'paused';
-      case app.PlaybackState.stopped:
-        return 'stopped';
-    }
-  }
-
-  @override
-  Future<void> dispose() async => await _commands.close();
-}
+import 'dart:async';
+import 'dart:io';
+import 'package:flutter/services.dart';
+import 'package:audio_service/audio_service.dart';
+import '../models/track_metadata.dart';
+import '../models/playback_state.dart' as app;
+import '../models/media_command.dart';
+import 'now_playing_block.dart';
+
+abstract class MediaSessionController {
+  /// Publishes a change to the now-playing session as one platform call.
+  /// Arguments left null keep their previous value.
+  void updateSession({
+    TrackMetadata? metadata,
+    app.PlaybackState? state,
+    Duration? position,
+    Duration? duration,
+  });
+  Stream<PlaybackCommand> get commandStream;
+  Future<void> dispose();
+}
+
+MediaSessionController createMediaSessionController() {
+  if (Platform.isAndroid) {
+    return _AndroidController();
+  } else if (Platform.isLinux) {
+    return _LinuxController();
+  } else if (Platform.isWindows || Platform.isMacOS) {
+    return _DesktopController();
+  }
+  throw UnsupportedError('Platform not supported');
+}
+
+/// Remembers the fields the native side last accepted so each
+/// updateSession call carries a sequence number and only what changed.
+class _SessionDiff {
+  int _sequence = 0;
+  final _sent = <String, Object>{};
+
+  /// Returns the updateSession arguments for [fields], or null when nothing
+  /// changed. [always] entries are sent whenever present.
+  Map<String, Object>? build(
+    Map<String, Object> fields, [
+    Map<String, Object> always = const {},
+  ]) {
+    final changed = <String, Object>{
+      for (final entry in fields.entries)
+        if (_sent[entry.key] != entry.value) entry.key: entry.value,
+    };
+    if (changed.isEmpty && always.isEmpty) return null;
+    _sent.addAll(changed);
+    return {'seq': ++_sequence, ...changed, ...always};
+  }
+
+  /// Forgets what was sent, e.g. after a failed call, so the next update
+  /// resends every field.
+  void reset() => _sent.clear();
+}
+
+class _AndroidController implements MediaSessionController {
+  final _commands = StreamController<PlaybackCommand>.broadcast();
+  AudioHandler? _handler;
+  bool _initialized = false;
+  Completer<void>? _initCompleter;
+
+  @override
+  Stream<PlaybackCommand> get commandStream => _commands.stream;
+
+  _AndroidController() {
+    _init();
+  }
+
+  Future<void> _init() async {
+    if (_initialized) return;
+    if (_initCompleter != null) {
+      await _initCompleter!.future;
+      return;
+    }
+    _initCompleter = Completer<void>();
+    try {
+      _handler = await AudioService.init(
+        builder: () => _AudioHandler(_commands),
+        config: const AudioServiceConfig(
+          androidNotificationChannelId: 'com.youtube_music_unbound.channel',
+          androidNotificationChannelName: 'YouTube Music Unbound',
+          androidNotificationOngoing: false,
+          androidShowNotificationBadge: true,
+          androidStopForegroundOnPause: false,
+          androidNotificationClickStartsActivity: true,
+          androidResumeOnClick: true,
+        ),
+      );
+      _initialized = true;
+      _initCompleter!.complete();
+    } catch (e) {
+      _initCompleter!.completeError(e);
+      _initCompleter = null;
+    }
+  }
+
+  @override
+  void updateSession({
+    TrackMetadata? metadata,
+    app.PlaybackState? state,
+    Duration? position,
+    Duration? duration,
+  }) {
+    if (metadata != null) _updateMetadata(metadata);
+    if (state != null) _updatePlaybackState(state);
+    if (position != null) _setPlaybackPosition(position);
+  }
+
+  void _updateMetadata(TrackMetadata metadata) async {
+    try {
+      await _init();
+      final item = MediaItem(
+        id: metadata.artworkUrl ?? metadata.title,
+        title: metadata.title,
+        artist: metadata.artist,
+        album: metadata.album,
+        artUri: metadata.artworkUrl != null
+            ? Uri.parse(metadata.artworkUrl!)
+            : null,
+        duration: metadata.duration,
+        playable: true,
+      );
+      if (_handler is _AudioHandler) {
+        (_handler as _AudioHandler).setMediaItem(item);
+      }
+    } catch (_) {}
+  }
+
+  void _updatePlaybackState(app.PlaybackState state) async {
+    try {
+      await _init();
+      final pbState = PlaybackState(
+        controls: [
+          MediaControl.skipToPrevious,
+          state == app.PlaybackState.playing
+              ? MediaControl.pause
+              : MediaControl.play,
+          MediaControl.skipToNext,
+        ],
+        systemActions: const {
+          MediaAction.seek,
+          MediaAction.seekForward,
+          MediaAction.seekBackward,
+          MediaAction.play,
+          MediaAction.pause,
+          MediaAction.skipToNext,
+          MediaAction.skipToPrevious,
+        },
+        androidCompactActionIndices: const [0, 1, 2],
+        processingState: _toProcessingState(state),
+        playing: state == app.PlaybackState.playing,
+      );
+      if (_handler is _AudioHandler) {
+        (_handler as _AudioHandler).setState(pbState);
+      }
+    } catch (_) {}
+  }
+
+  void _setPlaybackPosition(Duration position) async {
+    try {
+      await _init();
+      final current = _handler?.playbackState.value;
+      if (current != null && _handler is _AudioHandler) {
+        (_handler as _AudioHandler).setState(
+          current.copyWith(updatePosition: position),
+        );
+      }
+    } catch (_) {}
+  }
+
+  AudioProcessingState _toProcessingState(app.PlaybackState state) {
+    switch (state) {
+      case app.PlaybackState.playing:
+      case app.PlaybackState.paused:
+        return AudioProcessingState.ready;
+      case app.PlaybackState.stopped:
+        return AudioProcessingState.idle;
+      case app.PlaybackState.buffering:
+        return AudioProcessingState.buffering;
+    }
+  }
+
+  @override
+  Future<void> dispose() async {
+    await _commands.close();
+    await _handler?.stop();
+    _handler = null;
+  }
+}
+
+class _AudioHandler extends BaseAudioHandler {
+  final StreamController<PlaybackCommand> _commands;
+  bool _wasPlaying = false;
+
+  _AudioHandler(this._commands);
+
+  void setMediaItem(MediaItem item) => mediaItem.add(item);
+  void setState(PlaybackState state) => playbackState.add(state);
+
+  void _add(MediaCommand command, [Map<String, dynamic>? params]) =>
+      _commands.add(PlaybackCommand(command: command, params: params));
+
+  @override
+  Future<void> play() async => _add(MediaCommand.play);
+
+  @override
+  Future<void> pause() async => _add(MediaCommand.pause);
+
+  @override
+  Future<void> skipToNext() async => _add(MediaCommand.next);
+
+  @override
+  Future<void> skipToPrevious() async => _add(MediaCommand.previous);
+
+  @override
+  Future<void> stop() async => _add(MediaCommand.stop);
+
+  @override
+  Future<void> seek(Duration position) async => _add(
+    MediaCommand.setPosition,
+    {'position': position.inMicroseconds},
+  );
+
+  @override
+  Future<void> onTaskRemoved() async {
+    await stop();
+    await super.onTaskRemoved();
+  }
+
+  @override
+  Future<void> customAction(String name, [Map<String, dynamic>? extras]) async {
+    if (name == 'audioFocusLoss') {
+      final permanent = extras?['permanent'] as bool? ?? false;
+      _wasPlaying = playbackState.value.playing;
+      if (_wasPlaying) await pause();
+      if (permanent) _wasPlaying = false;
+    } else if (name == 'audioFocusGain') {
+      if (_wasPlaying) {
+        await play();
+        _wasPlaying = false;
+      }
+    }
+    await super.customAction(name, extras);
+  }
+}
+
+class _DesktopController implements MediaSessionController {
+  final _commands = StreamController<PlaybackCommand>.broadcast();
+  static const _channel = MethodChannel('youtube_music_unbound/smtc');
+  final _diff = _SessionDiff();
+  bool _initialized = false;
+
+  @override
+  Stream<PlaybackCommand> get commandStream => _commands.stream;
+
+  _DesktopController() {
+    if (Platform.isWindows || Platform.isMacOS) {
+      _channel.setMethodCallHandler(_handleCall);
+    }
+  }
+
+  Future<void> _init() async {
+    if (_initialized || (!Platform.isWindows && !Platform.isMacOS)) {
+      return;
+    }
+    try {
+      await _channel.invokeMethod('initialize');
+      _initialized = true;
+    } catch (_) {}
+  }
+
+  Future<void> _handleCall(MethodCall call) async {
+    if (call.method == 'onMediaCommand') {
+      final args = call.arguments as Map<dynamic, dynamic>;
+      final cmd = _parseCommand(args['command'] as String);
+      if (cmd != null) _commands.add(PlaybackCommand(command: cmd));
+    }
+  }
+
+  MediaCommand? _parseCommand(String cmd) {
+    switch (cmd) {
+      case 'play':
+        return MediaCommand.play;
+      case 'pause':
+        return MediaCommand.pause;
+      case 'next':
+        return MediaCommand.next;
+      case 'previous':
+        return MediaCommand.previous;
+      case 'stop':
+        return MediaCommand.stop;
+      default:
+        return null;
+    }
+  }
+
+  @override
+  void updateSession({
+    TrackMetadata? metadata,
+    app.PlaybackState? state,
+    Duration? position,
+    Duration? duration,
+  }) async {
+    if (!Platform.isWindows && !Platform.isMacOS) return;
+    final args = _diff.build({
+      if (metadata != null) ...{
+        'title': metadata.title,
+        'artist': metadata.artist,
+        'album': metadata.album ?? '',
+        'artworkUrl': metadata.artworkUrl ?? '',
+      },
+      if (state != null) 'state': _stateToString(state),
+      if (position != null) 'position': position.inMilliseconds,
+      if (duration != null) 'duration': duration.inMilliseconds,
+    });
+    if (args == null) return;
+    await _init();
+    try {
+      await _channel.invokeMethod('updateSession', args);
+    } catch (_) {
+      _diff.reset();
+    }
+  }
+
+  String _stateToString(app.PlaybackState state) {
+    switch (state) {
+      case app.PlaybackState.playing:
+        return 'playing';
+      case app.PlaybackState.paused:
+      case app.PlaybackState.buffering:
+        return 'paused';
+      case app.PlaybackState.stopped:
+        return 'stopped';
+    }
+  }
+
+  @override
+  Future<void> dispose() async => await _commands.close();
+}
+
+class _LinuxController implements MediaSessionController {
+  final _commands = StreamController<PlaybackCommand>.broadcast();
+  static const _channel = MethodChannel('youtube_music_unbound/mpris');
+  static const _coalesceWindow = Duration(milliseconds: 16);
+  static const _seekTolerance = Duration(seconds: 2);
+  final _diff = _SessionDiff();
+  // When the runner exports it, session fields are written here and the
+  // channel only carries a sessionChanged doorbell.
+  final _block = NowPlayingBlock.open();
+  bool _initialized = false;
+
+  // Mirrors the native position anchor so only discontinuities are sent;
+  // MPRIS extrapolates Position between reports.
+  final _clock = Stopwatch()..start();
+  Duration? _anchorPosition;
+  Duration _anchorTime = Duration.zero;
+  Duration? _duration;
+  bool _playing = false;
+
+  @override
+  Stream<PlaybackCommand> get commandStream => _commands.stream;
+
+  _LinuxController() {
+    _channel.setMethodCallHandler(_handleCall);
+  }
+
+  Future<void> _init() async {
+    if (_initialized) return;
+    try {
+      await _channel.invokeMethod('initialize', {
+        'coalesceMs': _coalesceWindow.inMilliseconds,
+      });
+      _initialized = true;
+    } catch (_) {}
+  }
+
+  Future<void> _handleCall(MethodCall call) async {
+    if (call.method == 'onMediaCommand') {
+      final args = Map<String, dynamic>.from(call.arguments as Map);
+      final cmd = _parseCommand(args.remove('command') as String);
+      if (cmd == null) return;
+
+      // MPRIS already published the new position; keep the local anchor in
+      // step so the WebView's next report is not mistaken for a seek.
+      if (cmd == MediaCommand.setPosition) {
+        _setAnchor(Duration(microseconds: args['position'] as int));
+      } else if (cmd == MediaCommand.seek) {
+        _setAnchor(
+          _expectedPosition() + Duration(microseconds: args['offset'] as int),
+        );
+      }
+
+      _commands.add(PlaybackCommand(command: cmd, params: args));
+    }
+  }
+
+  MediaCommand? _parseCommand(String cmd) {
+    for (final command in MediaCommand.values) {
+      if (command.name == cmd) return command;
+    }
+    return null;
+  }
+
+  @override
+  void updateSession({
+    TrackMetadata? metadata,
+    app.PlaybackState? state,
+    Duration? position,
+    Duration? duration,
+  }) async {
+    if (state != null) {
+      if (_anchorPosition != null) _setAnchor(_expectedPosition());
+      _playing = state == app.PlaybackState.playing;
+    }
+
+    // MPRIS extrapolates Position itself; only jumps are worth sending.
+    Duration? jump;
+    if (position != null &&
+        _isDiscontinuity(position, duration ?? _duration)) {
+      jump = position;
+      _setAnchor(position);
+    }
+    if (duration != null) _duration = duration;
+
+    final args = _diff.build(
+      {
+        if (metadata != null) ...{
+          'title': metadata.title,
+          'artist': metadata.artist,
+          'album': metadata.album ?? '',
+          'artworkUrl': metadata.artworkUrl ?? '',
+        },
+        if (state != null) 'state': _stateToString(state),
+        if (duration != null) 'duration': duration.inMicroseconds,
+      },
+      {if (jump != null) 'position': jump.inMicroseconds},
+    );
+    if (args == null) return;
+
+    final block = _block;
+    if (block != null) {
+      block.write(
+        title: args['title'] as String?,
+        artist: args['artist'] as String?,
+        album: args['album'] as String?,
+        artUrl: args['artworkUrl'] as String?,
+        state: state != null ? _blockState(state) : null,
+        position: jump,
+        duration: duration,
+      );
+      await _init();
+      try {
+        await _channel.invokeMethod('sessionChanged');
+      } catch (_) {}
+      return;
+    }
+
+    await _init();
+    try {
+      await _channel.invokeMethod('updateSession', args);
+    } catch (_) {
+      _diff.reset();
+    }
+  }
+
+  NowPlayingState _blockState(app.PlaybackState state) {
+    switch (state) {
+      case app.PlaybackState.playing:
+        return NowPlayingState.playing;
+      case app.PlaybackState.paused:
+      case app.PlaybackState.buffering:
+        return NowPlayingState.paused;
+      case app.PlaybackState.stopped:
+        return NowPlayingState.stopped;
+    }
+  }
+
+  Duration _expectedPosition() {
+    final anchor = _anchorPosition ?? Duration.zero;
+    if (!_playing) return anchor;
+    return anchor + (_clock.elapsed - _anchorTime);
+  }
+
+  void _setAnchor(Duration position) {
+    _anchorPosition = position;
+    _anchorTime = _clock.elapsed;
+  }
+
+  bool _isDiscontinuity(Duration position, Duration? duration) {
+    if (_anchorPosition == null || duration != _duration) return true;
+    return (position - _expectedPosition()).abs() > _seekTolerance;
+  }
+
+  String _stateToString(app.PlaybackState state) {
+    switch (state) {
+      case app.PlaybackState.playing:
+        return 'playing';
+      case app.PlaybackState.paused:
+      case app.PlaybackState.buffering:
+        return 'paused';
+      case app.PlaybackState.stopped:
+        return 'stopped';
+    }
+  }
+
+  @override
+  Future<void> dispose() async => await _commands.close();
+}
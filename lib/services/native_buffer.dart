@@ -0,0 +1,56 @@
+import 'dart:ffi';
+
+typedef _Malloc = Pointer<Uint8> Function(Size);
+typedef _MallocDart = Pointer<Uint8> Function(int);
+typedef _Free = Void Function(Pointer<Uint8>);
+typedef _FreeDart = void Function(Pointer<Uint8>);
+
+/// A reusable malloc'd buffer for passing bytes to the runner's exports
+/// through dart:ffi. package:ffi is not a dependency, so malloc and free
+/// are taken from the process like the exports themselves.
+class NativeBuffer {
+  final _MallocDart _malloc;
+  final _FreeDart _free;
+  Pointer<Uint8> _buffer = nullptr;
+  int _capacity = 0;
+
+  NativeBuffer._(this._malloc, this._free);
+
+  /// Looks up malloc and free in [process]. Throws if either is missing.
+  factory NativeBuffer(DynamicLibrary process) {
+    return NativeBuffer._(
+      process.lookupFunction<_Malloc, _MallocDart>('malloc', isLeaf: true),
+      process.lookupFunction<_Free, _FreeDart>('free', isLeaf: true),
+    );
+  }
+
+  /// Copies [bytes] into the buffer, followed by a NUL so it can also be
+  /// passed as a C string, growing it as needed. The pointer stays valid
+  /// until the next copy or [dispose].
+  Pointer<Uint8> copy(List<int> bytes) {
+    if (bytes.length + 1 > _capacity) {
+      if (_buffer != nullptr) _free(_buffer);
+      _capacity = bytes.length + 1 < 4096 ? 4096 : bytes.length + 1;
+      _buffer = _malloc(_capacity);
+    }
+    final view = _buffer.asTypedList(_capacity);
+    view.setAll(0, bytes);
+    view[bytes.length] = 0;
+    return _buffer;
+  }
+
+  void dispose() {
+    if (_buffer != nullptr) _free(_buffer);
+    _buffer = nullptr;
+    _capacity = 0;
+  }
+}
+
+/// Returns the length of the NUL-terminated string at [string].
+int cStringLength(Pointer<Uint8> string) {
+  var length = 0;
+  while (string[length] != 0) {
+    length++;
+  }
+  return length;
+}
@@ -0,0 +1,137 @@
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:io';
+
+const int _textSize = 512;
+const int _urlSize = 1024;
+
+/// Mirrors NowPlayingBlock in linux/runner/now_playing_block.h.
+final class _Block extends Struct {
+  @Uint32()
+  external int sequence;
+
+  @Uint32()
+  external int state;
+
+  @Uint64()
+  external int generation;
+
+  @Int64()
+  external int positionUs;
+
+  @Int64()
+  external int positionTimeUs;
+
+  @Int64()
+  external int durationUs;
+
+  @Array(_textSize)
+  external Array<Uint8> title;
+
+  @Array(_textSize)
+  external Array<Uint8> artist;
+
+  @Array(_textSize)
+  external Array<Uint8> album;
+
+  @Array(_urlSize)
+  external Array<Uint8> artUrl;
+}
+
+/// Matches NowPlayingState in now_playing_block.h.
+enum NowPlayingState { stopped, playing, paused }
+
+typedef _BlockGet = Pointer<_Block> Function();
+typedef _BlockOp = Void Function(Pointer<_Block>);
+typedef _BlockOpDart = void Function(Pointer<_Block>);
+typedef _SetPosition = Void Function(Pointer<_Block>, Int64);
+typedef _SetPositionDart = void Function(Pointer<_Block>, int);
+
+/// Now-playing state shared with the Linux runner through memory instead
+/// of encoded channel messages. The runner reads it under a seqlock; this
+/// side is the single writer.
+class NowPlayingBlock {
+  final Pointer<_Block> _block;
+  final _BlockOpDart _beginWrite;
+  final _BlockOpDart _endWrite;
+  final _SetPositionDart _setPosition;
+
+  NowPlayingBlock._(
+    this._block,
+    this._beginWrite,
+    this._endWrite,
+    this._setPosition,
+  );
+
+  /// Returns the runner's block, or null where the runner does not export
+  /// one.
+  static NowPlayingBlock? open() {
+    if (!Platform.isLinux) return null;
+    try {
+      final process = DynamicLibrary.process();
+      final get = process.lookupFunction<_BlockGet, _BlockGet>(
+        'now_playing_block_get',
+      );
+      return NowPlayingBlock._(
+        get(),
+        process.lookupFunction<_BlockOp, _BlockOpDart>(
+          'now_playing_block_begin_write',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_BlockOp, _BlockOpDart>(
+          'now_playing_block_end_write',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_SetPosition, _SetPositionDart>(
+          'now_playing_block_set_position',
+          isLeaf: true,
+        ),
+      );
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Generation of the last completed write.
+  int get generation => _block.ref.generation;
+
+  /// Writes the given fields as one update; null fields keep their value.
+  /// Returns the new generation.
+  int write({
+    String? title,
+    String? artist,
+    String? album,
+    String? artUrl,
+    NowPlayingState? state,
+    Duration? position,
+    Duration? duration,
+  }) {
+    final block = _block.ref;
+    _beginWrite(_block);
+    if (title != null) _writeString(block.title, _textSize, title);
+    if (artist != null) _writeString(block.artist, _textSize, artist);
+    if (album != null) _writeString(block.album, _textSize, album);
+    if (artUrl != null) _writeString(block.artUrl, _urlSize, artUrl);
+    if (state != null) block.state = state.index;
+    if (position != null) _setPosition(_block, position.inMicroseconds);
+    if (duration != null) block.durationUs = duration.inMicroseconds;
+    _endWrite(_block);
+    return block.generation;
+  }
+
+  /// Copies [value] as NUL-terminated UTF-8, truncated on a character
+  /// boundary to fit [size].
+  static void _writeString(Array<Uint8> slot, int size, String value) {
+    final bytes = utf8.encode(value);
+    var length = bytes.length < size ? bytes.length : size - 1;
+    while (length > 0 &&
+        length < bytes.length &&
+        (bytes[length] & 0xC0) == 0x80) {
+      length--;
+    }
+    for (var i = 0; i < length; i++) {
+      slot[i] = bytes[i];
+    }
+    slot[length] = 0;
+  }
+}
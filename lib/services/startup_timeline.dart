@@ -0,0 +1,141 @@
+import 'dart:developer' show Timeline;
+import 'dart:io';
+
+import 'package:flutter/foundation.dart';
+import 'package:flutter/services.dart';
+
+/// Records when each phase of a launch is first reached and prints the
+/// timeline once the page has painted, to compare launches with a cold and
+/// a warm asset cache. Enabled by setting YTMU_STARTUP_TIMING in the
+/// environment; otherwise marks are ignored.
+///
+/// Times are measured from the start of the process where /proc says when
+/// that was, and from the start of main() elsewhere.
+///
+/// With YTMU_STARTUP_TRACE set on Linux, marks and [span]s are also sent to
+/// the runner's startup trace (linux/runner/startup_trace.h), which lays
+/// them out beside the runner's own phases in a Chrome trace file.
+class StartupTimeline {
+  static const String environmentVariable = 'YTMU_STARTUP_TIMING';
+  static const String traceVariable = 'YTMU_STARTUP_TRACE';
+
+  static const _traceChannel = MethodChannel(
+    'youtube_music_unbound/startup_trace',
+  );
+
+  static final StartupTimeline instance = StartupTimeline._(
+    Platform.environment.containsKey(environmentVariable),
+    tracing:
+        Platform.isLinux &&
+        (Platform.environment[traceVariable]?.isNotEmpty ?? false),
+  );
+
+  final bool enabled;
+  final bool tracing;
+  final Stopwatch _clock = Stopwatch()..start();
+  final int _startEpochUs = DateTime.now().microsecondsSinceEpoch;
+  final Duration _processAge;
+  final Map<String, Duration> _phases = {};
+  bool _reported = false;
+
+  StartupTimeline._(this.enabled, {this.tracing = false})
+    : _processAge = enabled ? _readProcessAge() : Duration.zero;
+
+  /// Records [phase] as reached now, unless it was already.
+  void mark(String phase) {
+    if (tracing && !_phases.containsKey(phase)) {
+      _sendEvent(phase, Timeline.now);
+    }
+    if (!enabled && !tracing) return;
+    _phases.putIfAbsent(phase, () => _processAge + _clock.elapsed);
+  }
+
+  /// Records [phase] as reached at [epochMs], milliseconds since the epoch
+  /// as the page's performance.timeOrigin counts them.
+  void markAt(String phase, double epochMs) {
+    if (!enabled && !tracing) return;
+    final sinceStart = Duration(
+      microseconds: (epochMs * 1000).round() - _startEpochUs,
+    );
+    if (tracing && !_phases.containsKey(phase)) {
+      final ago = DateTime.now().microsecondsSinceEpoch - epochMs * 1000;
+      _sendEvent(phase, Timeline.now - ago.round());
+    }
+    _phases.putIfAbsent(phase, () => _processAge + sinceStart);
+  }
+
+  /// Returns the time to begin a [span] at, or 0 when not tracing.
+  int begin() => tracing ? Timeline.now : 0;
+
+  /// Sends a span named [name] from [beginUs], as returned by [begin], to
+  /// now to the startup trace.
+  void span(String name, int beginUs) {
+    if (!tracing || beginUs == 0) return;
+    _sendEvent(name, beginUs, Timeline.now);
+  }
+
+  /// Times [body] as a span named [name].
+  Future<T> trace<T>(String name, Future<T> Function() body) async {
+    final beginUs = begin();
+    try {
+      return await body();
+    } finally {
+      span(name, beginUs);
+    }
+  }
+
+  // Timeline.now reads the monotonic clock the runner stamps its own
+  // events with.
+  void _sendEvent(String name, int beginUs, [int? endUs]) {
+    _traceChannel
+        .invokeMethod('event', {
+          'name': name,
+          'begin': beginUs,
+          if (endUs != null) 'end': endUs,
+        })
+        .catchError((_) => null);
+  }
+
+  /// The phases reached so far, in order, with [extra] counters appended.
+  String format({Map<String, Object> extra = const {}}) {
+    final phases = _phases.entries.toList()
+      ..sort((a, b) => a.value.compareTo(b.value));
+    final buffer = StringBuffer('Startup timeline:\n');
+    for (final phase in phases) {
+      final ms = phase.value.inMicroseconds / 1000;
+      buffer.writeln('  ${ms.toStringAsFixed(1).padLeft(9)} ms  ${phase.key}');
+    }
+    extra.forEach((name, value) => buffer.writeln('  $name: $value'));
+    return buffer.toString();
+  }
+
+  /// Prints the timeline once, and writes the startup trace so far.
+  void report({Map<String, Object> extra = const {}}) {
+    if (_reported) return;
+    _reported = true;
+    if (tracing) {
+      _traceChannel.invokeMethod('write').catchError((_) => null);
+    }
+    if (enabled) debugPrint(format(extra: extra));
+  }
+
+  /// How long the process had been running when this was created, from its
+  /// start time in /proc/self/stat, in clock ticks since boot.
+  static Duration _readProcessAge() {
+    if (!Platform.isLinux) return Duration.zero;
+    try {
+      final stat = File('/proc/self/stat').readAsStringSync();
+      // Fields after the parenthesised command name, which may hold spaces;
+      // starttime is field 22, the 20th of these.
+      final fields = stat.substring(stat.lastIndexOf(')') + 2).split(' ');
+      const ticksPerSecond = 100;
+      final startedUs = int.parse(fields[19]) * 1000000 ~/ ticksPerSecond;
+      final uptime = File('/proc/uptime').readAsStringSync().split(' ').first;
+      final uptimeUs = (double.parse(uptime) * 1000000).round();
+      final age = uptimeUs - startedUs;
+      return age > 0 ? Duration(microseconds: age) : Duration.zero;
+    } catch (_) {
+      return Duration.zero;
+    }
+  }
+}
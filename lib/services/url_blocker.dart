@@ -0,0 +1,399 @@
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:io';
+
+import 'package:flutter/services.dart';
+
+import 'filter_lists.dart';
+import 'native_buffer.dart';
+
+typedef _MatcherNew = Pointer<Void> Function(Pointer<Uint8>, Size);
+typedef _MatcherNewDart = Pointer<Void> Function(Pointer<Uint8>, int);
+typedef _MatcherFree = Void Function(Pointer<Void>);
+typedef _MatcherFreeDart = void Function(Pointer<Void>);
+typedef _MatcherMatch = Int32 Function(Pointer<Void>, Pointer<Uint8>, Size);
+typedef _MatcherMatchDart = int Function(Pointer<Void>, Pointer<Uint8>, int);
+typedef _MatcherHits = Uint64 Function(Pointer<Void>, Uint32);
+typedef _MatcherHitsDart = int Function(Pointer<Void>, int);
+typedef _HostMatcherMatch =
+    Int32 Function(Pointer<Void>, Pointer<Uint8>, Size);
+typedef _HostMatcherMatchDart =
+    int Function(Pointer<Void>, Pointer<Uint8>, int);
+
+/// Decides which WebView requests to block, using the rules in
+/// [rulesAsset] and the domains in [hostsAsset]. On Linux the rules are
+/// compiled into the runner's native matcher (linux/runner/url_matcher.h)
+/// so each URL is checked in one pass, and the domains into its host trie
+/// (linux/runner/host_matcher.h); elsewhere the rules are matched as
+/// regular expressions and the domains looked up in a set. The user's own
+/// filter lists, where available, are consulted as well and their
+/// exception rules take precedence.
+class UrlBlocker {
+  static const String rulesAsset = 'assets/filters/network_block_patterns.txt';
+
+  static const String hostsAsset = 'assets/filters/blocked_hosts.txt';
+
+  /// Replaced with the rules, as a JSON array, in scripts that share them.
+  static const String scriptPlaceholder = '/*NETWORK_BLOCK_PATTERNS*/[]';
+
+  /// Replaced with the blocked domains, as a JSON array.
+  static const String hostsPlaceholder = '/*BLOCKED_HOSTS*/[]';
+
+  /// Replaced with the user's element hiding selectors for [pageHost].
+  static const String cosmeticPlaceholder = '/*COSMETIC_SELECTORS*/[]';
+
+  /// Host of the page whose requests are filtered.
+  static const String pageHost = 'music.youtube.com';
+
+  /// The rules, indexed by rule id.
+  final List<String> rules;
+
+  /// The blocked domains, lower-cased, indexed by entry id.
+  final List<String> hosts;
+  final _RuleMatcher _matcher;
+  final _HostMatcher _hostMatcher;
+  final FilterLists? _lists;
+
+  UrlBlocker(this.rules, {this.hosts = const [], FilterLists? lists})
+    : _matcher = _NativeRuleMatcher.open(rules) ?? _DartRuleMatcher(rules),
+      _hostMatcher =
+          _NativeHostMatcher.open(hosts) ?? _DartHostMatcher(hosts),
+      _lists = lists;
+
+  static Future<UrlBlocker> load() async {
+    return UrlBlocker(
+      parseRules(await rootBundle.loadString(rulesAsset)),
+      hosts: parseHosts(await rootBundle.loadString(hostsAsset)),
+      lists: FilterLists.open(),
+    );
+  }
+
+  /// Returns the rule lines of [text], skipping blank lines and comments.
+  static List<String> parseRules(String text) {
+    return const LineSplitter()
+        .convert(text)
+        .map((line) => line.trim())
+        .where(
+          (line) =>
+              line.isNotEmpty && !line.startsWith('#') && !line.startsWith('!'),
+        )
+        .toList();
+  }
+
+  /// Returns the domains listed in [text], which is in the hosts-file
+  /// format described in linux/runner/host_matcher.h.
+  static List<String> parseHosts(String text) {
+    final hosts = <String>[];
+    for (final line in const LineSplitter().convert(text)) {
+      final comment = line.indexOf('#');
+      final fields = (comment >= 0 ? line.substring(0, comment) : line)
+          .trim()
+          .split(_whitespace);
+      if (fields.first.isEmpty || fields.first.startsWith('!')) continue;
+
+      if (_address.hasMatch(fields.first)) {
+        hosts.addAll(fields.skip(1).where(_isHost));
+      } else if (fields.length == 1) {
+        var host = fields.first;
+        if (host.length > 3 && host.startsWith('||') && host.endsWith('^')) {
+          host = host.substring(2, host.length - 1);
+        }
+        if (_isHost(host)) hosts.add(host);
+      }
+    }
+    return hosts.map((host) => host.toLowerCase()).toList();
+  }
+
+  static final _whitespace = RegExp(r'\s+');
+  static final _address = RegExp(r'^(?:[0-9.]+|.*:.*)$');
+  static final _hostName = RegExp(
+    r'^[A-Za-z0-9_-]+(?:\.[A-Za-z0-9_-]+)*\.?$',
+  );
+  static const _systemNames = {
+    'localhost',
+    'localhost.localdomain',
+    'local',
+    'broadcasthost',
+    'ip6-localhost',
+    'ip6-loopback',
+    'ip6-localnet',
+    'ip6-mcastprefix',
+    'ip6-allnodes',
+    'ip6-allrouters',
+    'ip6-allhosts',
+  };
+
+  static bool _isHost(String host) =>
+      _hostName.hasMatch(host) &&
+      !_address.hasMatch(host) &&
+      !_systemNames.contains(host.toLowerCase());
+
+  /// Returns the id of a rule matching [url], or null.
+  int? match(String url) => _matcher.match(url);
+
+  /// Returns the id of the blocked domain that [url]'s host is or is under,
+  /// or null.
+  int? matchHost(String url) => _hostMatcher.match(url);
+
+  /// Whether to block a request for [url]. [type] is a [FilterRequestType]
+  /// value, inferred from the URL if omitted.
+  bool shouldBlock(String url, {int? type, bool isForMainFrame = false}) {
+    final decision = _lists?.decide(
+      url,
+      type:
+          type ?? FilterRequestType.infer(url, isForMainFrame: isForMainFrame),
+      documentHost: pageHost,
+    );
+    if (decision == FilterDecision.allow) return false;
+    return matchHost(url) != null ||
+        match(url) != null ||
+        decision == FilterDecision.block;
+  }
+
+  /// Returns how often each rule has matched, for rules that have.
+  Map<String, int> hitCounts() {
+    final counts = <String, int>{};
+    for (var i = 0; i < rules.length; i++) {
+      final hits = _matcher.hits(i);
+      if (hits > 0) counts[rules[i]] = hits;
+    }
+    return counts;
+  }
+
+  /// Returns [script] with [scriptPlaceholder] replaced by the rules,
+  /// [hostsPlaceholder] by the domains and [cosmeticPlaceholder] by the
+  /// user's selectors.
+  String injectInto(String script) {
+    return script
+        .replaceFirst(scriptPlaceholder, jsonEncode(rules))
+        .replaceFirst(hostsPlaceholder, jsonEncode(hosts))
+        .replaceFirst(
+          cosmeticPlaceholder,
+          jsonEncode(_lists?.cosmeticSelectors(pageHost) ?? const []),
+        );
+  }
+
+  void dispose() {
+    _matcher.dispose();
+    _hostMatcher.dispose();
+    _lists?.dispose();
+  }
+}
+
+abstract class _RuleMatcher {
+  int? match(String url);
+  int hits(int rule);
+  void dispose();
+}
+
+class _NativeRuleMatcher implements _RuleMatcher {
+  final Pointer<Void> _matcher;
+  final _MatcherMatchDart _match;
+  final _MatcherHitsDart _hits;
+  final _MatcherFreeDart _free;
+  final NativeBuffer _buffer;
+
+  _NativeRuleMatcher._(
+    this._matcher,
+    this._match,
+    this._hits,
+    this._free,
+    this._buffer,
+  );
+
+  /// Returns a matcher compiled from [rules], or null where the runner
+  /// does not export one.
+  static _NativeRuleMatcher? open(List<String> rules) {
+    if (!Platform.isLinux) return null;
+    try {
+      final process = DynamicLibrary.process();
+      final matcherNew = process.lookupFunction<_MatcherNew, _MatcherNewDart>(
+        'url_matcher_new',
+      );
+      final buffer = NativeBuffer(process);
+
+      final bytes = utf8.encode(rules.join('\n'));
+      final handle = matcherNew(buffer.copy(bytes), bytes.length);
+
+      return _NativeRuleMatcher._(
+        handle,
+        process.lookupFunction<_MatcherMatch, _MatcherMatchDart>(
+          'url_matcher_match',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_MatcherHits, _MatcherHitsDart>(
+          'url_matcher_rule_hits',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_MatcherFree, _MatcherFreeDart>(
+          'url_matcher_free',
+        ),
+        buffer,
+      );
+    } catch (_) {
+      return null;
+    }
+  }
+
+  @override
+  int? match(String url) {
+    final bytes = utf8.encode(url);
+    final rule = _match(_matcher, _buffer.copy(bytes), bytes.length);
+    return rule < 0 ? null : rule;
+  }
+
+  @override
+  int hits(int rule) => _hits(_matcher, rule);
+
+  @override
+  void dispose() {
+    _free(_matcher);
+    _buffer.dispose();
+  }
+}
+
+class _DartRuleMatcher implements _RuleMatcher {
+  final List<RegExp?> _patterns;
+  final List<int> _hits;
+
+  _DartRuleMatcher(List<String> rules)
+    : _patterns = rules.map(_compile).toList(),
+      _hits = List.filled(rules.length, 0);
+
+  /// Translates a rule into an equivalent regular expression, or null for
+  /// a rule with nothing to match.
+  static RegExp? _compile(String rule) {
+    var pattern = rule;
+    var prefix = '';
+    var suffix = '';
+    if (pattern.startsWith('||')) {
+      prefix = r'^[^:/?#]+://(?:[^/?#]*\.)?';
+      pattern = pattern.substring(2);
+    } else if (pattern.startsWith('|')) {
+      prefix = '^';
+      pattern = pattern.substring(1);
+    }
+    if (pattern.endsWith('|')) {
+      suffix = r'$';
+      pattern = pattern.substring(0, pattern.length - 1);
+    }
+    if (pattern.startsWith('*')) prefix = '';
+    if (pattern.endsWith('*')) suffix = '';
+
+    final segments = pattern.split('*').where((s) => s.isNotEmpty);
+    if (segments.isEmpty) return null;
+    return RegExp(
+      prefix + segments.map(RegExp.escape).join('.*') + suffix,
+      caseSensitive: false,
+    );
+  }
+
+  @override
+  int? match(String url) {
+    for (var i = 0; i < _patterns.length; i++) {
+      if (_patterns[i]?.hasMatch(url) ?? false) {
+        _hits[i]++;
+        return i;
+      }
+    }
+    return null;
+  }
+
+  @override
+  int hits(int rule) => _hits[rule];
+
+  @override
+  void dispose() {}
+}
+
+abstract class _HostMatcher {
+  int? match(String url);
+  void dispose();
+}
+
+class _NativeHostMatcher implements _HostMatcher {
+  final Pointer<Void> _matcher;
+  final _HostMatcherMatchDart _match;
+  final _MatcherFreeDart _free;
+  final NativeBuffer _buffer;
+
+  _NativeHostMatcher._(this._matcher, this._match, this._free, this._buffer);
+
+  /// Returns a matcher over [hosts], or null where the runner does not
+  /// export one.
+  static _NativeHostMatcher? open(List<String> hosts) {
+    if (!Platform.isLinux) return null;
+    try {
+      final process = DynamicLibrary.process();
+      final matcherNew = process.lookupFunction<_MatcherNew, _MatcherNewDart>(
+        'host_matcher_new',
+      );
+      final buffer = NativeBuffer(process);
+
+      final bytes = utf8.encode(hosts.join('\n'));
+      final handle = matcherNew(buffer.copy(bytes), bytes.length);
+
+      return _NativeHostMatcher._(
+        handle,
+        process.lookupFunction<_HostMatcherMatch, _HostMatcherMatchDart>(
+          'host_matcher_match_url',
+          isLeaf: true,
+        ),
+        process.lookupFunction<_MatcherFree, _MatcherFreeDart>(
+          'host_matcher_free',
+        ),
+        buffer,
+      );
+    } catch (_) {
+      return null;
+    }
+  }
+
+  @override
+  int? match(String url) {
+    final bytes = utf8.encode(url);
+    final entry = _match(_matcher, _buffer.copy(bytes), bytes.length);
+    return entry < 0 ? null : entry;
+  }
+
+  @override
+  void dispose() {
+    _free(_matcher);
+    _buffer.dispose();
+  }
+}
+
+class _DartHostMatcher implements _HostMatcher {
+  /// Domain to its lowest entry id.
+  final Map<String, int> _ids = {};
+
+  _DartHostMatcher(List<String> hosts) {
+    for (var i = 0; i < hosts.length; i++) {
+      final host = hosts[i].endsWith('.')
+          ? hosts[i].substring(0, hosts[i].length - 1)
+          : hosts[i];
+      _ids.putIfAbsent(host, () => i);
+    }
+  }
+
+  /// Tries the host's domains from the top-level one down, as the native
+  /// trie walks them, so a listed domain decides before its subdomains.
+  @override
+  int? match(String url) {
+    if (_ids.isEmpty) return null;
+    var host = Uri.tryParse(url)?.host.toLowerCase() ?? '';
+    if (host.endsWith('.')) host = host.substring(0, host.length - 1);
+    if (host.isEmpty) return null;
+
+    var dot = host.length;
+    while (dot > 0) {
+      dot = host.lastIndexOf('.', dot - 1);
+      final id = _ids[host.substring(dot + 1)];
+      if (id != null) return id;
+    }
+    return null;
+  }
+
+  @override
+  void dispose() {}
+}
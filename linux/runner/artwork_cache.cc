@@ -0,0 +1,367 @@
+#include "artwork_cache.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "http_client.h"
+
+static constexpr guint kMemoryEntries = 64;
+static constexpr gint kWorkerThreads = 4;
+// Edge length images are downscaled to. Panels, lock screens and
+// notifications draw artwork well below this, so it stays sharp on HiDPI.
+static constexpr gint kArtworkSize = 512;
+static constexpr gsize kMaxDownloadSize = 8 * 1024 * 1024;
+
+struct ArtworkEntry {
+  gchar* url;
+  gchar* path;
+};
+
+struct ArtworkWaiter {
+  ArtworkReadyCallback callback;
+  gpointer user_data;
+  GMainContext* context;
+};
+
+struct ArtworkDelivery {
+  ArtworkReadyCallback callback;
+  gpointer user_data;
+  gchar* url;
+  gchar* path;
+};
+
+struct _ArtworkCache {
+  GObject parent_instance;
+
+  gchar* directory;
+  // Holds one symlink per URL, named by the URL's hash and pointing at the
+  // content-addressed image in |directory|.
+  gchar* url_directory;
+  GThreadPool* pool;
+
+  GMutex mutex;
+  // Guarded by |mutex|. |recent| holds ArtworkEntry items, most recently
+  // used first; |memory| maps each entry's URL to its link in |recent|.
+  GQueue recent;
+  GHashTable* memory;
+  // URL to GPtrArray of ArtworkWaiter for downloads in progress.
+  GHashTable* in_flight;
+  guint64 hits;
+  guint64 misses;
+  guint64 failures;
+};
+
+G_DEFINE_TYPE(ArtworkCache, artwork_cache, G_TYPE_OBJECT)
+
+static void artwork_entry_free(gpointer data) {
+  ArtworkEntry* entry = static_cast<ArtworkEntry*>(data);
+  g_free(entry->url);
+  g_free(entry->path);
+  g_free(entry);
+}
+
+static void artwork_waiter_free(gpointer data) {
+  ArtworkWaiter* waiter = static_cast<ArtworkWaiter*>(data);
+  g_main_context_unref(waiter->context);
+  g_free(waiter);
+}
+
+static void artwork_delivery_free(gpointer data) {
+  ArtworkDelivery* delivery = static_cast<ArtworkDelivery*>(data);
+  g_free(delivery->url);
+  g_free(delivery->path);
+  g_free(delivery);
+}
+
+static void fetch_worker(gpointer data, gpointer user_data);
+
+static void artwork_cache_dispose(GObject* object) {
+  ArtworkCache* self = ARTWORK_CACHE(object);
+
+  // Drops queued downloads and waits for the ones already running.
+  if (self->pool != nullptr) {
+    g_thread_pool_free(self->pool, TRUE, TRUE);
+    self->pool = nullptr;
+  }
+
+  g_clear_pointer(&self->memory, g_hash_table_unref);
+  g_queue_clear_full(&self->recent, artwork_entry_free);
+  g_clear_pointer(&self->in_flight, g_hash_table_unref);
+  g_clear_pointer(&self->directory, g_free);
+  g_clear_pointer(&self->url_directory, g_free);
+
+  G_OBJECT_CLASS(artwork_cache_parent_class)->dispose(object);
+}
+
+static void artwork_cache_finalize(GObject* object) {
+  ArtworkCache* self = ARTWORK_CACHE(object);
+  g_mutex_clear(&self->mutex);
+
+  G_OBJECT_CLASS(artwork_cache_parent_class)->finalize(object);
+}
+
+static void artwork_cache_class_init(ArtworkCacheClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = artwork_cache_dispose;
+  G_OBJECT_CLASS(klass)->finalize = artwork_cache_finalize;
+}
+
+static void artwork_cache_init(ArtworkCache* self) {
+  g_mutex_init(&self->mutex);
+  g_queue_init(&self->recent);
+  self->memory = g_hash_table_new(g_str_hash, g_str_equal);
+  self->in_flight = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)g_ptr_array_unref);
+  self->pool = g_thread_pool_new_full(fetch_worker, self, g_free,
+                                      kWorkerThreads, FALSE, nullptr);
+}
+
+static gchar* url_link_path(ArtworkCache* self, const gchar* url) {
+  g_autofree gchar* key = g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                                        url, -1);
+  return g_build_filename(self->url_directory, key, nullptr);
+}
+
+// Must be called with |mutex| held.
+static void remember(ArtworkCache* self, const gchar* url, const gchar* path) {
+  GList* link = static_cast<GList*>(g_hash_table_lookup(self->memory, url));
+  if (link != nullptr) {
+    g_queue_unlink(&self->recent, link);
+    g_queue_push_head_link(&self->recent, link);
+    return;
+  }
+
+  ArtworkEntry* entry = g_new(ArtworkEntry, 1);
+  entry->url = g_strdup(url);
+  entry->path = g_strdup(path);
+  g_queue_push_head(&self->recent, entry);
+  g_hash_table_insert(self->memory, entry->url, self->recent.head);
+
+  if (self->recent.length > kMemoryEntries) {
+    ArtworkEntry* oldest =
+        static_cast<ArtworkEntry*>(g_queue_pop_tail(&self->recent));
+    g_hash_table_remove(self->memory, oldest->url);
+    artwork_entry_free(oldest);
+  }
+}
+
+// Resolves the per-URL link written by a previous run.
+static gchar* lookup_disk(ArtworkCache* self, const gchar* url) {
+  g_autofree gchar* link = url_link_path(self, url);
+  g_autofree gchar* target = g_file_read_link(link, nullptr);
+  if (target == nullptr) {
+    return nullptr;
+  }
+
+  g_autofree gchar* name = g_path_get_basename(target);
+  gchar* path = g_build_filename(self->directory, name, nullptr);
+  if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+    g_free(path);
+    return nullptr;
+  }
+  return path;
+}
+
+static GBytes* downscale(GBytes* image, GError** error) {
+  g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+  gsize size;
+  const guchar* data =
+      static_cast<const guchar*>(g_bytes_get_data(image, &size));
+  if (!gdk_pixbuf_loader_write(loader, data, size, error)) {
+    gdk_pixbuf_loader_close(loader, nullptr);
+    return nullptr;
+  }
+  if (!gdk_pixbuf_loader_close(loader, error)) {
+    return nullptr;
+  }
+
+  GdkPixbuf* pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gdouble scale = MIN(1.0, static_cast<gdouble>(kArtworkSize) /
+                               MAX(width, height));
+
+  g_autoptr(GdkPixbuf) scaled = scale < 1.0 ?
+      gdk_pixbuf_scale_simple(pixbuf, MAX(1, width * scale),
+                              MAX(1, height * scale), GDK_INTERP_BILINEAR) :
+      GDK_PIXBUF(g_object_ref(pixbuf));
+
+  gchar* buffer;
+  gsize length;
+  if (!gdk_pixbuf_save_to_buffer(scaled, &buffer, &length, "png", error,
+                                 nullptr)) {
+    return nullptr;
+  }
+  return g_bytes_new_take(buffer, length);
+}
+
+// Downloads |url| and stores it content-addressed. Returns the image path.
+static gchar* fetch_and_store(ArtworkCache* self, const gchar* url,
+                              GError** error) {
+  g_autoptr(GBytes) download = http_client_get(url, kMaxDownloadSize, error);
+  if (download == nullptr) {
+    return nullptr;
+  }
+
+  g_autoptr(GBytes) image = downscale(download, error);
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  g_autofree gchar* hash = g_compute_checksum_for_bytes(G_CHECKSUM_SHA256,
+                                                        image);
+  g_autofree gchar* name = g_strconcat(hash, ".png", nullptr);
+  g_autofree gchar* path = g_build_filename(self->directory, name, nullptr);
+
+  // Identical artwork from different URLs is stored once.
+  if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+    gsize size;
+    const gchar* data =
+        static_cast<const gchar*>(g_bytes_get_data(image, &size));
+    if (!g_file_set_contents(path, data, size, error)) {
+      return nullptr;
+    }
+  }
+
+  // Swap the URL link in atomically so readers never see it missing.
+  g_autofree gchar* link = url_link_path(self, url);
+  g_autofree gchar* temporary = g_strconcat(link, ".tmp", nullptr);
+  g_autofree gchar* target = g_build_filename("..", name, nullptr);
+  g_unlink(temporary);
+  if (symlink(target, temporary) != 0 || g_rename(temporary, link) != 0) {
+    g_warning("Failed to link artwork for %s: %s", url, g_strerror(errno));
+    g_unlink(temporary);
+  }
+
+  return static_cast<gchar*>(g_steal_pointer(&path));
+}
+
+static gboolean deliver(gpointer user_data) {
+  ArtworkDelivery* delivery = static_cast<ArtworkDelivery*>(user_data);
+  delivery->callback(delivery->url, delivery->path, delivery->user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void fetch_worker(gpointer data, gpointer user_data) {
+  ArtworkCache* self = ARTWORK_CACHE(user_data);
+  g_autofree gchar* url = static_cast<gchar*>(data);
+
+  g_autoptr(GError) error = nullptr;
+  g_autofree gchar* path = fetch_and_store(self, url, &error);
+  if (path == nullptr) {
+    g_debug("Artwork fetch failed for %s: %s", url, error->message);
+  }
+
+  g_mutex_lock(&self->mutex);
+  gpointer key = nullptr;
+  gpointer waiters = nullptr;
+  g_hash_table_steal_extended(self->in_flight, url, &key, &waiters);
+  g_free(key);
+  if (path != nullptr) {
+    remember(self, url, path);
+  } else {
+    self->failures++;
+  }
+  g_mutex_unlock(&self->mutex);
+
+  g_autoptr(GPtrArray) pending = static_cast<GPtrArray*>(waiters);
+  for (guint i = 0; pending != nullptr && i < pending->len; i++) {
+    ArtworkWaiter* waiter =
+        static_cast<ArtworkWaiter*>(g_ptr_array_index(pending, i));
+    ArtworkDelivery* delivery = g_new(ArtworkDelivery, 1);
+    delivery->callback = waiter->callback;
+    delivery->user_data = waiter->user_data;
+    delivery->url = g_strdup(url);
+    delivery->path = g_strdup(path);
+
+    GSource* source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, deliver, delivery, artwork_delivery_free);
+    g_source_attach(source, waiter->context);
+    g_source_unref(source);
+  }
+}
+
+ArtworkCache* artwork_cache_new(const gchar* directory) {
+  ArtworkCache* self = ARTWORK_CACHE(
+      g_object_new(artwork_cache_get_type(), nullptr));
+
+  self->directory = directory != nullptr ?
+      g_strdup(directory) :
+      g_build_filename(g_get_user_cache_dir(), "youtube_music_unbound",
+                       "artwork", nullptr);
+  self->url_directory = g_build_filename(self->directory, "urls", nullptr);
+  if (g_mkdir_with_parents(self->url_directory, 0700) != 0) {
+    g_warning("Failed to create %s: %s", self->url_directory,
+              g_strerror(errno));
+  }
+
+  return self;
+}
+
+gchar* artwork_cache_lookup(ArtworkCache* self, const gchar* url) {
+  g_return_val_if_fail(ARTWORK_IS_CACHE(self), nullptr);
+
+  g_mutex_lock(&self->mutex);
+  GList* link = static_cast<GList*>(g_hash_table_lookup(self->memory, url));
+  if (link != nullptr) {
+    self->hits++;
+    g_queue_unlink(&self->recent, link);
+    g_queue_push_head_link(&self->recent, link);
+    gchar* path = g_strdup(static_cast<ArtworkEntry*>(link->data)->path);
+    g_mutex_unlock(&self->mutex);
+    return path;
+  }
+  g_mutex_unlock(&self->mutex);
+
+  gchar* path = lookup_disk(self, url);
+
+  g_mutex_lock(&self->mutex);
+  if (path != nullptr) {
+    self->hits++;
+    remember(self, url, path);
+  } else {
+    self->misses++;
+  }
+  g_mutex_unlock(&self->mutex);
+  return path;
+}
+
+void artwork_cache_fetch(ArtworkCache* self, const gchar* url,
+                         GMainContext* context, ArtworkReadyCallback callback,
+                         gpointer user_data) {
+  g_return_if_fail(ARTWORK_IS_CACHE(self));
+
+  ArtworkWaiter* waiter = g_new(ArtworkWaiter, 1);
+  waiter->callback = callback;
+  waiter->user_data = user_data;
+  waiter->context = g_main_context_ref(context);
+
+  g_mutex_lock(&self->mutex);
+  GPtrArray* waiters =
+      static_cast<GPtrArray*>(g_hash_table_lookup(self->in_flight, url));
+  gboolean start = waiters == nullptr;
+  if (start) {
+    waiters = g_ptr_array_new_with_free_func(artwork_waiter_free);
+    g_hash_table_insert(self->in_flight, g_strdup(url), waiters);
+  }
+  g_ptr_array_add(waiters, waiter);
+  g_mutex_unlock(&self->mutex);
+
+  if (start) {
+    g_thread_pool_push(self->pool, g_strdup(url), nullptr);
+  }
+}
+
+void artwork_cache_get_stats(ArtworkCache* self, guint64* hits,
+                             guint64* misses, guint64* failures) {
+  g_return_if_fail(ARTWORK_IS_CACHE(self));
+
+  g_mutex_lock(&self->mutex);
+  *hits = self->hits;
+  *misses = self->misses;
+  *failures = self->failures;
+  g_mutex_unlock(&self->mutex);
+}
@@ -0,0 +1,73 @@
+#ifndef RUNNER_ARTWORK_CACHE_H_
+#define RUNNER_ARTWORK_CACHE_H_
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+G_DECLARE_FINAL_TYPE(ArtworkCache, artwork_cache, ARTWORK, CACHE, GObject)
+
+/**
+ * ArtworkReadyCallback:
+ * @url: the remote artwork URL that was requested.
+ * @path: (nullable): the local file holding the downscaled image, or %NULL
+ *   if it could not be fetched.
+ * @user_data: data passed to artwork_cache_fetch().
+ */
+typedef void (*ArtworkReadyCallback)(const gchar* url, const gchar* path,
+                                     gpointer user_data);
+
+/**
+ * artwork_cache_new:
+ * @directory: (nullable): where to store images, or %NULL for
+ *   $XDG_CACHE_HOME/youtube_music_unbound/artwork.
+ *
+ * Creates a cache of downscaled track artwork. Images are stored by the
+ * hash of their content, with a per-URL link pointing at them, and the
+ * most recently used URLs are also kept in memory.
+ *
+ * Returns: a new #ArtworkCache.
+ */
+ArtworkCache* artwork_cache_new(const gchar* directory);
+
+/**
+ * artwork_cache_lookup:
+ * @self: an #ArtworkCache.
+ * @url: a remote artwork URL.
+ *
+ * Checks memory, then disk, without blocking on the network. Counts a hit
+ * or a miss. Thread-safe.
+ *
+ * Returns: (transfer full) (nullable): the local path, or %NULL on a miss.
+ */
+gchar* artwork_cache_lookup(ArtworkCache* self, const gchar* url);
+
+/**
+ * artwork_cache_fetch:
+ * @self: an #ArtworkCache.
+ * @url: a remote artwork URL.
+ * @context: the #GMainContext to run @callback on.
+ * @callback: called once the image is stored or the fetch failed.
+ * @user_data: data for @callback.
+ *
+ * Downloads, downscales and stores @url on a worker thread. Concurrent
+ * requests for the same URL share one download. @callback is always
+ * queued on @context, never run from the worker.
+ */
+void artwork_cache_fetch(ArtworkCache* self, const gchar* url,
+                         GMainContext* context, ArtworkReadyCallback callback,
+                         gpointer user_data);
+
+/**
+ * artwork_cache_get_stats:
+ * @self: an #ArtworkCache.
+ * @hits: (out): lookups answered from memory or disk.
+ * @misses: (out): lookups that needed a fetch.
+ * @failures: (out): fetches that did not produce an image.
+ */
+void artwork_cache_get_stats(ArtworkCache* self, guint64* hits,
+                             guint64* misses, guint64* failures);
+
+G_END_DECLS
+
+#endif  // RUNNER_ARTWORK_CACHE_H_
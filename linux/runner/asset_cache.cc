@@ -0,0 +1,646 @@
+#include "asset_cache.h"
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static constexpr uint64_t kDefaultBudget = 64 * 1024 * 1024;
+// Bodies larger than budget / kMaxBodyShare are not stored, so one asset
+// cannot flush the rest.
+static constexpr uint64_t kMaxBodyShare = 8;
+static constexpr size_t kMaxUrlLength = 8 * 1024;
+static constexpr size_t kMaxHeadersLength = 8 * 1024;
+// The packed file is compacted once dead bodies take more than half the
+// live bytes, and at least this much.
+static constexpr uint64_t kMinCompactBytes = 1024 * 1024;
+static constexpr size_t kDigestLength = 32;
+
+static constexpr char kPackName[] = "assets.pack";
+static constexpr char kIndexName[] = "assets.idx";
+
+// assets.pack: PackHeader, then one record per body, each a PackRecord,
+// the body, and padding to 8 bytes. Records are only appended; a body no
+// URL uses stays until the file is compacted into a new generation.
+static constexpr char kPackMagic[8] = {'Y', 'T', 'M', 'U', 'P', 'A', 'C', 'K'};
+static constexpr uint32_t kRecordMagic = 0x59444f42;  // "BODY"
+
+// assets.idx: IndexHeader, then one IndexEntry per URL, most recently used
+// first, each followed by the URL and its headers. The index names the
+// generation and length of the packed file it describes; records appended
+// after it was written are dropped on open.
+static constexpr char kIndexMagic[8] = {'Y', 'T', 'M', 'U', 'I', 'D', 'X',
+                                        '1'};
+
+struct PackHeader {
+  char magic[8];
+  uint64_t generation;
+};
+
+struct PackRecord {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t body_length;
+  uint8_t digest[kDigestLength];
+};
+
+struct IndexHeader {
+  char magic[8];
+  uint64_t generation;
+  uint64_t pack_size;
+  uint32_t entry_count;
+  uint32_t reserved;
+};
+
+struct IndexEntry {
+  uint64_t record_offset;
+  uint32_t url_length;
+  uint32_t headers_length;
+};
+
+static_assert(sizeof(PackHeader) % 8 == 0, "records must stay aligned");
+static_assert(sizeof(PackRecord) % 8 == 0, "bodies must stay aligned");
+
+// A read-only view of the packed file. Hits keep the view they were served
+// from, so growing or replacing the file never pulls a body from under
+// them.
+struct Mapping {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  Mapping() = default;
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+  ~Mapping() {
+    if (data != nullptr) {
+      munmap(const_cast<uint8_t*>(data), size);
+    }
+  }
+};
+
+struct Body {
+  uint64_t record_offset;
+  uint64_t length;
+  // URLs using the body.
+  uint32_t references;
+};
+
+struct Entry {
+  std::string url;
+  std::string headers;
+  std::string digest;
+};
+
+struct PendingStore {
+  std::string url;
+  std::string headers;
+  std::string body;
+};
+
+struct AssetCache {
+  gchar* pack_path;
+  gchar* index_path;
+  uint64_t budget;
+  // Runs stores one at a time; only it writes the packed file and changes
+  // |bodies| or the entry set.
+  GThreadPool* writer;
+  int pack_fd = -1;
+
+  std::mutex mutex;
+  // Guarded by |mutex|. |recent| holds the entries, most recently used
+  // first; |entries| maps each URL to its place there.
+  std::list<Entry> recent;
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+  // Keyed by SHA-256 digest.
+  std::unordered_map<std::string, Body> bodies;
+  std::shared_ptr<const Mapping> mapping;
+  uint64_t generation = 0;
+  uint64_t pack_size = 0;
+  uint64_t live_bytes = 0;
+  // Whether |recent| differs from the index on disk.
+  bool dirty = false;
+  guint pending = 0;
+  std::condition_variable idle;
+  AssetCacheStats stats = {};
+
+  // Held by whoever writes the index or replaces the packed file.
+  std::mutex io_mutex;
+};
+
+struct AssetCacheHit {
+  std::shared_ptr<const Mapping> mapping;
+  const uint8_t* body;
+  size_t length;
+  std::string headers;
+};
+
+static uint64_t record_size(uint64_t body_length) {
+  return (sizeof(PackRecord) + body_length + 7) & ~uint64_t{7};
+}
+
+static bool write_all(int fd, const void* data, size_t length,
+                      uint64_t offset) {
+  const uint8_t* cursor = static_cast<const uint8_t*>(data);
+  while (length > 0) {
+    ssize_t written = pwrite(fd, cursor, length, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    cursor += written;
+    length -= written;
+    offset += written;
+  }
+  return true;
+}
+
+static std::shared_ptr<const Mapping> map_pack(int fd, uint64_t size) {
+  auto mapping = std::make_shared<Mapping>();
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  mapping->data = static_cast<const uint8_t*>(data);
+  mapping->size = size;
+  return mapping;
+}
+
+static std::string digest_of(const std::string& body) {
+  g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  g_checksum_update(checksum, reinterpret_cast<const guchar*>(body.data()),
+                    body.size());
+  std::string digest(kDigestLength, '\0');
+  gsize length = kDigestLength;
+  g_checksum_get_digest(checksum, reinterpret_cast<guint8*>(&digest[0]),
+                        &length);
+  return digest;
+}
+
+// Starts an empty packed file of a new generation at |cache->pack_path|.
+// Called with |io_mutex| held, or before the writer runs.
+static bool reset_pack(AssetCache* cache) {
+  if (cache->pack_fd >= 0) {
+    close(cache->pack_fd);
+  }
+  cache->pack_fd = open(cache->pack_path,
+                        O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (cache->pack_fd < 0) {
+    return false;
+  }
+  PackHeader header = {};
+  memcpy(header.magic, kPackMagic, sizeof(kPackMagic));
+  header.generation = g_get_real_time();
+  if (!write_all(cache->pack_fd, &header, sizeof(header), 0)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->recent.clear();
+  cache->entries.clear();
+  cache->bodies.clear();
+  cache->mapping = map_pack(cache->pack_fd, sizeof(header));
+  cache->generation = header.generation;
+  cache->pack_size = sizeof(header);
+  cache->live_bytes = 0;
+  cache->dirty = true;
+  return cache->mapping != nullptr;
+}
+
+// Takes over the packed file and index left by an earlier run, keeping the
+// entries whose records check out. Returns false if there is nothing
+// usable.
+static bool load(AssetCache* cache) {
+  g_autofree gchar* index = nullptr;
+  gsize index_length = 0;
+  if (!g_file_get_contents(cache->index_path, &index, &index_length,
+                           nullptr) ||
+      index_length < sizeof(IndexHeader)) {
+    return false;
+  }
+  IndexHeader header;
+  memcpy(&header, index, sizeof(header));
+  if (memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+    return false;
+  }
+
+  cache->pack_fd = open(cache->pack_path, O_RDWR | O_CLOEXEC);
+  struct stat info;
+  if (cache->pack_fd < 0 || fstat(cache->pack_fd, &info) != 0 ||
+      static_cast<uint64_t>(info.st_size) < header.pack_size ||
+      header.pack_size < sizeof(PackHeader)) {
+    return false;
+  }
+  // Records appended after the index was last written have no URL.
+  if (static_cast<uint64_t>(info.st_size) > header.pack_size &&
+      ftruncate(cache->pack_fd, header.pack_size) != 0) {
+    return false;
+  }
+  std::shared_ptr<const Mapping> mapping =
+      map_pack(cache->pack_fd, header.pack_size);
+  if (mapping == nullptr) {
+    return false;
+  }
+  PackHeader pack;
+  memcpy(&pack, mapping->data, sizeof(pack));
+  if (memcmp(pack.magic, kPackMagic, sizeof(kPackMagic)) != 0 ||
+      pack.generation != header.generation) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  size_t cursor = sizeof(IndexHeader);
+  for (uint32_t i = 0; i < header.entry_count; i++) {
+    IndexEntry entry;
+    if (index_length - cursor < sizeof(entry)) {
+      break;
+    }
+    memcpy(&entry, index + cursor, sizeof(entry));
+    cursor += sizeof(entry);
+    if (index_length - cursor <
+        uint64_t{entry.url_length} + entry.headers_length) {
+      break;
+    }
+    std::string url(index + cursor, entry.url_length);
+    cursor += entry.url_length;
+    std::string headers(index + cursor, entry.headers_length);
+    cursor += entry.headers_length;
+
+    PackRecord record;
+    if (entry.record_offset < sizeof(PackHeader) ||
+        entry.record_offset % 8 != 0 ||
+        entry.record_offset > mapping->size ||
+        mapping->size - entry.record_offset < sizeof(record)) {
+      continue;
+    }
+    memcpy(&record, mapping->data + entry.record_offset, sizeof(record));
+    if (record.magic != kRecordMagic ||
+        record.body_length >
+            mapping->size - entry.record_offset - sizeof(record) ||
+        cache->entries.count(url) != 0) {
+      continue;
+    }
+
+    std::string digest(reinterpret_cast<const char*>(record.digest),
+                       kDigestLength);
+    auto body = cache->bodies.emplace(
+        digest, Body{entry.record_offset, record.body_length, 0});
+    if (body.first->second.record_offset != entry.record_offset) {
+      continue;
+    }
+    if (body.second) {
+      cache->live_bytes += record_size(record.body_length);
+    }
+    body.first->second.references++;
+    cache->recent.push_back(
+        Entry{std::move(url), std::move(headers), std::move(digest)});
+    cache->entries.emplace(cache->recent.back().url,
+                           std::prev(cache->recent.end()));
+  }
+  cache->mapping = std::move(mapping);
+  cache->generation = header.generation;
+  cache->pack_size = header.pack_size;
+  return true;
+}
+
+// Writes the index for the current entries. Called with |io_mutex| held.
+static void write_index(AssetCache* cache) {
+  std::string index(sizeof(IndexHeader), '\0');
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (!cache->dirty) {
+      return;
+    }
+    IndexHeader header = {};
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.generation = cache->generation;
+    header.pack_size = cache->pack_size;
+    header.entry_count = static_cast<uint32_t>(cache->recent.size());
+    memcpy(&index[0], &header, sizeof(header));
+    for (const Entry& entry : cache->recent) {
+      IndexEntry record = {cache->bodies.at(entry.digest).record_offset,
+                           static_cast<uint32_t>(entry.url.size()),
+                           static_cast<uint32_t>(entry.headers.size())};
+      index.append(reinterpret_cast<const char*>(&record), sizeof(record));
+      index += entry.url;
+      index += entry.headers;
+    }
+    cache->dirty = false;
+  }
+
+  // The packed file must be on disk before an index that names its
+  // records.
+  fdatasync(cache->pack_fd);
+  g_autoptr(GError) error = nullptr;
+  if (!g_file_set_contents(cache->index_path, index.data(), index.size(),
+                           &error)) {
+    g_warning("Failed to write the asset cache index: %s", error->message);
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->dirty = true;
+  }
+}
+
+// Drops the entry at |it|, and its body if no other URL uses it. Called
+// with |mutex| held.
+static void drop_entry(AssetCache* cache, std::list<Entry>::iterator it) {
+  auto body = cache->bodies.find(it->digest);
+  if (--body->second.references == 0) {
+    cache->live_bytes -= record_size(body->second.length);
+    cache->bodies.erase(body);
+  }
+  cache->entries.erase(it->url);
+  cache->recent.erase(it);
+  cache->dirty = true;
+}
+
+// Points |url| at the body with |digest|, as the most recently used entry.
+// Called with |mutex| held.
+static void attach(AssetCache* cache, std::string url, std::string headers,
+                   const std::string& digest) {
+  // Referenced first, so replacing a URL's entry with the same body keeps
+  // the body.
+  cache->bodies.at(digest).references++;
+  auto existing = cache->entries.find(url);
+  if (existing != cache->entries.end()) {
+    drop_entry(cache, existing->second);
+  }
+  cache->recent.push_front(Entry{std::move(url), std::move(headers), digest});
+  cache->entries.emplace(cache->recent.front().url, cache->recent.begin());
+  cache->dirty = true;
+
+  while (cache->live_bytes > cache->budget && cache->recent.size() > 1) {
+    drop_entry(cache, std::prev(cache->recent.end()));
+    cache->stats.evictions++;
+  }
+}
+
+// Appends |body| to the packed file. Called on the writer thread.
+static bool append_body(AssetCache* cache, const std::string& digest,
+                        const std::string& body) {
+  std::lock_guard<std::mutex> io_lock(cache->io_mutex);
+  const uint64_t offset = cache->pack_size;
+  PackRecord record = {};
+  record.magic = kRecordMagic;
+  record.body_length = body.size();
+  memcpy(record.digest, digest.data(), kDigestLength);
+  static constexpr uint8_t kPadding[8] = {};
+  const uint64_t size = record_size(body.size());
+  if (!write_all(cache->pack_fd, &record, sizeof(record), offset) ||
+      !write_all(cache->pack_fd, body.data(), body.size(),
+                 offset + sizeof(record)) ||
+      !write_all(cache->pack_fd, kPadding,
+                 size - sizeof(record) - body.size(),
+                 offset + sizeof(record) + body.size())) {
+    g_warning("Failed to write to the asset cache: %s", g_strerror(errno));
+    return false;
+  }
+  std::shared_ptr<const Mapping> mapping =
+      map_pack(cache->pack_fd, offset + size);
+  if (mapping == nullptr) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->mapping = std::move(mapping);
+  cache->pack_size = offset + size;
+  cache->bodies.emplace(digest, Body{offset, body.size(), 0});
+  cache->live_bytes += size;
+  cache->stats.stores++;
+  return true;
+}
+
+// Rewrites the packed file with only the bodies in use, once enough of it
+// is dead. Called on the writer thread.
+static void maybe_compact(AssetCache* cache) {
+  std::lock_guard<std::mutex> io_lock(cache->io_mutex);
+  std::shared_ptr<const Mapping> old_mapping;
+  std::vector<std::pair<std::string, Body>> live;
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    const uint64_t dead =
+        cache->pack_size - sizeof(PackHeader) - cache->live_bytes;
+    if (dead < kMinCompactBytes || dead < cache->live_bytes / 2) {
+      return;
+    }
+    old_mapping = cache->mapping;
+    live.assign(cache->bodies.begin(), cache->bodies.end());
+  }
+  std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+    return a.second.record_offset < b.second.record_offset;
+  });
+
+  g_autofree gchar* temporary_path =
+      g_strconcat(cache->pack_path, ".tmp", nullptr);
+  int fd = open(temporary_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0600);
+  if (fd < 0) {
+    return;
+  }
+  PackHeader header = {};
+  memcpy(header.magic, kPackMagic, sizeof(kPackMagic));
+  header.generation = cache->generation + 1;
+  uint64_t size = sizeof(header);
+  bool ok = write_all(fd, &header, sizeof(header), 0);
+  std::vector<uint64_t> offsets;
+  for (const auto& body : live) {
+    if (!ok) {
+      break;
+    }
+    const uint64_t length = record_size(body.second.length);
+    offsets.push_back(size);
+    ok = write_all(fd, old_mapping->data + body.second.record_offset, length,
+                   size);
+    size += length;
+  }
+  std::shared_ptr<const Mapping> mapping;
+  if (ok && fdatasync(fd) == 0) {
+    mapping = map_pack(fd, size);
+  }
+  if (mapping == nullptr || rename(temporary_path, cache->pack_path) != 0) {
+    close(fd);
+    g_unlink(temporary_path);
+    return;
+  }
+
+  close(cache->pack_fd);
+  cache->pack_fd = fd;
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  for (size_t i = 0; i < live.size(); i++) {
+    cache->bodies.at(live[i].first).record_offset = offsets[i];
+  }
+  cache->mapping = std::move(mapping);
+  cache->generation = header.generation;
+  cache->pack_size = size;
+  cache->dirty = true;
+  cache->stats.compactions++;
+}
+
+static void store_worker(gpointer data, gpointer user_data) {
+  std::unique_ptr<PendingStore> store(static_cast<PendingStore*>(data));
+  AssetCache* cache = static_cast<AssetCache*>(user_data);
+
+  const std::string digest = digest_of(store->body);
+  bool stored;
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    stored = cache->bodies.count(digest) != 0;
+  }
+  if (!stored) {
+    stored = append_body(cache, digest, store->body);
+  }
+
+  bool idle;
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (stored) {
+      attach(cache, std::move(store->url), std::move(store->headers), digest);
+    }
+    idle = cache->pending == 1;
+  }
+  // The index is written once per burst of stores, not per store.
+  if (idle) {
+    maybe_compact(cache);
+    std::lock_guard<std::mutex> io_lock(cache->io_mutex);
+    write_index(cache);
+  }
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  if (--cache->pending == 0) {
+    cache->idle.notify_all();
+  }
+}
+
+AssetCache* asset_cache_new(const char* directory, uint64_t budget) {
+  g_autofree gchar* default_directory = nullptr;
+  if (directory == nullptr) {
+    default_directory = g_build_filename(
+        g_get_user_cache_dir(), "youtube_music_unbound", "assets", nullptr);
+    directory = default_directory;
+  }
+  if (g_mkdir_with_parents(directory, 0700) != 0) {
+    g_warning("Failed to create %s: %s", directory, g_strerror(errno));
+    return nullptr;
+  }
+
+  AssetCache* cache = new AssetCache();
+  cache->pack_path = g_build_filename(directory, kPackName, nullptr);
+  cache->index_path = g_build_filename(directory, kIndexName, nullptr);
+  cache->budget = budget > 0 ? budget : kDefaultBudget;
+  if (!load(cache) && !reset_pack(cache)) {
+    g_warning("Failed to open %s: %s", cache->pack_path, g_strerror(errno));
+    asset_cache_free(cache);
+    return nullptr;
+  }
+  // A budget lowered since the last run applies at once.
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    while (cache->live_bytes > cache->budget && !cache->recent.empty()) {
+      drop_entry(cache, std::prev(cache->recent.end()));
+      cache->stats.evictions++;
+    }
+  }
+  cache->writer = g_thread_pool_new(store_worker, cache, 1, FALSE, nullptr);
+  return cache;
+}
+
+void asset_cache_free(AssetCache* cache) {
+  if (cache == nullptr) {
+    return;
+  }
+  if (cache->writer != nullptr) {
+    g_thread_pool_free(cache->writer, FALSE, TRUE);
+    write_index(cache);
+  }
+  if (cache->pack_fd >= 0) {
+    close(cache->pack_fd);
+  }
+  g_free(cache->pack_path);
+  g_free(cache->index_path);
+  delete cache;
+}
+
+AssetCacheHit* asset_cache_lookup(AssetCache* cache, const char* url,
+                                  size_t length) {
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  auto found = cache->entries.find(std::string(url, length));
+  if (found == cache->entries.end()) {
+    cache->stats.misses++;
+    return nullptr;
+  }
+  auto it = found->second;
+  const Body& body = cache->bodies.at(it->digest);
+  if (it != cache->recent.begin()) {
+    cache->recent.splice(cache->recent.begin(), cache->recent, it);
+    cache->dirty = true;
+  }
+  cache->stats.hits++;
+  return new AssetCacheHit{
+      cache->mapping,
+      cache->mapping->data + body.record_offset + sizeof(PackRecord),
+      body.length, it->headers};
+}
+
+const uint8_t* asset_cache_hit_body(const AssetCacheHit* hit) {
+  return hit->body;
+}
+
+size_t asset_cache_hit_body_length(const AssetCacheHit* hit) {
+  return hit->length;
+}
+
+const char* asset_cache_hit_headers(const AssetCacheHit* hit) {
+  return hit->headers.c_str();
+}
+
+void asset_cache_hit_free(AssetCacheHit* hit) {
+  delete hit;
+}
+
+void asset_cache_put(AssetCache* cache, const char* url, size_t url_length,
+                     const char* headers, size_t headers_length,
+                     const uint8_t* body, size_t body_length) {
+  if (url_length == 0 || url_length > kMaxUrlLength ||
+      headers_length > kMaxHeadersLength || body_length == 0 ||
+      body_length > cache->budget / kMaxBodyShare) {
+    return;
+  }
+  auto* store = new PendingStore{
+      std::string(url, url_length), std::string(headers, headers_length),
+      std::string(reinterpret_cast<const char*>(body), body_length)};
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->pending++;
+  }
+  g_thread_pool_push(cache->writer, store, nullptr);
+}
+
+void asset_cache_flush(AssetCache* cache) {
+  {
+    std::unique_lock<std::mutex> lock(cache->mutex);
+    cache->idle.wait(lock, [cache] { return cache->pending == 0; });
+  }
+  std::lock_guard<std::mutex> io_lock(cache->io_mutex);
+  write_index(cache);
+}
+
+void asset_cache_get_stats(AssetCache* cache, AssetCacheStats* stats) {
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  *stats = cache->stats;
+  stats->entries = static_cast<uint32_t>(cache->recent.size());
+  stats->bodies = static_cast<uint32_t>(cache->bodies.size());
+  stats->live_bytes = cache->live_bytes;
+  stats->file_bytes = cache->pack_size;
+}
@@ -0,0 +1,95 @@
+#ifndef RUNNER_ASSET_CACHE_H_
+#define RUNNER_ASSET_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A disk cache for immutable, versioned static assets (the page's script
+// and style bundles, fonts), so a launch can serve them without a network
+// round trip. Exported for lib/services/asset_cache.dart, which reaches it
+// through dart:ffi from the WebView's request interception.
+//
+// Entries are keyed by URL and point at bodies stored by the SHA-256 of
+// their content, so a bundle served under several URLs is stored once.
+// Bodies are appended to one packed file that is memory-mapped for
+// lookups; a small index beside it, rewritten atomically, maps URLs to
+// bodies in least-recently-used order. When the bodies outgrow the budget,
+// the least recently used URLs are dropped, and the packed file is
+// compacted once enough of it is dead. Writes happen on a worker thread,
+// so neither lookups nor stores wait for the disk.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AssetCache AssetCache;
+typedef struct AssetCacheHit AssetCacheHit;
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  // Bodies written to the packed file; stores of a body already held only
+  // add a URL.
+  uint64_t stores;
+  uint64_t evictions;
+  uint64_t compactions;
+  uint32_t entries;
+  uint32_t bodies;
+  // Bytes of the packed file holding bodies some URL still uses.
+  uint64_t live_bytes;
+  uint64_t file_bytes;
+} AssetCacheStats;
+
+#define ASSET_CACHE_EXPORT __attribute__((visibility("default")))
+
+// Opens the cache in |directory|, or in
+// $XDG_CACHE_HOME/youtube_music_unbound/assets if NULL, creating it if
+// needed. Bodies are kept within |budget| bytes, or 64 MiB if 0. A damaged
+// cache is discarded. Returns NULL if the directory cannot be used.
+ASSET_CACHE_EXPORT AssetCache* asset_cache_new(const char* directory,
+                                               uint64_t budget);
+
+// Finishes pending writes and closes the cache.
+ASSET_CACHE_EXPORT void asset_cache_free(AssetCache* cache);
+
+// Returns the entry for the |length| bytes at |url|, to be released with
+// asset_cache_hit_free, or NULL. Counts a hit or a miss. Thread-safe.
+ASSET_CACHE_EXPORT AssetCacheHit* asset_cache_lookup(AssetCache* cache,
+                                                     const char* url,
+                                                     size_t length);
+
+// The body of |hit|, valid until the hit is released.
+ASSET_CACHE_EXPORT const uint8_t* asset_cache_hit_body(
+    const AssetCacheHit* hit);
+
+ASSET_CACHE_EXPORT size_t asset_cache_hit_body_length(
+    const AssetCacheHit* hit);
+
+// The response headers stored with |hit|, as "Name: value" lines.
+ASSET_CACHE_EXPORT const char* asset_cache_hit_headers(
+    const AssetCacheHit* hit);
+
+ASSET_CACHE_EXPORT void asset_cache_hit_free(AssetCacheHit* hit);
+
+// Stores |body| with |headers| ("Name: value" lines) for |url|, replacing
+// any entry it had. The arguments are copied and written on the worker
+// thread; until then lookups of |url| miss. Bodies larger than an eighth
+// of the budget are not stored. Thread-safe.
+ASSET_CACHE_EXPORT void asset_cache_put(AssetCache* cache, const char* url,
+                                        size_t url_length,
+                                        const char* headers,
+                                        size_t headers_length,
+                                        const uint8_t* body,
+                                        size_t body_length);
+
+// Waits for pending stores and writes the index.
+ASSET_CACHE_EXPORT void asset_cache_flush(AssetCache* cache);
+
+ASSET_CACHE_EXPORT void asset_cache_get_stats(AssetCache* cache,
+                                              AssetCacheStats* stats);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_ASSET_CACHE_H_
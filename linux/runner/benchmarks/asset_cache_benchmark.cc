@@ -0,0 +1,513 @@
+// Loads a page's worth of static assets the way the WebView does, through
+// the asset cache, from a stand-in origin on loopback that adds a round
+// trip and paces its responses to a given bandwidth:
+//
+//   cold     an empty cache; every asset is fetched and stored
+//   warm     the cache reopened, as on the next launch; every asset hits
+//   release  a series of new releases of the page, loaded without pacing:
+//            every URL is new, only the scripts and styles change, and
+//            the cache has to stay within its budget
+//
+// A pool of connections works through the assets in page order, render
+// blocking scripts and styles first. "First paint" is when the last of
+// those has arrived, which is what holds the WebView's first frame back;
+// "load" is when every asset has. Every body is checked. Run with --help
+// for the tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "asset_cache.h"
+
+static gint connection_count = 6;
+static gint rtt_ms = 40;
+static gint bandwidth_mbps = 50;
+static gint release_count = 40;
+static gint budget_mib = 64;
+
+static const GOptionEntry kOptions[] = {
+    {"connections", 'c', 0, G_OPTION_ARG_INT, &connection_count,
+     "Concurrent connections, as a browser opens per origin", "N"},
+    {"rtt-ms", 'r', 0, G_OPTION_ARG_INT, &rtt_ms,
+     "Round trip the origin adds before each response", "MS"},
+    {"bandwidth-mbps", 'b', 0, G_OPTION_ARG_INT, &bandwidth_mbps,
+     "Bandwidth the origin paces its responses to, shared", "MBIT/S"},
+    {"releases", 'n', 0, G_OPTION_ARG_INT, &release_count,
+     "Releases loaded in the release pass", "N"},
+    {"budget-mib", 'm', 0, G_OPTION_ARG_INT, &budget_mib,
+     "Cache budget", "MIB"},
+    {nullptr},
+};
+
+struct Asset {
+  std::string path;
+  const gchar* type;
+  bool render_blocking;
+  std::string body;
+};
+
+// Roughly what the YouTube Music page loads from its static hosts: one
+// large application bundle, a few smaller scripts and styles, fonts and
+// icons. Each release serves everything under new URLs, but only its
+// scripts and styles have new content.
+static std::vector<Asset> make_assets(gint release) {
+  struct Kind {
+    const gchar* name;
+    const gchar* type;
+    bool render_blocking;
+    gint count;
+    gsize min_size;
+    gsize max_size;
+  };
+  static const Kind kKinds[] = {
+      {"desktop_polymer.js", "text/javascript", true, 1, 2600000, 2600000},
+      {"script.js", "text/javascript", true, 4, 40000, 420000},
+      {"style.css", "text/css", true, 2, 30000, 180000},
+      {"font.woff2", "font/woff2", false, 12, 18000, 42000},
+      {"icon.png", "image/png", false, 24, 2000, 30000},
+  };
+  std::vector<Asset> assets;
+  guint32 seed = 1;
+  for (const Kind& kind : kKinds) {
+    for (gint i = 0; i < kind.count; i++) {
+      seed = seed * 1103515245 + 12345;
+      gsize size = kind.min_size + seed % (kind.max_size - kind.min_size + 1);
+      guint32 content = kind.render_blocking ? seed + release : seed;
+      Asset asset;
+      asset.path = "/s/music/" + std::to_string(release) + "/" +
+                   std::to_string(i) + "_" + kind.name;
+      asset.type = kind.type;
+      asset.render_blocking = kind.render_blocking;
+      asset.body.resize(size);
+      for (gsize j = 0; j < size; j++) {
+        asset.body[j] = static_cast<char>((j * 31 + content) >> 3);
+      }
+      assets.push_back(std::move(asset));
+    }
+  }
+  return assets;
+}
+
+// The stand-in origin. Serves one request per connection, each on its own
+// thread, and closes it.
+
+struct Origin {
+  int listener;
+  guint16 port;
+  // Swapped only between page loads.
+  const std::vector<Asset>* assets;
+  bool paced = true;
+};
+
+struct OriginConnection {
+  Origin* origin;
+  int fd;
+};
+
+static int listen_loopback(guint16* port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    g_error("Cannot listen on loopback: %s", g_strerror(errno));
+  }
+  *port = ntohs(address.sin_port);
+  return fd;
+}
+
+static int connect_loopback(guint16 port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+static bool send_all(int fd, const gchar* data, gsize length) {
+  gsize sent = 0;
+  while (sent < length) {
+    ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// Reads until |terminator| has been read, or to end of stream if it is
+// NULL. Returns false on an error.
+static bool read_until(int fd, std::string* data, const gchar* terminator) {
+  char chunk[64 * 1024];
+  while (terminator == nullptr || data->find(terminator) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      return terminator == nullptr;
+    }
+    data->append(chunk, n);
+  }
+  return true;
+}
+
+static gpointer origin_connection_thread(gpointer user_data) {
+  OriginConnection* connection = static_cast<OriginConnection*>(user_data);
+  Origin* origin = connection->origin;
+  std::string request;
+  if (read_until(connection->fd, &request, "\r\n\r\n")) {
+    size_t path_start = request.find(' ') + 1;
+    std::string path =
+        request.substr(path_start, request.find(' ', path_start) - path_start);
+    const Asset* asset = nullptr;
+    for (const Asset& candidate : *origin->assets) {
+      if (candidate.path == path) {
+        asset = &candidate;
+      }
+    }
+    if (origin->paced) {
+      g_usleep(rtt_ms * 1000);
+    }
+    if (asset == nullptr) {
+      send_all(connection->fd, "HTTP/1.1 404 Not Found\r\n\r\n", 26);
+    } else {
+      g_autofree gchar* head = g_strdup_printf(
+          "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %" G_GSIZE_FORMAT
+          "\r\nConnection: close\r\n\r\n",
+          asset->type, asset->body.size());
+      send_all(connection->fd, head, strlen(head));
+      // Paced per connection to an even share of the bandwidth.
+      const gsize chunk = 16 * 1024;
+      const gdouble bytes_per_us =
+          bandwidth_mbps / 8.0 / MAX(connection_count, 1);
+      for (gsize sent = 0; sent < asset->body.size(); sent += chunk) {
+        gsize length = MIN(chunk, asset->body.size() - sent);
+        if (!send_all(connection->fd, asset->body.data() + sent, length)) {
+          break;
+        }
+        if (origin->paced) {
+          g_usleep(static_cast<gulong>(length / bytes_per_us));
+        }
+      }
+    }
+  }
+  close(connection->fd);
+  delete connection;
+  return nullptr;
+}
+
+static gpointer origin_thread(gpointer user_data) {
+  Origin* origin = static_cast<Origin*>(user_data);
+  while (true) {
+    int fd = accept4(origin->listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      // The listener was shut down.
+      return nullptr;
+    }
+    g_thread_unref(g_thread_new("origin", origin_connection_thread,
+                                new OriginConnection{origin, fd}));
+  }
+}
+
+// The page load.
+
+struct PageLoad {
+  AssetCache* cache;
+  const Origin* origin;
+  const std::vector<Asset>* assets;
+  gint64 start;
+  std::atomic<size_t> next{0};
+  std::atomic<gint> render_blocking_left{0};
+  std::atomic<gint64> first_paint{0};
+  std::atomic<guint64> errors{0};
+  std::atomic<guint64> fetched_bytes{0};
+};
+
+static bool fetch(const Origin* origin, const Asset& asset, std::string* body) {
+  int fd = connect_loopback(origin->port);
+  if (fd < 0) {
+    return false;
+  }
+  std::string request = "GET " + asset.path +
+                        " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  std::string response;
+  bool ok = send_all(fd, request.data(), request.size()) &&
+            read_until(fd, &response, nullptr);
+  close(fd);
+  size_t head_end = response.find("\r\n\r\n");
+  if (!ok || head_end == std::string::npos ||
+      response.compare(0, 12, "HTTP/1.1 200") != 0) {
+    return false;
+  }
+  *body = response.substr(head_end + 4);
+  return true;
+}
+
+// Serves |asset| from the cache, or fetches and stores it, as the request
+// interception does. Returns false if the body is wrong.
+static bool load_asset(PageLoad* load, const Asset& asset) {
+  g_autofree gchar* url = g_strdup_printf(
+      "http://127.0.0.1:%u%s", load->origin->port, asset.path.c_str());
+  gsize url_length = strlen(url);
+  AssetCacheHit* hit = asset_cache_lookup(load->cache, url, url_length);
+  if (hit != nullptr) {
+    bool ok = asset_cache_hit_body_length(hit) == asset.body.size() &&
+              memcmp(asset_cache_hit_body(hit), asset.body.data(),
+                     asset.body.size()) == 0;
+    asset_cache_hit_free(hit);
+    return ok;
+  }
+
+  std::string body;
+  if (!fetch(load->origin, asset, &body)) {
+    return false;
+  }
+  load->fetched_bytes += body.size();
+  g_autofree gchar* headers =
+      g_strdup_printf("Content-Type: %s\n", asset.type);
+  asset_cache_put(load->cache, url, url_length, headers, strlen(headers),
+                  reinterpret_cast<const guint8*>(body.data()), body.size());
+  return body == asset.body;
+}
+
+static gpointer connection_thread(gpointer user_data) {
+  PageLoad* load = static_cast<PageLoad*>(user_data);
+  while (true) {
+    size_t index = load->next++;
+    if (index >= load->assets->size()) {
+      return nullptr;
+    }
+    const Asset& asset = (*load->assets)[index];
+    if (!load_asset(load, asset)) {
+      load->errors++;
+    }
+    if (asset.render_blocking && --load->render_blocking_left == 0) {
+      load->first_paint = g_get_monotonic_time() - load->start;
+    }
+  }
+}
+
+struct LoadResult {
+  gint64 first_paint_us;
+  gint64 load_us;
+  guint64 errors;
+  guint64 fetched_bytes;
+};
+
+static LoadResult load_page(AssetCache* cache, const Origin* origin,
+                            const std::vector<Asset>& assets) {
+  PageLoad load;
+  load.cache = cache;
+  load.origin = origin;
+  load.assets = &assets;
+  for (const Asset& asset : assets) {
+    if (asset.render_blocking) {
+      load.render_blocking_left++;
+    }
+  }
+  load.start = g_get_monotonic_time();
+  std::vector<GThread*> threads;
+  for (gint i = 0; i < connection_count; i++) {
+    threads.push_back(g_thread_new("connection", connection_thread, &load));
+  }
+  for (GThread* thread : threads) {
+    g_thread_join(thread);
+  }
+  return LoadResult{load.first_paint, g_get_monotonic_time() - load.start,
+                    load.errors, load.fetched_bytes};
+}
+
+static void print_load(const gchar* name, const LoadResult& result,
+                       AssetCache* cache) {
+  AssetCacheStats stats;
+  asset_cache_get_stats(cache, &stats);
+  g_print("%-6s %10.1f %10.1f %10.2f %7" G_GUINT64_FORMAT " %7" G_GUINT64_FORMAT
+          "\n",
+          name, result.first_paint_us / 1000.0, result.load_us / 1000.0,
+          result.fetched_bytes / 1048576.0, stats.hits, stats.misses);
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Bytes of the bodies the cache never stores, those over an eighth of
+// |budget|; only these are fetched once the cache is warm.
+static guint64 unstored_bytes(const std::vector<Asset>& assets,
+                              guint64 budget) {
+  guint64 bytes = 0;
+  for (const Asset& asset : assets) {
+    if (asset.body.size() > budget / 8) {
+      bytes += asset.body.size();
+    }
+  }
+  return bytes;
+}
+
+static void remove_cache(const gchar* directory) {
+  for (const gchar* name : {"assets.pack", "assets.pack.tmp", "assets.idx"}) {
+    g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+    g_unlink(path);
+  }
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the static asset cache");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  connection_count = MAX(connection_count, 1);
+  rtt_ms = MAX(rtt_ms, 0);
+  bandwidth_mbps = MAX(bandwidth_mbps, 1);
+  release_count = MAX(release_count, 1);
+  budget_mib = MAX(budget_mib, 1);
+  const guint64 budget = static_cast<guint64>(budget_mib) * 1024 * 1024;
+
+  g_autofree gchar* directory = g_dir_make_tmp("asset-cache-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  std::vector<Asset> assets = make_assets(0);
+  gsize total_bytes = 0;
+  gint render_blocking = 0;
+  for (const Asset& asset : assets) {
+    total_bytes += asset.body.size();
+    render_blocking += asset.render_blocking;
+  }
+
+  Origin origin;
+  origin.assets = &assets;
+  origin.listener = listen_loopback(&origin.port);
+  GThread* acceptor = g_thread_new("origin", origin_thread, &origin);
+
+  g_print("%zu assets, %.2f MiB, %d render blocking; %d connections, "
+          "%d ms round trip, %d Mbit/s\n",
+          assets.size(), total_bytes / 1048576.0, render_blocking,
+          connection_count, rtt_ms, bandwidth_mbps);
+  g_print("%-6s %10s %10s %10s %7s %7s\n", "", "paint ms", "load ms",
+          "fetch MiB", "hits", "misses");
+
+  guint64 errors = 0;
+  AssetCache* cache = asset_cache_new(directory, budget);
+  if (cache == nullptr) {
+    return 1;
+  }
+  LoadResult cold = load_page(cache, &origin, assets);
+  errors += cold.errors;
+  print_load("cold", cold, cache);
+  asset_cache_free(cache);
+
+  gint64 start = g_get_monotonic_time();
+  cache = asset_cache_new(directory, budget);
+  gint64 open_us = g_get_monotonic_time() - start;
+  LoadResult warm = load_page(cache, &origin, assets);
+  errors += warm.errors;
+  print_load("warm", warm, cache);
+  AssetCacheStats stats;
+  asset_cache_get_stats(cache, &stats);
+  if (warm.fetched_bytes != unstored_bytes(assets, budget)) {
+    g_print("%" G_GUINT64_FORMAT " assets missed on the warm load\n",
+            stats.misses);
+    errors++;
+  }
+
+  // Lookups alone, cycling through the page.
+  std::vector<gint64> lookups;
+  for (gint round = 0; round < 200; round++) {
+    for (const Asset& asset : assets) {
+      g_autofree gchar* url = g_strdup_printf(
+          "http://127.0.0.1:%u%s", origin.port, asset.path.c_str());
+      gsize url_length = strlen(url);
+      gint64 lookup_start = g_get_monotonic_time();
+      AssetCacheHit* hit = asset_cache_lookup(cache, url, url_length);
+      lookups.push_back(g_get_monotonic_time() - lookup_start);
+      asset_cache_hit_free(hit);
+    }
+  }
+  g_print("reopened in %" G_GINT64_FORMAT " us with %u entries; lookup p50 %"
+          G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT " us\n\n",
+          open_us, stats.entries, percentile(lookups, 0.5),
+          percentile(lookups, 0.99));
+
+  // New releases until the cache has turned over several times. The last
+  // one is loaded again after a reopen and must hit throughout.
+  origin.paced = false;
+  std::vector<Asset> release_assets;
+  start = g_get_monotonic_time();
+  for (gint release = 1; release <= release_count; release++) {
+    release_assets = make_assets(release);
+    origin.assets = &release_assets;
+    errors += load_page(cache, &origin, release_assets).errors;
+  }
+  asset_cache_flush(cache);
+  gint64 releases_us = g_get_monotonic_time() - start;
+  asset_cache_get_stats(cache, &stats);
+  asset_cache_free(cache);
+  cache = asset_cache_new(directory, budget);
+  LoadResult last = load_page(cache, &origin, release_assets);
+  errors += last.errors;
+  if (last.fetched_bytes != unstored_bytes(release_assets, budget)) {
+    g_print("The last release missed after a reopen\n");
+    errors++;
+  }
+  asset_cache_free(cache);
+  g_print("%d releases in %.1f s: %" G_GUINT64_FORMAT " bodies stored, %"
+          G_GUINT64_FORMAT " entries evicted, %" G_GUINT64_FORMAT
+          " compactions\n",
+          release_count, releases_us / 1e6, stats.stores, stats.evictions,
+          stats.compactions);
+  g_print("kept %u entries, %u bodies, %.2f MiB live in a %.2f MiB file, "
+          "budget %d MiB\n",
+          stats.entries, stats.bodies, stats.live_bytes / 1048576.0,
+          stats.file_bytes / 1048576.0, budget_mib);
+  if (stats.live_bytes > budget) {
+    errors++;
+  }
+
+  shutdown(origin.listener, SHUT_RDWR);
+  g_thread_join(acceptor);
+  close(origin.listener);
+  remove_cache(directory);
+  g_rmdir(directory);
+
+  if (errors > 0) {
+    g_print("%" G_GUINT64_FORMAT " errors\n", errors);
+  }
+  return errors == 0 ? 0 : 1;
+}
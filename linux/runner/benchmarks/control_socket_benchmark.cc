@@ -0,0 +1,395 @@
+// Loads the control socket the way a desk full of status bars and scripts
+// would, on a socket in a private directory:
+//
+//   subscribe  hundreds of subscribers while the now-playing block changes
+//              at a steady rate; time from each write of the block to each
+//              subscriber reading it, and how many changes were coalesced
+//   stalled    subscribers that never read, alongside the ones above; they
+//              must not hold the others back, and the changes they skip
+//              are counted as coalesced
+//   status     clients asking for the status in a loop; round trip time
+//   commands   clients sending seek commands, each of which must reach the
+//              handler on the main thread exactly once
+//
+// Run with --help for the tunables.
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "control_socket.h"
+#include "now_playing_block.h"
+
+static gint subscriber_count = 500;
+static gint stalled_count = 20;
+static gint change_count = 2000;
+static gint interval_us = 500;
+static gint client_count = 8;
+static gint requests_per_client = 2000;
+
+static const GOptionEntry kOptions[] = {
+    {"subscribers", 's', 0, G_OPTION_ARG_INT, &subscriber_count,
+     "Subscribers that keep up", "N"},
+    {"stalled", 0, 0, G_OPTION_ARG_INT, &stalled_count,
+     "Subscribers that never read", "N"},
+    {"changes", 'n', 0, G_OPTION_ARG_INT, &change_count,
+     "Writes of the now-playing block", "N"},
+    {"interval-us", 'i', 0, G_OPTION_ARG_INT, &interval_us,
+     "Time between writes", "US"},
+    {"clients", 'c', 0, G_OPTION_ARG_INT, &client_count,
+     "Concurrent clients for status and commands", "N"},
+    {"requests", 'r', 0, G_OPTION_ARG_INT, &requests_per_client,
+     "Requests per client", "N"},
+    {nullptr},
+};
+
+static constexpr char kTitlePrefix[] = "\"title\":\"change ";
+
+static int connect_to(const gchar* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  g_strlcpy(address.sun_path, path, sizeof(address.sun_path));
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address),
+                        sizeof(address)) != 0) {
+    g_error("Cannot connect to %s: %s", path, g_strerror(errno));
+  }
+  return fd;
+}
+
+static void send_all(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      g_error("Send failed: %s", g_strerror(errno));
+    }
+    sent += n;
+  }
+}
+
+// Reads one line from a blocking socket, keeping what follows it in
+// |buffer|.
+static bool read_line(int fd, std::string* buffer, std::string* line) {
+  size_t newline;
+  while ((newline = buffer->find('\n')) == std::string::npos) {
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer->append(chunk, n);
+  }
+  line->assign(*buffer, 0, newline);
+  buffer->erase(0, newline + 1);
+  return true;
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = std::min(samples.size() - 1,
+                          static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+static void write_change(gint index) {
+  NowPlayingBlock* block = now_playing_block_get();
+  now_playing_block_begin_write(block);
+  block->state = NOW_PLAYING_PLAYING;
+  g_snprintf(block->title, sizeof(block->title), "change %d", index);
+  g_strlcpy(block->artist, "Artist", sizeof(block->artist));
+  g_strlcpy(block->album, "Album", sizeof(block->album));
+  block->duration_us = 200 * G_USEC_PER_SEC;
+  now_playing_block_set_position(block, index * 1000);
+  now_playing_block_end_write(block);
+  now_playing_block_notify();
+}
+
+// The subscribers that keep up, all served by one thread through epoll.
+struct Subscribers {
+  std::vector<int> fds;
+  std::vector<std::string> buffers;
+  std::vector<gint> last_seen;
+  std::unique_ptr<std::atomic<gint64>[]> write_times;
+  std::vector<gint64> latencies;
+  guint64 lines = 0;
+  std::atomic<bool> done{false};
+};
+
+static void run_subscribers(Subscribers* subscribers) {
+  int epoll = epoll_create1(EPOLL_CLOEXEC);
+  for (size_t i = 0; i < subscribers->fds.size(); i++) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, subscribers->fds[i], &event);
+  }
+
+  size_t finished = 0;
+  const gint64 deadline = g_get_monotonic_time() + 60 * G_USEC_PER_SEC;
+  epoll_event events[64];
+  while (finished < subscribers->fds.size() &&
+         g_get_monotonic_time() < deadline) {
+    int count = epoll_wait(epoll, events, G_N_ELEMENTS(events), 100);
+    for (int e = 0; e < count; e++) {
+      const size_t i = events[e].data.u64;
+      char chunk[16384];
+      ssize_t n = recv(subscribers->fds[i], chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        g_error("Subscriber %zu lost its connection", i);
+      }
+      const gint64 now = g_get_monotonic_time();
+      std::string& buffer = subscribers->buffers[i];
+      buffer.append(chunk, n);
+      size_t start = 0;
+      for (size_t newline = buffer.find('\n'); newline != std::string::npos;
+           newline = buffer.find('\n', start)) {
+        subscribers->lines++;
+        const size_t title = buffer.find(kTitlePrefix, start);
+        if (title < newline) {
+          const gint index =
+              atoi(buffer.c_str() + title + strlen(kTitlePrefix));
+          if (index > subscribers->last_seen[i]) {
+            subscribers->latencies.push_back(
+                now - subscribers->write_times[index].load());
+            subscribers->last_seen[i] = index;
+            if (index == change_count - 1) {
+              finished++;
+            }
+          }
+        }
+        start = newline + 1;
+      }
+      buffer.erase(0, start);
+    }
+  }
+  close(epoll);
+  subscribers->done = true;
+}
+
+struct Requester {
+  std::vector<gint64> latencies;
+  guint64 errors = 0;
+};
+
+static void run_client(const gchar* path, const std::string& request,
+                       Requester* client) {
+  int fd = connect_to(path);
+  std::string buffer;
+  std::string line;
+  for (gint i = 0; i < requests_per_client; i++) {
+    const gint64 start = g_get_monotonic_time();
+    send_all(fd, request);
+    if (!read_line(fd, &buffer, &line)) {
+      g_error("Lost the connection");
+    }
+    client->latencies.push_back(g_get_monotonic_time() - start);
+    if (line.compare(0, 10, "{\"ok\":true") != 0) {
+      client->errors++;
+    }
+  }
+  close(fd);
+}
+
+static std::atomic<guint64> commands_handled{0};
+static std::atomic<guint64> commands_wrong{0};
+
+static void on_command(const MprisCommand& command, gpointer user_data) {
+  commands_handled++;
+  if (command.type != MprisCommandType::kSeek ||
+      command.time_us != 1500 * 1000) {
+    commands_wrong++;
+  }
+}
+
+static void print_row(const gchar* name, std::vector<gint64>& latencies,
+                      guint64 errors) {
+  const gint64 p50 = percentile(latencies, 0.5);
+  const gint64 p99 = percentile(latencies, 0.99);
+  const gint64 max = percentile(latencies, 1.0);
+  g_print("%-10s %9zu %7" G_GUINT64_FORMAT " %9" G_GINT64_FORMAT
+          " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT "\n",
+          name, latencies.size(), errors, p50, p99, max);
+}
+
+static std::vector<gint64> gather(std::vector<Requester>& clients) {
+  std::vector<gint64> all;
+  for (Requester& client : clients) {
+    all.insert(all.end(), client.latencies.begin(), client.latencies.end());
+  }
+  return all;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- load the control socket");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (change_count < 1) {
+    change_count = 1;
+  }
+
+  // Both ends of every connection live in this process.
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  g_autofree gchar* directory = g_dir_make_tmp("control-socket-XXXXXX",
+                                               &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autofree gchar* path = g_build_filename(directory, "ytmu.sock", nullptr);
+  ControlSocket* control = control_socket_new();
+  control_socket_set_command_handler(control, on_command, nullptr);
+  if (!control_socket_start(control, path, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  Subscribers subscribers;
+  subscribers.write_times.reset(new std::atomic<gint64>[change_count]);
+  for (gint i = 0; i < subscriber_count; i++) {
+    const int fd = connect_to(path);
+    send_all(fd, "subscribe\n");
+    subscribers.fds.push_back(fd);
+  }
+  subscribers.buffers.resize(subscriber_count);
+  subscribers.last_seen.assign(subscriber_count, -1);
+  std::vector<int> stalled;
+  for (gint i = 0; i < stalled_count; i++) {
+    const int fd = connect_to(path);
+    send_all(fd, "subscribe\n");
+    stalled.push_back(fd);
+  }
+
+  ControlSocketStats stats;
+  const gint64 deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+  do {
+    g_usleep(1000);
+    control_socket_get_stats(control, &stats);
+  } while (stats.subscribers <
+               static_cast<guint64>(subscriber_count + stalled_count) &&
+           g_get_monotonic_time() < deadline);
+
+  g_print("%d subscribers (%d stalled), %d changes %d us apart, "
+          "%d clients x %d requests\n\n",
+          subscriber_count + stalled_count, stalled_count, change_count,
+          interval_us, client_count, requests_per_client);
+  g_print("%-10s %9s %7s %9s %9s %9s\n", "", "samples", "errors", "p50 us",
+          "p99 us", "max us");
+
+  std::thread reader(run_subscribers, &subscribers);
+  const gint64 start = g_get_monotonic_time();
+  for (gint i = 0; i < change_count; i++) {
+    subscribers.write_times[i] = g_get_monotonic_time();
+    write_change(i);
+    const gint64 next = start + static_cast<gint64>(i + 1) * interval_us;
+    const gint64 wait = next - g_get_monotonic_time();
+    if (wait > 0) {
+      g_usleep(wait);
+    }
+  }
+  reader.join();
+
+  guint64 missed = 0;
+  for (gint last : subscribers.last_seen) {
+    if (last != change_count - 1) {
+      missed++;
+    }
+  }
+  print_row("subscribe", subscribers.latencies, missed);
+  control_socket_get_stats(control, &stats);
+  const guint64 coalesced_before_status = stats.coalesced;
+
+  std::vector<Requester> clients(client_count);
+  std::vector<std::thread> threads;
+  for (gint i = 0; i < client_count; i++) {
+    threads.emplace_back(run_client, path, "status\n", &clients[i]);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  std::vector<gint64> status_latencies = gather(clients);
+  guint64 status_errors = 0;
+  for (const Requester& client : clients) {
+    status_errors += client.errors;
+  }
+  print_row("status", status_latencies, status_errors);
+
+  std::vector<Requester> commanders(client_count);
+  for (gint i = 0; i < client_count; i++) {
+    threads.emplace_back(run_client, path,
+                         "{\"command\":\"seek\",\"offset\":1.5}\n",
+                         &commanders[i]);
+  }
+  const guint64 expected =
+      static_cast<guint64>(client_count) * requests_per_client;
+  const gint64 command_deadline = g_get_monotonic_time() + 60 * G_USEC_PER_SEC;
+  while (commands_handled < expected &&
+         g_get_monotonic_time() < command_deadline) {
+    g_main_context_iteration(nullptr, FALSE);
+    g_usleep(100);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  std::vector<gint64> command_latencies = gather(commanders);
+  guint64 command_errors = commands_wrong + (expected > commands_handled
+                                                 ? expected - commands_handled
+                                                 : commands_handled - expected);
+  for (const Requester& client : commanders) {
+    command_errors += client.errors;
+  }
+  print_row("commands", command_latencies, command_errors);
+
+  control_socket_get_stats(control, &stats);
+  g_print("\nsocket: %" G_GUINT64_FORMAT " connections, %" G_GUINT64_FORMAT
+          " requests, %" G_GUINT64_FORMAT " commands, %" G_GUINT64_FORMAT
+          " events, %" G_GUINT64_FORMAT " changes coalesced\n",
+          stats.connections, stats.requests, stats.commands, stats.events,
+          coalesced_before_status);
+  g_print("%.1f%% of changes reached the subscribers that keep up; "
+          "%" G_GUINT64_FORMAT " did not see the last one\n",
+          100.0 * subscribers.latencies.size() /
+              (static_cast<gdouble>(subscriber_count) * change_count),
+          missed);
+
+  for (int fd : subscribers.fds) {
+    close(fd);
+  }
+  for (int fd : stalled) {
+    close(fd);
+  }
+  g_object_unref(control);
+  g_rmdir(directory);
+  return missed == 0 && status_errors == 0 && command_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+// Drives the Discord IPC client against a stand-in Discord on a socket in
+// a private runtime directory, which answers the handshake and records
+// every frame it receives:
+//
+//   late start  Discord starts after the client; time from the socket
+//               appearing to the handshake completing
+//   burst       rapid track changes, as when skipping through a queue;
+//               SET_ACTIVITY frames sent and time from the last change to
+//               its frame
+//   steady      writes of the block that only advance the position in
+//               step with the clock, which must send nothing
+//   seek        a jump in position, which must send exactly one frame
+//   pause       pausing, which must send one frame clearing the activity
+//   restart     Discord quits and starts again; time to reconnect and
+//               re-send the presence
+//
+// Each scenario fails unless Discord ends up showing the latest state.
+// Run with --help for the tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "discord_ipc.h"
+#include "now_playing_block.h"
+
+static constexpr char kApplicationId[] = "1234567890123456789";
+static constexpr char kReady[] =
+    "{\"cmd\":\"DISPATCH\",\"data\":{\"v\":1},\"evt\":\"READY\","
+    "\"nonce\":null}";
+
+static gint burst_changes = 200;
+static gint burst_interval_ms = 10;
+
+static const GOptionEntry kOptions[] = {
+    {"changes", 'n', 0, G_OPTION_ARG_INT, &burst_changes,
+     "Track changes in the burst", "N"},
+    {"interval-ms", 'i', 0, G_OPTION_ARG_INT, &burst_interval_ms,
+     "Time between track changes in the burst", "MS"},
+    {nullptr},
+};
+
+struct Frame {
+  gint64 time_us;
+  uint32_t opcode;
+  std::string payload;
+};
+
+// The stand-in Discord: one connection at a time, served on its own thread
+// with blocking I/O.
+struct FakeDiscord {
+  std::string path;
+  int listener = -1;
+  int connection = -1;
+  std::thread thread;
+  std::mutex mutex;
+  std::vector<Frame> frames;
+  gint64 listen_time_us = 0;
+};
+
+static bool send_frame(int fd, uint32_t opcode, const std::string& payload) {
+  std::string frame(8, '\0');
+  const uint32_t header[2] = {opcode, static_cast<uint32_t>(payload.size())};
+  memcpy(&frame[0], header, sizeof(header));
+  frame += payload;
+  return send(fd, frame.data(), frame.size(), MSG_NOSIGNAL) ==
+         static_cast<ssize_t>(frame.size());
+}
+
+static void serve(FakeDiscord* discord) {
+  for (;;) {
+    const int fd = accept(discord->listener, nullptr, nullptr);
+    if (fd < 0) return;
+    {
+      std::lock_guard<std::mutex> lock(discord->mutex);
+      discord->connection = fd;
+    }
+    std::string inbox;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+      inbox.append(buffer, received);
+      while (inbox.size() >= 8) {
+        uint32_t header[2];
+        memcpy(header, inbox.data(), sizeof(header));
+        if (inbox.size() - 8 < header[1]) break;
+        Frame frame = {g_get_monotonic_time(), header[0],
+                       inbox.substr(8, header[1])};
+        inbox.erase(0, 8 + header[1]);
+        std::lock_guard<std::mutex> lock(discord->mutex);
+        if (frame.opcode == 0) send_frame(fd, 1, kReady);
+        discord->frames.push_back(std::move(frame));
+      }
+    }
+    std::lock_guard<std::mutex> lock(discord->mutex);
+    discord->connection = -1;
+    close(fd);
+  }
+}
+
+static bool fake_discord_start(FakeDiscord* discord) {
+  discord->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  g_strlcpy(address.sun_path, discord->path.c_str(), sizeof(address.sun_path));
+  if (bind(discord->listener, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(discord->listener, 4) != 0) {
+    close(discord->listener);
+    return false;
+  }
+  discord->listen_time_us = g_get_monotonic_time();
+  discord->thread = std::thread(serve, discord);
+  return true;
+}
+
+// Closes the socket and drops the connection, as Discord does on exit.
+static void fake_discord_stop(FakeDiscord* discord) {
+  unlink(discord->path.c_str());
+  shutdown(discord->listener, SHUT_RDWR);
+  {
+    std::lock_guard<std::mutex> lock(discord->mutex);
+    if (discord->connection >= 0) shutdown(discord->connection, SHUT_RDWR);
+  }
+  discord->thread.join();
+  close(discord->listener);
+  discord->listener = -1;
+}
+
+// Sends a PING, which the client has to answer with a PONG.
+static void fake_discord_ping(FakeDiscord* discord) {
+  std::lock_guard<std::mutex> lock(discord->mutex);
+  if (discord->connection >= 0) {
+    send_frame(discord->connection, 3, "{\"nonce\":\"ping\"}");
+  }
+}
+
+// The SET_ACTIVITY frames received since |since_us|.
+static std::vector<Frame> activities(FakeDiscord* discord, gint64 since_us) {
+  std::lock_guard<std::mutex> lock(discord->mutex);
+  std::vector<Frame> result;
+  for (const Frame& frame : discord->frames) {
+    if (frame.time_us >= since_us && frame.opcode == 1 &&
+        frame.payload.find("\"SET_ACTIVITY\"") != std::string::npos) {
+      result.push_back(frame);
+    }
+  }
+  return result;
+}
+
+static bool received_opcode(FakeDiscord* discord, uint32_t opcode) {
+  std::lock_guard<std::mutex> lock(discord->mutex);
+  for (const Frame& frame : discord->frames) {
+    if (frame.opcode == opcode) return true;
+  }
+  return false;
+}
+
+// Runs the default main context until |done| or |timeout_ms| passes.
+static bool run_until(const std::function<bool()>& done, gint timeout_ms) {
+  const gint64 deadline = g_get_monotonic_time() + timeout_ms * 1000;
+  while (!done()) {
+    if (g_get_monotonic_time() >= deadline) return false;
+    g_main_context_iteration(nullptr, FALSE);
+    g_usleep(200);
+  }
+  return true;
+}
+
+static void run_for(gint ms) {
+  run_until([] { return false; }, ms);
+}
+
+// Writes the block as the media session controller does, then notifies.
+static void write_block(NowPlayingState state, const std::string& title,
+                        gint64 position_us) {
+  NowPlayingBlock* block = now_playing_block_get();
+  now_playing_block_begin_write(block);
+  block->state = state;
+  g_strlcpy(block->title, title.c_str(), sizeof(block->title));
+  g_strlcpy(block->artist, "Benchmark Artist", sizeof(block->artist));
+  g_strlcpy(block->album, "Benchmark Album", sizeof(block->album));
+  g_strlcpy(block->art_url, "https://lh3.googleusercontent.com/benchmark",
+            sizeof(block->art_url));
+  block->duration_us = 240 * G_USEC_PER_SEC;
+  now_playing_block_set_position(block, position_us);
+  now_playing_block_end_write(block);
+  now_playing_block_notify();
+}
+
+static bool shows(const Frame& frame, const std::string& title) {
+  return frame.payload.find("\"details\":\"" + title + "\"") !=
+         std::string::npos;
+}
+
+static void report(const gchar* name, size_t writes, size_t frames,
+                   double latency_ms, bool ok) {
+  g_print("%-11s %7zu %7zu %11.1f  %s\n", name, writes, frames, latency_ms,
+          ok ? "ok" : "FAILED");
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the Discord IPC client");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  burst_changes = MAX(burst_changes, 1);
+  burst_interval_ms = MAX(burst_interval_ms, 0);
+
+  g_autofree gchar* directory = g_dir_make_tmp("discord-ipc-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_setenv("XDG_RUNTIME_DIR", directory, TRUE);
+  g_autofree gchar* path =
+      g_build_filename(directory, "discord-ipc-0", nullptr);
+  FakeDiscord discord;
+  discord.path = path;
+  bool all_ok = true;
+
+  g_print("%-11s %7s %7s %11s\n", "", "writes", "frames", "latency ms");
+
+  // Late start: the client is waiting for the socket before it exists.
+  write_block(NOW_PLAYING_STOPPED, "", 0);
+  DiscordIpc* ipc = discord_ipc_new(kApplicationId);
+  run_for(100);
+  if (!fake_discord_start(&discord)) {
+    g_printerr("Cannot listen on %s\n", path);
+    return 1;
+  }
+  bool ok = run_until([ipc] { return discord_ipc_is_ready(ipc) != 0; }, 5000);
+  const double connect_ms =
+      (g_get_monotonic_time() - discord.listen_time_us) / 1000.0;
+  report("late start", 0, 0, connect_ms, ok);
+  all_ok &= ok;
+
+  // Burst: the last title must arrive, within the rate limit.
+  gint64 start_us = g_get_monotonic_time();
+  std::string title;
+  for (gint i = 0; i < burst_changes; i++) {
+    title = "Track " + std::to_string(i);
+    write_block(NOW_PLAYING_PLAYING, title, 0);
+    run_for(burst_interval_ms);
+  }
+  const gint64 last_change_us = g_get_monotonic_time();
+  ok = run_until(
+      [&] {
+        const auto sent = activities(&discord, start_us);
+        return !sent.empty() && shows(sent.back(), title);
+      },
+      25000);
+  auto sent = activities(&discord, start_us);
+  double latency_ms =
+      sent.empty() ? 0 : (sent.back().time_us - last_change_us) / 1000.0;
+  const gint64 window_us = sent.empty() ? 0 : sent.back().time_us - start_us;
+  ok = ok && sent.size() <= 5 + static_cast<size_t>(window_us / 20000000) * 5;
+  report("burst", burst_changes, sent.size(), latency_ms, ok);
+  all_ok &= ok;
+
+  // Steady: the position advances with the clock; nothing to send.
+  run_for(300);
+  start_us = g_get_monotonic_time();
+  const gint64 playing_since_us = start_us;
+  for (gint i = 0; i < 20; i++) {
+    write_block(NOW_PLAYING_PLAYING, title,
+                g_get_monotonic_time() - playing_since_us);
+    run_for(100);
+  }
+  run_for(1500);
+  sent = activities(&discord, start_us);
+  ok = sent.empty();
+  report("steady", 20, sent.size(), 0, ok);
+  all_ok &= ok;
+
+  // Seek: a minute forward is one update, once the rate limit allows.
+  start_us = g_get_monotonic_time();
+  write_block(NOW_PLAYING_PLAYING, title, 60 * G_USEC_PER_SEC);
+  ok = run_until([&] { return !activities(&discord, start_us).empty(); },
+                 25000);
+  run_for(1500);
+  sent = activities(&discord, start_us);
+  latency_ms = sent.empty() ? 0 : (sent.front().time_us - start_us) / 1000.0;
+  ok = ok && sent.size() == 1 && shows(sent.back(), title);
+  report("seek", 1, sent.size(), latency_ms, ok);
+  all_ok &= ok;
+
+  // Pause: the activity is cleared.
+  start_us = g_get_monotonic_time();
+  write_block(NOW_PLAYING_PAUSED, title, 61 * G_USEC_PER_SEC);
+  ok = run_until([&] { return !activities(&discord, start_us).empty(); },
+                 25000);
+  run_for(1500);
+  sent = activities(&discord, start_us);
+  latency_ms = sent.empty() ? 0 : (sent.front().time_us - start_us) / 1000.0;
+  ok = ok && sent.size() == 1 &&
+       sent.back().payload.find("\"activity\"") == std::string::npos;
+  report("pause", 1, sent.size(), latency_ms, ok);
+  all_ok &= ok;
+
+  // Restart: Discord quits and comes back; the presence is shown again.
+  write_block(NOW_PLAYING_PLAYING, title, 62 * G_USEC_PER_SEC);
+  fake_discord_stop(&discord);
+  ok = run_until([ipc] { return discord_ipc_is_ready(ipc) == 0; }, 5000);
+  {
+    std::lock_guard<std::mutex> lock(discord.mutex);
+    discord.frames.clear();
+  }
+  start_us = g_get_monotonic_time();
+  ok = ok && fake_discord_start(&discord);
+  ok = ok && run_until(
+                 [&] {
+                   const auto sent = activities(&discord, start_us);
+                   return !sent.empty() && shows(sent.back(), title);
+                 },
+                 25000);
+  sent = activities(&discord, start_us);
+  latency_ms = sent.empty() ? 0 : (sent.back().time_us - start_us) / 1000.0;
+  report("restart", 1, sent.size(), latency_ms, ok);
+  all_ok &= ok;
+
+  // Keepalive: a PING is answered with a PONG.
+  fake_discord_ping(&discord);
+  ok = run_until([&] { return received_opcode(&discord, 4); }, 2000);
+  if (!ok) g_print("PING was not answered\n");
+  all_ok &= ok;
+
+  DiscordIpcStats stats;
+  discord_ipc_get_stats(ipc, &stats);
+  g_print("\n%" G_GUINT64_FORMAT " connects, %" G_GUINT64_FORMAT
+          " disconnects, %" G_GUINT64_FORMAT " changes, %" G_GUINT64_FORMAT
+          " activities, %" G_GUINT64_FORMAT " unchanged\n",
+          stats.connects, stats.disconnects, stats.changes, stats.activities,
+          stats.unchanged);
+
+  discord_ipc_free(ipc);
+  fake_discord_stop(&discord);
+  g_rmdir(directory);
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+// Benchmarks the compiled filter index: compile time and size for a set of
+// lists, the cost of opening the index, resident memory, and match and
+// cosmetic lookup times over a corpus of request URLs.
+//
+// Pass real lists to measure at scale, e.g.
+//   filter_benchmark -l easylist.txt -l easyprivacy.txt -l hosts.txt
+// Run with --help for the tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "filter_compiler.h"
+#include "filter_engine.h"
+#include "filter_index.h"
+
+static gchar** list_paths = nullptr;
+static gchar* corpus_path = nullptr;
+static gchar* document_host = nullptr;
+static gint total_urls = 2000000;
+
+static const GOptionEntry kOptions[] = {
+    {"list", 'l', 0, G_OPTION_ARG_FILENAME_ARRAY, &list_paths,
+     "Filter list; may be repeated", "PATH"},
+    {"corpus", 'c', 0, G_OPTION_ARG_FILENAME, &corpus_path,
+     "Request URLs, one per line", "PATH"},
+    {"document-host", 'd', 0, G_OPTION_ARG_STRING, &document_host,
+     "Host of the page making the requests", "HOST"},
+    {"urls", 'n', 0, G_OPTION_ARG_INT, &total_urls,
+     "URLs matched per run, cycling through the corpus", "N"},
+    {nullptr},
+};
+
+// Resident set size in KiB, from /proc/self/status.
+static glong resident_kib() {
+  g_autofree gchar* status = nullptr;
+  if (!g_file_get_contents("/proc/self/status", &status, nullptr, nullptr)) {
+    return -1;
+  }
+  const gchar* line = strstr(status, "VmRSS:");
+  return line != nullptr ? strtol(line + 6, nullptr, 10) : -1;
+}
+
+static std::vector<std::string> read_urls(const gchar* text) {
+  std::vector<std::string> urls;
+  g_auto(GStrv) split = g_strsplit(text, "\n", -1);
+  for (gchar** line = split; *line != nullptr; line++) {
+    g_strstrip(*line);
+    if (**line != '\0' && **line != '#') {
+      urls.push_back(*line);
+    }
+  }
+  return urls;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the compiled filter index");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  total_urls = MAX(total_urls, 1);
+  const gchar* host = document_host ? document_host : "music.youtube.com";
+
+  std::vector<std::string> lists;
+  const gchar* const default_lists[] = {YTMU_DEFAULT_RULES, nullptr};
+  for (const gchar* const* path = list_paths ? list_paths : default_lists;
+       *path != nullptr; path++) {
+    g_autofree gchar* text = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(*path, &text, &length, &error)) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    lists.emplace_back(text, length);
+  }
+  g_autofree gchar* corpus_text = nullptr;
+  if (!g_file_get_contents(corpus_path ? corpus_path : YTMU_DEFAULT_CORPUS,
+                           &corpus_text, nullptr, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  std::vector<std::string> urls = read_urls(corpus_text);
+  if (urls.empty()) {
+    g_printerr("The corpus is empty\n");
+    return 1;
+  }
+
+  g_autofree gchar* directory = g_dir_make_tmp("filter-benchmark-XXXXXX",
+                                               &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autofree gchar* index_path = g_build_filename(directory, "filters.idx",
+                                                  nullptr);
+
+  gint64 start = g_get_monotonic_time();
+  {
+    FilterCompiler compiler;
+    for (const std::string& list : lists) {
+      compiler.AddList(list.data(), list.size());
+    }
+    if (!compiler.Write(index_path, 1, &error)) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    const FilterCompileStats& stats = compiler.stats();
+    g_print("compiled in %" G_GINT64_FORMAT " ms: %u network, %u host, "
+            "%u cosmetic rules, %u unsupported\n",
+            (g_get_monotonic_time() - start) / 1000, stats.network_rules,
+            stats.host_rules, stats.cosmetic_rules, stats.unsupported_rules);
+  }
+  lists.clear();
+  lists.shrink_to_fit();
+
+  glong rss_before = resident_kib();
+  start = g_get_monotonic_time();
+  std::unique_ptr<FilterIndex> index = FilterIndex::Open(index_path, &error);
+  gint64 open_us = g_get_monotonic_time() - start;
+  if (!index) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_print("index      %zu bytes, %u rules\n", index->size(),
+          index->rule_count());
+  g_print("open       %" G_GINT64_FORMAT " us, +%ld KiB resident\n", open_us,
+          resident_kib() - rss_before);
+
+  gint blocked = 0;
+  gint allowed = 0;
+  for (const std::string& url : urls) {
+    FilterVerdict verdict = index->Match(
+        FilterRequest{url.data(), url.size(), host, FILTER_REQUEST_OTHER});
+    blocked += verdict.decision == FilterDecision::kBlock;
+    allowed += verdict.decision == FilterDecision::kAllow;
+  }
+  g_print("%zu URLs, %d blocked, %d allowed by exceptions\n", urls.size(),
+          blocked, allowed);
+
+  // Accumulates the verdicts so the calls are not optimised out.
+  glong checksum = 0;
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < total_urls; i++) {
+    const std::string& url = urls[i % urls.size()];
+    checksum += static_cast<glong>(
+        index->Match(FilterRequest{url.data(), url.size(), host,
+                                   FILTER_REQUEST_OTHER})
+            .decision);
+  }
+  gint64 match_us = g_get_monotonic_time() - start;
+  g_print("match      %8.1f ns/url, +%ld KiB resident\n",
+          match_us * 1000.0 / total_urls, resident_kib() - rss_before);
+
+  start = g_get_monotonic_time();
+  std::string selectors = index->CosmeticSelectors(host);
+  g_print("cosmetic   %" G_GINT64_FORMAT " us for %s, %zu bytes\n",
+          g_get_monotonic_time() - start, host, selectors.size());
+  g_print("checksum   %ld\n", checksum);
+
+  index.reset();
+  g_unlink(index_path);
+  g_rmdir(directory);
+  return 0;
+}
@@ -0,0 +1,399 @@
+// Drives the filter proxy end to end: a stand-in origin server on loopback,
+// the proxy in front of it, and client threads sending a mix of requests
+// through it:
+//
+//   direct   a body fetched from the origin without the proxy, as baseline
+//   relay    the same body through the proxy, spliced
+//   pruned   a player response through the proxy, ad data removed
+//   blocked  a URL the rules block, answered by the proxy
+//   tunnel   a CONNECT tunnel to the origin, then the body through it
+//
+// Every response is checked. Run with --help for the tunables.
+
+#include <gio/gio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "filter_proxy.h"
+#include "json_pruner.h"
+#include "url_matcher.h"
+
+static gint client_count = 8;
+static gint requests_per_client = 500;
+static gint body_kib = 256;
+static gchar* rules_path = nullptr;
+static gchar* response_path = nullptr;
+
+static const GOptionEntry kOptions[] = {
+    {"clients", 'c', 0, G_OPTION_ARG_INT, &client_count,
+     "Concurrent client threads", "N"},
+    {"requests", 'n', 0, G_OPTION_ARG_INT, &requests_per_client,
+     "Requests per client, spread over the scenarios", "N"},
+    {"body-kib", 'b', 0, G_OPTION_ARG_INT, &body_kib,
+     "Size of the relayed body", "KIB"},
+    {"rules", 'r', 0, G_OPTION_ARG_FILENAME, &rules_path,
+     "Network block rules", "PATH"},
+    {"response", 0, 0, G_OPTION_ARG_FILENAME, &response_path,
+     "Player response served for the pruned scenario", "PATH"},
+    {nullptr},
+};
+
+enum Scenario { kDirect, kRelay, kPruned, kBlocked, kTunnel, kScenarioCount };
+
+static const gchar* const kScenarioNames[] = {"direct", "relay", "pruned",
+                                              "blocked", "tunnel"};
+
+// The stand-in origin. Serves one request per connection and closes it.
+
+struct Origin {
+  int listener;
+  guint16 port;
+  std::string body;
+  std::string player_response;
+  std::atomic<guint64> leaked{0};
+};
+
+static int listen_loopback(guint16* port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    g_error("Cannot listen on loopback: %s", g_strerror(errno));
+  }
+  *port = ntohs(address.sin_port);
+  return fd;
+}
+
+static int connect_loopback(guint16 port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+static bool send_all(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// Reads until |terminator| has been read, or to end of stream if it is
+// NULL. Returns false on an error.
+static bool read_until(int fd, std::string* data, const gchar* terminator) {
+  char chunk[64 * 1024];
+  while (terminator == nullptr || data->find(terminator) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      return terminator == nullptr;
+    }
+    data->append(chunk, n);
+  }
+  return true;
+}
+
+static gpointer origin_thread(gpointer user_data) {
+  Origin* origin = static_cast<Origin*>(user_data);
+  while (true) {
+    int fd = accept4(origin->listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      // The listener was shut down.
+      return nullptr;
+    }
+    std::string request;
+    if (read_until(fd, &request, "\r\n\r\n")) {
+      size_t path_start = request.find(' ') + 1;
+      std::string path =
+          request.substr(path_start, request.find(' ', path_start) -
+                                         path_start);
+      const std::string* body = &origin->body;
+      const gchar* type = "application/octet-stream";
+      if (path == "/youtubei/v1/player") {
+        body = &origin->player_response;
+        type = "application/json; charset=UTF-8";
+      } else if (path.find("/pagead/") != std::string::npos) {
+        origin->leaked++;
+      }
+      g_autofree gchar* head = g_strdup_printf(
+          "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %" G_GSIZE_FORMAT
+          "\r\nConnection: close\r\n\r\n",
+          type, body->size());
+      if (send_all(fd, head)) {
+        send_all(fd, *body);
+      }
+    }
+    close(fd);
+  }
+}
+
+// The load generator.
+
+struct Client {
+  const Origin* origin;
+  guint16 proxy_port;
+  gsize pruned_length;
+  std::vector<gint64> latencies[kScenarioCount];
+  guint64 errors[kScenarioCount] = {};
+};
+
+static bool check_response(const std::string& response, const gchar* status,
+                           std::string* body) {
+  size_t head_end = response.find("\r\n\r\n");
+  if (head_end == std::string::npos || response.size() < 12 ||
+      response.compare(9, strlen(status), status) != 0) {
+    return false;
+  }
+  *body = response.substr(head_end + 4);
+  return true;
+}
+
+static bool run_request(Client* client, Scenario scenario) {
+  guint16 origin_port = client->origin->port;
+  g_autofree gchar* authority = g_strdup_printf("127.0.0.1:%u", origin_port);
+  int fd = connect_loopback(scenario == kDirect ? origin_port
+                                                : client->proxy_port);
+  if (fd < 0) {
+    return false;
+  }
+
+  std::string request;
+  switch (scenario) {
+    case kDirect:
+      request = "GET /blob HTTP/1.1\r\nHost: " + std::string(authority) +
+                "\r\n\r\n";
+      break;
+    case kRelay:
+      request = "GET http://" + std::string(authority) +
+                "/blob HTTP/1.1\r\nHost: " + authority + "\r\n\r\n";
+      break;
+    case kPruned:
+      request = "GET http://" + std::string(authority) +
+                "/youtubei/v1/player HTTP/1.1\r\nHost: " + authority +
+                "\r\nAccept-Encoding: gzip\r\n\r\n";
+      break;
+    case kBlocked:
+      request = "GET http://" + std::string(authority) +
+                "/pagead/adview?ai=1 HTTP/1.1\r\nHost: " + authority +
+                "\r\n\r\n";
+      break;
+    case kTunnel:
+      request = "CONNECT " + std::string(authority) + " HTTP/1.1\r\nHost: " +
+                authority + "\r\n\r\n";
+      break;
+    case kScenarioCount:
+      break;
+  }
+
+  std::string response;
+  std::string body;
+  bool ok = send_all(fd, request);
+  if (ok && scenario == kTunnel) {
+    ok = read_until(fd, &response, "\r\n\r\n") &&
+         check_response(response, "200", &body) && body.empty() &&
+         send_all(fd, "GET /blob HTTP/1.1\r\nHost: " + std::string(authority) +
+                          "\r\n\r\n");
+    response.clear();
+  }
+  ok = ok && read_until(fd, &response, nullptr);
+  close(fd);
+
+  switch (scenario) {
+    case kBlocked:
+      return ok && check_response(response, "403", &body);
+    case kPruned:
+      return ok && check_response(response, "200", &body) &&
+             body.size() == client->pruned_length &&
+             !json_prune_needed(body.data(), body.size());
+    default:
+      return ok && check_response(response, "200", &body) &&
+             body == client->origin->body;
+  }
+}
+
+static gpointer client_thread(gpointer user_data) {
+  Client* client = static_cast<Client*>(user_data);
+  for (gint i = 0; i < requests_per_client; i++) {
+    Scenario scenario = static_cast<Scenario>(i % kScenarioCount);
+    gint64 start = g_get_monotonic_time();
+    if (run_request(client, scenario)) {
+      client->latencies[scenario].push_back(g_get_monotonic_time() - start);
+    } else {
+      client->errors[scenario]++;
+    }
+  }
+  return nullptr;
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+static gboolean should_block(const gchar* url, gsize length,
+                             gpointer user_data) {
+  return url_matcher_match(static_cast<UrlMatcher*>(user_data), url, length) >=
+         0;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the filter proxy end to end");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  client_count = MAX(client_count, 1);
+  requests_per_client = MAX(requests_per_client, kScenarioCount);
+
+  g_autofree gchar* rules = nullptr;
+  gsize rules_length = 0;
+  Origin origin;
+  gchar* player_response = nullptr;
+  gsize player_response_length = 0;
+  if (!g_file_get_contents(rules_path ? rules_path : YTMU_DEFAULT_RULES,
+                           &rules, &rules_length, &error) ||
+      !g_file_get_contents(
+          response_path ? response_path : YTMU_DEFAULT_PLAYER_RESPONSE,
+          &player_response, &player_response_length, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  origin.player_response.assign(player_response, player_response_length);
+  g_free(player_response);
+  for (gint i = 0; i < body_kib * 1024; i++) {
+    origin.body.push_back(static_cast<char>('a' + i % 26));
+  }
+
+  // The pruned scenario expects exactly what json_prune makes of it.
+  std::string pruned = origin.player_response;
+  gint64 pruned_length =
+      json_prune(pruned.data(), pruned.size(), pruned.data(), nullptr);
+  if (pruned_length < 0) {
+    g_printerr("Malformed ad data in the player response\n");
+    return 1;
+  }
+
+  origin.listener = listen_loopback(&origin.port);
+  std::vector<GThread*> origin_threads;
+  for (gint i = 0; i < client_count; i++) {
+    origin_threads.push_back(g_thread_new("origin", origin_thread, &origin));
+  }
+
+  UrlMatcher* matcher = url_matcher_new(rules, rules_length);
+  g_autoptr(FilterProxy) proxy = filter_proxy_new(
+      should_block, matcher,
+      [](gpointer data) { url_matcher_free(static_cast<UrlMatcher*>(data)); });
+  if (!filter_proxy_start(proxy, 0, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  std::vector<Client> clients(client_count);
+  std::vector<GThread*> threads;
+  gint64 start = g_get_monotonic_time();
+  for (Client& client : clients) {
+    client.origin = &origin;
+    client.proxy_port = filter_proxy_get_port(proxy);
+    client.pruned_length = pruned_length;
+    threads.push_back(g_thread_new("client", client_thread, &client));
+  }
+  for (GThread* thread : threads) {
+    g_thread_join(thread);
+  }
+  gint64 elapsed_us = MAX(g_get_monotonic_time() - start, 1);
+
+  shutdown(origin.listener, SHUT_RDWR);
+  for (GThread* thread : origin_threads) {
+    g_thread_join(thread);
+  }
+  close(origin.listener);
+
+  g_print("%d clients, %d requests each, %d KiB relayed body\n",
+          client_count, requests_per_client, body_kib);
+  g_print("%-8s %9s %7s %9s %9s %10s\n", "", "requests", "errors", "p50 us",
+          "p99 us", "MB/s");
+  guint64 total_errors = 0;
+  for (gint s = 0; s < kScenarioCount; s++) {
+    std::vector<gint64> latencies;
+    guint64 errors = 0;
+    for (Client& client : clients) {
+      latencies.insert(latencies.end(), client.latencies[s].begin(),
+                       client.latencies[s].end());
+      errors += client.errors[s];
+    }
+    total_errors += errors;
+
+    // Body bytes over this scenario's share of the run, with the clients
+    // running in parallel.
+    gint64 busy_us = 0;
+    for (gint64 latency : latencies) {
+      busy_us += latency;
+    }
+    gsize body_bytes = s == kPruned    ? static_cast<gsize>(pruned_length)
+                       : s == kBlocked ? 0
+                                       : origin.body.size();
+    gdouble rate = busy_us > 0 ? static_cast<gdouble>(body_bytes) *
+                                     latencies.size() * client_count / busy_us
+                               : 0;
+    size_t count = latencies.size();
+    gint64 p50 = percentile(latencies, 0.5);
+    gint64 p99 = percentile(latencies, 0.99);
+    g_print("%-8s %9zu %7" G_GUINT64_FORMAT " %9" G_GINT64_FORMAT
+            " %9" G_GINT64_FORMAT " %10.1f\n",
+            kScenarioNames[s], count, errors, p50, p99, rate);
+  }
+
+  FilterProxyStats stats;
+  filter_proxy_get_stats(proxy, &stats);
+  g_print("%.0f requests/s overall\n",
+          static_cast<gdouble>(client_count) * requests_per_client *
+              G_USEC_PER_SEC / elapsed_us);
+  g_print("proxy: %" G_GUINT64_FORMAT " connections, %" G_GUINT64_FORMAT
+          " blocked, %" G_GUINT64_FORMAT " pruned (%" G_GUINT64_FORMAT
+          " bytes), %" G_GUINT64_FORMAT " bytes spliced, %" G_GUINT64_FORMAT
+          " failed\n",
+          stats.connections, stats.blocked, stats.pruned, stats.pruned_bytes,
+          stats.spliced_bytes, stats.failed);
+  if (origin.leaked > 0) {
+    g_print("%" G_GUINT64_FORMAT " blocked requests reached the origin\n",
+            origin.leaked.load());
+  }
+  return total_errors == 0 && origin.leaked == 0 ? 0 : 1;
+}
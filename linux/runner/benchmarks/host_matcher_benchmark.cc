@@ -0,0 +1,295 @@
+// Benchmarks the host matcher on a hosts list of realistic size, against a
+// hash set of the same domains looked up one suffix at a time, and reports
+// the memory each takes per domain.
+//
+// Without --hosts, a list of --domains random domains shaped like those of
+// the public ad and tracker lists is generated. Run with --help for the
+// other tunables.
+
+#include <glib.h>
+#include <malloc.h>
+
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "host_matcher.h"
+#include "host_trie.h"
+
+static gchar* hosts_path = nullptr;
+static gchar* corpus_path = nullptr;
+static gint domain_count = 300000;
+static gint total_lookups = 2000000;
+static gint seed = 1;
+
+static const GOptionEntry kOptions[] = {
+    {"hosts", 'l', 0, G_OPTION_ARG_FILENAME, &hosts_path,
+     "Hosts list instead of a generated one", "PATH"},
+    {"domains", 'd', 0, G_OPTION_ARG_INT, &domain_count,
+     "Domains in the generated list", "N"},
+    {"corpus", 'c', 0, G_OPTION_ARG_FILENAME, &corpus_path,
+     "Request URLs, one per line", "PATH"},
+    {"lookups", 'n', 0, G_OPTION_ARG_INT, &total_lookups,
+     "Lookups per workload", "N"},
+    {"seed", 's', 0, G_OPTION_ARG_INT, &seed, "Random seed", "N"},
+    {nullptr},
+};
+
+constexpr const char* kTopLevelDomains[] = {
+    "com", "net", "org", "io", "info", "ru", "de", "xyz", "top", "co.uk",
+    "com.br", "cn", "fr", "online", "site", "biz", "pl", "in", "jp", "nl",
+};
+
+constexpr const char* kSubdomains[] = {
+    "ads", "track", "cdn", "www", "pixel", "metrics", "stats", "ad",
+    "analytics", "img", "static", "api", "log", "t", "s", "m",
+};
+
+static std::string random_label(GRand* rand, gint min_length,
+                                gint max_length) {
+  static const char kChars[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+  gint length = g_rand_int_range(rand, min_length, max_length + 1);
+  std::string label;
+  for (gint i = 0; i < length; i++) {
+    // No hyphen at either end.
+    gint choices = i == 0 || i == length - 1 ? 36 : 37;
+    label.push_back(kChars[g_rand_int_range(rand, 0, choices)]);
+  }
+  return label;
+}
+
+static std::string random_domain(GRand* rand) {
+  std::string domain = random_label(rand, 4, 14);
+  domain += '.';
+  domain += kTopLevelDomains[g_rand_int_range(
+      rand, 0, G_N_ELEMENTS(kTopLevelDomains))];
+  // Lists name many hosts under the same few prefixes.
+  for (gint i = g_rand_int_range(rand, 0, 3); i > 0; i--) {
+    std::string prefix =
+        g_rand_boolean(rand)
+            ? kSubdomains[g_rand_int_range(rand, 0,
+                                           G_N_ELEMENTS(kSubdomains))]
+            : random_label(rand, 1, 8);
+    domain = prefix + "." + domain;
+  }
+  return domain;
+}
+
+// A hosts file as the public lists publish them.
+static std::string generate_list(GRand* rand, gint count) {
+  std::string list = "# Generated by host_matcher_benchmark\n";
+  for (gint i = 0; i < count; i++) {
+    list += "0.0.0.0 ";
+    list += random_domain(rand);
+    list += '\n';
+  }
+  return list;
+}
+
+// The domains of |list| that |matcher| blocks, in order: every field but
+// a leading address, without "||" and "^", less the names it skipped.
+static std::vector<std::string> list_domains(const std::string& list,
+                                             const HostMatcher* matcher) {
+  std::vector<std::string> domains;
+  g_auto(GStrv) lines = g_strsplit(list.c_str(), "\n", -1);
+  for (gchar** line = lines; *line != nullptr; line++) {
+    gchar* comment = strchr(*line, '#');
+    if (comment != nullptr) {
+      *comment = '\0';
+    }
+    g_auto(GStrv) fields = g_strsplit_set(g_strstrip(*line), " \t", -1);
+    for (gchar** field = fields; *field != nullptr; field++) {
+      std::string domain = *field;
+      if (g_str_has_prefix(domain.c_str(), "||") &&
+          g_str_has_suffix(domain.c_str(), "^")) {
+        domain = domain.substr(2, domain.size() - 3);
+      }
+      for (char& c : domain) {
+        c = g_ascii_tolower(c);
+      }
+      if (!domain.empty() &&
+          host_matcher_match_host(matcher, domain.data(), domain.size()) >=
+              0) {
+        domains.push_back(std::move(domain));
+      }
+    }
+  }
+  return domains;
+}
+
+static size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// The straightforward alternative: every suffix of the host in a set.
+static bool set_match(const std::unordered_set<std::string>& set,
+                      const char* host, size_t length) {
+  std::string lower(host, length);
+  for (char& c : lower) {
+    c = g_ascii_tolower(c);
+  }
+  for (size_t start = 0;;) {
+    if (set.count(lower.substr(start)) > 0) {
+      return true;
+    }
+    size_t dot = lower.find('.', start);
+    if (dot == std::string::npos) {
+      return false;
+    }
+    start = dot + 1;
+  }
+}
+
+struct Workload {
+  const char* name;
+  // URLs; the host is found in each as part of the lookup.
+  std::vector<std::string> urls;
+};
+
+// Times both matchers over |workload| and checks that they agree.
+static bool run(const Workload& workload, const HostMatcher* matcher,
+                const std::unordered_set<std::string>& set) {
+  const std::vector<std::string>& urls = workload.urls;
+  gint blocked = 0;
+  gint mismatches = 0;
+  for (const std::string& url : urls) {
+    size_t start, end;
+    HostTrie::FindHost(url.data(), url.size(), &start, &end);
+    bool by_trie =
+        host_matcher_match_url(matcher, url.data(), url.size()) >= 0;
+    bool by_set =
+        end > start && set_match(set, url.data() + start, end - start);
+    blocked += by_trie;
+    mismatches += by_trie != by_set;
+  }
+
+  // Both loops accumulate the results so the calls are not optimised out.
+  glong checksum = 0;
+  gint64 begin = g_get_monotonic_time();
+  for (gint i = 0; i < total_lookups; i++) {
+    const std::string& url = urls[i % urls.size()];
+    checksum += host_matcher_match_url(matcher, url.data(), url.size());
+  }
+  gint64 trie_us = g_get_monotonic_time() - begin;
+
+  begin = g_get_monotonic_time();
+  for (gint i = 0; i < total_lookups; i++) {
+    const std::string& url = urls[i % urls.size()];
+    size_t start, end;
+    HostTrie::FindHost(url.data(), url.size(), &start, &end);
+    checksum += end > start && set_match(set, url.data() + start,
+                                         end - start);
+  }
+  gint64 set_us = g_get_monotonic_time() - begin;
+
+  g_print("%-9s %7zu URLs %6.1f%% blocked  trie %6.1f ns  set %6.1f ns  "
+          "(%.1fx)  checksum %ld\n",
+          workload.name, urls.size(), 100.0 * blocked / urls.size(),
+          trie_us * 1000.0 / total_lookups, set_us * 1000.0 / total_lookups,
+          static_cast<gdouble>(set_us) / MAX(trie_us, 1), checksum);
+  if (mismatches > 0) {
+    g_printerr("%s: the trie and the set disagree on %d URLs\n",
+               workload.name, mismatches);
+  }
+  return mismatches == 0;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the host matcher");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  domain_count = MAX(domain_count, 1);
+  total_lookups = MAX(total_lookups, 1);
+  g_autoptr(GRand) rand = g_rand_new_with_seed(seed);
+
+  std::string list;
+  if (hosts_path != nullptr) {
+    g_autofree gchar* text = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(hosts_path, &text, &length, &error)) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    list.assign(text, length);
+  } else {
+    list = generate_list(rand, domain_count);
+  }
+  g_autofree gchar* corpus_text = nullptr;
+  if (!g_file_get_contents(corpus_path ? corpus_path : YTMU_DEFAULT_CORPUS,
+                           &corpus_text, nullptr, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  gint64 start = g_get_monotonic_time();
+  HostMatcher* matcher = host_matcher_new(list.data(), list.size());
+  gint64 build_us = g_get_monotonic_time() - start;
+  const guint32 domains = host_matcher_domain_count(matcher);
+  if (domains == 0) {
+    g_printerr("The list has no domains\n");
+    host_matcher_free(matcher);
+    return 1;
+  }
+  const size_t trie_bytes = host_matcher_memory_size(matcher);
+
+  std::vector<std::string> listed = list_domains(list, matcher);
+  size_t heap_before = heap_in_use();
+  std::unordered_set<std::string> set(listed.begin(), listed.end());
+  size_t set_bytes = heap_in_use() - heap_before;
+
+  g_print("%u domains from %zu bytes of list, built in %" G_GINT64_FORMAT
+          " us\n",
+          domains, list.size(), build_us);
+  g_print("trie      %9zu bytes  %5.1f bytes/domain\n", trie_bytes,
+          static_cast<gdouble>(trie_bytes) / domains);
+  if (heap_before > 0) {
+    g_print("set       %9zu bytes  %5.1f bytes/domain\n", set_bytes,
+            static_cast<gdouble>(set_bytes) / domains);
+  }
+  g_print("\n");
+
+  Workload corpus = {"corpus", {}};
+  g_auto(GStrv) lines = g_strsplit(corpus_text, "\n", -1);
+  for (gchar** line = lines; *line != nullptr; line++) {
+    g_strstrip(*line);
+    if (**line != '\0' && **line != '#') {
+      corpus.urls.push_back(*line);
+    }
+  }
+  if (corpus.urls.empty()) {
+    g_printerr("The corpus is empty\n");
+    host_matcher_free(matcher);
+    return 1;
+  }
+
+  // Subdomains of listed domains, which walk the trie to a terminal, and
+  // unlisted domains of the same shape, which most often stop at their
+  // second label.
+  Workload listed_hosts = {"listed", {}};
+  Workload unlisted_hosts = {"unlisted", {}};
+  for (gint i = 0; i < 100000; i++) {
+    const std::string& domain =
+        listed[g_rand_int_range(rand, 0, static_cast<gint32>(listed.size()))];
+    listed_hosts.urls.push_back("https://" + random_label(rand, 1, 6) + "." +
+                                domain + "/pagead/1");
+    unlisted_hosts.urls.push_back("https://" + random_domain(rand) +
+                                  "/pagead/1");
+  }
+
+  bool agreed = run(corpus, matcher, set);
+  agreed &= run(listed_hosts, matcher, set);
+  agreed &= run(unlisted_hosts, matcher, set);
+
+  host_matcher_free(matcher);
+  return agreed ? 0 : 1;
+}
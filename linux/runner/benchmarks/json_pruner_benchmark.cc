@@ -0,0 +1,152 @@
+// Benchmarks the JSON pruner over captured API responses. Compare with
+// json_pruner_benchmark.js, which times what adblock.js does in the page:
+//
+//   json_pruner_benchmark [-f response.json ...]
+//   node json_pruner_benchmark.js [response.json ...]
+//
+// Each fixture's pruned form is checked before it is timed, and the run
+// fails if it is wrong. Run with --help for the tunables.
+
+#include <glib.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "json_pruner.h"
+
+static gchar** fixture_paths = nullptr;
+static gint iterations = 2000;
+
+static const GOptionEntry kOptions[] = {
+    {"fixture", 'f', 0, G_OPTION_ARG_FILENAME_ARRAY, &fixture_paths,
+     "Response body to prune; may be repeated", "PATH"},
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+     "Times each fixture is pruned", "N"},
+    {nullptr},
+};
+
+// Returns the offset of the value of the first pruned member in |input|,
+// or -1 if there is none. Mentions of a pruned name that are not member
+// names are passed over.
+static gssize find_pruned_value(const gchar* input, gsize length) {
+  static const gchar* const kNames[] = {
+      "\"adPlacements\"", "\"adSlots\"", "\"playerAds\"",
+      "\"adBreakHeartbeatParams\"", "\"serverAbrStreamingUrl\""};
+  const gchar* end = input + length;
+  gssize first = -1;
+  for (const gchar* name : kNames) {
+    for (const gchar* found = g_strstr_len(input, length, name);
+         found != nullptr;
+         found = g_strstr_len(found + 1, end - found - 1, name)) {
+      const gchar* p = found + strlen(name);
+      while (p < end && g_ascii_isspace(*p)) p++;
+      if (p == end || *p != ':') continue;
+      p++;
+      while (p < end && g_ascii_isspace(*p)) p++;
+      if (p < end && (first < 0 || p - input < first)) first = p - input;
+      break;
+    }
+  }
+  return first;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the JSON ad pruner");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  iterations = MAX(iterations, 1);
+
+  // Bodies cut off inside a pruned member, which must pass through
+  // unchanged rather than lose what precedes the cut.
+  static const gchar* const kTruncated[] = {
+      "{\"adSlots\":tru",
+      "{\"adSlots\": 12",
+      "{\"adSlots\": \"x",
+      "{\"adSlots\": [1, {\"a\": 2}",
+  };
+  for (const gchar* body : kTruncated) {
+    gchar output[64];
+    if (json_prune(body, strlen(body), output, nullptr) >= 0) {
+      g_printerr("truncated ad data accepted: %s\n", body);
+      return 1;
+    }
+  }
+
+  const gchar* const default_fixtures[] = {YTMU_DEFAULT_PLAYER_RESPONSE,
+                                           YTMU_DEFAULT_NEXT_RESPONSE,
+                                           nullptr};
+  for (const gchar* const* path =
+           fixture_paths ? fixture_paths : default_fixtures;
+       *path != nullptr; path++) {
+    g_autofree gchar* input = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(*path, &input, &length, &error)) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    std::vector<char> output(MAX(length, 1));
+
+    guint32 removed = 0;
+    gint64 pruned_length =
+        json_prune(input, length, output.data(), &removed);
+    if (pruned_length < 0) {
+      g_printerr("%s: malformed ad data\n", *path);
+      return 1;
+    }
+
+    // Pruning the result again must find nothing to remove and leave it
+    // byte for byte as it was, so nothing but the pruned members was
+    // touched on the way.
+    std::vector<char> repruned(MAX(pruned_length, 1));
+    guint32 removed_again = 0;
+    if (json_prune(output.data(), pruned_length, repruned.data(),
+                   &removed_again) != pruned_length ||
+        removed_again != 0 ||
+        memcmp(repruned.data(), output.data(), pruned_length) != 0) {
+      g_printerr("%s: pruning is not idempotent\n", *path);
+      return 1;
+    }
+
+    // A body cut off inside a pruned member must be rejected rather than
+    // passed on half removed.
+    gssize value = find_pruned_value(input, length);
+    if (value >= 0 &&
+        json_prune(input, value + 1, output.data(), nullptr) >= 0) {
+      g_printerr("%s: truncated ad data accepted\n", *path);
+      return 1;
+    }
+
+    // Accumulates the results so the calls are not optimised out.
+    gint64 checksum = 0;
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++) {
+      checksum += json_prune(input, length, output.data(), nullptr);
+    }
+    gint64 prune_us = MAX(g_get_monotonic_time() - start, 1);
+
+    start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++) {
+      checksum += json_prune_needed(input, length);
+    }
+    gint64 check_us = MAX(g_get_monotonic_time() - start, 1);
+
+    g_autofree gchar* name = g_path_get_basename(*path);
+    g_print("%s: %" G_GSIZE_FORMAT " -> %" G_GINT64_FORMAT
+            " bytes, %u members removed\n",
+            name, length, pruned_length, removed);
+    g_print("  prune   %8.1f us  %8.1f MB/s\n",
+            static_cast<gdouble>(prune_us) / iterations,
+            static_cast<gdouble>(length) * iterations / prune_us);
+    g_print("  check   %8.1f us  %8.1f MB/s\n",
+            static_cast<gdouble>(check_us) / iterations,
+            static_cast<gdouble>(length) * iterations / check_us);
+    g_print("  checksum %" G_GINT64_FORMAT "\n", checksum);
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Times what adblock.js does with a response body in the page, parsing it,
+// pruning it with pruneAdData and serialising it again, for comparison with
+// json_pruner_benchmark. Also times the least a JavaScript handler call to
+// the app costs the page for the same body: encoding it as the call's
+// argument and decoding the string that comes back.
+//
+//   node json_pruner_benchmark.js [response.json ...] [--iterations=N]
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+
+// Kept in step with assets/scripts/adblock.js.
+const AD_PROPERTIES = [
+  'adPlacements',
+  'adSlots',
+  'playerAds',
+  'adBreakHeartbeatParams'
+];
+
+const pruneAdData = (data, deep = true) => {
+  if (!data || typeof data !== 'object') return data;
+
+  AD_PROPERTIES.forEach(prop => {
+    if (prop in data) {
+      delete data[prop];
+    }
+  });
+
+  if (data.playerResponse) {
+    AD_PROPERTIES.forEach(prop => {
+      if (prop in data.playerResponse) {
+        delete data.playerResponse[prop];
+      }
+    });
+
+    if (data.playerResponse.streamingData?.serverAbrStreamingUrl) {
+      delete data.playerResponse.streamingData.serverAbrStreamingUrl;
+    }
+  }
+
+  if (deep) {
+    for (const key in data) {
+      if (data[key] && typeof data[key] === 'object') {
+        pruneAdData(data[key], false);
+      }
+    }
+  }
+
+  return data;
+};
+
+const args = process.argv.slice(2);
+const iterationsArg = args.find(arg => arg.startsWith('--iterations='));
+const iterations = iterationsArg ? Number(iterationsArg.split('=')[1]) : 2000;
+let fixtures = args.filter(arg => !arg.startsWith('--'));
+if (fixtures.length === 0) {
+  fixtures = ['player_response.json', 'next_response.json'].map(
+    name => path.join(__dirname, 'data', name)
+  );
+}
+
+for (const fixture of fixtures) {
+  const text = fs.readFileSync(fixture, 'utf8');
+  const bytes = Buffer.byteLength(text);
+  const pruned = JSON.stringify(pruneAdData(JSON.parse(text)));
+
+  let checksum = 0;
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < iterations; i++) {
+    checksum += JSON.stringify(pruneAdData(JSON.parse(text))).length;
+  }
+  const us = Number(process.hrtime.bigint() - start) / 1000;
+
+  const handlerStart = process.hrtime.bigint();
+  for (let i = 0; i < iterations; i++) {
+    const [received] = JSON.parse(JSON.stringify([text]));
+    const [returned] = JSON.parse(JSON.stringify([received]));
+    checksum += returned.length;
+  }
+  const handlerUs = Number(process.hrtime.bigint() - handlerStart) / 1000;
+
+  console.log(`${path.basename(fixture)}: ${bytes} -> ${pruned.length} bytes`);
+  console.log(
+    `  parse+prune+stringify ${(us / iterations).toFixed(1).padStart(8)} us` +
+      `  ${((bytes * iterations) / us).toFixed(1).padStart(8)} MB/s`
+  );
+  console.log(
+    `  handler round trip    ` +
+      `${(handlerUs / iterations).toFixed(1).padStart(8)} us` +
+      `  ${((bytes * iterations) / handlerUs).toFixed(1).padStart(8)} MB/s`
+  );
+  console.log(`  checksum ${checksum}`);
+}
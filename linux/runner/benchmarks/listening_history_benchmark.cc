@@ -0,0 +1,334 @@
+// Builds years of listening history in a private directory, then opens and
+// queries it the way the app and its consumers would:
+//
+//   append     plays appended one at a time, flushed in batches of 16 as
+//              the recorder does; cost per append and per flush
+//   size       what the three files take on disk
+//   cold       opening the history with none of its pages cached, then
+//              the first query: plays of the last 30 days, and a year of
+//              plays of the most and of a rarely played artist
+//   unindexed  the same with artists.idx missing, so every record is
+//              indexed in memory on open
+//   warm       the same queries against an open history
+//
+// Every query is checked against the plays as generated. Run with --help
+// for the tunables.
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "listening_history.h"
+
+static gint years = 5;
+static gint plays_per_day = 60;
+static gint artist_count = 3000;
+static gint repeat_count = 20;
+
+static const GOptionEntry kOptions[] = {
+    {"years", 'y', 0, G_OPTION_ARG_INT, &years, "Years of history", "N"},
+    {"plays-per-day", 'p', 0, G_OPTION_ARG_INT, &plays_per_day,
+     "Plays per day", "N"},
+    {"artists", 'a', 0, G_OPTION_ARG_INT, &artist_count,
+     "Distinct artists, played with a power-law skew", "N"},
+    {"repeats", 'r', 0, G_OPTION_ARG_INT, &repeat_count,
+     "Cold and warm runs of each query", "N"},
+    {nullptr},
+};
+
+static constexpr size_t kFlushBatch = 16;
+static constexpr gint64 kDayUs = G_GINT64_CONSTANT(24 * 3600) * G_USEC_PER_SEC;
+
+static constexpr const char* kFileNames[] = {"plays.log", "strings.log",
+                                             "artists.idx"};
+
+// A generated play, to check queries against.
+struct GeneratedPlay {
+  gint64 started_at_us;
+  gint artist;
+};
+
+static gint64 now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = std::min(samples.size() - 1,
+                          static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+static void print_row(const gchar* name, std::vector<gint64>& ns,
+                      const gchar* unit, gint64 divisor) {
+  const gint64 p50 = percentile(ns, 0.5) / divisor;
+  const gint64 p99 = percentile(ns, 0.99) / divisor;
+  const gint64 max = percentile(ns, 1.0) / divisor;
+  g_print("%-18s %8zu %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+          " %9" G_GINT64_FORMAT " %s\n",
+          name, ns.size(), p50, p99, max, unit);
+}
+
+// Drops the history's pages from the page cache, so the next open reads
+// them from disk. They are clean after the close, so this is allowed.
+static void evict(const gchar* directory) {
+  for (const char* name : kFileNames) {
+    g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+}
+
+static guint64 file_size(const gchar* directory, const char* name) {
+  g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+  GStatBuf info;
+  return g_stat(path, &info) == 0 ? info.st_size : 0;
+}
+
+struct Queries {
+  gint64 now_us;
+  gint top_artist;
+  gint rare_artist;
+  size_t month_expected;
+  size_t top_expected;
+  size_t rare_expected;
+};
+
+// Runs the three queries, timing each into |times| (month, top, rare) and
+// counting a mismatch with the generated plays as an error.
+static void run_queries(const ListeningHistory& history,
+                        const Queries& queries, std::vector<gint64>* times,
+                        gint* errors) {
+  gint64 begin = now_ns();
+  size_t first, last;
+  history.TimeRange(queries.now_us - 30 * kDayUs, queries.now_us + 1, &first,
+                    &last);
+  times[0].push_back(now_ns() - begin);
+  if (last - first != queries.month_expected) {
+    (*errors)++;
+  }
+
+  const gint artists[] = {queries.top_artist, queries.rare_artist};
+  const size_t expected[] = {queries.top_expected, queries.rare_expected};
+  for (int i = 0; i < 2; i++) {
+    g_autofree gchar* name = g_strdup_printf("Artist %d", artists[i]);
+    std::vector<uint32_t> plays;
+    begin = now_ns();
+    const uint32_t artist = history.FindArtist(name);
+    if (artist != ListeningHistory::kNoString) {
+      history.ArtistPlays(artist, queries.now_us - 365 * kDayUs,
+                          queries.now_us + 1, &plays);
+    }
+    times[i + 1].push_back(now_ns() - begin);
+    if (plays.size() != expected[i]) {
+      (*errors)++;
+    }
+  }
+}
+
+// Opens the history cold |repeat_count| times and runs the queries once
+// against each, printing a row per step.
+static gint run_cold(const gchar* label, const gchar* directory,
+                     const Queries& queries, bool unindexed) {
+  std::vector<gint64> open_ns;
+  std::vector<gint64> times[3];
+  gint errors = 0;
+  g_autofree gchar* index_path =
+      g_build_filename(directory, "artists.idx", nullptr);
+  for (gint i = 0; i < repeat_count; i++) {
+    if (unindexed) {
+      g_unlink(index_path);
+    }
+    evict(directory);
+    g_autoptr(GError) error = nullptr;
+    const gint64 begin = now_ns();
+    std::unique_ptr<ListeningHistory> history =
+        ListeningHistory::Open(directory, &error);
+    open_ns.push_back(now_ns() - begin);
+    if (history == nullptr) {
+      g_error("%s", error->message);
+    }
+    run_queries(*history, queries, times, &errors);
+    if (unindexed) {
+      // Keeps the destructor from writing the index back.
+      g_unlink(index_path);
+    }
+  }
+
+  g_autofree gchar* open_label = g_strdup_printf("%s open", label);
+  g_autofree gchar* month_label = g_strdup_printf("%s 30 days", label);
+  g_autofree gchar* top_label = g_strdup_printf("%s top artist", label);
+  g_autofree gchar* rare_label = g_strdup_printf("%s rare artist", label);
+  print_row(open_label, open_ns, "us", 1000);
+  print_row(month_label, times[0], "us", 1000);
+  print_row(top_label, times[1], "us", 1000);
+  print_row(rare_label, times[2], "us", 1000);
+  return errors;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- build and query the listening history");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  years = std::max(years, 1);
+  plays_per_day = std::max(plays_per_day, 1);
+  artist_count = std::max(artist_count, 2);
+  repeat_count = std::max(repeat_count, 1);
+
+  g_autofree gchar* directory = g_dir_make_tmp("history-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  // Artists are drawn with a cubic skew, so a few get most of the plays;
+  // each has five albums of twelve tracks.
+  GRand* random = g_rand_new_with_seed(1);
+  const gint64 play_count = static_cast<gint64>(years) * 365 * plays_per_day;
+  const gint64 spacing_us = kDayUs / plays_per_day;
+  const gint64 now_us = g_get_real_time();
+  std::vector<GeneratedPlay> generated;
+  generated.reserve(play_count);
+
+  std::vector<gint64> append_ns;
+  std::vector<gint64> flush_ns;
+  append_ns.reserve(play_count);
+  {
+    std::unique_ptr<ListeningHistory> history =
+        ListeningHistory::Open(directory, &error);
+    if (history == nullptr) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    for (gint64 i = 0; i < play_count; i++) {
+      const gdouble skew = g_rand_double(random);
+      const gint artist = std::min<gint>(
+          artist_count - 1, artist_count * skew * skew * skew);
+      const gint album = g_rand_int_range(random, 0, 5);
+      const gint track = g_rand_int_range(random, 0, 12);
+      const gint64 started_at_us =
+          now_us - (play_count - i) * spacing_us +
+          g_rand_int_range(random, 0, spacing_us / 2);
+      generated.push_back({started_at_us, artist});
+
+      g_autofree gchar* title =
+          g_strdup_printf("Track %d of album %d by %d", track, album, artist);
+      g_autofree gchar* artist_name = g_strdup_printf("Artist %d", artist);
+      g_autofree gchar* album_name =
+          g_strdup_printf("Album %d by %d", album, artist);
+      HistoryPlay play = {};
+      play.started_at_us = started_at_us;
+      play.length_ms = 180000 + g_rand_int_range(random, 0, 120000);
+      play.listened_ms = g_rand_int_range(random, 5000, play.length_ms);
+      play.title = title;
+      play.artist = artist_name;
+      play.album = album_name;
+
+      const gint64 begin = now_ns();
+      if (!history->Append(play, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+      }
+      append_ns.push_back(now_ns() - begin);
+      if (history->unflushed() >= kFlushBatch) {
+        const gint64 flush_begin = now_ns();
+        if (!history->Flush(&error)) {
+          g_printerr("%s\n", error->message);
+          return 1;
+        }
+        flush_ns.push_back(now_ns() - flush_begin);
+      }
+    }
+  }
+  g_rand_free(random);
+
+  Queries queries = {};
+  queries.now_us = now_us;
+  std::vector<size_t> artist_plays(artist_count);
+  for (const GeneratedPlay& play : generated) {
+    if (play.started_at_us >= now_us - 30 * kDayUs) {
+      queries.month_expected++;
+    }
+    if (play.started_at_us >= now_us - 365 * kDayUs) {
+      artist_plays[play.artist]++;
+    }
+  }
+  queries.top_artist = std::max_element(artist_plays.begin(),
+                                        artist_plays.end()) -
+                       artist_plays.begin();
+  // The least played artist who still has some plays in the last year.
+  queries.rare_artist = queries.top_artist;
+  for (gint artist = 0; artist < artist_count; artist++) {
+    if (artist_plays[artist] > 0 &&
+        artist_plays[artist] < artist_plays[queries.rare_artist]) {
+      queries.rare_artist = artist;
+    }
+  }
+  queries.top_expected = artist_plays[queries.top_artist];
+  queries.rare_expected = artist_plays[queries.rare_artist];
+
+  g_print("%" G_GINT64_FORMAT " plays over %d years, %d artists; "
+          "%zu plays of the top artist and %zu of a rare one last year\n",
+          play_count, years, artist_count, queries.top_expected,
+          queries.rare_expected);
+  g_print("%-18s %8s %9s %9s %9s\n", "", "samples", "p50", "p99", "max");
+  print_row("append", append_ns, "ns", 1);
+  print_row("flush", flush_ns, "us", 1000);
+
+  gint errors = run_cold("cold", directory, queries, false);
+  errors += run_cold("unindexed", directory, queries, true);
+
+  {
+    std::unique_ptr<ListeningHistory> history =
+        ListeningHistory::Open(directory, &error);
+    if (history == nullptr) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    std::vector<gint64> times[3];
+    for (gint i = 0; i < repeat_count; i++) {
+      run_queries(*history, queries, times, &errors);
+    }
+    print_row("warm 30 days", times[0], "us", 1000);
+    print_row("warm top artist", times[1], "us", 1000);
+    print_row("warm rare artist", times[2], "us", 1000);
+
+    const guint64 plays_bytes = file_size(directory, "plays.log");
+    const guint64 strings_bytes = file_size(directory, "strings.log");
+    const guint64 index_bytes = file_size(directory, "artists.idx");
+    g_print("\nsize: plays.log %" G_GUINT64_FORMAT " KiB, strings.log %"
+            G_GUINT64_FORMAT " KiB, artists.idx %" G_GUINT64_FORMAT
+            " KiB; %.1f bytes per play\n",
+            plays_bytes / 1024, strings_bytes / 1024, index_bytes / 1024,
+            static_cast<gdouble>(history->disk_bytes()) / play_count);
+  }
+  g_print("%d queries disagreed with the generated plays\n", errors);
+
+  for (const char* name : kFileNames) {
+    g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+    g_unlink(path);
+  }
+  g_rmdir(directory);
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+// Benchmarks the MPRIS server against a private dbus-daemon:
+//
+//   * PropertiesChanged latency, from mpris_server_push_update to the
+//     signal arriving on a separate client connection, at fixed rates.
+//   * Get/GetAll throughput with several concurrent client connections.
+//   * Heap allocations per update, counted process-wide.
+//
+// Run with --help for the tunables.
+
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "mpris_server.h"
+
+static constexpr char kBusName[] = "org.mpris.MediaPlayer2.YouTubeMusicUnbound";
+static constexpr char kObjectPath[] = "/org/mpris/MediaPlayer2";
+static constexpr char kPlayerInterface[] = "org.mpris.MediaPlayer2.Player";
+static constexpr char kPropertiesInterface[] =
+    "org.freedesktop.DBus.Properties";
+
+static gint updates_per_run = 2000;
+static gint client_count = 4;
+static gint throughput_seconds = 3;
+static gint coalesce_ms = 0;
+
+static const GOptionEntry kOptions[] = {
+    {"updates", 'u', 0, G_OPTION_ARG_INT, &updates_per_run,
+     "Updates pushed per latency run", "N"},
+    {"clients", 'c', 0, G_OPTION_ARG_INT, &client_count,
+     "Concurrent client connections for Get/GetAll", "N"},
+    {"seconds", 's', 0, G_OPTION_ARG_INT, &throughput_seconds,
+     "Duration of each throughput run", "SECONDS"},
+    {"coalesce-ms", 0, 0, G_OPTION_ARG_INT, &coalesce_ms,
+     "PropertiesChanged coalescing window", "MS"},
+    {nullptr},
+};
+
+// Allocation counting. Every allocation in the process goes through these,
+// so the count covers the D-Bus thread and GDBus worker as well.
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+}
+
+static std::atomic<guint64> allocation_count{0};
+
+extern "C" void* malloc(size_t size) noexcept {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) noexcept {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer) noexcept {
+  __libc_free(pointer);
+}
+
+static GDBusConnection* connect_client(const gchar* address) {
+  g_autoptr(GError) error = nullptr;
+  GDBusConnection* connection = g_dbus_connection_new_for_address_sync(
+      address,
+      static_cast<GDBusConnectionFlags>(
+          G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+      nullptr, nullptr, &error);
+  if (connection == nullptr) {
+    g_printerr("Failed to connect to the test bus: %s\n", error->message);
+    exit(EXIT_FAILURE);
+  }
+  return connection;
+}
+
+static gboolean wait_for_name(GDBusConnection* connection) {
+  gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  while (g_get_monotonic_time() < deadline) {
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(
+        connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+        "org.freedesktop.DBus", "NameHasOwner",
+        g_variant_new("(s)", kBusName), G_VARIANT_TYPE("(b)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    gboolean has_owner = FALSE;
+    if (reply != nullptr) {
+      g_variant_get(reply, "(b)", &has_owner);
+    }
+    if (has_owner) {
+      return TRUE;
+    }
+    g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+  }
+  return FALSE;
+}
+
+static MprisUpdate title_update(const std::string& title) {
+  MprisUpdate update;
+  update.flags = kUpdateTitle;
+  update.title = title;
+  return update;
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Latency.
+
+struct LatencyRun {
+  MprisServer* server;
+  GMainLoop* loop;
+  std::string prefix;
+  gint rate;
+  gint64 start_time;
+  gint sent;
+  // Push time of each update, and its latency once its signal arrives.
+  std::vector<gint64> sent_at;
+  std::vector<gint64> latencies;
+  gint64 last_signal_time;
+};
+
+static void on_properties_changed(GDBusConnection* connection,
+                                  const gchar* sender_name,
+                                  const gchar* object_path,
+                                  const gchar* interface_name,
+                                  const gchar* signal_name,
+                                  GVariant* parameters,
+                                  gpointer user_data) {
+  LatencyRun* run = static_cast<LatencyRun*>(user_data);
+  gint64 now = g_get_monotonic_time();
+
+  g_autoptr(GVariant) changed = g_variant_get_child_value(parameters, 1);
+  g_autoptr(GVariant) metadata =
+      g_variant_lookup_value(changed, "Metadata", G_VARIANT_TYPE_VARDICT);
+  if (metadata == nullptr) {
+    return;
+  }
+  const gchar* title = nullptr;
+  if (!g_variant_lookup(metadata, "xesam:title", "&s", &title) ||
+      !g_str_has_prefix(title, run->prefix.c_str())) {
+    return;
+  }
+
+  // Coalesced updates are never seen individually; only the one that was
+  // current at flush time is timed.
+  gint64 index = g_ascii_strtoll(title + run->prefix.size(), nullptr, 10);
+  if (index >= 0 && index < static_cast<gint64>(run->sent_at.size())) {
+    run->latencies.push_back(now - run->sent_at[index]);
+  }
+  run->last_signal_time = now;
+  if (index == updates_per_run - 1) {
+    g_main_loop_quit(run->loop);
+  }
+}
+
+static gboolean on_push_tick(gpointer user_data) {
+  LatencyRun* run = static_cast<LatencyRun*>(user_data);
+  gint64 now = g_get_monotonic_time();
+  gint64 due = (now - run->start_time) * run->rate / G_USEC_PER_SEC + 1;
+
+  while (run->sent < due && run->sent < updates_per_run) {
+    run->sent_at[run->sent] = g_get_monotonic_time();
+    mpris_server_push_update(
+        run->server,
+        title_update(run->prefix + std::to_string(run->sent)));
+    run->sent++;
+  }
+  return run->sent < updates_per_run ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static gboolean on_latency_timeout(gpointer user_data) {
+  g_main_loop_quit(static_cast<GMainLoop*>(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static void run_latency(MprisServer* server, GDBusConnection* client,
+                        gint rate) {
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  LatencyRun run{};
+  run.server = server;
+  run.loop = loop;
+  run.prefix = "rate" + std::to_string(rate) + "-";
+  run.rate = rate;
+  run.sent_at.resize(updates_per_run);
+  run.latencies.reserve(updates_per_run);
+
+  guint subscription = g_dbus_connection_signal_subscribe(
+      client, kBusName, kPropertiesInterface, "PropertiesChanged",
+      kObjectPath, kPlayerInterface, G_DBUS_SIGNAL_FLAGS_NONE,
+      on_properties_changed, &run, nullptr);
+
+  run.start_time = g_get_monotonic_time();
+  guint tick = g_timeout_add(1, on_push_tick, &run);
+  guint timeout = g_timeout_add_seconds(
+      updates_per_run / rate + 5, on_latency_timeout, loop);
+  g_main_loop_run(loop);
+
+  g_source_remove(timeout);
+  if (run.sent < updates_per_run) {
+    g_source_remove(tick);
+  }
+  g_dbus_connection_signal_unsubscribe(client, subscription);
+
+  gint64 p50 = percentile(run.latencies, 0.5);
+  gint64 p99 = percentile(run.latencies, 0.99);
+  g_print("latency  %6d/s  sent %6d  signals %6zu  p50 %7" G_GINT64_FORMAT
+          " us  p99 %7" G_GINT64_FORMAT " us\n",
+          rate, run.sent, run.latencies.size(), p50, p99);
+}
+
+// Throughput.
+
+struct ThroughputClient {
+  const gchar* address;
+  const gchar* method;
+  gint64 deadline;
+  guint64 calls;
+  guint64 errors;
+};
+
+static gpointer throughput_thread(gpointer user_data) {
+  ThroughputClient* client = static_cast<ThroughputClient*>(user_data);
+  g_autoptr(GDBusConnection) connection = connect_client(client->address);
+  gboolean get_all = g_strcmp0(client->method, "GetAll") == 0;
+
+  while (g_get_monotonic_time() < client->deadline) {
+    GVariant* parameters = get_all ?
+        g_variant_new("(s)", kPlayerInterface) :
+        g_variant_new("(ss)", kPlayerInterface, "Metadata");
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(
+        connection, kBusName, kObjectPath, kPropertiesInterface,
+        client->method, parameters, nullptr, G_DBUS_CALL_FLAGS_NONE, -1,
+        nullptr, nullptr);
+    if (reply != nullptr) {
+      client->calls++;
+    } else {
+      client->errors++;
+    }
+  }
+  return nullptr;
+}
+
+static void run_throughput(const gchar* address, const gchar* method) {
+  std::vector<ThroughputClient> clients(client_count);
+  std::vector<GThread*> threads;
+  gint64 deadline = g_get_monotonic_time() +
+                    throughput_seconds * G_USEC_PER_SEC;
+
+  for (ThroughputClient& client : clients) {
+    client = ThroughputClient{address, method, deadline, 0, 0};
+    threads.push_back(g_thread_new("mpris-client", throughput_thread,
+                                   &client));
+  }
+
+  guint64 calls = 0;
+  guint64 errors = 0;
+  for (size_t i = 0; i < threads.size(); i++) {
+    g_thread_join(threads[i]);
+    calls += clients[i].calls;
+    errors += clients[i].errors;
+  }
+
+  g_print("%-7s  %d clients  %10.0f calls/s  errors %" G_GUINT64_FORMAT "\n",
+          method, client_count,
+          static_cast<gdouble>(calls) / throughput_seconds, errors);
+}
+
+// Allocations.
+
+static void run_allocations(MprisServer* server) {
+  MprisServerStats stats;
+  mpris_server_get_stats(server, &stats);
+  guint64 target = stats.metadata_version + updates_per_run;
+
+  // Titles stay within the small-string buffer, so building the updates
+  // does not itself allocate.
+  guint64 before = allocation_count.load();
+  for (gint i = 0; i < updates_per_run; i++) {
+    mpris_server_push_update(server, title_update("a" + std::to_string(i)));
+    // Keep the queue from overflowing into the slower fallback path.
+    if (i % 32 == 31) {
+      g_usleep(G_TIME_SPAN_MILLISECOND);
+    }
+  }
+
+  gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  do {
+    g_usleep(G_TIME_SPAN_MILLISECOND);
+    mpris_server_get_stats(server, &stats);
+  } while (stats.metadata_version < target &&
+           g_get_monotonic_time() < deadline);
+  // Let the last PropertiesChanged flush.
+  g_usleep(50 * G_TIME_SPAN_MILLISECOND);
+  guint64 allocations = allocation_count.load() - before;
+
+  g_print("allocations  %.1f per update  (%" G_GUINT64_FORMAT
+          " updates applied)\n",
+          static_cast<gdouble>(allocations) / updates_per_run,
+          stats.metadata_version - (target - updates_per_run));
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark the MPRIS server");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  updates_per_run = MAX(updates_per_run, 1);
+  client_count = MAX(client_count, 1);
+  throughput_seconds = MAX(throughput_seconds, 1);
+
+  // Points DBUS_SESSION_BUS_ADDRESS at a private daemon, which the server
+  // then owns its name on.
+  g_autoptr(GTestDBus) bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(bus);
+  const gchar* address = g_test_dbus_get_bus_address(bus);
+
+  MprisServer* server = mpris_server_new();
+  mpris_server_set_coalesce_ms(server, coalesce_ms);
+  if (!mpris_server_start(server)) {
+    return EXIT_FAILURE;
+  }
+
+  GDBusConnection* client = connect_client(address);
+  if (!wait_for_name(client)) {
+    g_printerr("The server did not acquire %s\n", kBusName);
+    return EXIT_FAILURE;
+  }
+
+  {
+    MprisUpdate update = title_update("warmup");
+    update.flags |= kUpdateArtist | kUpdateState | kUpdateDuration;
+    update.artist = "Benchmark";
+    update.state = "playing";
+    update.duration = 180 * G_USEC_PER_SEC;
+    mpris_server_push_update(server, std::move(update));
+  }
+
+  for (gint rate : {100, 1000, 10000}) {
+    run_latency(server, client, rate);
+  }
+  run_throughput(address, "Get");
+  run_throughput(address, "GetAll");
+  run_allocations(server);
+
+  g_object_unref(client);
+  g_object_unref(server);
+  g_test_dbus_down(bus);
+  return EXIT_SUCCESS;
+}
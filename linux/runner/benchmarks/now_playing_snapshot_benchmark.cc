@@ -0,0 +1,219 @@
+// Reads the now-playing snapshot file the way status bars polling it would,
+// while the publisher mirrors the now-playing block into it, on a file in a
+// private directory. Each reader thread maps the file itself.
+//
+//   idle        readers copying the snapshot while nothing writes it
+//   loaded      the same while the main thread writes the block, and the
+//               publisher the snapshot, as fast as it can or at
+//               --interval-us; every copy is checked for a torn snapshot
+//   generation  readers only checking the generation, as a poller that
+//               skips unchanged snapshots would, under the same load
+//
+// Costs are per read, timed over batches of reads; a copy includes checking
+// it. Run with --help for the tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "now_playing_block.h"
+#include "now_playing_publisher.h"
+#include "now_playing_snapshot.h"
+
+static gint reader_count = 4;
+static gint duration_ms = 1000;
+static gint interval_us = 0;
+static gint batch_size = 1000;
+
+static const GOptionEntry kOptions[] = {
+    {"readers", 'r', 0, G_OPTION_ARG_INT, &reader_count,
+     "Reader threads, each with its own mapping", "N"},
+    {"duration-ms", 'd', 0, G_OPTION_ARG_INT, &duration_ms,
+     "How long each scenario runs", "MS"},
+    {"interval-us", 'i', 0, G_OPTION_ARG_INT, &interval_us,
+     "Time between writes under load, 0 for back to back", "US"},
+    {"batch", 'b', 0, G_OPTION_ARG_INT, &batch_size,
+     "Reads timed together", "N"},
+    {nullptr},
+};
+
+enum class ReadMode { kCopy, kGeneration };
+
+// Keeps the generation loads from being optimized away.
+static std::atomic<guint64> generation_sink{0};
+
+struct Reader {
+  std::vector<gint64> batch_ns;
+  guint64 reads = 0;
+  guint64 failed = 0;
+  guint64 torn = 0;
+};
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = std::min(samples.size() - 1,
+                          static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Every field the writer sets carries the same index, so a copy mixing two
+// writes shows up as a mismatch.
+static void write_change(gint index) {
+  NowPlayingBlock* block = now_playing_block_get();
+  now_playing_block_begin_write(block);
+  block->state = NOW_PLAYING_PLAYING;
+  g_snprintf(block->title, sizeof(block->title), "title %d", index);
+  g_snprintf(block->artist, sizeof(block->artist), "artist %d", index);
+  g_snprintf(block->album, sizeof(block->album), "album %d", index);
+  block->duration_us = index;
+  now_playing_block_set_position(block, index);
+  now_playing_block_end_write(block);
+  now_playing_block_notify();
+}
+
+static bool consistent(const NowPlayingSnapshot& copy) {
+  gint title = -1;
+  gint artist = -2;
+  gint album = -3;
+  if (sscanf(copy.title, "title %d", &title) != 1 ||
+      sscanf(copy.artist, "artist %d", &artist) != 1 ||
+      sscanf(copy.album, "album %d", &album) != 1) {
+    return false;
+  }
+  return title == artist && title == album && copy.position_us == title &&
+         copy.duration_us == title;
+}
+
+static void run_reader(const gchar* path, ReadMode mode,
+                       const std::atomic<bool>* done, Reader* reader) {
+  const NowPlayingSnapshot* snapshot = now_playing_snapshot_open(path);
+  if (snapshot == nullptr) {
+    g_error("Cannot map %s", path);
+  }
+
+  NowPlayingSnapshot copy;
+  guint64 sink = 0;
+  while (!done->load(std::memory_order_relaxed)) {
+    const gint64 begin = g_get_monotonic_time();
+    for (gint i = 0; i < batch_size; i++) {
+      if (mode == ReadMode::kGeneration) {
+        sink += now_playing_snapshot_generation(snapshot);
+      } else if (!now_playing_snapshot_read(snapshot, &copy)) {
+        reader->failed++;
+      } else if (!consistent(copy)) {
+        reader->torn++;
+      }
+    }
+    // Nanoseconds per read, from microseconds per batch.
+    reader->batch_ns.push_back((g_get_monotonic_time() - begin) * 1000 /
+                               batch_size);
+    reader->reads += batch_size;
+  }
+  generation_sink.fetch_add(sink, std::memory_order_relaxed);
+  now_playing_snapshot_close(snapshot);
+}
+
+// Runs the readers for --duration-ms, writing the block from this thread
+// meanwhile if |loaded|. Returns whether no copy was torn.
+static bool run_scenario(const gchar* name, const gchar* path, ReadMode mode,
+                         bool loaded, NowPlayingPublisher* publisher,
+                         gint* next_change) {
+  std::atomic<bool> done{false};
+  std::vector<Reader> readers(reader_count);
+  std::vector<std::thread> threads;
+  for (Reader& reader : readers) {
+    threads.emplace_back(run_reader, path, mode, &done, &reader);
+  }
+
+  const guint64 writes_before = now_playing_publisher_get_writes(publisher);
+  const gint64 deadline =
+      g_get_monotonic_time() + static_cast<gint64>(duration_ms) * 1000;
+  while (g_get_monotonic_time() < deadline) {
+    if (!loaded) {
+      g_usleep(1000);
+      continue;
+    }
+    write_change((*next_change)++);
+    if (interval_us > 0) {
+      g_usleep(interval_us);
+    }
+  }
+  done = true;
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const guint64 writes =
+      now_playing_publisher_get_writes(publisher) - writes_before;
+
+  std::vector<gint64> batch_ns;
+  guint64 reads = 0;
+  guint64 failed = 0;
+  guint64 torn = 0;
+  for (Reader& reader : readers) {
+    batch_ns.insert(batch_ns.end(), reader.batch_ns.begin(),
+                    reader.batch_ns.end());
+    reads += reader.reads;
+    failed += reader.failed;
+    torn += reader.torn;
+  }
+  const gint64 p50 = percentile(batch_ns, 0.5);
+  const gint64 p99 = percentile(batch_ns, 0.99);
+  const gint64 max = percentile(batch_ns, 1.0);
+  g_print("%-10s %11" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT
+          " %7" G_GUINT64_FORMAT " %5" G_GUINT64_FORMAT " %7" G_GINT64_FORMAT
+          " %7" G_GINT64_FORMAT " %7" G_GINT64_FORMAT "\n",
+          name, reads, writes, failed, torn, p50, p99, max);
+  return torn == 0;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- read the now-playing snapshot under load");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  reader_count = std::max(reader_count, 1);
+  batch_size = std::max(batch_size, 1);
+
+  g_autofree gchar* directory = g_dir_make_tmp("now-playing-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  g_autofree gchar* path =
+      g_build_filename(directory, NOW_PLAYING_SNAPSHOT_NAME, nullptr);
+  gint next_change = 0;
+  write_change(next_change++);
+  NowPlayingPublisher* publisher = now_playing_publisher_new();
+  if (!now_playing_publisher_start(publisher, path, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_print("%d readers, %d ms per scenario, writes %s\n", reader_count,
+          duration_ms, interval_us > 0 ? "paced" : "back to back");
+  g_print("%-10s %11s %9s %7s %5s %7s %7s %7s\n", "", "reads", "writes",
+          "failed", "torn", "p50 ns", "p99 ns", "max ns");
+  bool ok = run_scenario("idle", path, ReadMode::kCopy, false, publisher,
+                         &next_change);
+  ok &= run_scenario("loaded", path, ReadMode::kCopy, true, publisher,
+                     &next_change);
+  ok &= run_scenario("generation", path, ReadMode::kGeneration, true,
+                     publisher, &next_change);
+
+  g_object_unref(publisher);
+  g_unlink(path);
+  g_rmdir(directory);
+  return ok ? 0 : 1;
+}
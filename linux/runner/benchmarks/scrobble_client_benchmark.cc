@@ -0,0 +1,554 @@
+// Submits scrobbles through the scrobble client to a stand-in Last.fm
+// endpoint on loopback that fails a share of its requests: a 503, a
+// connection closed without a response, a 200 carrying error 11 (service
+// offline), or a reply held back:
+//
+//   append   plays written to the on-disk queue one at a time, each synced
+//   flaky    a burst of plays drained through the failing endpoint
+//   offline  plays queued while the endpoint is unreachable, the client
+//            shut down, a torn line left at the end of the queue as a
+//            crash would, and a new client draining the backlog
+//
+// The endpoint checks every request's signature and batch size, and every
+// play must arrive exactly once and in order. Run with --help for the
+// tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scrobble_client.h"
+#include "scrobble_queue.h"
+
+static gint play_count = 1000;
+static gint backlog_count = 300;
+static gint failure_percent = 30;
+static gint slow_ms = 200;
+static gint retry_min_ms = 20;
+static gint retry_max_ms = 500;
+
+static const GOptionEntry kOptions[] = {
+    {"plays", 'n', 0, G_OPTION_ARG_INT, &play_count,
+     "Plays in the append and flaky passes", "N"},
+    {"backlog", 'b', 0, G_OPTION_ARG_INT, &backlog_count,
+     "Plays queued in the offline pass", "N"},
+    {"failures", 'f', 0, G_OPTION_ARG_INT, &failure_percent,
+     "Share of requests the endpoint fails", "PERCENT"},
+    {"slow-ms", 's', 0, G_OPTION_ARG_INT, &slow_ms,
+     "How long a held-back reply is held", "MS"},
+    {"retry-min-ms", 0, 0, G_OPTION_ARG_INT, &retry_min_ms,
+     "The client's first retry delay", "MS"},
+    {"retry-max-ms", 0, 0, G_OPTION_ARG_INT, &retry_max_ms,
+     "The client's longest retry delay", "MS"},
+    {nullptr},
+};
+
+static constexpr char kApiKey[] = "benchmark-key";
+static constexpr char kApiSecret[] = "benchmark-secret";
+static constexpr char kSessionKey[] = "benchmark-session";
+static constexpr size_t kMaxBatch = 50;
+static constexpr gint64 kDrainTimeoutUs = 120 * G_USEC_PER_SEC;
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = std::min(samples.size() - 1,
+                          static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Names that need escaping in a form, and a tab that the queue replaces.
+static ScrobbleEntry make_entry(gint i) {
+  ScrobbleEntry entry;
+  entry.timestamp = 1700000000 + i * 200;
+  entry.duration = 180 + i % 120;
+  g_autofree gchar* artist = g_strdup_printf("Ärtist & Co=%d", i % 37);
+  g_autofree gchar* track = g_strdup_printf("track %05d", i);
+  entry.artist = artist;
+  entry.track = track;
+  if (i % 3 != 0) {
+    g_autofree gchar* album = g_strdup_printf("Album\t%d+%%", i % 11);
+    entry.album = album;
+  }
+  return entry;
+}
+
+// The stand-in endpoint. Serves one request per connection, in turn.
+
+typedef enum {
+  FAULT_NONE,
+  FAULT_UNAVAILABLE,
+  FAULT_DROP,
+  FAULT_OFFLINE_ERROR,
+  FAULT_SLOW,
+  FAULT_COUNT,
+} Fault;
+
+static const gchar* const kFaultNames[] = {"none", "503", "dropped",
+                                           "error 11", "slow"};
+
+struct Endpoint {
+  int listener;
+  guint16 port;
+  GRand* rand;
+  GMutex mutex;
+  // Guarded by |mutex|.
+  std::vector<std::string> received;
+  guint64 requests = 0;
+  guint64 faults[FAULT_COUNT] = {};
+  guint64 bad_signatures = 0;
+  guint64 oversized = 0;
+  size_t largest_batch = 0;
+};
+
+static int listen_loopback(guint16* port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    g_error("Cannot listen on loopback: %s", g_strerror(errno));
+  }
+  *port = ntohs(address.sin_port);
+  return fd;
+}
+
+static bool send_all(int fd, const gchar* data, gsize length) {
+  gsize sent = 0;
+  while (sent < length) {
+    ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// Reads a request with a Content-Length body into |body|.
+static bool read_request(int fd, std::string* body) {
+  std::string data;
+  char chunk[16 * 1024];
+  size_t header_end;
+  while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    data.append(chunk, n);
+  }
+  size_t length_at = data.find("Content-Length:");
+  if (length_at == std::string::npos || length_at > header_end) {
+    return false;
+  }
+  const size_t length = g_ascii_strtoull(
+      data.c_str() + length_at + strlen("Content-Length:"), nullptr, 10);
+  while (data.size() < header_end + 4 + length) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    data.append(chunk, n);
+  }
+  body->assign(data, header_end + 4, length);
+  return true;
+}
+
+// Checks the form's signature and batch, and returns its tracks in order.
+static bool check_form(Endpoint* endpoint, const std::string& body,
+                       std::vector<std::string>* tracks) {
+  std::map<std::string, std::string> params;
+  g_auto(GStrv) pairs = g_strsplit(body.c_str(), "&", -1);
+  for (gchar** pair = pairs; *pair != nullptr; pair++) {
+    gchar* equals = strchr(*pair, '=');
+    if (equals == nullptr) {
+      return false;
+    }
+    *equals = '\0';
+    g_autofree gchar* value = g_uri_unescape_string(equals + 1, nullptr);
+    if (value == nullptr) {
+      return false;
+    }
+    params[*pair] = value;
+  }
+
+  std::string signed_text;
+  for (const auto& param : params) {
+    if (param.first != "api_sig" && param.first != "format") {
+      signed_text += param.first + param.second;
+    }
+  }
+  signed_text += kApiSecret;
+  g_autofree gchar* expected = g_compute_checksum_for_string(
+      G_CHECKSUM_MD5, signed_text.c_str(), signed_text.size());
+  if (params["api_sig"] != expected || params["api_key"] != kApiKey ||
+      params["sk"] != kSessionKey || params["method"] != "track.scrobble") {
+    g_mutex_lock(&endpoint->mutex);
+    endpoint->bad_signatures++;
+    g_mutex_unlock(&endpoint->mutex);
+    return false;
+  }
+
+  for (size_t i = 0;; i++) {
+    g_autofree gchar* key = g_strdup_printf("track[%zu]", i);
+    auto track = params.find(key);
+    if (track == params.end()) {
+      break;
+    }
+    tracks->push_back(track->second);
+  }
+  g_mutex_lock(&endpoint->mutex);
+  endpoint->largest_batch = MAX(endpoint->largest_batch, tracks->size());
+  if (tracks->empty() || tracks->size() > kMaxBatch) {
+    endpoint->oversized++;
+  }
+  g_mutex_unlock(&endpoint->mutex);
+  return !tracks->empty() && tracks->size() <= kMaxBatch;
+}
+
+static void respond(int fd, const gchar* status, const std::string& json) {
+  g_autofree gchar* head = g_strdup_printf(
+      "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: "
+      "%zu\r\nConnection: close\r\n\r\n",
+      status, json.size());
+  if (send_all(fd, head, strlen(head))) {
+    send_all(fd, json.data(), json.size());
+  }
+}
+
+static void serve(Endpoint* endpoint, int fd) {
+  std::string body;
+  if (!read_request(fd, &body)) {
+    return;
+  }
+  std::vector<std::string> tracks;
+  if (!check_form(endpoint, body, &tracks)) {
+    respond(fd, "400 Bad Request", "{\"error\":13,\"message\":\"Invalid\"}");
+    return;
+  }
+
+  g_mutex_lock(&endpoint->mutex);
+  endpoint->requests++;
+  Fault fault = FAULT_NONE;
+  if (g_rand_int_range(endpoint->rand, 0, 100) < failure_percent) {
+    fault = static_cast<Fault>(
+        g_rand_int_range(endpoint->rand, FAULT_UNAVAILABLE, FAULT_COUNT));
+  }
+  endpoint->faults[fault]++;
+  g_mutex_unlock(&endpoint->mutex);
+
+  switch (fault) {
+    case FAULT_UNAVAILABLE:
+      respond(fd, "503 Service Unavailable", "");
+      return;
+    case FAULT_DROP:
+      return;
+    case FAULT_OFFLINE_ERROR:
+      respond(fd, "200 OK",
+              "{\"error\":11,\"message\":\"Service Offline\"}");
+      return;
+    case FAULT_SLOW:
+      g_usleep(slow_ms * 1000);
+      break;
+    default:
+      break;
+  }
+
+  // Recorded before replying: a reply the client never reads would be a
+  // legitimate duplicate, and this endpoint never loses one.
+  g_mutex_lock(&endpoint->mutex);
+  endpoint->received.insert(endpoint->received.end(), tracks.begin(),
+                            tracks.end());
+  g_mutex_unlock(&endpoint->mutex);
+  g_autofree gchar* json = g_strdup_printf(
+      "{\"scrobbles\":{\"@attr\":{\"accepted\":%zu,\"ignored\":0}}}",
+      tracks.size());
+  respond(fd, "200 OK", json);
+}
+
+static gpointer endpoint_thread(gpointer user_data) {
+  Endpoint* endpoint = static_cast<Endpoint*>(user_data);
+  while (true) {
+    int fd = accept4(endpoint->listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      // The listener was shut down.
+      return nullptr;
+    }
+    serve(endpoint, fd);
+    close(fd);
+  }
+}
+
+// A port nothing listens on, for the offline pass.
+static guint16 closed_port() {
+  guint16 port;
+  close(listen_loopback(&port));
+  return port;
+}
+
+static ScrobbleClient* new_client(const gchar* directory, guint16 port) {
+  g_autoptr(GKeyFile) settings = g_key_file_new();
+  g_autofree gchar* url = g_strdup_printf("http://127.0.0.1:%u/2.0/", port);
+  g_key_file_set_string(settings, "scrobble", "url", url);
+  g_key_file_set_string(settings, "scrobble", "api_key", kApiKey);
+  g_key_file_set_string(settings, "scrobble", "api_secret", kApiSecret);
+  g_key_file_set_string(settings, "scrobble", "session_key", kSessionKey);
+  g_key_file_set_int64(settings, "scrobble", "retry_min_ms", retry_min_ms);
+  g_key_file_set_int64(settings, "scrobble", "retry_max_ms", retry_max_ms);
+  g_autoptr(GError) error = nullptr;
+  ScrobbleClient* client = scrobble_client_new(directory, settings, &error);
+  if (client == nullptr) {
+    g_error("Cannot start the scrobble client: %s", error->message);
+  }
+  return client;
+}
+
+// Waits until |done| holds for the client's counters. Returns false on a
+// timeout.
+template <typename Predicate>
+static bool wait_for(ScrobbleClient* client, ScrobbleClientStats* stats,
+                     Predicate done) {
+  const gint64 deadline = g_get_monotonic_time() + kDrainTimeoutUs;
+  while (true) {
+    scrobble_client_get_stats(client, stats);
+    if (done(*stats)) {
+      return true;
+    }
+    if (g_get_monotonic_time() > deadline) {
+      return false;
+    }
+    g_usleep(1000);
+  }
+}
+
+// Checks that the endpoint received tracks |first| to |first + count| once
+// each and in order, then forgets them.
+static guint64 check_received(Endpoint* endpoint, gint first, gint count) {
+  g_mutex_lock(&endpoint->mutex);
+  std::vector<std::string> received;
+  received.swap(endpoint->received);
+  g_mutex_unlock(&endpoint->mutex);
+
+  std::set<std::string> seen;
+  guint64 duplicates = 0;
+  guint64 out_of_order = 0;
+  for (size_t i = 0; i < received.size(); i++) {
+    if (!seen.insert(received[i]).second) {
+      duplicates++;
+    }
+    if (i > 0 && received[i] < received[i - 1]) {
+      out_of_order++;
+    }
+  }
+  guint64 missing = 0;
+  for (gint i = first; i < first + count; i++) {
+    missing += seen.count(make_entry(i).track) == 0;
+  }
+  g_print("  %zu received, %" G_GUINT64_FORMAT " missing, %" G_GUINT64_FORMAT
+          " duplicated, %" G_GUINT64_FORMAT " out of order\n",
+          received.size(), missing, duplicates, out_of_order);
+  return missing + duplicates + out_of_order +
+         (received.size() != static_cast<size_t>(count));
+}
+
+static void print_endpoint(Endpoint* endpoint) {
+  g_mutex_lock(&endpoint->mutex);
+  g_print("  endpoint: %" G_GUINT64_FORMAT " requests, largest batch %zu;",
+          endpoint->requests, endpoint->largest_batch);
+  for (gint fault = FAULT_UNAVAILABLE; fault < FAULT_COUNT; fault++) {
+    g_print(" %s %" G_GUINT64_FORMAT, kFaultNames[fault],
+            endpoint->faults[fault]);
+    endpoint->faults[fault] = 0;
+  }
+  g_print("\n");
+  endpoint->requests = 0;
+  endpoint->largest_batch = 0;
+  g_mutex_unlock(&endpoint->mutex);
+}
+
+static void print_stats(const ScrobbleClientStats& stats, gint64 elapsed_us) {
+  g_print("  client: %" G_GUINT64_FORMAT " queued, %" G_GUINT64_FORMAT
+          " submitted in %" G_GUINT64_FORMAT " batches, %" G_GUINT64_FORMAT
+          " failed requests, %" G_GUINT64_FORMAT " dropped, %" G_GUINT64_FORMAT
+          " pending; %.2f s\n",
+          stats.queued, stats.submitted, stats.batches, stats.failures,
+          stats.dropped, stats.pending, elapsed_us / 1e6);
+}
+
+static void remove_queue(const gchar* directory) {
+  for (const char* name : {"queue", "head"}) {
+    g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+    g_unlink(path);
+  }
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- scrobble client benchmark");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  failure_percent = CLAMP(failure_percent, 0, 100);
+  g_autofree gchar* directory = g_dir_make_tmp("scrobble-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  Endpoint endpoint;
+  endpoint.listener = listen_loopback(&endpoint.port);
+  endpoint.rand = g_rand_new_with_seed(7);
+  g_mutex_init(&endpoint.mutex);
+  GThread* acceptor = g_thread_new("endpoint", endpoint_thread, &endpoint);
+  guint64 errors = 0;
+
+  g_print("%d%% of requests failed; retries after %d to %d ms\n\n",
+          failure_percent, retry_min_ms, retry_max_ms);
+
+  // The queue on its own.
+  {
+    std::unique_ptr<ScrobbleQueue> queue =
+        ScrobbleQueue::Open(directory, &error);
+    if (queue == nullptr) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    std::vector<gint64> appends;
+    for (gint i = 0; i < play_count; i++) {
+      ScrobbleEntry entry = make_entry(i);
+      gint64 start = g_get_monotonic_time();
+      if (!queue->Append(entry, nullptr)) {
+        errors++;
+      }
+      appends.push_back(g_get_monotonic_time() - start);
+    }
+    queue.reset();
+    queue = ScrobbleQueue::Open(directory, nullptr);
+    if (queue == nullptr || queue->size() != static_cast<size_t>(play_count)) {
+      g_print("The queue lost entries across a reopen\n");
+      errors++;
+    }
+    remove_queue(directory);
+    g_print("append: %d plays, p50 %" G_GINT64_FORMAT " us, p99 %"
+            G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us\n\n",
+            play_count, percentile(appends, 0.5), percentile(appends, 0.99),
+            percentile(appends, 1.0));
+  }
+
+  // A burst through the failing endpoint.
+  {
+    ScrobbleClient* client = new_client(directory, endpoint.port);
+    std::vector<gint64> enqueues;
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < play_count; i++) {
+      ScrobbleEntry entry = make_entry(i);
+      gint64 enqueue_start = g_get_monotonic_time();
+      scrobble_client_enqueue(client, entry);
+      enqueues.push_back(g_get_monotonic_time() - enqueue_start);
+    }
+    ScrobbleClientStats stats;
+    const guint64 expected = play_count;
+    if (!wait_for(client, &stats, [expected](const ScrobbleClientStats& s) {
+          return s.submitted == expected && s.pending == 0;
+        })) {
+      g_print("flaky: timed out\n");
+      errors++;
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+    g_print("flaky: enqueue p50 %" G_GINT64_FORMAT " us, p99 %"
+            G_GINT64_FORMAT " us\n",
+            percentile(enqueues, 0.5), percentile(enqueues, 0.99));
+    print_stats(stats, elapsed);
+    print_endpoint(&endpoint);
+    errors += check_received(&endpoint, 0, play_count);
+    errors += stats.dropped;
+    g_object_unref(client);
+    g_print("\n");
+  }
+
+  // A backlog built up offline, then drained by a new client.
+  {
+    ScrobbleClient* client = new_client(directory, closed_port());
+    const gint first = play_count;
+    for (gint i = first; i < first + backlog_count; i++) {
+      scrobble_client_enqueue(client, make_entry(i));
+    }
+    ScrobbleClientStats stats;
+    const guint64 expected = backlog_count;
+    if (!wait_for(client, &stats, [expected](const ScrobbleClientStats& s) {
+          return s.queued == expected && s.failures >= 3;
+        })) {
+      g_print("offline: timed out\n");
+      errors++;
+    }
+    g_print("offline: %" G_GUINT64_FORMAT " queued, %" G_GUINT64_FORMAT
+            " failed requests\n",
+            stats.queued, stats.failures);
+    g_object_unref(client);
+
+    g_autofree gchar* path = g_build_filename(directory, "queue", nullptr);
+    FILE* file = fopen(path, "a");
+    fputs("0badf00d\t1700000000\t200\tTorn", file);
+    fclose(file);
+
+    gint64 start = g_get_monotonic_time();
+    client = new_client(directory, endpoint.port);
+    scrobble_client_get_stats(client, &stats);
+    g_print("  reopened with %" G_GUINT64_FORMAT " pending\n", stats.pending);
+    if (!wait_for(client, &stats, [expected](const ScrobbleClientStats& s) {
+          return s.submitted == expected && s.pending == 0;
+        })) {
+      g_print("offline: timed out draining\n");
+      errors++;
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+    print_stats(stats, elapsed);
+    print_endpoint(&endpoint);
+    errors += check_received(&endpoint, first, backlog_count);
+    g_object_unref(client);
+
+    GStatBuf info;
+    if (g_stat(path, &info) != 0 || info.st_size != 0) {
+      g_print("The drained queue was not emptied\n");
+      errors++;
+    }
+  }
+
+  g_mutex_lock(&endpoint.mutex);
+  errors += endpoint.bad_signatures + endpoint.oversized;
+  g_mutex_unlock(&endpoint.mutex);
+
+  shutdown(endpoint.listener, SHUT_RDWR);
+  g_thread_join(acceptor);
+  close(endpoint.listener);
+  g_rand_free(endpoint.rand);
+  remove_queue(directory);
+  g_rmdir(directory);
+
+  if (errors > 0) {
+    g_print("%" G_GUINT64_FORMAT " errors\n", errors);
+  }
+  return errors == 0 ? 0 : 1;
+}
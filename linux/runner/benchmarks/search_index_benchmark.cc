@@ -0,0 +1,415 @@
+// Builds a listening history of tens of thousands of distinct tracks in a
+// private directory, then indexes and searches it the way the shell search
+// provider does:
+//
+//   collect  gathering the distinct tracks from the open history, which
+//            the app does on its main thread
+//   build    indexing them, which the provider does on its own thread;
+//            and what the index takes in memory
+//   queries  searches as typed into the shell: the first one, two and
+//            three letters of a word, a whole word, two words from
+//            different fields, a word prefix with a word, and a miss
+//   live     plays added one at a time, half of them of new tracks,
+//            rebuilds included
+//
+// The first hundred queries of each kind have their full result sets
+// checked against a scan of the tracks as generated, and their best few
+// against the head of the full ranking; the latter again after the live
+// plays. Run with --help for the tunables.
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "listening_history.h"
+#include "track_search_index.h"
+
+static gint track_count = 40000;
+static gint play_count = 200000;
+static gint query_count = 2000;
+static gint repeat_count = 10;
+
+static const GOptionEntry kOptions[] = {
+    {"tracks", 't', 0, G_OPTION_ARG_INT, &track_count, "Distinct tracks",
+     "N"},
+    {"plays", 'p', 0, G_OPTION_ARG_INT, &play_count,
+     "Plays, drawn with a power-law skew", "N"},
+    {"queries", 'q', 0, G_OPTION_ARG_INT, &query_count,
+     "Queries of each kind", "N"},
+    {"repeats", 'r', 0, G_OPTION_ARG_INT, &repeat_count,
+     "Runs of collect and build", "N"},
+    {nullptr},
+};
+
+// As many results as the provider asks for.
+static constexpr size_t kMaxResults = 20;
+// Queries of each kind whose results are checked against a scan.
+static constexpr size_t kCheckedQueries = 100;
+static constexpr gint kVocabularySize = 4000;
+
+static const char* const kQueryKinds[] = {
+    "1 letter", "2 letters", "3 letters", "word",
+    "two words", "prefix + word", "miss",
+};
+
+struct GeneratedTrack {
+  std::string title;
+  std::string artist;
+  std::string album;
+};
+
+static gint64 now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static gint64 percentile(std::vector<gint64>& samples, gdouble fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = std::min(samples.size() - 1,
+                          static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+static void print_row(const gchar* name, std::vector<gint64>& ns,
+                      const gchar* unit, gint64 divisor) {
+  const gint64 p50 = percentile(ns, 0.5) / divisor;
+  const gint64 p99 = percentile(ns, 0.99) / divisor;
+  const gint64 max = percentile(ns, 1.0) / divisor;
+  g_print("%-16s %8zu %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+          " %9" G_GINT64_FORMAT " %s\n",
+          name, ns.size(), p50, p99, max, unit);
+}
+
+// Pronounceable words of two to four syllables, so trigrams are spread
+// the way they are in names rather than uniformly.
+static std::vector<std::string> make_vocabulary(GRand* random) {
+  static const char kConsonants[] = "bcdfghjklmnprstvwz";
+  static const char kVowels[] = "aeiouy";
+  std::set<std::string> seen;
+  std::vector<std::string> words;
+  while (words.size() < static_cast<size_t>(kVocabularySize)) {
+    std::string word;
+    const gint syllables = g_rand_int_range(random, 2, 5);
+    for (gint s = 0; s < syllables; s++) {
+      word += kConsonants[g_rand_int_range(random, 0, sizeof(kConsonants) - 1)];
+      word += kVowels[g_rand_int_range(random, 0, sizeof(kVowels) - 1)];
+    }
+    if (seen.insert(word).second) {
+      words.push_back(word);
+    }
+  }
+  return words;
+}
+
+// Up to |max_words| words, the first capitalized, drawn with a skew
+// towards the start of the vocabulary.
+static std::string make_name(GRand* random,
+                             const std::vector<std::string>& vocabulary,
+                             gint max_words) {
+  std::string name;
+  const gint words = g_rand_int_range(random, 1, max_words + 1);
+  for (gint w = 0; w < words; w++) {
+    const gdouble skew = g_rand_double(random);
+    std::string word = vocabulary[static_cast<size_t>(
+        vocabulary.size() * skew * skew)];
+    if (w == 0) {
+      word[0] = g_ascii_toupper(word[0]);
+    } else {
+      name += ' ';
+    }
+    name += word;
+  }
+  return name;
+}
+
+static std::vector<std::string> split_words(const std::string& text) {
+  std::vector<std::string> words;
+  gchar** parts = g_strsplit(text.c_str(), " ", -1);
+  for (gchar** part = parts; *part != nullptr; part++) {
+    if (**part != '\0') {
+      g_autofree gchar* lower = g_ascii_strdown(*part, -1);
+      words.push_back(lower);
+    }
+  }
+  g_strfreev(parts);
+  return words;
+}
+
+// Whether |field|, lower-cased, matches |token| the way the index should:
+// anywhere for three letters or more, at the start of a word otherwise.
+static bool field_matches(const std::string& field, const std::string& token) {
+  g_autofree gchar* lower = g_ascii_strdown(field.c_str(), -1);
+  const std::string text = lower;
+  for (size_t at = text.find(token); at != std::string::npos;
+       at = text.find(token, at + 1)) {
+    if (token.size() >= 3 || at == 0 || !g_ascii_isalnum(text[at - 1])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The ids of every track matching all of |tokens|, by scanning.
+static std::set<uint32_t> scan(const std::vector<GeneratedTrack>& tracks,
+                               const std::vector<std::string>& tokens) {
+  std::set<uint32_t> ids;
+  for (size_t id = 0; id < tracks.size(); id++) {
+    const GeneratedTrack& track = tracks[id];
+    bool all = true;
+    for (const std::string& token : tokens) {
+      if (!field_matches(track.title, token) &&
+          !field_matches(track.artist, token) &&
+          !field_matches(track.album, token)) {
+        all = false;
+        break;
+      }
+    }
+    if (all) {
+      ids.insert(static_cast<uint32_t>(id));
+    }
+  }
+  return ids;
+}
+
+// A query of |kind| made from a random track's words.
+static std::vector<std::string> make_query(
+    GRand* random, size_t kind, const std::vector<GeneratedTrack>& tracks) {
+  const GeneratedTrack& track =
+      tracks[g_rand_int_range(random, 0, tracks.size())];
+  const std::string* fields[] = {&track.title, &track.artist, &track.album};
+  const gint field = g_rand_int_range(random, 0, 3);
+  std::vector<std::string> words = split_words(*fields[field]);
+  const std::string& word = words[g_rand_int_range(random, 0, words.size())];
+  std::vector<std::string> other =
+      split_words(*fields[(field + 1 + g_rand_int_range(random, 0, 2)) % 3]);
+  const std::string& other_word =
+      other[g_rand_int_range(random, 0, other.size())];
+
+  switch (kind) {
+    case 0:
+    case 1:
+    case 2:
+      return {word.substr(0, kind + 1)};
+    case 3:
+      return {word};
+    case 4:
+      return {word, other_word};
+    case 5:
+      return {word.substr(0, 2), other_word};
+    default:
+      return {"qx" + word};
+  }
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- index and search played tracks");
+  g_option_context_add_main_entries(context, kOptions, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  track_count = std::max(track_count, 1);
+  play_count = std::max(play_count, track_count);
+  query_count = std::max(query_count, 1);
+  repeat_count = std::max(repeat_count, 1);
+
+  g_autofree gchar* directory = g_dir_make_tmp("search-XXXXXX", &error);
+  if (directory == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  // Tracks are by one of a tenth as many artists, on one of a few albums
+  // each; every track is played once, then the rest of the plays are
+  // drawn with a cubic skew.
+  GRand* random = g_rand_new_with_seed(1);
+  const std::vector<std::string> vocabulary = make_vocabulary(random);
+  const gint artist_count = std::max(track_count / 10, 1);
+  std::vector<std::string> artists;
+  for (gint a = 0; a < artist_count; a++) {
+    artists.push_back(make_name(random, vocabulary, 3));
+  }
+  std::set<std::string> seen;
+  std::vector<GeneratedTrack> tracks;
+  while (tracks.size() < static_cast<size_t>(track_count)) {
+    const gint artist = g_rand_int_range(random, 0, artist_count);
+    GeneratedTrack track;
+    track.title = make_name(random, vocabulary, 5);
+    track.artist = artists[artist];
+    track.album = make_name(random, vocabulary, 4);
+    if (seen.insert(track.title + '\n' + track.artist + '\n' + track.album)
+            .second) {
+      tracks.push_back(std::move(track));
+    }
+  }
+
+  const gint64 now_us = g_get_real_time();
+  {
+    std::unique_ptr<ListeningHistory> history =
+        ListeningHistory::Open(directory, &error);
+    if (history == nullptr) {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+    const gint64 spacing_us = 60 * G_USEC_PER_SEC;
+    for (gint i = 0; i < play_count; i++) {
+      size_t track = i;
+      if (i >= track_count) {
+        const gdouble skew = g_rand_double(random);
+        track = static_cast<size_t>(track_count * skew * skew * skew);
+      }
+      HistoryPlay play = {};
+      play.started_at_us = now_us - (play_count - i) * spacing_us;
+      play.length_ms = 200000;
+      play.listened_ms = 200000;
+      play.title = tracks[track].title.c_str();
+      play.artist = tracks[track].artist.c_str();
+      play.album = tracks[track].album.c_str();
+      if (!history->Append(play, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+      }
+    }
+  }
+
+  std::unique_ptr<ListeningHistory> history =
+      ListeningHistory::Open(directory, &error);
+  if (history == nullptr) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  std::vector<gint64> collect_ns;
+  std::vector<gint64> build_ns;
+  std::unique_ptr<TrackSearchIndex> index;
+  for (gint i = 0; i < repeat_count; i++) {
+    gint64 begin = now_ns();
+    std::vector<SearchTrack> collected =
+        TrackSearchIndex::CollectTracks(*history);
+    collect_ns.push_back(now_ns() - begin);
+    begin = now_ns();
+    index = std::make_unique<TrackSearchIndex>(std::move(collected));
+    build_ns.push_back(now_ns() - begin);
+  }
+
+  gint errors = 0;
+  if (index->size() != tracks.size()) {
+    g_printerr("indexed %zu tracks, generated %zu\n", index->size(),
+               tracks.size());
+    errors++;
+  }
+
+  g_print("%zu tracks, %d plays; index takes %zu KiB\n", index->size(),
+          play_count, index->memory_bytes() / 1024);
+  g_print("%-16s %8s %9s %9s %9s\n", "", "samples", "p50", "p99", "max");
+  print_row("collect", collect_ns, "ms", 1000000);
+  print_row("build", build_ns, "ms", 1000000);
+
+  // Compares what |tokens| find against a scan, if |expected| is given,
+  // and the best few against the head of the full ranking, which a search
+  // for them alone must not cut short.
+  std::vector<uint32_t> results;
+  auto check = [&](const std::vector<std::string>& tokens,
+                   const std::set<uint32_t>* expected) {
+    std::vector<const gchar*> terms;
+    for (const std::string& token : tokens) {
+      terms.push_back(token.c_str());
+    }
+    terms.push_back(nullptr);
+
+    index->Search(terms.data(), index->size(), now_us, &results);
+    const std::set<uint32_t> found(results.begin(), results.end());
+    if (found.size() != results.size() ||
+        (expected != nullptr && found != *expected)) {
+      errors++;
+    }
+    std::vector<uint32_t> best;
+    index->Search(terms.data(), kMaxResults, now_us, &best);
+    results.resize(MIN(results.size(), kMaxResults));
+    if (best != results) {
+      errors++;
+    }
+  };
+
+  std::vector<std::vector<std::string>> queries;
+  for (size_t kind = 0; kind < G_N_ELEMENTS(kQueryKinds); kind++) {
+    queries.clear();
+    for (gint q = 0; q < query_count; q++) {
+      queries.push_back(make_query(random, kind, tracks));
+    }
+
+    std::vector<gint64> query_ns;
+    for (const std::vector<std::string>& tokens : queries) {
+      std::vector<const gchar*> terms;
+      for (const std::string& token : tokens) {
+        terms.push_back(token.c_str());
+      }
+      terms.push_back(nullptr);
+
+      const gint64 begin = now_ns();
+      index->Search(terms.data(), kMaxResults, now_us, &results);
+      query_ns.push_back(now_ns() - begin);
+    }
+    print_row(kQueryKinds[kind], query_ns, "us", 1000);
+
+    // Checked apart from the timing, which the scans would leave with cold
+    // caches.
+    for (size_t q = 0; q < MIN(queries.size(), kCheckedQueries); q++) {
+      const std::set<uint32_t> expected = scan(tracks, queries[q]);
+      check(queries[q], &expected);
+    }
+  }
+
+  // Plays as the recorder reports them, every other one of a new track,
+  // until past a few rebuilds.
+  std::vector<gint64> live_ns;
+  const gint live_count = 1000;
+  for (gint i = 0; i < live_count; i++) {
+    const gint64 begin = now_ns();
+    if (i % 2 == 0) {
+      g_autofree gchar* title = g_strdup_printf("Live track %d", i);
+      index->AddPlay(title, "Live artist", "", now_us - live_count + i);
+    } else {
+      const GeneratedTrack& track = tracks[g_rand_int_range(
+          random, 0, static_cast<gint32>(tracks.size()))];
+      index->AddPlay(track.title.c_str(), track.artist.c_str(),
+                     track.album.c_str(), now_us - live_count + i);
+    }
+    live_ns.push_back(now_ns() - begin);
+  }
+  print_row("live", live_ns, "us", 1000);
+  const gchar* live_terms[] = {"live", "track", nullptr};
+  index->Search(live_terms, live_count, now_us, &results);
+  if (results.size() != static_cast<size_t>(live_count / 2)) {
+    errors++;
+  }
+  // Rankings, with plays both indexed and not.
+  for (size_t kind = 0; kind < G_N_ELEMENTS(kQueryKinds); kind++) {
+    for (size_t q = 0; q < kCheckedQueries; q++) {
+      check(make_query(random, kind, tracks), nullptr);
+    }
+  }
+
+  g_print("%d checks failed\n", errors);
+
+  history.reset();
+  for (const char* name : {"plays.log", "strings.log", "artists.idx"}) {
+    g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+    g_unlink(path);
+  }
+  g_rmdir(directory);
+  g_rand_free(random);
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,897 @@
+#include "control_socket.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "now_playing_block.h"
+
+static constexpr char kSocketName[] = "ytmu.sock";
+
+// Longest request line accepted.
+static constexpr size_t kMaxLineBytes = 4096;
+
+// A client with this much output queued is not read from until it has
+// caught up. Checked between reads, so a single read may overshoot it.
+static constexpr size_t kMaxQueuedBytes = 64 * 1024;
+
+static constexpr size_t kMaxClients = 1024;
+static constexpr int kMaxEvents = 64;
+static constexpr size_t kReadBytes = 4096;
+
+static constexpr MprisCommandType kCommandTypes[] = {
+    MprisCommandType::kPlay,      MprisCommandType::kPause,
+    MprisCommandType::kPlayPause, MprisCommandType::kNext,
+    MprisCommandType::kPrevious,  MprisCommandType::kStop,
+    MprisCommandType::kSeek,      MprisCommandType::kSetPosition,
+    MprisCommandType::kSetVolume, MprisCommandType::kSetRate,
+};
+
+// Shared between the socket thread and readers of the stats.
+struct ControlShared {
+  std::atomic<bool> stopping{false};
+  std::atomic<guint64> connections{0};
+  std::atomic<guint64> requests{0};
+  std::atomic<guint64> commands{0};
+  std::atomic<guint64> events{0};
+  std::atomic<guint64> coalesced{0};
+  std::atomic<guint64> subscribers{0};
+};
+
+// Bytes queued for a client.
+struct ControlOutbox {
+  std::string data;
+  size_t sent = 0;
+
+  bool empty() const { return sent == data.size(); }
+  size_t queued() const { return data.size() - sent; }
+};
+
+struct ControlClient {
+  int fd = -1;
+  // Position in ControlLoop::clients.
+  size_t index = 0;
+  // Registered epoll interest.
+  uint32_t events = 0;
+  bool closed = false;
+  // The client has shut down its end; closed once its replies are sent.
+  bool eof = false;
+  bool subscribed = false;
+  // A change arrived while the outbox was still being sent.
+  bool behind = false;
+  // Everything after the last complete request line.
+  std::string input;
+  ControlOutbox outbox;
+};
+
+// Owned by the socket thread.
+struct ControlLoop {
+  std::vector<ControlClient*> clients;
+  std::vector<ControlClient*> closed;
+  // The latest change sent to subscribers, and the block generation it
+  // was built from.
+  std::string event;
+  guint64 generation = 0;
+  bool has_event = false;
+  bool listening = false;
+};
+
+struct ControlRequest {
+  std::string command;
+  std::vector<std::pair<std::string, double>> numbers;
+};
+
+struct _ControlSocket {
+  GObject parent_instance;
+
+  GMainContext* main_context;
+  MprisCommandHandler command_handler;
+  gpointer command_handler_data;
+  ControlShared* shared;
+  ControlLoop* loop;
+  GThread* thread;
+  // Set once listening, and removed again on dispose.
+  gchar* path;
+  int listener;
+  int epoll;
+  int wake;
+  gboolean observing;
+};
+
+G_DEFINE_TYPE(ControlSocket, control_socket, G_TYPE_OBJECT)
+
+// epoll tags for the socket's own descriptors.
+static char listener_tag;
+static char wake_tag;
+
+static void close_fd(int* fd) {
+  if (*fd >= 0) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+static void skip_space(std::string_view s, size_t* i) {
+  while (*i < s.size() && g_ascii_isspace(s[*i])) {
+    (*i)++;
+  }
+}
+
+// Parses the JSON string at s[*i] into |out|. Escaped surrogates, which no
+// command needs, become U+FFFD.
+static bool parse_string(std::string_view s, size_t* i, std::string* out) {
+  if (*i >= s.size() || s[*i] != '"') {
+    return false;
+  }
+  for ((*i)++; *i < s.size(); (*i)++) {
+    const char c = s[*i];
+    if (c == '"') {
+      (*i)++;
+      return true;
+    }
+    if (c != '\\') {
+      out->push_back(c);
+      continue;
+    }
+    if (++(*i) >= s.size()) {
+      return false;
+    }
+    switch (s[*i]) {
+      case '"':
+      case '\\':
+      case '/':
+        out->push_back(s[*i]);
+        break;
+      case 'b':
+        out->push_back('\b');
+        break;
+      case 'f':
+        out->push_back('\f');
+        break;
+      case 'n':
+        out->push_back('\n');
+        break;
+      case 'r':
+        out->push_back('\r');
+        break;
+      case 't':
+        out->push_back('\t');
+        break;
+      case 'u': {
+        if (*i + 4 >= s.size()) {
+          return false;
+        }
+        gunichar u = 0;
+        for (size_t k = 1; k <= 4; k++) {
+          const int digit = g_ascii_xdigit_value(s[*i + k]);
+          if (digit < 0) {
+            return false;
+          }
+          u = u * 16 + digit;
+        }
+        *i += 4;
+        if (u >= 0xd800 && u < 0xe000) {
+          u = 0xfffd;
+        }
+        char utf8[6];
+        out->append(utf8, g_unichar_to_utf8(u, utf8));
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+// Parses a request line: a flat JSON object with a "command" string and
+// number arguments, or a bare command name.
+static bool parse_request(std::string_view line, ControlRequest* request) {
+  if (line[0] != '{') {
+    for (char c : line) {
+      if (!g_ascii_isalpha(c)) {
+        return false;
+      }
+    }
+    request->command = std::string(line);
+    return true;
+  }
+
+  size_t i = 1;
+  skip_space(line, &i);
+  if (i < line.size() && line[i] == '}') {
+    i++;
+  } else {
+    while (true) {
+      std::string key;
+      skip_space(line, &i);
+      if (!parse_string(line, &i, &key)) {
+        return false;
+      }
+      skip_space(line, &i);
+      if (i >= line.size() || line[i] != ':') {
+        return false;
+      }
+      i++;
+      skip_space(line, &i);
+      if (i >= line.size()) {
+        return false;
+      }
+      if (line[i] == '"') {
+        std::string value;
+        if (!parse_string(line, &i, &value)) {
+          return false;
+        }
+        if (key == "command") {
+          request->command = std::move(value);
+        }
+      } else if (line.compare(i, 4, "true") == 0 ||
+                 line.compare(i, 4, "null") == 0) {
+        i += 4;
+      } else if (line.compare(i, 5, "false") == 0) {
+        i += 5;
+      } else {
+        const size_t start = i;
+        while (i < line.size() && line[i] != '\0' &&
+               strchr("+-.0123456789eE", line[i]) != nullptr) {
+          i++;
+        }
+        const std::string number(line.substr(start, i - start));
+        gchar* end = nullptr;
+        const double value = g_ascii_strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0' || !std::isfinite(value)) {
+          return false;
+        }
+        request->numbers.emplace_back(std::move(key), value);
+      }
+      skip_space(line, &i);
+      if (i >= line.size()) {
+        return false;
+      }
+      if (line[i] == '}') {
+        i++;
+        break;
+      }
+      if (line[i] != ',') {
+        return false;
+      }
+      i++;
+    }
+  }
+  skip_space(line, &i);
+  return i == line.size() && !request->command.empty();
+}
+
+static bool find_number(const ControlRequest& request, const char* key,
+                        double* value) {
+  for (const auto& number : request.numbers) {
+    if (number.first == key) {
+      *value = number.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The argument a command takes, if any.
+static const char* argument_name(MprisCommandType type) {
+  switch (type) {
+    case MprisCommandType::kSeek:
+      return "offset";
+    case MprisCommandType::kSetPosition:
+      return "position";
+    case MprisCommandType::kSetVolume:
+      return "volume";
+    case MprisCommandType::kSetRate:
+      return "rate";
+    default:
+      return nullptr;
+  }
+}
+
+static void append_json_string(std::string* out, const char* value) {
+  out->push_back('"');
+  for (const char* p = value; *p != '\0'; p++) {
+    const unsigned char c = *p;
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char escape[8];
+      g_snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out->append(escape);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+static void append_seconds(std::string* out, gint64 us) {
+  char number[G_ASCII_DTOSTR_BUF_SIZE];
+  out->append(g_ascii_formatd(number, sizeof(number), "%.3f",
+                              MAX(us, 0) / 1e6));
+}
+
+// Appends the now-playing block as a status object, with the position
+// extrapolated to now. Returns false if the block could not be read.
+static bool append_status(std::string* out, guint64* generation) {
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block)) {
+    return false;
+  }
+  const char* state = "stopped";
+  gint64 position_us = block.position_us;
+  if (block.state == NOW_PLAYING_PLAYING) {
+    state = "playing";
+    if (block.position_time_us > 0) {
+      position_us += g_get_monotonic_time() - block.position_time_us;
+    }
+  } else if (block.state == NOW_PLAYING_PAUSED) {
+    state = "paused";
+  }
+
+  out->append("{\"state\":\"");
+  out->append(state);
+  out->append("\",\"title\":");
+  append_json_string(out, block.title);
+  out->append(",\"artist\":");
+  append_json_string(out, block.artist);
+  out->append(",\"album\":");
+  append_json_string(out, block.album);
+  out->append(",\"artUrl\":");
+  append_json_string(out, block.art_url);
+  out->append(",\"position\":");
+  append_seconds(out, position_us);
+  out->append(",\"length\":");
+  append_seconds(out, block.duration_us);
+  out->push_back('}');
+  if (generation != nullptr) {
+    *generation = block.generation;
+  }
+  return true;
+}
+
+// Carries a command from the socket thread to the owner thread.
+struct ControlDelivery {
+  ControlSocket* self;
+  MprisCommand command;
+};
+
+static gboolean deliver_command(gpointer user_data) {
+  ControlDelivery* delivery = static_cast<ControlDelivery*>(user_data);
+  ControlSocket* self = delivery->self;
+  if (self->command_handler != nullptr) {
+    self->command_handler(delivery->command, self->command_handler_data);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void free_command_delivery(gpointer user_data) {
+  ControlDelivery* delivery = static_cast<ControlDelivery*>(user_data);
+  g_object_unref(delivery->self);
+  delete delivery;
+}
+
+static void set_listening(ControlSocket* self, bool listening) {
+  if (self->loop->listening == listening) {
+    return;
+  }
+  if (listening) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &listener_tag;
+    epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->listener, &event);
+  } else {
+    epoll_ctl(self->epoll, EPOLL_CTL_DEL, self->listener, nullptr);
+  }
+  self->loop->listening = listening;
+}
+
+static void close_client(ControlSocket* self, ControlClient* c) {
+  if (c->closed) {
+    return;
+  }
+  c->closed = true;
+  // Closing a descriptor removes it from the epoll set.
+  close_fd(&c->fd);
+  if (c->subscribed) {
+    self->shared->subscribers--;
+  }
+  std::vector<ControlClient*>& clients = self->loop->clients;
+  clients[c->index] = clients.back();
+  clients[c->index]->index = c->index;
+  clients.pop_back();
+  // Freed once the current batch of events, which may still name it, has
+  // been handled.
+  self->loop->closed.push_back(c);
+  // A descriptor is free again if accepting had run out of them.
+  set_listening(self, true);
+}
+
+static void reply(ControlClient* c, std::string_view line) {
+  c->outbox.data.append(line);
+  c->outbox.data.push_back('\n');
+}
+
+static void reply_error(ControlClient* c, const char* message) {
+  std::string line = "{\"ok\":false,\"error\":";
+  append_json_string(&line, message);
+  line.push_back('}');
+  reply(c, line);
+}
+
+static void handle_line(ControlSocket* self, ControlClient* c,
+                        std::string_view line) {
+  while (!line.empty() && g_ascii_isspace(line.back())) {
+    line.remove_suffix(1);
+  }
+  while (!line.empty() && g_ascii_isspace(line.front())) {
+    line.remove_prefix(1);
+  }
+  if (line.empty()) {
+    return;
+  }
+  self->shared->requests++;
+
+  ControlRequest request;
+  if (!parse_request(line, &request)) {
+    reply_error(c, "malformed request");
+    return;
+  }
+
+  if (request.command == "status") {
+    std::string status = "{\"ok\":true,\"status\":";
+    if (append_status(&status, nullptr)) {
+      status.push_back('}');
+      reply(c, status);
+    } else {
+      reply_error(c, "status unavailable");
+    }
+    return;
+  }
+  if (request.command == "subscribe") {
+    if (!c->subscribed) {
+      c->subscribed = true;
+      self->shared->subscribers++;
+    }
+    reply(c, "{\"ok\":true}");
+    // The current state, so the subscriber need not ask for it.
+    std::string event = "{\"event\":\"changed\",\"status\":";
+    if (append_status(&event, nullptr)) {
+      event.push_back('}');
+      reply(c, event);
+      self->shared->events++;
+    }
+    return;
+  }
+  if (request.command == "unsubscribe") {
+    if (c->subscribed) {
+      c->subscribed = false;
+      c->behind = false;
+      self->shared->subscribers--;
+    }
+    reply(c, "{\"ok\":true}");
+    return;
+  }
+
+  for (MprisCommandType type : kCommandTypes) {
+    if (request.command != mpris_command_name(type)) {
+      continue;
+    }
+    MprisCommand command = {type, 0, 0};
+    const char* argument = argument_name(type);
+    double value = 0;
+    if (argument != nullptr) {
+      if (!find_number(request, argument, &value)) {
+        g_autofree gchar* message =
+            g_strdup_printf("%s needs a number %s", mpris_command_name(type),
+                            argument);
+        reply_error(c, message);
+        return;
+      }
+      if (type == MprisCommandType::kSeek ||
+          type == MprisCommandType::kSetPosition) {
+        command.time_us = llround(value * G_USEC_PER_SEC);
+      } else {
+        command.value = value;
+      }
+    }
+    self->shared->commands++;
+    g_main_context_invoke_full(self->main_context, G_PRIORITY_DEFAULT,
+                               deliver_command,
+                               new ControlDelivery{
+                                   CONTROL_SOCKET(g_object_ref(self)),
+                                   command},
+                               free_command_delivery);
+    reply(c, "{\"ok\":true}");
+    return;
+  }
+  reply_error(c, "unknown command");
+}
+
+// Reads and answers requests until the client has nothing more to send,
+// has too many replies queued or hangs up. Returns false on a hard error.
+static bool read_client(ControlSocket* self, ControlClient* c) {
+  char buffer[kReadBytes];
+  while (!c->eof && c->outbox.queued() < kMaxQueuedBytes) {
+    ssize_t n = recv(c->fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN;
+    }
+    if (n == 0) {
+      c->eof = true;
+      // A last request without a newline, as from printf status | nc -U.
+      handle_line(self, c, c->input);
+      c->input.clear();
+      break;
+    }
+    c->input.append(buffer, n);
+    size_t start = 0;
+    for (size_t newline = c->input.find('\n');
+         newline != std::string::npos;
+         newline = c->input.find('\n', start)) {
+      handle_line(self, c,
+                  std::string_view(c->input).substr(start, newline - start));
+      start = newline + 1;
+    }
+    c->input.erase(0, start);
+    if (c->input.size() > kMaxLineBytes) {
+      reply_error(c, "request too long");
+      c->input.clear();
+      c->eof = true;
+    }
+  }
+  return true;
+}
+
+// Sends what it can of |outbox|. Returns false on a hard error.
+static bool flush(int fd, ControlOutbox* outbox) {
+  while (!outbox->empty()) {
+    ssize_t n = send(fd, outbox->data.data() + outbox->sent,
+                     outbox->queued(), MSG_NOSIGNAL);
+    if (n > 0) {
+      outbox->sent += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return n < 0 && errno == EAGAIN;
+    }
+  }
+  outbox->data.clear();
+  outbox->sent = 0;
+  return true;
+}
+
+// Sends what is queued for |c| and, once that is all out, the latest
+// change if it fell behind; then closes it or updates its epoll interest.
+static void drive(ControlSocket* self, ControlClient* c) {
+  bool ok = flush(c->fd, &c->outbox);
+  if (ok && c->outbox.empty() && c->behind) {
+    c->behind = false;
+    c->outbox.data = self->loop->event;
+    self->shared->events++;
+    ok = flush(c->fd, &c->outbox);
+  }
+  if (!ok || (c->eof && c->outbox.empty())) {
+    close_client(self, c);
+    return;
+  }
+
+  uint32_t wanted = 0;
+  if (!c->eof && c->outbox.queued() < kMaxQueuedBytes) {
+    wanted |= EPOLLIN;
+  }
+  if (!c->outbox.empty()) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted != c->events) {
+    epoll_event event = {};
+    event.events = wanted;
+    event.data.ptr = c;
+    epoll_ctl(self->epoll, c->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+              c->fd, &event);
+    c->events = wanted;
+  }
+}
+
+static void handle_event(ControlSocket* self, ControlClient* c, uint32_t events) {
+  if (c->closed) {
+    return;
+  }
+  if (events & EPOLLERR) {
+    close_client(self, c);
+    return;
+  }
+  if ((events & (EPOLLIN | EPOLLHUP)) && !read_client(self, c)) {
+    close_client(self, c);
+    return;
+  }
+  drive(self, c);
+}
+
+// Sends the now-playing block to every subscriber if it changed. Only a
+// subscriber with nothing queued gets it now; the rest get whatever is
+// latest once they have caught up.
+static void publish(ControlSocket* self) {
+  ControlLoop* loop = self->loop;
+  std::string event = "{\"event\":\"changed\",\"status\":";
+  guint64 generation = 0;
+  if (!append_status(&event, &generation) ||
+      (loop->has_event && generation == loop->generation)) {
+    return;
+  }
+  event.append("}\n");
+  loop->event = std::move(event);
+  loop->generation = generation;
+  loop->has_event = true;
+
+  // A copy, since a client that fails is removed from the list.
+  const std::vector<ControlClient*> clients = loop->clients;
+  for (ControlClient* c : clients) {
+    if (c->closed || !c->subscribed) {
+      continue;
+    }
+    if (!c->outbox.empty()) {
+      c->behind = true;
+      self->shared->coalesced++;
+      continue;
+    }
+    c->outbox.data = loop->event;
+    self->shared->events++;
+    drive(self, c);
+  }
+}
+
+static void accept_clients(ControlSocket* self) {
+  while (true) {
+    int fd = accept4(self->listener, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno == EMFILE || errno == ENFILE) {
+        // Until a client goes; the listener would otherwise stay readable.
+        g_debug("Control socket is out of descriptors");
+        set_listening(self, false);
+      } else if (errno != EAGAIN) {
+        g_debug("Control socket accept failed: %s", g_strerror(errno));
+      }
+      return;
+    }
+    if (self->loop->clients.size() >= kMaxClients) {
+      close(fd);
+      continue;
+    }
+
+    ControlClient* c = new ControlClient();
+    c->fd = fd;
+    c->index = self->loop->clients.size();
+    self->loop->clients.push_back(c);
+    self->shared->connections++;
+    drive(self, c);
+  }
+}
+
+static void free_closed(ControlSocket* self) {
+  for (ControlClient* c : self->loop->closed) {
+    delete c;
+  }
+  self->loop->closed.clear();
+}
+
+static gpointer socket_thread_main(gpointer data) {
+  ControlSocket* self = CONTROL_SOCKET(data);
+
+  epoll_event events[kMaxEvents];
+  while (!self->shared->stopping) {
+    int count = epoll_wait(self->epoll, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      g_warning("Control socket stopped: %s", g_strerror(errno));
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      void* tag = events[i].data.ptr;
+      if (tag == &listener_tag) {
+        accept_clients(self);
+      } else if (tag == &wake_tag) {
+        uint64_t value;
+        if (read(self->wake, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+          g_debug("Control socket wake failed: %s", g_strerror(errno));
+        }
+        if (!self->shared->stopping) {
+          publish(self);
+        }
+      } else {
+        handle_event(self, static_cast<ControlClient*>(tag), events[i].events);
+      }
+    }
+    free_closed(self);
+  }
+
+  while (!self->loop->clients.empty()) {
+    close_client(self, self->loop->clients.back());
+  }
+  free_closed(self);
+  return nullptr;
+}
+
+// Runs on the owner thread for every write of the now-playing block.
+static void on_block_written(void* data) {
+  ControlSocket* self = CONTROL_SOCKET(data);
+  uint64_t one = 1;
+  if (write(self->wake, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    g_debug("Control socket wake failed: %s", g_strerror(errno));
+  }
+}
+
+static void control_socket_dispose(GObject* object) {
+  ControlSocket* self = CONTROL_SOCKET(object);
+
+  if (self->observing) {
+    now_playing_block_remove_observer(on_block_written, self);
+    self->observing = FALSE;
+  }
+  if (self->thread != nullptr) {
+    self->shared->stopping = true;
+    uint64_t one = 1;
+    if (write(self->wake, &one, sizeof(one)) < 0) {
+      g_warning("Failed to stop the control socket: %s", g_strerror(errno));
+    }
+    g_thread_join(self->thread);
+    self->thread = nullptr;
+  }
+  close_fd(&self->listener);
+  close_fd(&self->epoll);
+  close_fd(&self->wake);
+  if (self->path != nullptr) {
+    unlink(self->path);
+    g_clear_pointer(&self->path, g_free);
+  }
+
+  self->command_handler = nullptr;
+  self->command_handler_data = nullptr;
+  g_clear_pointer(&self->main_context, g_main_context_unref);
+
+  delete self->loop;
+  self->loop = nullptr;
+  delete self->shared;
+  self->shared = nullptr;
+
+  G_OBJECT_CLASS(control_socket_parent_class)->dispose(object);
+}
+
+static void control_socket_class_init(ControlSocketClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = control_socket_dispose;
+}
+
+static void control_socket_init(ControlSocket* self) {
+  self->main_context = g_main_context_ref_thread_default();
+  self->shared = new ControlShared();
+  self->loop = new ControlLoop();
+  self->listener = -1;
+  self->epoll = -1;
+  self->wake = -1;
+}
+
+ControlSocket* control_socket_new() {
+  return CONTROL_SOCKET(g_object_new(control_socket_get_type(), nullptr));
+}
+
+void control_socket_set_command_handler(ControlSocket* self,
+                                        MprisCommandHandler handler,
+                                        gpointer user_data) {
+  g_return_if_fail(CONTROL_IS_SOCKET(self));
+
+  self->command_handler = handler;
+  self->command_handler_data = user_data;
+}
+
+// Binds |fd| to |address|, taking it over from a socket file no process
+// listens on any more.
+static bool bind_socket(int fd, const sockaddr_un& address) {
+  const sockaddr* generic = reinterpret_cast<const sockaddr*>(&address);
+  if (bind(fd, generic, sizeof(address)) == 0) {
+    return true;
+  }
+  if (errno != EADDRINUSE) {
+    return false;
+  }
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  const bool live = probe >= 0 && connect(probe, generic, sizeof(address)) == 0;
+  close_fd(&probe);
+  if (live) {
+    errno = EADDRINUSE;
+    return false;
+  }
+  unlink(address.sun_path);
+  return bind(fd, generic, sizeof(address)) == 0;
+}
+
+gboolean control_socket_start(ControlSocket* self, const gchar* path,
+                              GError** error) {
+  g_return_val_if_fail(CONTROL_IS_SOCKET(self), FALSE);
+
+  if (self->thread != nullptr) {
+    return TRUE;
+  }
+
+  g_autofree gchar* socket_path =
+      path != nullptr
+          ? g_strdup(path)
+          : g_build_filename(g_get_user_runtime_dir(), kSocketName, nullptr);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                "Socket path is too long: %s", socket_path);
+    return FALSE;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  self->listener =
+      socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (self->listener < 0 || !bind_socket(self->listener, address) ||
+      listen(self->listener, SOMAXCONN) != 0) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Cannot listen on %s: %s", socket_path, g_strerror(saved));
+    close_fd(&self->listener);
+    return FALSE;
+  }
+  chmod(socket_path, 0600);
+
+  self->epoll = epoll_create1(EPOLL_CLOEXEC);
+  self->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->epoll < 0 || self->wake < 0) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Cannot start the control socket: %s", g_strerror(saved));
+    unlink(socket_path);
+    close_fd(&self->listener);
+    close_fd(&self->epoll);
+    close_fd(&self->wake);
+    return FALSE;
+  }
+  self->path = g_steal_pointer(&socket_path);
+  set_listening(self, true);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.ptr = &wake_tag;
+  epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->wake, &event);
+
+  now_playing_block_add_observer(on_block_written, self);
+  self->observing = TRUE;
+  self->thread = g_thread_new("control-socket", socket_thread_main, self);
+  return TRUE;
+}
+
+void control_socket_get_stats(ControlSocket* self, ControlSocketStats* stats) {
+  g_return_if_fail(CONTROL_IS_SOCKET(self));
+  const ControlShared* shared = self->shared;
+  stats->connections = shared->connections;
+  stats->requests = shared->requests;
+  stats->commands = shared->commands;
+  stats->events = shared->events;
+  stats->coalesced = shared->coalesced;
+  stats->subscribers = shared->subscribers;
+}
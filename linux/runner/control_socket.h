@@ -0,0 +1,91 @@
+#ifndef RUNNER_CONTROL_SOCKET_H_
+#define RUNNER_CONTROL_SOCKET_H_
+
+#include <gio/gio.h>
+
+#include "mpris_server.h"
+
+// Line-delimited JSON control of the player over a Unix socket, for status
+// bars and scripts that would otherwise poll MPRIS. One epoll thread
+// serves every client.
+//
+// Each request is a line holding a JSON object, or just a command name:
+//
+//   {"command":"status"}       -> {"ok":true,"status":{...}}
+//   {"command":"seek","offset":-10}
+//   playPause                  -> {"ok":true}
+//   subscribe                  -> {"ok":true}, then one line per change:
+//                                 {"event":"changed","status":{...}}
+//
+// Commands are named as by mpris_command_name(); seek takes "offset",
+// setPosition "position" (both in seconds) and setVolume "volume". A status
+// holds state, title, artist, album, artUrl, position and length, in
+// seconds as of when it was sent. Replies come in request order.
+//
+// A subscriber that does not keep up is sent only the latest status once
+// it has read what was queued for it, so it never holds more than one
+// event's worth of memory and never delays the others.
+
+G_BEGIN_DECLS
+
+#define CONTROL_TYPE_SOCKET control_socket_get_type()
+G_DECLARE_FINAL_TYPE(ControlSocket, control_socket, CONTROL, SOCKET, GObject)
+
+G_END_DECLS
+
+typedef struct {
+  guint64 connections;
+  guint64 requests;
+  guint64 commands;
+  // Lines sent to subscribers.
+  guint64 events;
+  // Changes a backed-up subscriber skipped.
+  guint64 coalesced;
+  guint64 subscribers;
+} ControlSocketStats;
+
+/**
+ * control_socket_new:
+ *
+ * Creates a socket that is not yet listening. The calling thread becomes
+ * its owner thread: commands are delivered on its thread-default main
+ * context, and it must be the thread that calls now_playing_block_notify().
+ *
+ * Returns: a new #ControlSocket.
+ */
+ControlSocket* control_socket_new();
+
+/**
+ * control_socket_set_command_handler:
+ * @handler: (nullable): called on the owner thread for each command.
+ *
+ * Pass %NULL before dropping whatever @user_data points at; commands
+ * already queued are then discarded.
+ */
+void control_socket_set_command_handler(ControlSocket* self,
+                                        MprisCommandHandler handler,
+                                        gpointer user_data);
+
+/**
+ * control_socket_start:
+ * @path: (nullable): where to listen, or %NULL for ytmu.sock in
+ *   $XDG_RUNTIME_DIR.
+ * @error: return location for a #GError.
+ *
+ * Binds @path, replacing a socket no process listens on any more, and
+ * starts the socket thread. Subscribers are sent every write of the
+ * now-playing block from then on. The socket stops, and @path is removed,
+ * when it is disposed.
+ *
+ * Returns: %TRUE if the socket is listening.
+ */
+gboolean control_socket_start(ControlSocket* self, const gchar* path,
+                              GError** error);
+
+/**
+ * control_socket_get_stats:
+ * @stats: (out): counters since the socket started. Thread-safe.
+ */
+void control_socket_get_stats(ControlSocket* self, ControlSocketStats* stats);
+
+#endif  // RUNNER_CONTROL_SOCKET_H_
@@ -0,0 +1,544 @@
+#include "discord_ipc.h"
+
+#include <glib-unix.h>
+#include <glib.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "now_playing_block.h"
+
+// Frames are an 8-byte little-endian header, opcode then payload length,
+// followed by a JSON payload.
+enum Opcode : uint32_t {
+  kHandshake = 0,
+  kFrame = 1,
+  kClose = 2,
+  kPing = 3,
+  kPong = 4,
+};
+
+static constexpr size_t kHeaderLength = 8;
+static constexpr size_t kMaxFrameLength = 64 * 1024;
+
+// A change is sent once the block has been quiet this long...
+static constexpr gint64 kSettleUs = 250 * 1000;
+// ...or this long after the first change not yet sent, whichever is sooner.
+static constexpr gint64 kMaxDelayUs = 1000 * 1000;
+// Discord drops SET_ACTIVITY beyond five per twenty seconds.
+static constexpr int kRateLimitCount = 5;
+static constexpr gint64 kRateLimitWindowUs = 20 * G_USEC_PER_SEC;
+// Start and end times closer than this to the shown ones are drift from
+// extrapolating the position, not a seek.
+static constexpr gint64 kPositionToleranceMs = 2000;
+
+// After the socket appears Discord may not be listening yet; retry after
+// these delays before waiting for the next one.
+static constexpr guint kRetryDelaysMs[] = {100, 500, 2000};
+// Without inotify, how often to look for Discord.
+static constexpr guint kPollSeconds = 15;
+
+static constexpr size_t kMaxTextLength = 128;
+static constexpr size_t kMaxImageKeyLength = 256;
+
+static constexpr char kSocketPrefix[] = "discord-ipc-";
+static constexpr int kSocketCount = 10;
+// Where Discord puts its socket under the runtime directory: directly, and
+// as the Flatpak and Snap packages do.
+static const char* const kSocketDirectories[] = {
+    "",
+    "app/com.discordapp.Discord",
+    "snap.discord",
+};
+
+enum class Connection { kDisconnected, kHandshaking, kReady };
+
+struct Presence {
+  bool active = false;
+  std::string details;
+  std::string state;
+  std::string large_image;
+  std::string large_text;
+  // Milliseconds since the epoch, or 0 when the duration is unknown.
+  gint64 start_ms = 0;
+  gint64 end_ms = 0;
+};
+
+struct DiscordIpc {
+  std::string application_id;
+  std::string runtime_directory;
+
+  Connection connection = Connection::kDisconnected;
+  int fd = -1;
+  guint socket_source = 0;
+  GIOCondition socket_condition = static_cast<GIOCondition>(0);
+  std::string inbox;
+  std::string outbox;
+
+  int inotify_fd = -1;
+  guint inotify_source = 0;
+  guint connect_source = 0;
+  guint connect_attempt = 0;
+
+  guint publish_source = 0;
+  // Monotonic time of the first change not yet sent, or 0.
+  gint64 first_change_us = 0;
+  // The presence Discord shows, while ready.
+  Presence shown;
+  // Monotonic times of the last sends, oldest at |next_send|.
+  gint64 send_times_us[kRateLimitCount] = {};
+  int next_send = 0;
+  uint64_t nonce = 0;
+
+  DiscordIpcStats stats = {};
+};
+
+static void disconnect(DiscordIpc* ipc);
+static void publish(DiscordIpc* ipc);
+
+// Appends |value| to |out| as a JSON string, at most |max_length| bytes of
+// it, cut at a character boundary.
+static void append_json_string(std::string* out, const std::string& value,
+                               size_t max_length) {
+  size_t length = std::min(value.size(), max_length);
+  while (length > 0 && length < value.size() &&
+         (static_cast<unsigned char>(value[length]) & 0xc0) == 0x80) {
+    length--;
+  }
+  out->push_back('"');
+  for (size_t i = 0; i < length; i++) {
+    const unsigned char c = value[i];
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char escape[8];
+      g_snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out->append(escape);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+// Discord rejects text shorter than two characters; pads |text| with a
+// blank it does not trim.
+static std::string presence_text(const char* text) {
+  std::string result = text;
+  if (result.size() < 2) result += "\xe2\xa0\x80";
+  return result;
+}
+
+// Reads the presence the block describes. Returns false if a write kept
+// racing the read.
+static bool read_presence(Presence* presence) {
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block)) return false;
+  *presence = Presence();
+  if (block.state != NOW_PLAYING_PLAYING || block.title[0] == '\0') {
+    return true;
+  }
+  presence->active = true;
+  presence->details = presence_text(block.title);
+  if (block.artist[0] != '\0') {
+    presence->state = std::string("by ") + block.artist;
+  }
+  const size_t art_length = strlen(block.art_url);
+  presence->large_image = art_length > 0 && art_length <= kMaxImageKeyLength
+                              ? block.art_url
+                              : "default";
+  presence->large_text =
+      presence_text(block.album[0] != '\0' ? block.album : block.title);
+  if (block.duration_us > 0) {
+    gint64 position_us = block.position_us;
+    if (block.position_time_us > 0) {
+      position_us += g_get_monotonic_time() - block.position_time_us;
+    }
+    presence->start_ms = (g_get_real_time() - position_us) / 1000;
+    presence->end_ms = presence->start_ms + block.duration_us / 1000;
+  }
+  return true;
+}
+
+static bool same_presence(const Presence& a, const Presence& b) {
+  if (!a.active || !b.active) return a.active == b.active;
+  return a.details == b.details && a.state == b.state &&
+         a.large_image == b.large_image && a.large_text == b.large_text &&
+         (a.start_ms == 0) == (b.start_ms == 0) &&
+         std::llabs(a.start_ms - b.start_ms) <= kPositionToleranceMs &&
+         std::llabs(a.end_ms - b.end_ms) <= kPositionToleranceMs;
+}
+
+// A SET_ACTIVITY command for |presence|, or one clearing the activity if it
+// is inactive.
+static std::string activity_command(DiscordIpc* ipc,
+                                    const Presence& presence) {
+  std::string json = "{\"cmd\":\"SET_ACTIVITY\",\"args\":{\"pid\":";
+  json += std::to_string(getpid());
+  if (presence.active) {
+    json += ",\"activity\":{\"details\":";
+    append_json_string(&json, presence.details, kMaxTextLength);
+    if (!presence.state.empty()) {
+      json += ",\"state\":";
+      append_json_string(&json, presence.state, kMaxTextLength);
+    }
+    if (presence.start_ms != 0) {
+      json += ",\"timestamps\":{\"start\":" + std::to_string(presence.start_ms) +
+              ",\"end\":" + std::to_string(presence.end_ms) + "}";
+    }
+    json += ",\"assets\":{\"large_image\":";
+    append_json_string(&json, presence.large_image, kMaxImageKeyLength);
+    json += ",\"large_text\":";
+    append_json_string(&json, presence.large_text, kMaxTextLength);
+    json += "}}";
+  }
+  json += "},\"nonce\":\"" + std::to_string(++ipc->nonce) + "\"}";
+  return json;
+}
+
+static gboolean on_socket(gint fd, GIOCondition condition, gpointer data);
+
+// Watches for output only while some is queued.
+static void update_socket_watch(DiscordIpc* ipc) {
+  const GIOCondition condition = static_cast<GIOCondition>(
+      G_IO_IN | G_IO_HUP | G_IO_ERR | (ipc->outbox.empty() ? 0 : G_IO_OUT));
+  if (ipc->socket_source != 0 && condition == ipc->socket_condition) return;
+  if (ipc->socket_source != 0) g_source_remove(ipc->socket_source);
+  ipc->socket_condition = condition;
+  ipc->socket_source = g_unix_fd_add(ipc->fd, condition, on_socket, ipc);
+}
+
+// Writes as much of the queued output as the socket takes. Returns false if
+// the connection failed.
+static bool flush_outbox(DiscordIpc* ipc) {
+  while (!ipc->outbox.empty()) {
+    const ssize_t written = send(ipc->fd, ipc->outbox.data(),
+                                 ipc->outbox.size(), MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return false;
+    }
+    ipc->outbox.erase(0, written);
+  }
+  update_socket_watch(ipc);
+  return true;
+}
+
+// Queues a frame and writes what the socket takes without blocking. May
+// disconnect.
+static void send_frame(DiscordIpc* ipc, Opcode opcode,
+                       const std::string& payload) {
+  const uint32_t header[2] = {
+      GUINT32_TO_LE(static_cast<uint32_t>(opcode)),
+      GUINT32_TO_LE(static_cast<uint32_t>(payload.size())),
+  };
+  ipc->outbox.append(reinterpret_cast<const char*>(header), kHeaderLength);
+  ipc->outbox.append(payload);
+  if (!flush_outbox(ipc)) disconnect(ipc);
+}
+
+static gint64 next_allowed_send(const DiscordIpc* ipc) {
+  const gint64 oldest = ipc->send_times_us[ipc->next_send];
+  return oldest == 0 ? 0 : oldest + kRateLimitWindowUs;
+}
+
+static gboolean on_publish_timeout(gpointer data) {
+  DiscordIpc* ipc = static_cast<DiscordIpc*>(data);
+  ipc->publish_source = 0;
+  ipc->first_change_us = 0;
+  publish(ipc);
+  return G_SOURCE_REMOVE;
+}
+
+// Sends the latest presence once the block settles, within the rate limit.
+static void schedule_publish(DiscordIpc* ipc) {
+  const gint64 now = g_get_monotonic_time();
+  if (ipc->first_change_us == 0) ipc->first_change_us = now;
+  gint64 due = std::min(now + kSettleUs, ipc->first_change_us + kMaxDelayUs);
+  due = std::max(due, next_allowed_send(ipc));
+  if (ipc->publish_source != 0) g_source_remove(ipc->publish_source);
+  const gint64 delay_ms = std::max<gint64>(0, (due - now + 999) / 1000);
+  ipc->publish_source = g_timeout_add(delay_ms, on_publish_timeout, ipc);
+}
+
+static void publish(DiscordIpc* ipc) {
+  if (ipc->connection != Connection::kReady) return;
+  Presence presence;
+  if (!read_presence(&presence)) {
+    schedule_publish(ipc);
+    return;
+  }
+  if (same_presence(presence, ipc->shown)) {
+    ipc->stats.unchanged++;
+    return;
+  }
+  const gint64 now = g_get_monotonic_time();
+  if (now < next_allowed_send(ipc)) {
+    schedule_publish(ipc);
+    return;
+  }
+  ipc->send_times_us[ipc->next_send] = now;
+  ipc->next_send = (ipc->next_send + 1) % kRateLimitCount;
+  ipc->stats.activities++;
+  const std::string command = activity_command(ipc, presence);
+  ipc->shown = std::move(presence);
+  send_frame(ipc, kFrame, command);
+}
+
+static void on_block_written(void* data) {
+  DiscordIpc* ipc = static_cast<DiscordIpc*>(data);
+  if (ipc->connection != Connection::kReady) return;
+  ipc->stats.changes++;
+  schedule_publish(ipc);
+}
+
+static void on_ready(DiscordIpc* ipc) {
+  ipc->connection = Connection::kReady;
+  ipc->stats.connects++;
+  // A new connection shows nothing until told otherwise, and has its own
+  // rate limit.
+  ipc->shown = Presence();
+  std::fill(std::begin(ipc->send_times_us), std::end(ipc->send_times_us), 0);
+  publish(ipc);
+}
+
+static void handle_frame(DiscordIpc* ipc, uint32_t opcode,
+                         const std::string& payload) {
+  switch (opcode) {
+    case kFrame:
+      if (ipc->connection == Connection::kHandshaking &&
+          payload.find("\"evt\":\"READY\"") != std::string::npos) {
+        on_ready(ipc);
+      } else if (payload.find("\"evt\":\"ERROR\"") != std::string::npos) {
+        g_warning("Discord rejected a request: %s", payload.c_str());
+      }
+      break;
+    case kPing:
+      send_frame(ipc, kPong, payload);
+      break;
+    case kClose:
+      g_debug("Discord closed the connection: %s", payload.c_str());
+      disconnect(ipc);
+      break;
+    default:
+      break;
+  }
+}
+
+static gboolean on_socket(gint fd, GIOCondition condition, gpointer data) {
+  DiscordIpc* ipc = static_cast<DiscordIpc*>(data);
+  if ((condition & G_IO_OUT) && !flush_outbox(ipc)) {
+    disconnect(ipc);
+    return G_SOURCE_REMOVE;
+  }
+  if (!(condition & (G_IO_IN | G_IO_HUP | G_IO_ERR))) return G_SOURCE_CONTINUE;
+
+  char buffer[4096];
+  for (;;) {
+    const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      ipc->inbox.append(buffer, received);
+      continue;
+    }
+    if (received < 0 && errno == EINTR) continue;
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    disconnect(ipc);
+    return G_SOURCE_REMOVE;
+  }
+
+  size_t offset = 0;
+  while (ipc->inbox.size() - offset >= kHeaderLength) {
+    uint32_t header[2];
+    memcpy(header, ipc->inbox.data() + offset, kHeaderLength);
+    const uint32_t opcode = GUINT32_FROM_LE(header[0]);
+    const uint32_t length = GUINT32_FROM_LE(header[1]);
+    if (length > kMaxFrameLength) {
+      g_warning("Discord sent an oversized frame");
+      disconnect(ipc);
+      return G_SOURCE_REMOVE;
+    }
+    if (ipc->inbox.size() - offset - kHeaderLength < length) break;
+    const std::string payload =
+        ipc->inbox.substr(offset + kHeaderLength, length);
+    offset += kHeaderLength + length;
+    handle_frame(ipc, opcode, payload);
+    if (ipc->fd < 0) return G_SOURCE_REMOVE;
+  }
+  ipc->inbox.erase(0, offset);
+  return G_SOURCE_CONTINUE;
+}
+
+// Connects to the first Discord socket that accepts, and starts the
+// handshake. Returns false if none did.
+static bool try_connect(DiscordIpc* ipc) {
+  for (const char* directory : kSocketDirectories) {
+    for (int i = 0; i < kSocketCount; i++) {
+      struct sockaddr_un address = {};
+      address.sun_family = AF_UNIX;
+      const int length = g_snprintf(
+          address.sun_path, sizeof(address.sun_path), "%s/%s%s%s%d",
+          ipc->runtime_directory.c_str(), directory,
+          directory[0] != '\0' ? "/" : "", kSocketPrefix, i);
+      if (length < 0 || static_cast<size_t>(length) >= sizeof(address.sun_path)) {
+        continue;
+      }
+      const int fd =
+          socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (fd < 0) return false;
+      if (connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                  sizeof(address)) != 0) {
+        close(fd);
+        continue;
+      }
+      ipc->fd = fd;
+      ipc->connection = Connection::kHandshaking;
+      std::string handshake = "{\"v\":1,\"client_id\":";
+      append_json_string(&handshake, ipc->application_id, kMaxTextLength);
+      handshake += "}";
+      send_frame(ipc, kHandshake, handshake);
+      return ipc->fd >= 0;
+    }
+  }
+  return false;
+}
+
+static gboolean on_connect_timeout(gpointer data);
+
+// After a failed attempt: retries shortly if the socket has just appeared,
+// polls if inotify is unavailable, and otherwise waits for the socket.
+static void retry_connect(DiscordIpc* ipc) {
+  if (ipc->connect_source != 0) return;
+  guint delay_ms;
+  if (ipc->connect_attempt < G_N_ELEMENTS(kRetryDelaysMs)) {
+    delay_ms = kRetryDelaysMs[ipc->connect_attempt++];
+  } else if (ipc->inotify_fd < 0) {
+    delay_ms = kPollSeconds * 1000;
+  } else {
+    return;
+  }
+  ipc->connect_source = g_timeout_add(delay_ms, on_connect_timeout, ipc);
+}
+
+static gboolean on_connect_timeout(gpointer data) {
+  DiscordIpc* ipc = static_cast<DiscordIpc*>(data);
+  ipc->connect_source = 0;
+  if (ipc->fd < 0 && !try_connect(ipc)) retry_connect(ipc);
+  return G_SOURCE_REMOVE;
+}
+
+static void disconnect(DiscordIpc* ipc) {
+  if (ipc->fd < 0) return;
+  if (ipc->socket_source != 0) g_source_remove(ipc->socket_source);
+  ipc->socket_source = 0;
+  if (ipc->publish_source != 0) g_source_remove(ipc->publish_source);
+  ipc->publish_source = 0;
+  close(ipc->fd);
+  ipc->fd = -1;
+  ipc->inbox.clear();
+  ipc->outbox.clear();
+  if (ipc->connection == Connection::kReady) ipc->stats.disconnects++;
+  ipc->connection = Connection::kDisconnected;
+  ipc->first_change_us = 0;
+  ipc->connect_attempt = G_N_ELEMENTS(kRetryDelaysMs);
+  retry_connect(ipc);
+}
+
+static gboolean on_inotify(gint fd, GIOCondition condition, gpointer data) {
+  DiscordIpc* ipc = static_cast<DiscordIpc*>(data);
+  alignas(struct inotify_event) char buffer[4096];
+  bool appeared = false;
+  for (;;) {
+    const ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length <= 0) break;
+    for (ssize_t offset = 0; offset < length;) {
+      const auto* event =
+          reinterpret_cast<const struct inotify_event*>(buffer + offset);
+      if (event->len > 0 &&
+          g_str_has_prefix(event->name, kSocketPrefix)) {
+        appeared = true;
+      }
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+  }
+  if (appeared && ipc->fd < 0) {
+    if (ipc->connect_source != 0) g_source_remove(ipc->connect_source);
+    ipc->connect_source = 0;
+    ipc->connect_attempt = 0;
+    if (!try_connect(ipc)) retry_connect(ipc);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// Watches the directories Discord creates its socket in.
+static void watch_socket_directories(DiscordIpc* ipc) {
+  ipc->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (ipc->inotify_fd < 0) return;
+  int watches = 0;
+  for (const char* directory : kSocketDirectories) {
+    g_autofree gchar* path =
+        g_build_filename(ipc->runtime_directory.c_str(), directory, nullptr);
+    if (inotify_add_watch(ipc->inotify_fd, path,
+                          IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) >= 0) {
+      watches++;
+    }
+  }
+  if (watches == 0) {
+    close(ipc->inotify_fd);
+    ipc->inotify_fd = -1;
+    return;
+  }
+  ipc->inotify_source = g_unix_fd_add(ipc->inotify_fd, G_IO_IN, on_inotify, ipc);
+}
+
+// Discord's own choice of directory for the socket.
+static std::string find_runtime_directory() {
+  for (const char* name : {"XDG_RUNTIME_DIR", "TMPDIR", "TMP", "TEMP"}) {
+    const gchar* value = g_getenv(name);
+    if (value != nullptr && value[0] != '\0') return value;
+  }
+  return "/tmp";
+}
+
+DiscordIpc* discord_ipc_new(const char* application_id) {
+  g_return_val_if_fail(application_id != nullptr, nullptr);
+  DiscordIpc* ipc = new DiscordIpc();
+  ipc->application_id = application_id;
+  ipc->runtime_directory = find_runtime_directory();
+  watch_socket_directories(ipc);
+  now_playing_block_add_observer(on_block_written, ipc);
+  ipc->connect_attempt = G_N_ELEMENTS(kRetryDelaysMs);
+  if (!try_connect(ipc)) retry_connect(ipc);
+  return ipc;
+}
+
+void discord_ipc_free(DiscordIpc* ipc) {
+  if (ipc == nullptr) return;
+  now_playing_block_remove_observer(on_block_written, ipc);
+  if (ipc->connection == Connection::kReady && ipc->shown.active) {
+    // Best effort: whatever the socket takes without blocking.
+    send_frame(ipc, kFrame, activity_command(ipc, Presence()));
+  }
+  if (ipc->inotify_source != 0) g_source_remove(ipc->inotify_source);
+  if (ipc->inotify_fd >= 0) close(ipc->inotify_fd);
+  ipc->inotify_fd = -1;
+  disconnect(ipc);
+  if (ipc->connect_source != 0) g_source_remove(ipc->connect_source);
+  delete ipc;
+}
+
+int discord_ipc_is_ready(const DiscordIpc* ipc) {
+  return ipc->connection == Connection::kReady ? 1 : 0;
+}
+
+void discord_ipc_get_stats(const DiscordIpc* ipc, DiscordIpcStats* stats) {
+  *stats = ipc->stats;
+}
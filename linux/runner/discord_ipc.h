@@ -0,0 +1,54 @@
+#ifndef RUNNER_DISCORD_IPC_H_
+#define RUNNER_DISCORD_IPC_H_
+
+#include <stdint.h>
+
+// Discord Rich Presence over Discord's local IPC socket
+// ($XDG_RUNTIME_DIR/discord-ipc-N), driven by the now-playing block rather
+// than a timer. my_application.cc starts and stops it when
+// lib/services/discord_rpc_service.dart asks.
+//
+// Every write of the block is compared with the presence Discord already
+// shows; only a change of track, of playing state or a jump in position
+// sends SET_ACTIVITY. A burst of changes, such as skipping through a
+// queue, is coalesced into a single update of the latest state, and
+// updates never exceed Discord's limit of five per twenty seconds. While
+// Discord is not running, the client waits for its socket to appear
+// through inotify instead of polling. Everything runs on the default main
+// context.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DiscordIpc DiscordIpc;
+
+typedef struct {
+  uint64_t connects;
+  uint64_t disconnects;
+  // Writes of the block seen while connected.
+  uint64_t changes;
+  // SET_ACTIVITY frames sent, clearing ones included.
+  uint64_t activities;
+  // Coalesced changes that left the presence as Discord already shows it.
+  uint64_t unchanged;
+} DiscordIpcStats;
+
+// Starts publishing the now-playing block as the presence of the Discord
+// application |application_id|, connecting now or once Discord starts.
+// Main thread only, like the calls below.
+DiscordIpc* discord_ipc_new(const char* application_id);
+
+// Clears the presence if connected and closes the connection.
+void discord_ipc_free(DiscordIpc* ipc);
+
+// Returns 1 once Discord has accepted the handshake, 0 otherwise.
+int discord_ipc_is_ready(const DiscordIpc* ipc);
+
+void discord_ipc_get_stats(const DiscordIpc* ipc, DiscordIpcStats* stats);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_DISCORD_IPC_H_
@@ -0,0 +1,563 @@
+#include "filter_compiler.h"
+
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "filter_engine.h"
+
+struct TypeOption {
+  const char* name;
+  uint32_t types;
+};
+
+constexpr TypeOption kTypeOptions[] = {
+    {"document", FILTER_REQUEST_DOCUMENT},
+    {"doc", FILTER_REQUEST_DOCUMENT},
+    {"subdocument", FILTER_REQUEST_SUBDOCUMENT},
+    {"frame", FILTER_REQUEST_SUBDOCUMENT},
+    {"script", FILTER_REQUEST_SCRIPT},
+    {"stylesheet", FILTER_REQUEST_STYLESHEET},
+    {"css", FILTER_REQUEST_STYLESHEET},
+    {"image", FILTER_REQUEST_IMAGE},
+    {"media", FILTER_REQUEST_MEDIA},
+    {"font", FILTER_REQUEST_FONT},
+    {"xmlhttprequest", FILTER_REQUEST_XHR},
+    {"xhr", FILTER_REQUEST_XHR},
+    {"websocket", FILTER_REQUEST_WEBSOCKET},
+    {"ping", FILTER_REQUEST_PING},
+    {"beacon", FILTER_REQUEST_PING},
+    {"object", FILTER_REQUEST_OTHER},
+    {"other", FILTER_REQUEST_OTHER},
+    {"all", FILTER_REQUEST_ALL},
+};
+
+// Procedural operators and other selector syntax that is not CSS.
+constexpr const char* kProceduralOperators[] = {
+    ":-abp-",      ":has-text(",     ":matches-attr(", ":matches-css",
+    ":matches-path(", ":matches-prop(", ":min-text-length(", ":others(",
+    ":remove(",    ":remove-attr(",  ":remove-class(", ":style(",
+    ":upward(",    ":watch-attr(",   ":xpath(",
+};
+
+// Tokens found in most URLs, which would make crowded buckets.
+constexpr const char* kCommonTokens[] = {
+    "com", "http", "https", "html", "js", "net", "org", "www",
+};
+
+static bool starts_with(const std::string& text, const char* prefix) {
+  return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static std::string to_lower(std::string text) {
+  for (char& c : text) {
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+  }
+  return text;
+}
+
+static bool is_host_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' ||
+         c == '.' || c == '_';
+}
+
+static bool is_host(const std::string& text) {
+  return !text.empty() && text.front() != '.' && text.back() != '.' &&
+         std::all_of(text.begin(), text.end(), is_host_char);
+}
+
+static std::vector<std::string> split(const std::string& text,
+                                      char separator) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find(separator, start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    parts.push_back(text.substr(start, end - start));
+    start = end + 1;
+  }
+  return parts;
+}
+
+// The tokens a URL matching |pattern| is certain to contain: runs of token
+// characters bounded on both sides by a literal or an anchor, not by '*'.
+static std::vector<std::string> pattern_tokens(const std::string& pattern,
+                                               uint32_t flags) {
+  std::vector<std::string> tokens;
+  const std::string lower = to_lower(pattern);
+  for (size_t i = 0; i < lower.size();) {
+    if (!filter_is_token_char(lower[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < lower.size() && filter_is_token_char(lower[i])) {
+      i++;
+    }
+    bool bounded_left = start > 0
+                            ? lower[start - 1] != '*'
+                            : (flags & (kRuleAnchorStart | kRuleAnchorHost));
+    bool bounded_right =
+        i < lower.size() ? lower[i] != '*' : (flags & kRuleAnchorEnd);
+    if (bounded_left && bounded_right) {
+      tokens.push_back(lower.substr(start, i - start));
+    }
+  }
+  return tokens;
+}
+
+static uint32_t next_power_of_two(uint32_t value) {
+  uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// Accumulates the string section, storing each distinct string once.
+class StringPool {
+ public:
+  uint32_t Add(const std::string& text) {
+    auto found = offsets_.find(text);
+    if (found != offsets_.end()) {
+      return found->second;
+    }
+    uint32_t offset = static_cast<uint32_t>(data_.size());
+    data_ += text;
+    offsets_.emplace(text, offset);
+    return offset;
+  }
+
+  const std::string& data() const { return data_; }
+
+ private:
+  std::string data_;
+  std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+void FilterCompiler::AddList(const char* text, size_t length) {
+  const char* end = text + length;
+  for (const char* line = text; line < end;) {
+    const char* line_end =
+        static_cast<const char*>(memchr(line, '\n', end - line));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    AddLine(line, line_end - line);
+    line = line_end + 1;
+  }
+}
+
+void FilterCompiler::AddLine(const char* line, size_t length) {
+  while (length > 0 && g_ascii_isspace(*line)) {
+    line++;
+    length--;
+  }
+  while (length > 0 && g_ascii_isspace(line[length - 1])) {
+    length--;
+  }
+  if (length == 0 || line[0] == '!' || line[0] == '[') {
+    return;
+  }
+  const std::string text(line, length);
+
+  size_t marker = text.find('#');
+  while (marker != std::string::npos &&
+         !(text.compare(marker, 2, "##") == 0 ||
+           text.compare(marker, 3, "#@#") == 0 ||
+           text.compare(marker, 3, "#?#") == 0 ||
+           text.compare(marker, 3, "#$#") == 0 ||
+           text.compare(marker, 3, "#%#") == 0 ||
+           text.compare(marker, 2, "#@") == 0)) {
+    marker = text.find('#', marker + 1);
+  }
+  bool supported;
+  if (marker != std::string::npos) {
+    supported = AddCosmeticRule(text, marker);
+  } else if (text[0] == '#') {
+    // A hosts-file comment.
+    return;
+  } else if (starts_with(text, "0.0.0.0") || starts_with(text, "127.0.0.1") ||
+             starts_with(text, "::")) {
+    supported = AddHostsLine(text);
+  } else {
+    supported = AddNetworkRule(text);
+  }
+  if (!supported) {
+    stats_.unsupported_rules++;
+  }
+}
+
+// "0.0.0.0 host [host...] [# comment]".
+bool FilterCompiler::AddHostsLine(const std::string& line) {
+  g_auto(GStrv) fields = g_strsplit_set(line.c_str(), " \t", -1);
+  for (gchar** field = fields + 1; *field != nullptr; field++) {
+    if (**field == '#') {
+      break;
+    }
+    std::string host = to_lower(*field);
+    if (host.empty() || host == "localhost" || host == "local" ||
+        host == "broadcasthost" || host == "0.0.0.0" || !is_host(host)) {
+      continue;
+    }
+    rules_.push_back(NetworkRule{host + "^", std::string(),
+                                 FILTER_REQUEST_DEFAULT, kRuleAnchorHost,
+                                 true});
+    AddHost(host, static_cast<uint32_t>(rules_.size() - 1));
+  }
+  return true;
+}
+
+bool FilterCompiler::AddNetworkRule(const std::string& line) {
+  NetworkRule rule = {std::string(), std::string(), 0, 0, false};
+  std::string pattern = line;
+  if (starts_with(pattern, "@@")) {
+    rule.flags |= kRuleException;
+    pattern.erase(0, 2);
+  }
+
+  uint32_t types = 0;
+  uint32_t excluded_types = 0;
+  size_t dollar = pattern.rfind('$');
+  if (dollar != std::string::npos) {
+    for (const std::string& option : split(pattern.substr(dollar + 1), ',')) {
+      std::string name = to_lower(option);
+      std::string value;
+      size_t equals = name.find('=');
+      if (equals != std::string::npos) {
+        value = option.substr(equals + 1);
+        name.erase(equals);
+      }
+      bool negated = !name.empty() && name[0] == '~';
+      if (negated) {
+        name.erase(0, 1);
+      }
+
+      const TypeOption* type_option = nullptr;
+      for (const TypeOption& candidate : kTypeOptions) {
+        if (name == candidate.name) {
+          type_option = &candidate;
+        }
+      }
+      if (type_option != nullptr && value.empty()) {
+        (negated ? excluded_types : types) |= type_option->types;
+      } else if (name == "third-party" || name == "3p") {
+        rule.flags |= negated ? kRuleFirstParty : kRuleThirdParty;
+      } else if (name == "first-party" || name == "1p") {
+        rule.flags |= negated ? kRuleThirdParty : kRuleFirstParty;
+      } else if (name == "important" && !negated) {
+        rule.flags |= kRuleImportant;
+      } else if (name == "match-case" && !negated) {
+        rule.flags |= kRuleMatchCase;
+      } else if ((name == "domain" || name == "from") && !value.empty()) {
+        rule.domains = to_lower(value);
+        if (rule.domains.find('*') != std::string::npos) {
+          // Entity matching ("example.*") needs the public suffix list.
+          return false;
+        }
+      } else if (name == "redirect") {
+        // uBlock substitutes a neutered resource; blocking is close enough.
+      } else {
+        // $csp, $removeparam, $popup and the like change what a rule does
+        // rather than where it applies; blocking instead would be wrong.
+        return false;
+      }
+    }
+    pattern.erase(dollar);
+  }
+  if ((rule.flags & kRuleThirdParty) && (rule.flags & kRuleFirstParty)) {
+    return false;
+  }
+  rule.types = (types ? types : FILTER_REQUEST_DEFAULT) & ~excluded_types;
+  if (rule.types == 0) {
+    return false;
+  }
+
+  if (pattern.size() > 1 && pattern.front() == '/' && pattern.back() == '/') {
+    // Regular expressions.
+    return false;
+  }
+  if (starts_with(pattern, "||")) {
+    rule.flags |= kRuleAnchorHost;
+    pattern.erase(0, 2);
+  } else if (starts_with(pattern, "|")) {
+    rule.flags |= kRuleAnchorStart;
+    pattern.erase(0, 1);
+  }
+  if (!pattern.empty() && pattern.back() == '|') {
+    rule.flags |= kRuleAnchorEnd;
+    pattern.pop_back();
+  }
+  // A wildcard next to an anchor cancels it.
+  if (!pattern.empty() && pattern.front() == '*') {
+    rule.flags &= ~(kRuleAnchorStart | kRuleAnchorHost);
+  }
+  if (!pattern.empty() && pattern.back() == '*') {
+    rule.flags &= ~kRuleAnchorEnd;
+  }
+  auto double_star = [](char a, char b) { return a == '*' && b == '*'; };
+  pattern.erase(std::unique(pattern.begin(), pattern.end(), double_star),
+                pattern.end());
+  while (!pattern.empty() && pattern.front() == '*') {
+    pattern.erase(0, 1);
+  }
+  while (!pattern.empty() && pattern.back() == '*') {
+    pattern.pop_back();
+  }
+  if (pattern.find('|') != std::string::npos) {
+    return false;
+  }
+  rule.pattern = rule.flags & kRuleMatchCase ? pattern : to_lower(pattern);
+
+  const bool host_only =
+      rule.flags == kRuleAnchorHost && rule.domains.empty() &&
+      rule.types == FILTER_REQUEST_DEFAULT && rule.pattern.size() > 1 &&
+      rule.pattern.back() == '^' &&
+      is_host(rule.pattern.substr(0, rule.pattern.size() - 1));
+  rule.in_trie = host_only;
+  rules_.push_back(std::move(rule));
+  if (host_only) {
+    const std::string& stored = rules_.back().pattern;
+    AddHost(stored.substr(0, stored.size() - 1),
+            static_cast<uint32_t>(rules_.size() - 1));
+  } else {
+    stats_.network_rules++;
+  }
+  return true;
+}
+
+// Files |rule| under |host| in the host trie, or, for a host the trie
+// cannot hold such as one with an empty label, leaves it to the tables.
+void FilterCompiler::AddHost(const std::string& host, uint32_t rule) {
+  if (hosts_.Add(host.data(), host.size(), rule)) {
+    stats_.host_rules++;
+  } else {
+    rules_[rule].in_trie = false;
+    stats_.network_rules++;
+  }
+}
+
+bool FilterCompiler::AddCosmeticRule(const std::string& line, size_t marker) {
+  bool exception;
+  size_t selector_start;
+  if (line.compare(marker, 2, "##") == 0) {
+    exception = false;
+    selector_start = marker + 2;
+  } else if (line.compare(marker, 3, "#@#") == 0) {
+    exception = true;
+    selector_start = marker + 3;
+  } else {
+    // Extended syntax: #?#, #$#, #%# and their exceptions.
+    return false;
+  }
+
+  std::string selector = line.substr(selector_start);
+  if (selector.empty() || selector[0] == '+' || selector[0] == '^') {
+    // Scriptlets and HTML filters.
+    return false;
+  }
+  for (const char* op : kProceduralOperators) {
+    if (selector.find(op) != std::string::npos) {
+      return false;
+    }
+  }
+
+  std::vector<std::string> included;
+  std::vector<std::string> excluded;
+  if (marker > 0) {
+    for (std::string domain : split(to_lower(line.substr(0, marker)), ',')) {
+      bool negated = !domain.empty() && domain[0] == '~';
+      if (negated) {
+        domain.erase(0, 1);
+      }
+      if (!is_host(domain)) {
+        return false;
+      }
+      (negated ? excluded : included).push_back(std::move(domain));
+    }
+  }
+
+  stats_.cosmetic_rules++;
+  if (exception) {
+    if (included.empty()) {
+      generic_exceptions_.insert(selector);
+    }
+    for (const std::string& domain : included) {
+      specific_.push_back(CosmeticRule{domain, selector, kCosmeticException});
+    }
+    return true;
+  }
+
+  if (included.empty()) {
+    generic_selectors_.insert(selector);
+  }
+  for (const std::string& domain : included) {
+    specific_.push_back(CosmeticRule{domain, selector, 0});
+  }
+  for (const std::string& domain : excluded) {
+    specific_.push_back(CosmeticRule{domain, selector, kCosmeticException});
+  }
+  return true;
+}
+
+std::string FilterCompiler::Build(uint64_t source_stamp) {
+  StringPool strings;
+  std::vector<FilterRule> rules;
+  rules.reserve(rules_.size());
+  for (const NetworkRule& rule : rules_) {
+    rules.push_back(FilterRule{strings.Add(rule.pattern),
+                               static_cast<uint32_t>(rule.pattern.size()),
+                               strings.Add(rule.domains),
+                               static_cast<uint32_t>(rule.domains.size()),
+                               rule.types, rule.flags});
+  }
+
+  // Each rule is filed under its rarest token, so buckets stay short.
+  std::vector<std::vector<std::string>> rule_tokens(rules_.size());
+  std::unordered_map<std::string, uint32_t> token_counts;
+  for (size_t id = 0; id < rules_.size(); id++) {
+    if (rules_[id].in_trie) {
+      continue;
+    }
+    rule_tokens[id] = pattern_tokens(rules_[id].pattern, rules_[id].flags);
+    for (const std::string& token : rule_tokens[id]) {
+      token_counts[token]++;
+    }
+  }
+  for (const char* token : kCommonTokens) {
+    token_counts[token] += 1 << 20;
+  }
+
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> tokenized(
+      kTableCount);
+  std::vector<std::vector<uint32_t>> untokenized(kTableCount);
+  for (uint32_t id = 0; id < rules_.size(); id++) {
+    if (rules_[id].in_trie) {
+      continue;
+    }
+    const uint32_t flags = rules_[id].flags;
+    FilterTable table = flags & kRuleException   ? kTableAllow
+                        : flags & kRuleImportant ? kTableImportant
+                                                 : kTableBlock;
+    const std::string* best = nullptr;
+    for (const std::string& token : rule_tokens[id]) {
+      if (best == nullptr || token_counts[token] < token_counts[*best] ||
+          (token_counts[token] == token_counts[*best] &&
+           token.size() > best->size())) {
+        best = &token;
+      }
+    }
+    if (best == nullptr) {
+      untokenized[table].push_back(id);
+    } else {
+      tokenized[table].emplace_back(
+          filter_token_hash(best->data(), best->size()), id);
+    }
+  }
+
+  std::vector<std::vector<uint32_t>> table_sections(kTableCount *
+                                                    kTableSectionCount);
+  for (uint32_t t = 0; t < kTableCount; t++) {
+    auto& entries = tokenized[t];
+    std::vector<uint32_t>& buckets =
+        table_sections[t * kTableSectionCount + kTableBuckets];
+    std::vector<uint32_t>& ids =
+        table_sections[t * kTableSectionCount + kTableIds];
+    table_sections[t * kTableSectionCount + kTableUntokenized] =
+        untokenized[t];
+    if (entries.empty()) {
+      continue;
+    }
+
+    std::vector<uint32_t> hashes;
+    for (const auto& entry : entries) {
+      hashes.push_back(entry.first);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    uint32_t distinct = static_cast<uint32_t>(
+        std::unique(hashes.begin(), hashes.end()) - hashes.begin());
+    const uint32_t bucket_count = next_power_of_two(distinct * 2);
+
+    // Counting sort by bucket, keeping rule order within a bucket.
+    buckets.assign(bucket_count + 1, 0);
+    for (const auto& entry : entries) {
+      buckets[(entry.first & (bucket_count - 1)) + 1]++;
+    }
+    for (uint32_t b = 0; b < bucket_count; b++) {
+      buckets[b + 1] += buckets[b];
+    }
+    std::vector<uint32_t> cursor(buckets.begin(), buckets.end() - 1);
+    ids.resize(entries.size());
+    for (const auto& entry : entries) {
+      ids[cursor[entry.first & (bucket_count - 1)]++] = entry.second;
+    }
+  }
+
+  const std::string host_trie = hosts_.Build();
+
+  std::vector<FilterCosmetic> generic;
+  for (const std::string& selector : generic_selectors_) {
+    if (generic_exceptions_.count(selector) == 0) {
+      generic.push_back(FilterCosmetic{
+          0, 0, strings.Add(selector),
+          static_cast<uint32_t>(selector.size()), 0, 0});
+    }
+  }
+  std::sort(specific_.begin(), specific_.end(),
+            [](const CosmeticRule& a, const CosmeticRule& b) {
+              return a.domain < b.domain;
+            });
+  std::vector<FilterCosmetic> specific;
+  for (const CosmeticRule& rule : specific_) {
+    specific.push_back(FilterCosmetic{
+        strings.Add(rule.domain), static_cast<uint32_t>(rule.domain.size()),
+        strings.Add(rule.selector),
+        static_cast<uint32_t>(rule.selector.size()), rule.flags, 0});
+  }
+
+  FilterIndexHeader header = {};
+  memcpy(header.magic, kFilterIndexMagic, sizeof(header.magic));
+  header.version = kFilterIndexVersion;
+  header.section_count = kSectionCount;
+  header.source_stamp = source_stamp;
+  header.rule_count = static_cast<uint32_t>(rules.size());
+  header.cosmetic_count = static_cast<uint32_t>(generic.size() +
+                                                specific.size());
+
+  std::string file(sizeof(header), '\0');
+  auto append = [&file, &header](FilterSection section, const void* data,
+                                 size_t size) {
+    file.resize((file.size() + 7) & ~static_cast<size_t>(7), '\0');
+    header.sections[section].offset = file.size();
+    header.sections[section].size = size;
+    file.append(static_cast<const char*>(data), size);
+  };
+  append(kSectionStrings, strings.data().data(), strings.data().size());
+  append(kSectionRules, rules.data(), rules.size() * sizeof(FilterRule));
+  for (uint32_t s = 0; s < table_sections.size(); s++) {
+    append(static_cast<FilterSection>(kSectionTables + s),
+           table_sections[s].data(),
+           table_sections[s].size() * sizeof(uint32_t));
+  }
+  append(kSectionHostTrie, host_trie.data(), host_trie.size());
+  append(kSectionCosmeticGeneric, generic.data(),
+         generic.size() * sizeof(FilterCosmetic));
+  append(kSectionCosmeticSpecific, specific.data(),
+         specific.size() * sizeof(FilterCosmetic));
+
+  header.file_size = file.size();
+  memcpy(&file[0], &header, sizeof(header));
+  return file;
+}
+
+bool FilterCompiler::Write(const gchar* path, uint64_t source_stamp,
+                           GError** error) {
+  std::string file = Build(source_stamp);
+  return g_file_set_contents(path, file.data(), file.size(), error);
+}
@@ -0,0 +1,75 @@
+#ifndef RUNNER_FILTER_COMPILER_H_
+#define RUNNER_FILTER_COMPILER_H_
+
+#include <glib.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "filter_format.h"
+#include "host_trie.h"
+
+struct FilterCompileStats {
+  uint32_t network_rules;
+  // "||host^" rules and hosts-file entries, matched through the host trie.
+  uint32_t host_rules;
+  uint32_t cosmetic_rules;
+  // Lines in a syntax the index cannot express: regular expressions,
+  // scriptlets, procedural cosmetic filters and options such as $csp or
+  // $removeparam. They are skipped.
+  uint32_t unsupported_rules;
+};
+
+// Compiles Adblock Plus / uBlock Origin filter lists, and hosts files, into
+// the index format of filter_format.h. Supported are network rules with
+// '*', '^', '|' and '||', the options $third-party, $first-party, $domain,
+// $important, $match-case and the request type options, "@@" exceptions,
+// and element hiding rules ("##" and "#@#").
+class FilterCompiler {
+ public:
+  FilterCompiler() = default;
+  FilterCompiler(const FilterCompiler&) = delete;
+  FilterCompiler& operator=(const FilterCompiler&) = delete;
+
+  // Adds the rules of one list. May be called once per list.
+  void AddList(const char* text, size_t length);
+
+  // Writes the index atomically, replacing any file at |path|.
+  bool Write(const gchar* path, uint64_t source_stamp, GError** error);
+
+  const FilterCompileStats& stats() const { return stats_; }
+
+ private:
+  struct NetworkRule {
+    std::string pattern;
+    std::string domains;
+    uint32_t types;
+    uint32_t flags;
+    // Matched through the host trie rather than a token table.
+    bool in_trie;
+  };
+  struct CosmeticRule {
+    std::string domain;
+    std::string selector;
+    uint32_t flags;
+  };
+
+  void AddLine(const char* line, size_t length);
+  bool AddHostsLine(const std::string& line);
+  bool AddNetworkRule(const std::string& line);
+  bool AddCosmeticRule(const std::string& line, size_t marker);
+  void AddHost(const std::string& host, uint32_t rule);
+
+  std::string Build(uint64_t source_stamp);
+
+  std::vector<NetworkRule> rules_;
+  // Hosts to their rules; a host listed twice keeps its first rule.
+  HostTrieBuilder hosts_;
+  std::set<std::string> generic_selectors_;
+  std::set<std::string> generic_exceptions_;
+  std::vector<CosmeticRule> specific_;
+  FilterCompileStats stats_ = {};
+};
+
+#endif  // RUNNER_FILTER_COMPILER_H_
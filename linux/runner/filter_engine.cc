@@ -0,0 +1,331 @@
+#include "filter_engine.h"
+
+#include <glib/gstdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filter_compiler.h"
+#include "filter_index.h"
+
+// Editors save a list as several events; compile once they have settled.
+static constexpr guint kReloadDelayMs = 500;
+
+struct _FilterEngine {
+  GObject parent_instance;
+
+  gchar* lists_dir;
+  gchar* index_path;
+  GFileMonitor* monitor;
+  guint reload_source;
+  GCancellable* cancellable;
+  // Source stamp of the installed index, 0 if none is installed.
+  guint64 installed_stamp;
+  gboolean compiling;
+  // The lists changed again while |compiling|.
+  gboolean reload_pending;
+};
+
+G_DEFINE_TYPE(FilterEngine, filter_engine, G_TYPE_OBJECT)
+
+// The index behind the filter_engine_* functions. Callers take a reference
+// for the length of one call, so a reload never unmaps an index in use.
+static std::shared_ptr<const FilterIndex> active_index;
+static std::atomic<uint64_t> active_generation{0};
+
+typedef std::shared_ptr<const FilterIndex> IndexRef;
+
+struct CompileJob {
+  std::vector<std::string> paths;
+  guint64 stamp;
+  gchar* index_path;
+};
+
+static void compile_job_free(gpointer data) {
+  CompileJob* job = static_cast<CompileJob*>(data);
+  g_free(job->index_path);
+  delete job;
+}
+
+static void index_ref_free(gpointer data) {
+  delete static_cast<IndexRef*>(data);
+}
+
+static void install(FilterEngine* self, IndexRef index) {
+  self->installed_stamp = index ? index->source_stamp() : 0;
+  std::atomic_store(&active_index, std::move(index));
+  active_generation++;
+}
+
+// The list files in |directory|, sorted so the stamp does not depend on
+// directory order.
+static std::vector<std::string> list_files(const gchar* directory) {
+  std::vector<std::string> paths;
+  g_autoptr(GDir) dir = g_dir_open(directory, 0, nullptr);
+  if (dir == nullptr) {
+    return paths;
+  }
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    if (g_str_has_suffix(name, ".txt")) {
+      g_autofree gchar* path = g_build_filename(directory, name, nullptr);
+      paths.push_back(path);
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Identifies a set of lists by name, size and modification time, so a
+// cached index can be reused without reading them. 0 means no lists.
+static guint64 lists_stamp(const std::vector<std::string>& paths) {
+  guint64 stamp = 14695981039346656037u;
+  auto mix = [&stamp](const void* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+      stamp ^= static_cast<const guint8*>(data)[i];
+      stamp *= 1099511628211u;
+    }
+  };
+  guint count = 0;
+  for (const std::string& path : paths) {
+    GStatBuf info;
+    if (g_stat(path.c_str(), &info) != 0) {
+      continue;
+    }
+    gint64 values[] = {static_cast<gint64>(info.st_size),
+                       static_cast<gint64>(info.st_mtim.tv_sec),
+                       static_cast<gint64>(info.st_mtim.tv_nsec)};
+    mix(path.c_str(), path.size() + 1);
+    mix(values, sizeof(values));
+    count++;
+  }
+  return count > 0 ? MAX(stamp, 1) : 0;
+}
+
+static void compile_thread(GTask* task, gpointer source_object,
+                           gpointer task_data, GCancellable* cancellable) {
+  CompileJob* job = static_cast<CompileJob*>(task_data);
+  gint64 start = g_get_monotonic_time();
+
+  FilterCompiler compiler;
+  for (const std::string& path : job->paths) {
+    g_autofree gchar* text = nullptr;
+    gsize length = 0;
+    g_autoptr(GError) error = nullptr;
+    if (!g_file_get_contents(path.c_str(), &text, &length, &error)) {
+      g_warning("Skipping filter list: %s", error->message);
+      continue;
+    }
+    compiler.AddList(text, length);
+  }
+
+  g_autofree gchar* directory = g_path_get_dirname(job->index_path);
+  g_mkdir_with_parents(directory, 0700);
+  GError* error = nullptr;
+  if (!compiler.Write(job->index_path, job->stamp, &error)) {
+    g_task_return_error(task, error);
+    return;
+  }
+  std::unique_ptr<FilterIndex> index = FilterIndex::Open(job->index_path,
+                                                         &error);
+  if (!index) {
+    g_task_return_error(task, error);
+    return;
+  }
+
+  const FilterCompileStats& stats = compiler.stats();
+  g_debug("Compiled %zu filter lists in %" G_GINT64_FORMAT " ms: %u network, "
+          "%u host, %u cosmetic rules, %u unsupported, %zu bytes",
+          job->paths.size(), (g_get_monotonic_time() - start) / 1000,
+          stats.network_rules, stats.host_rules, stats.cosmetic_rules,
+          stats.unsupported_rules, index->size());
+  g_task_return_pointer(task, new IndexRef(std::move(index)), index_ref_free);
+}
+
+static void reload(FilterEngine* self);
+
+static void compile_done(GObject* source_object, GAsyncResult* result,
+                         gpointer user_data) {
+  g_autoptr(GError) error = nullptr;
+  IndexRef* index = static_cast<IndexRef*>(
+      g_task_propagate_pointer(G_TASK(result), &error));
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    return;
+  }
+
+  FilterEngine* self = FILTER_ENGINE(source_object);
+  self->compiling = FALSE;
+  if (index != nullptr) {
+    install(self, *index);
+    index_ref_free(index);
+  } else {
+    g_warning("Failed to compile filter lists: %s", error->message);
+  }
+
+  if (self->reload_pending) {
+    self->reload_pending = FALSE;
+    reload(self);
+  }
+}
+
+static void compile(FilterEngine* self, std::vector<std::string> paths,
+                    guint64 stamp) {
+  if (self->compiling) {
+    self->reload_pending = TRUE;
+    return;
+  }
+  self->compiling = TRUE;
+
+  CompileJob* job = new CompileJob{std::move(paths), stamp,
+                                   g_strdup(self->index_path)};
+  g_autoptr(GTask) task = g_task_new(self, self->cancellable, compile_done,
+                                     nullptr);
+  g_task_set_return_on_cancel(task, TRUE);
+  g_task_set_task_data(task, job, compile_job_free);
+  g_task_run_in_thread(task, compile_thread);
+}
+
+// Brings the installed index in line with the lists on disk.
+static void reload(FilterEngine* self) {
+  std::vector<std::string> paths = list_files(self->lists_dir);
+  guint64 stamp = lists_stamp(paths);
+  if (stamp == self->installed_stamp) {
+    return;
+  }
+  if (stamp == 0) {
+    install(self, nullptr);
+    return;
+  }
+  compile(self, std::move(paths), stamp);
+}
+
+static gboolean reload_cb(gpointer user_data) {
+  FilterEngine* self = FILTER_ENGINE(user_data);
+  self->reload_source = 0;
+  reload(self);
+  return G_SOURCE_REMOVE;
+}
+
+static void lists_changed_cb(GFileMonitor* monitor, GFile* file,
+                             GFile* other_file, GFileMonitorEvent event,
+                             gpointer user_data) {
+  FilterEngine* self = FILTER_ENGINE(user_data);
+  if (self->reload_source != 0) {
+    g_source_remove(self->reload_source);
+  }
+  self->reload_source = g_timeout_add(kReloadDelayMs, reload_cb, self);
+}
+
+static void filter_engine_dispose(GObject* object) {
+  FilterEngine* self = FILTER_ENGINE(object);
+
+  if (self->cancellable != nullptr) {
+    g_cancellable_cancel(self->cancellable);
+    g_clear_object(&self->cancellable);
+    install(self, nullptr);
+  }
+  if (self->reload_source != 0) {
+    g_source_remove(self->reload_source);
+    self->reload_source = 0;
+  }
+  if (self->monitor != nullptr) {
+    g_signal_handlers_disconnect_by_data(self->monitor, self);
+    g_clear_object(&self->monitor);
+  }
+  g_clear_pointer(&self->lists_dir, g_free);
+  g_clear_pointer(&self->index_path, g_free);
+
+  G_OBJECT_CLASS(filter_engine_parent_class)->dispose(object);
+}
+
+static void filter_engine_class_init(FilterEngineClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = filter_engine_dispose;
+}
+
+static void filter_engine_init(FilterEngine* self) {
+  self->cancellable = g_cancellable_new();
+}
+
+FilterEngine* filter_engine_new(const gchar* lists_dir,
+                                const gchar* index_path) {
+  FilterEngine* self = FILTER_ENGINE(
+      g_object_new(filter_engine_get_type(), nullptr));
+  self->lists_dir = g_strdup(lists_dir);
+  self->index_path = g_strdup(index_path);
+
+  if (g_mkdir_with_parents(self->lists_dir, 0700) != 0) {
+    g_warning("Failed to create %s: %s", self->lists_dir, g_strerror(errno));
+  }
+  g_autoptr(GFile) directory = g_file_new_for_path(self->lists_dir);
+  g_autoptr(GError) error = nullptr;
+  self->monitor = g_file_monitor_directory(directory, G_FILE_MONITOR_NONE,
+                                           nullptr, &error);
+  if (self->monitor != nullptr) {
+    g_signal_connect(self->monitor, "changed", G_CALLBACK(lists_changed_cb),
+                     self);
+  } else {
+    g_warning("Failed to watch %s: %s", self->lists_dir, error->message);
+  }
+
+  // Serve the cached index straight away, even if the lists have changed
+  // since it was compiled; reload() replaces it once the new one is ready.
+  std::vector<std::string> paths = list_files(self->lists_dir);
+  if (lists_stamp(paths) != 0) {
+    std::unique_ptr<FilterIndex> cached =
+        FilterIndex::Open(self->index_path, nullptr);
+    if (cached) {
+      install(self, std::move(cached));
+    }
+  }
+  reload(self);
+
+  return self;
+}
+
+FilterEngine* filter_engine_new_default() {
+  g_autofree gchar* lists_dir = g_build_filename(
+      g_get_user_config_dir(), "youtube_music_unbound", "filters", nullptr);
+  g_autofree gchar* index_path = g_build_filename(
+      g_get_user_cache_dir(), "youtube_music_unbound", "filters.idx",
+      nullptr);
+  return filter_engine_new(lists_dir, index_path);
+}
+
+int32_t filter_engine_match(const char* url, size_t url_length,
+                            const char* document_host, uint32_t type) {
+  IndexRef index = std::atomic_load(&active_index);
+  if (!index || url == nullptr) {
+    return 0;
+  }
+  FilterVerdict verdict =
+      index->Match(FilterRequest{url, url_length, document_host, type});
+  switch (verdict.decision) {
+    case FilterDecision::kBlock:
+      return 1;
+    case FilterDecision::kAllow:
+      return -1;
+    case FilterDecision::kNone:
+      break;
+  }
+  return 0;
+}
+
+char* filter_engine_cosmetic_selectors(const char* host) {
+  IndexRef index = std::atomic_load(&active_index);
+  if (!index) {
+    return g_strdup("");
+  }
+  return g_strdup(index->CosmeticSelectors(host).c_str());
+}
+
+void filter_engine_free_string(char* string) {
+  g_free(string);
+}
+
+uint64_t filter_engine_generation(void) {
+  return active_generation.load();
+}
@@ -0,0 +1,94 @@
+#ifndef RUNNER_FILTER_ENGINE_H_
+#define RUNNER_FILTER_ENGINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Request classes used by $script, $image and the other type options.
+// Mirrored by lib/services/filter_lists.dart; keep in sync.
+typedef enum {
+  FILTER_REQUEST_DOCUMENT = 1 << 0,
+  FILTER_REQUEST_SUBDOCUMENT = 1 << 1,
+  FILTER_REQUEST_SCRIPT = 1 << 2,
+  FILTER_REQUEST_STYLESHEET = 1 << 3,
+  FILTER_REQUEST_IMAGE = 1 << 4,
+  FILTER_REQUEST_MEDIA = 1 << 5,
+  FILTER_REQUEST_FONT = 1 << 6,
+  FILTER_REQUEST_XHR = 1 << 7,
+  FILTER_REQUEST_WEBSOCKET = 1 << 8,
+  FILTER_REQUEST_PING = 1 << 9,
+  FILTER_REQUEST_OTHER = 1 << 10,
+} FilterRequestType;
+
+// Rules without type options apply to everything but documents.
+#define FILTER_REQUEST_DEFAULT 0x7FE
+#define FILTER_REQUEST_ALL 0x7FF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILTER_ENGINE_EXPORT __attribute__((visibility("default")))
+
+// Decides a request against the active filter lists. Returns 1 if a rule
+// blocks it, -1 if an exception rule allows it, and 0 if no rule applies
+// or no lists are loaded. |document_host| is the host of the page making
+// the request. Safe to call from any thread, including during a reload.
+FILTER_ENGINE_EXPORT int32_t filter_engine_match(const char* url,
+                                                 size_t url_length,
+                                                 const char* document_host,
+                                                 uint32_t type);
+
+// Returns the element hiding selectors for pages on |host|, one per line,
+// to be released with filter_engine_free_string.
+FILTER_ENGINE_EXPORT char* filter_engine_cosmetic_selectors(const char* host);
+
+FILTER_ENGINE_EXPORT void filter_engine_free_string(char* string);
+
+// Incremented each time a new index is installed.
+FILTER_ENGINE_EXPORT uint64_t filter_engine_generation(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#ifdef __cplusplus
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define FILTER_TYPE_ENGINE filter_engine_get_type()
+G_DECLARE_FINAL_TYPE(FilterEngine, filter_engine, FILTER, ENGINE, GObject)
+
+G_END_DECLS
+
+/**
+ * filter_engine_new:
+ * @lists_dir: directory of ABP/uBlock list files (*.txt).
+ * @index_path: where the compiled index is cached.
+ *
+ * Maps the cached index if there is one, so matching is available at once,
+ * and recompiles it on a worker thread if the lists have changed since.
+ * The lists directory is then monitored and every change is compiled and
+ * swapped in atomically. The engine serves the filter_engine_* functions
+ * until it is disposed; create at most one.
+ *
+ * Returns: a new #FilterEngine.
+ */
+FilterEngine* filter_engine_new(const gchar* lists_dir,
+                                const gchar* index_path);
+
+/**
+ * filter_engine_new_default:
+ *
+ * Creates an engine over $XDG_CONFIG_HOME/youtube_music_unbound/filters,
+ * caching the index under $XDG_CACHE_HOME/youtube_music_unbound.
+ *
+ * Returns: a new #FilterEngine.
+ */
+FilterEngine* filter_engine_new_default();
+
+#endif  // __cplusplus
+
+#endif  // RUNNER_FILTER_ENGINE_H_
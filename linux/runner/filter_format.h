@@ -0,0 +1,139 @@
+#ifndef RUNNER_FILTER_FORMAT_H_
+#define RUNNER_FILTER_FORMAT_H_
+
+#include <stdint.h>
+
+#include <type_traits>
+
+// On-disk layout of a compiled filter index, written by FilterCompiler and
+// memory-mapped by FilterIndex. Every structure is used in place, so they
+// are plain little-endian PODs at 4-byte aligned offsets from the start of
+// the file. Bump kFilterIndexVersion on any change; readers reject other
+// versions and the index is recompiled from the lists.
+
+constexpr char kFilterIndexMagic[8] = {'Y', 'T', 'M', 'U', 'F', 'L', 'T', 0};
+constexpr uint32_t kFilterIndexVersion = 2;
+constexpr uint32_t kFilterNoRule = UINT32_MAX;
+
+// Network rules are kept in three tables, consulted in this order:
+// important rules block outright, then block rules are checked against
+// allow (exception) rules.
+enum FilterTable : uint32_t {
+  kTableImportant,
+  kTableBlock,
+  kTableAllow,
+  kTableCount,
+};
+
+// A table's rules are bucketed by the hash of one token of their pattern
+// (a run of [a-z0-9%]) that any matching URL must contain. Its sections
+// are a power-of-two bucket array of rule id offsets (bucket_count + 1
+// entries), the rule ids themselves, and the ids of rules with no usable
+// token, which are checked for every URL.
+enum FilterTableSection : uint32_t {
+  kTableBuckets,
+  kTableIds,
+  kTableUntokenized,
+  kTableSectionCount,
+};
+
+enum FilterSection : uint32_t {
+  // Rule patterns, domain lists and selectors.
+  kSectionStrings,
+  // FilterRule[].
+  kSectionRules,
+  // kTableCount * kTableSectionCount uint32_t arrays; see FilterTable.
+  kSectionTables,
+  // A HostTrie (see host_trie.h) mapping hosts to rule ids. Rules that
+  // are just "||host^", and hosts-file entries, are looked up by host
+  // instead of by token.
+  kSectionHostTrie = kSectionTables + kTableCount * kTableSectionCount,
+  // FilterCosmetic[]: selectors hidden on every site.
+  kSectionCosmeticGeneric,
+  // FilterCosmetic[] sorted by domain: selectors hidden, or exempted
+  // from hiding, on a domain and its subdomains.
+  kSectionCosmeticSpecific,
+  kSectionCount,
+};
+
+struct FilterSectionRange {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct FilterIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  uint64_t file_size;
+  // Identifies the list files the index was compiled from; see
+  // filter_engine.cc.
+  uint64_t source_stamp;
+  uint32_t rule_count;
+  uint32_t cosmetic_count;
+  FilterSectionRange sections[kSectionCount];
+};
+
+enum FilterRuleFlags : uint32_t {
+  kRuleAnchorStart = 1 << 0,
+  kRuleAnchorEnd = 1 << 1,
+  kRuleAnchorHost = 1 << 2,
+  kRuleException = 1 << 3,
+  kRuleImportant = 1 << 4,
+  kRuleMatchCase = 1 << 5,
+  kRuleThirdParty = 1 << 6,
+  kRuleFirstParty = 1 << 7,
+};
+
+struct FilterRule {
+  // Pattern without anchors or options, lower-cased unless kRuleMatchCase.
+  // '*' and '^' keep their ABP meaning.
+  uint32_t pattern_offset;
+  uint32_t pattern_length;
+  // The $domain= list as written, '|'-separated with '~' for exclusions.
+  uint32_t domains_offset;
+  uint32_t domains_length;
+  // FilterRequestType bits the rule applies to.
+  uint32_t types;
+  uint32_t flags;
+};
+
+enum FilterCosmeticFlags : uint32_t {
+  kCosmeticException = 1 << 0,
+};
+
+struct FilterCosmetic {
+  uint32_t domain_offset;
+  uint32_t domain_length;
+  uint32_t selector_offset;
+  uint32_t selector_length;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<FilterIndexHeader>::value &&
+                  sizeof(FilterIndexHeader) % 8 == 0,
+              "FilterIndexHeader must be usable in place");
+static_assert(sizeof(FilterRule) == 24, "FilterRule layout changed");
+static_assert(sizeof(FilterCosmetic) == 24, "FilterCosmetic layout changed");
+
+constexpr uint32_t filter_table_section(FilterTable table,
+                                        FilterTableSection section) {
+  return kSectionTables + table * kTableSectionCount + section;
+}
+
+// FNV-1a, used for token buckets by both the compiler and the reader.
+inline uint32_t filter_token_hash(const char* token, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(token[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+inline bool filter_is_token_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+}
+
+#endif  // RUNNER_FILTER_FORMAT_H_
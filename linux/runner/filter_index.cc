@@ -0,0 +1,572 @@
+#include "filter_index.h"
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "filter_engine.h"
+
+// Per-request state shared by the three tables and the host trie.
+struct FilterIndex::MatchContext {
+  const char* url;
+  // |url| with ASCII lower-cased, for rules without $match-case.
+  const char* lower;
+  size_t length;
+  // The URL's host, without user info or port, as offsets into |url|.
+  size_t host_start;
+  size_t host_end;
+  const char* document_host;
+  size_t document_host_length;
+  // Unknown without a document host; party options then never apply.
+  bool party_known;
+  bool third_party;
+  uint32_t type;
+  // Distinct token hashes of |lower|.
+  const std::vector<uint32_t>* tokens;
+};
+
+static thread_local std::string lower_buffer;
+static thread_local std::vector<uint32_t> token_buffer;
+
+static inline char to_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// ABP's '^': anything but a letter, digit or one of "_-.%". The end of the
+// URL also matches; see match_here.
+static inline bool is_separator(char c) {
+  return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' ||
+           c == '%');
+}
+
+static bool equals(const char* a, size_t a_length, const char* b,
+                   size_t b_length) {
+  return a_length == b_length && memcmp(a, b, a_length) == 0;
+}
+
+// Orders strings as std::string does, which is how the compiler sorted
+// them.
+static int compare(const char* a, size_t a_length, const char* b,
+                   size_t b_length) {
+  int result = memcmp(a, b, std::min(a_length, b_length));
+  if (result != 0) {
+    return result;
+  }
+  return a_length < b_length ? -1 : a_length > b_length ? 1 : 0;
+}
+
+// True if |host| is |domain| or a subdomain of it.
+static bool is_in_domain(const char* host, size_t host_length,
+                         const char* domain, size_t domain_length) {
+  if (host_length < domain_length) {
+    return false;
+  }
+  size_t offset = host_length - domain_length;
+  return memcmp(host + offset, domain, domain_length) == 0 &&
+         (offset == 0 || host[offset - 1] == '.');
+}
+
+// Matches |pattern| at the start of |text|. Unless |anchored_end|, the
+// pattern need only match a prefix. '*' backtracks to the most recent star
+// only, which is complete for patterns whose only metacharacters are '*'
+// and '^'.
+static bool match_here(const char* pattern, size_t pattern_length,
+                       const char* text, size_t text_length,
+                       bool anchored_end) {
+  size_t p = 0;
+  size_t t = 0;
+  size_t star_p = SIZE_MAX;
+  size_t star_t = 0;
+
+  while (true) {
+    if (p == pattern_length) {
+      if (!anchored_end || t == text_length) {
+        return true;
+      }
+    } else if (pattern[p] == '*') {
+      star_p = ++p;
+      star_t = t;
+      continue;
+    } else if (t < text_length &&
+               (pattern[p] == '^' ? is_separator(text[t])
+                                  : pattern[p] == text[t])) {
+      p++;
+      t++;
+      continue;
+    } else if (t == text_length && pattern[p] == '^') {
+      p++;
+      continue;
+    }
+
+    if (star_p == SIZE_MAX || star_t >= text_length) {
+      return false;
+    }
+    p = star_p;
+    t = ++star_t;
+  }
+}
+
+static bool match_pattern(const char* pattern, size_t pattern_length,
+                          uint32_t flags, const char* text, size_t length,
+                          size_t host_start, size_t host_end) {
+  const bool anchored_end = flags & kRuleAnchorEnd;
+
+  if (flags & kRuleAnchorStart) {
+    return match_here(pattern, pattern_length, text, length, anchored_end);
+  }
+
+  if (flags & kRuleAnchorHost) {
+    for (size_t start = host_start; start < host_end; start++) {
+      if ((start == host_start || text[start - 1] == '.') &&
+          match_here(pattern, pattern_length, text + start, length - start,
+                     anchored_end)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  if (pattern_length == 0) {
+    return true;
+  }
+  // Jump between occurrences of a literal first character.
+  const char first = pattern[0];
+  const bool literal = first != '^';
+  for (size_t start = 0; start <= length; start++) {
+    if (literal) {
+      const void* next = memchr(text + start, first, length - start);
+      if (next == nullptr) {
+        return false;
+      }
+      start = static_cast<const char*>(next) - text;
+    }
+    if (match_here(pattern, pattern_length, text + start, length - start,
+                   anchored_end)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The last two labels of |host|. Without a public suffix list this treats
+// e.g. "co.uk" as a site, which only makes party checks more lenient.
+static void site_of(const char* host, size_t length, const char** site,
+                    size_t* site_length) {
+  size_t dots = 0;
+  size_t start = length;
+  while (start > 0) {
+    if (host[start - 1] == '.' && ++dots == 2) {
+      break;
+    }
+    start--;
+  }
+  *site = host + start;
+  *site_length = length - start;
+}
+
+// Evaluates a $domain= list against the document host.
+static bool domains_apply(const char* domains, size_t length,
+                          const char* host, size_t host_length) {
+  if (length == 0) {
+    return true;
+  }
+  bool has_includes = false;
+  bool included = false;
+  size_t start = 0;
+  while (start < length) {
+    size_t end = start;
+    while (end < length && domains[end] != '|') {
+      end++;
+    }
+    const char* entry = domains + start;
+    size_t entry_length = end - start;
+    start = end + 1;
+    if (entry_length == 0) {
+      continue;
+    }
+
+    bool negated = entry[0] == '~';
+    if (negated) {
+      entry++;
+      entry_length--;
+    } else {
+      has_includes = true;
+    }
+    if (host == nullptr ||
+        !is_in_domain(host, host_length, entry, entry_length)) {
+      continue;
+    }
+    if (negated) {
+      return false;
+    }
+    included = true;
+  }
+  return !has_includes || included;
+}
+
+FilterIndex::FilterIndex(const uint8_t* data, size_t size)
+    : data_(data), size_(size) {
+  header_ = reinterpret_cast<const FilterIndexHeader*>(data_);
+}
+
+FilterIndex::~FilterIndex() {
+  munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+std::unique_ptr<FilterIndex> FilterIndex::Open(const gchar* path,
+                                               GError** error) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to open %s: %s", path, g_strerror(saved_errno));
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      info.st_size < static_cast<off_t>(sizeof(FilterIndexHeader))) {
+    close(fd);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a filter index", path);
+    return nullptr;
+  }
+
+  size_t size = info.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int saved_errno = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to map %s: %s", path, g_strerror(saved_errno));
+    return nullptr;
+  }
+  // Lookups touch a few scattered pages each; readahead would only fault
+  // in pages no lookup needs.
+  madvise(data, size, MADV_RANDOM);
+
+  std::unique_ptr<FilterIndex> index(
+      new FilterIndex(static_cast<const uint8_t*>(data), size));
+  if (!index->Validate(error)) {
+    g_prefix_error(error, "%s: ", path);
+    return nullptr;
+  }
+  return index;
+}
+
+// Checks the header and the section bounds. Offsets inside sections are
+// checked as they are used, so a damaged index can only fail lookups.
+bool FilterIndex::Validate(GError** error) {
+  if (memcmp(header_->magic, kFilterIndexMagic, sizeof(kFilterIndexMagic)) !=
+          0 ||
+      header_->version != kFilterIndexVersion ||
+      header_->section_count != kSectionCount ||
+      header_->file_size != size_) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Not a filter index of version %u", kFilterIndexVersion);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < kSectionCount; i++) {
+    const FilterSectionRange& range = header_->sections[i];
+    if (range.offset % 4 != 0 || range.offset > size_ ||
+        range.size > size_ - range.offset) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                  "Section %u is out of bounds", i);
+      return false;
+    }
+  }
+
+  size_t size;
+  strings_ = reinterpret_cast<const char*>(Section(kSectionStrings, &size));
+  strings_size_ = size;
+
+  rules_ = reinterpret_cast<const FilterRule*>(Section(kSectionRules, &size));
+  if (size % sizeof(FilterRule) != 0 ||
+      size / sizeof(FilterRule) != header_->rule_count) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Rule table does not match the rule count");
+    return false;
+  }
+
+  for (uint32_t t = 0; t < kTableCount; t++) {
+    FilterTable table_id = static_cast<FilterTable>(t);
+    Table& table = tables_[t];
+    size_t buckets_size, ids_size, untokenized_size;
+    table.buckets = reinterpret_cast<const uint32_t*>(Section(
+        static_cast<FilterSection>(filter_table_section(table_id,
+                                                        kTableBuckets)),
+        &buckets_size));
+    table.ids = reinterpret_cast<const uint32_t*>(Section(
+        static_cast<FilterSection>(filter_table_section(table_id, kTableIds)),
+        &ids_size));
+    table.untokenized = reinterpret_cast<const uint32_t*>(Section(
+        static_cast<FilterSection>(filter_table_section(table_id,
+                                                        kTableUntokenized)),
+        &untokenized_size));
+
+    size_t bucket_entries = buckets_size / sizeof(uint32_t);
+    table.bucket_count = bucket_entries > 0 ? bucket_entries - 1 : 0;
+    table.id_count = ids_size / sizeof(uint32_t);
+    table.untokenized_count = untokenized_size / sizeof(uint32_t);
+    if (buckets_size % sizeof(uint32_t) != 0 ||
+        (table.bucket_count & (table.bucket_count - 1)) != 0 ||
+        (bucket_entries == 1)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                  "Table %u has a malformed bucket array", t);
+      return false;
+    }
+  }
+
+  const uint8_t* host_trie = Section(kSectionHostTrie, &size);
+  if (!host_trie_.Attach(host_trie, size)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Host trie is malformed");
+    return false;
+  }
+  cosmetic_generic_ = reinterpret_cast<const FilterCosmetic*>(
+      Section(kSectionCosmeticGeneric, &size));
+  cosmetic_generic_count_ = size / sizeof(FilterCosmetic);
+  cosmetic_specific_ = reinterpret_cast<const FilterCosmetic*>(
+      Section(kSectionCosmeticSpecific, &size));
+  cosmetic_specific_count_ = size / sizeof(FilterCosmetic);
+  return true;
+}
+
+const uint8_t* FilterIndex::Section(FilterSection section,
+                                    size_t* size) const {
+  const FilterSectionRange& range = header_->sections[section];
+  *size = range.size;
+  return data_ + range.offset;
+}
+
+const char* FilterIndex::String(uint32_t offset, uint32_t length) const {
+  if (offset > strings_size_ || length > strings_size_ - offset) {
+    return nullptr;
+  }
+  return strings_ + offset;
+}
+
+std::string FilterIndex::RulePattern(uint32_t rule) const {
+  if (rule >= header_->rule_count) {
+    return std::string();
+  }
+  const char* pattern =
+      String(rules_[rule].pattern_offset, rules_[rule].pattern_length);
+  return pattern ? std::string(pattern, rules_[rule].pattern_length)
+                 : std::string();
+}
+
+bool FilterIndex::MatchRule(uint32_t id, const MatchContext& context) const {
+  if (id >= header_->rule_count) {
+    return false;
+  }
+  const FilterRule& rule = rules_[id];
+  if ((rule.types & context.type) == 0) {
+    return false;
+  }
+  if (rule.flags & (kRuleThirdParty | kRuleFirstParty)) {
+    if (!context.party_known ||
+        ((rule.flags & kRuleThirdParty) && !context.third_party) ||
+        ((rule.flags & kRuleFirstParty) && context.third_party)) {
+      return false;
+    }
+  }
+  if (rule.domains_length > 0) {
+    const char* domains = String(rule.domains_offset, rule.domains_length);
+    if (domains == nullptr ||
+        !domains_apply(domains, rule.domains_length, context.document_host,
+                       context.document_host_length)) {
+      return false;
+    }
+  }
+
+  const char* pattern = String(rule.pattern_offset, rule.pattern_length);
+  if (pattern == nullptr) {
+    return false;
+  }
+  const char* text =
+      rule.flags & kRuleMatchCase ? context.url : context.lower;
+  return match_pattern(pattern, rule.pattern_length, rule.flags, text,
+                       context.length, context.host_start, context.host_end);
+}
+
+uint32_t FilterIndex::MatchTable(const Table& table,
+                                 const MatchContext& context) const {
+  for (uint32_t i = 0; i < table.untokenized_count; i++) {
+    if (MatchRule(table.untokenized[i], context)) {
+      return table.untokenized[i];
+    }
+  }
+  if (table.bucket_count == 0) {
+    return kFilterNoRule;
+  }
+
+  for (uint32_t hash : *context.tokens) {
+    uint32_t bucket = hash & (table.bucket_count - 1);
+    uint32_t begin = table.buckets[bucket];
+    uint32_t end = std::min(table.buckets[bucket + 1], table.id_count);
+    for (uint32_t i = begin; i < end; i++) {
+      if (MatchRule(table.ids[i], context)) {
+        return table.ids[i];
+      }
+    }
+  }
+  return kFilterNoRule;
+}
+
+// The first listed domain the host is in, walking down from its top-level
+// domain, blocks it.
+uint32_t FilterIndex::MatchHost(const MatchContext& context) const {
+  if (context.host_end <= context.host_start ||
+      (context.type & FILTER_REQUEST_DEFAULT) == 0) {
+    return kFilterNoRule;
+  }
+  uint32_t rule = host_trie_.Match(context.lower + context.host_start,
+                                   context.host_end - context.host_start);
+  return rule == HostTrie::kNoMatch ? kFilterNoRule : rule;
+}
+
+FilterVerdict FilterIndex::Match(const FilterRequest& request) const {
+  lower_buffer.assign(request.url, request.url_length);
+  for (char& c : lower_buffer) {
+    c = to_lower(c);
+  }
+
+  token_buffer.clear();
+  const char* lower = lower_buffer.data();
+  for (size_t i = 0; i < request.url_length;) {
+    if (!filter_is_token_char(lower[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < request.url_length && filter_is_token_char(lower[i])) {
+      i++;
+    }
+    token_buffer.push_back(filter_token_hash(lower + start, i - start));
+  }
+  std::sort(token_buffer.begin(), token_buffer.end());
+  token_buffer.erase(std::unique(token_buffer.begin(), token_buffer.end()),
+                     token_buffer.end());
+
+  MatchContext context = {};
+  context.url = request.url;
+  context.lower = lower;
+  context.length = request.url_length;
+  context.type = request.type;
+  context.tokens = &token_buffer;
+  HostTrie::FindHost(request.url, request.url_length, &context.host_start,
+                     &context.host_end);
+  if (request.document_host != nullptr) {
+    context.document_host = request.document_host;
+    context.document_host_length = strlen(request.document_host);
+    if (context.host_end > context.host_start) {
+      const char* site;
+      size_t site_length;
+      site_of(context.document_host, context.document_host_length, &site,
+              &site_length);
+      context.party_known = true;
+      context.third_party = !is_in_domain(
+          lower + context.host_start, context.host_end - context.host_start,
+          site, site_length);
+    }
+  }
+
+  uint32_t rule = MatchTable(tables_[kTableImportant], context);
+  if (rule != kFilterNoRule) {
+    return FilterVerdict{FilterDecision::kBlock, rule};
+  }
+
+  rule = MatchHost(context);
+  if (rule == kFilterNoRule) {
+    rule = MatchTable(tables_[kTableBlock], context);
+  }
+  if (rule == kFilterNoRule) {
+    return FilterVerdict{FilterDecision::kNone, kFilterNoRule};
+  }
+
+  uint32_t exception = MatchTable(tables_[kTableAllow], context);
+  if (exception != kFilterNoRule) {
+    return FilterVerdict{FilterDecision::kAllow, exception};
+  }
+  return FilterVerdict{FilterDecision::kBlock, rule};
+}
+
+std::string FilterIndex::CosmeticSelectors(const char* host) const {
+  const size_t host_length = host ? strlen(host) : 0;
+  std::vector<const FilterCosmetic*> hidden;
+  std::vector<const FilterCosmetic*> exempt;
+
+  // Look up the host and each of its parent domains.
+  for (size_t start = 0; host != nullptr && start < host_length;) {
+    const char* domain = host + start;
+    size_t domain_length = host_length - start;
+    const FilterCosmetic* begin = cosmetic_specific_;
+    const FilterCosmetic* end = cosmetic_specific_ + cosmetic_specific_count_;
+    auto key_less = [this](const FilterCosmetic& entry,
+                           std::pair<const char*, size_t> key) {
+      const char* entry_domain =
+          String(entry.domain_offset, entry.domain_length);
+      return entry_domain != nullptr &&
+             compare(entry_domain, entry.domain_length, key.first,
+                     key.second) < 0;
+    };
+    const FilterCosmetic* first = std::lower_bound(
+        begin, end, std::make_pair(domain, domain_length), key_less);
+    for (const FilterCosmetic* entry = first; entry < end; entry++) {
+      const char* entry_domain =
+          String(entry->domain_offset, entry->domain_length);
+      if (entry_domain == nullptr ||
+          !equals(entry_domain, entry->domain_length, domain, domain_length)) {
+        break;
+      }
+      (entry->flags & kCosmeticException ? exempt : hidden).push_back(entry);
+    }
+
+    const char* dot = static_cast<const char*>(
+        memchr(domain, '.', domain_length));
+    if (dot == nullptr) {
+      break;
+    }
+    start = dot - host + 1;
+  }
+
+  std::string selectors;
+  auto append = [&](const FilterCosmetic& entry) {
+    const char* selector =
+        String(entry.selector_offset, entry.selector_length);
+    if (selector == nullptr) {
+      return;
+    }
+    for (const FilterCosmetic* exception : exempt) {
+      const char* exempted =
+          String(exception->selector_offset, exception->selector_length);
+      if (exempted != nullptr &&
+          equals(exempted, exception->selector_length, selector,
+                 entry.selector_length)) {
+        return;
+      }
+    }
+    selectors.append(selector, entry.selector_length);
+    selectors.push_back('\n');
+  };
+  for (uint32_t i = 0; i < cosmetic_generic_count_; i++) {
+    append(cosmetic_generic_[i]);
+  }
+  for (const FilterCosmetic* entry : hidden) {
+    append(*entry);
+  }
+  if (!selectors.empty()) {
+    selectors.pop_back();
+  }
+  return selectors;
+}
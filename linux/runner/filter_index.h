@@ -0,0 +1,94 @@
+#ifndef RUNNER_FILTER_INDEX_H_
+#define RUNNER_FILTER_INDEX_H_
+
+#include <glib.h>
+
+#include <memory>
+#include <string>
+
+#include "filter_format.h"
+#include "host_trie.h"
+
+struct FilterRequest {
+  const char* url;
+  size_t url_length;
+  // Host of the page making the request, or nullptr if unknown.
+  const char* document_host;
+  // A FilterRequestType value.
+  uint32_t type;
+};
+
+enum class FilterDecision {
+  kNone,
+  kBlock,
+  kAllow,
+};
+
+struct FilterVerdict {
+  FilterDecision decision;
+  // The deciding rule, or kFilterNoRule.
+  uint32_t rule;
+};
+
+// A compiled filter index (see filter_format.h), mapped read-only and
+// queried in place. Opening it costs one mmap and a header check no matter
+// how many rules it holds; pages are faulted in as lookups touch them.
+// Immutable once open, so any number of threads may query it.
+class FilterIndex {
+ public:
+  // Returns nullptr with |error| set if |path| is missing, truncated or
+  // not an index of this version.
+  static std::unique_ptr<FilterIndex> Open(const gchar* path, GError** error);
+
+  ~FilterIndex();
+  FilterIndex(const FilterIndex&) = delete;
+  FilterIndex& operator=(const FilterIndex&) = delete;
+
+  FilterVerdict Match(const FilterRequest& request) const;
+
+  // Returns the selectors to hide on pages on |host|, one per line.
+  std::string CosmeticSelectors(const char* host) const;
+
+  // Returns the pattern of |rule| as stored, for diagnostics.
+  std::string RulePattern(uint32_t rule) const;
+
+  uint64_t source_stamp() const { return header_->source_stamp; }
+  uint32_t rule_count() const { return header_->rule_count; }
+  size_t size() const { return size_; }
+
+ private:
+  struct Table {
+    const uint32_t* buckets;
+    uint32_t bucket_count;
+    const uint32_t* ids;
+    uint32_t id_count;
+    const uint32_t* untokenized;
+    uint32_t untokenized_count;
+  };
+  struct MatchContext;
+
+  FilterIndex(const uint8_t* data, size_t size);
+
+  bool Validate(GError** error);
+  const uint8_t* Section(FilterSection section, size_t* size) const;
+  const char* String(uint32_t offset, uint32_t length) const;
+
+  uint32_t MatchHost(const MatchContext& context) const;
+  uint32_t MatchTable(const Table& table, const MatchContext& context) const;
+  bool MatchRule(uint32_t id, const MatchContext& context) const;
+
+  const uint8_t* data_;
+  size_t size_;
+  const FilterIndexHeader* header_;
+  const char* strings_;
+  size_t strings_size_;
+  const FilterRule* rules_;
+  Table tables_[kTableCount];
+  HostTrie host_trie_;
+  const FilterCosmetic* cosmetic_generic_;
+  uint32_t cosmetic_generic_count_;
+  const FilterCosmetic* cosmetic_specific_;
+  uint32_t cosmetic_specific_count_;
+};
+
+#endif  // RUNNER_FILTER_INDEX_H_
@@ -0,0 +1,1243 @@
+#include "filter_proxy.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "filter_engine.h"
+#include "host_matcher.h"
+#include "json_pruner.h"
+#include "url_matcher.h"
+
+// Longest request or response head accepted.
+static constexpr size_t kMaxHeadBytes = 64 * 1024;
+
+// Longest JSON body buffered for pruning; larger ones are relayed as is.
+static constexpr size_t kMaxPrunedBodyBytes = 16 * 1024 * 1024;
+
+// What a relay moves per splice: the default pipe capacity.
+static constexpr size_t kSpliceBytes = 64 * 1024;
+
+static constexpr size_t kMaxConnections = 512;
+static constexpr int kMaxEvents = 64;
+static constexpr guint kResolverThreads = 4;
+static constexpr gint64 kResolveCacheUs = 60 * G_USEC_PER_SEC;
+
+// Only responses to these paths are worth pruning, so only their requests
+// lose Accept-Encoding; json_prune needs the body uncompressed.
+static constexpr std::string_view kPrunedPathPrefix = "/youtubei/";
+
+// The page whose requests the proxy sees; see UrlBlocker.pageHost.
+static constexpr char kPageHost[] = "music.youtube.com";
+
+static constexpr char kBundledRules[] =
+    "data/flutter_assets/assets/filters/network_block_patterns.txt";
+static constexpr char kBundledHosts[] =
+    "data/flutter_assets/assets/filters/blocked_hosts.txt";
+
+static constexpr char kTunnelEstablished[] =
+    "HTTP/1.1 200 Connection Established\r\n\r\n";
+
+struct Resolution {
+  guint64 connection_id;
+  std::string key;
+  std::vector<sockaddr_storage> addresses;
+};
+
+// Shared between the proxy thread, the resolver pool and readers of the
+// stats.
+struct ProxyShared {
+  std::atomic<bool> stopping{false};
+  std::mutex resolved_mutex;
+  std::vector<Resolution> resolved;
+  std::atomic<guint64> connections{0};
+  std::atomic<guint64> requests{0};
+  std::atomic<guint64> tunnels{0};
+  std::atomic<guint64> blocked{0};
+  std::atomic<guint64> failed{0};
+  std::atomic<guint64> pruned{0};
+  std::atomic<guint64> spliced_bytes{0};
+  std::atomic<guint64> pruned_bytes{0};
+};
+
+struct ResolveJob {
+  guint64 connection_id;
+  std::string host;
+  std::string port;
+};
+
+// Bytes queued for one socket, sent before anything is spliced to it.
+struct Outbox {
+  std::string data;
+  size_t sent = 0;
+
+  bool empty() const { return sent == data.size(); }
+};
+
+// One direction of a relayed connection. Bytes go from |from| into a pipe
+// and from the pipe to |to|; the pipe is only refilled once empty, so a
+// failed splice into it always means |from| has nothing to read.
+struct Relay {
+  int from = -1;
+  int to = -1;
+  int pipe_read = -1;
+  int pipe_write = -1;
+  size_t buffered = 0;
+  bool active = false;
+  // |from| reached end of stream.
+  bool eof = false;
+};
+
+enum class ConnectionState {
+  kRequestHead,
+  kResolving,
+  kConnecting,
+  kForwarding,
+  // Sending a reply of the proxy's own, then closing.
+  kReplying,
+};
+
+struct Connection;
+
+// What an epoll registration refers to.
+struct Endpoint {
+  Connection* connection;
+  bool upstream;
+};
+
+struct Connection {
+  guint64 id = 0;
+  ConnectionState state = ConnectionState::kRequestHead;
+  bool closed = false;
+  int client = -1;
+  int upstream = -1;
+  Endpoint client_end{this, false};
+  Endpoint upstream_end{this, true};
+  // Registered epoll interest; 0 means not registered.
+  uint32_t client_events = 0;
+  uint32_t upstream_events = 0;
+
+  bool tunnel = false;
+  bool head_request = false;
+  bool strip_encoding = false;
+  std::string host;
+  std::string port;
+  // The request head and whatever followed it.
+  std::string request;
+  size_t request_head_length = 0;
+  std::vector<sockaddr_storage> addresses;
+  size_t next_address = 0;
+
+  Outbox to_client;
+  Outbox to_upstream;
+  Relay up;
+  Relay down;
+
+  // The response head and, when pruning, the body; plain HTTP only.
+  std::string response;
+  bool response_head_done = false;
+  bool pruning = false;
+  size_t response_head_length = 0;
+  size_t body_length = 0;
+  bool response_done = false;
+};
+
+struct ResolvedAddresses {
+  std::vector<sockaddr_storage> addresses;
+  gint64 expiry;
+};
+
+// Owned by the proxy thread.
+struct ProxyLoop {
+  std::unordered_map<guint64, Connection*> connections;
+  std::vector<Connection*> closed;
+  std::unordered_map<std::string, ResolvedAddresses> resolve_cache;
+  guint64 next_id = 1;
+};
+
+struct _FilterProxy {
+  GObject parent_instance;
+
+  FilterProxyBlockFunc should_block;
+  gpointer user_data;
+  GDestroyNotify destroy;
+  ProxyShared* shared;
+  ProxyLoop* loop;
+  GThreadPool* resolver;
+  GThread* thread;
+  int listener;
+  int epoll;
+  int wake;
+  guint16 port;
+};
+
+G_DEFINE_TYPE(FilterProxy, filter_proxy, G_TYPE_OBJECT)
+
+// epoll tags for the proxy's own descriptors.
+static char listener_tag;
+static char wake_tag;
+
+static void close_fd(int* fd) {
+  if (*fd >= 0) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+static void close_relay(Relay* relay) {
+  close_fd(&relay->pipe_read);
+  close_fd(&relay->pipe_write);
+}
+
+static bool ascii_equal(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         g_ascii_strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+static bool ascii_has_prefix(std::string_view s, std::string_view prefix) {
+  return s.size() >= prefix.size() &&
+         ascii_equal(s.substr(0, prefix.size()), prefix);
+}
+
+static bool ascii_contains(std::string_view s, std::string_view needle) {
+  for (size_t i = 0; i + needle.size() <= s.size(); i++) {
+    if (ascii_equal(s.substr(i, needle.size()), needle)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+struct Header {
+  std::string_view name;
+  std::string_view value;
+};
+
+// Splits the head |head|, without its blank line, into the first line and
+// the header fields. Returns false if a field has no colon.
+static bool parse_head(std::string_view head, std::string_view* first_line,
+                       std::vector<Header>* headers) {
+  size_t eol = head.find("\r\n");
+  *first_line = head.substr(0, eol);
+  while (eol != std::string_view::npos) {
+    head.remove_prefix(eol + 2);
+    eol = head.find("\r\n");
+    std::string_view line = head.substr(0, eol);
+    if (line.empty()) {
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      return false;
+    }
+    headers->push_back(Header{trim(line.substr(0, colon)),
+                              trim(line.substr(colon + 1))});
+  }
+  return true;
+}
+
+static std::string_view find_header(const std::vector<Header>& headers,
+                                    std::string_view name) {
+  for (const Header& header : headers) {
+    if (ascii_equal(header.name, name)) {
+      return header.value;
+    }
+  }
+  return {};
+}
+
+// Headers that describe the hop to the proxy rather than the message. The
+// proxy closes every connection after one exchange and says so itself.
+static bool is_hop_by_hop(std::string_view name) {
+  return ascii_equal(name, "Connection") || ascii_equal(name, "Keep-Alive") ||
+         ascii_equal(name, "Proxy-Connection") ||
+         ascii_equal(name, "Proxy-Authorization");
+}
+
+// Splits host[:port] or [v6]:port. Returns false if the host is empty.
+static bool parse_authority(std::string_view authority,
+                            std::string_view default_port, std::string* host,
+                            std::string* port) {
+  std::string_view port_part;
+  if (!authority.empty() && authority.front() == '[') {
+    size_t close = authority.find(']');
+    if (close == std::string_view::npos) {
+      return false;
+    }
+    *host = std::string(authority.substr(1, close - 1));
+    if (close + 1 < authority.size() && authority[close + 1] == ':') {
+      port_part = authority.substr(close + 2);
+    }
+  } else {
+    size_t colon = authority.rfind(':');
+    *host = std::string(authority.substr(0, colon));
+    if (colon != std::string_view::npos) {
+      port_part = authority.substr(colon + 1);
+    }
+  }
+  *port = std::string(port_part.empty() ? default_port : port_part);
+  return !host->empty();
+}
+
+static void update_interest(FilterProxy* self, int fd, Endpoint* endpoint,
+                            uint32_t* registered, uint32_t wanted) {
+  if (fd < 0 || *registered == wanted) {
+    return;
+  }
+  // A socket nothing is wanted from is left out entirely, since a hung-up
+  // one would otherwise keep reporting EPOLLHUP.
+  if (wanted == 0) {
+    epoll_ctl(self->epoll, EPOLL_CTL_DEL, fd, nullptr);
+  } else {
+    epoll_event event = {};
+    event.events = wanted;
+    event.data.ptr = endpoint;
+    epoll_ctl(self->epoll, *registered == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+              fd, &event);
+  }
+  *registered = wanted;
+}
+
+static void close_connection(FilterProxy* self, Connection* c) {
+  if (c->closed) {
+    return;
+  }
+  c->closed = true;
+  // Closing a descriptor removes it from the epoll set.
+  close_fd(&c->client);
+  close_fd(&c->upstream);
+  close_relay(&c->up);
+  close_relay(&c->down);
+  self->loop->connections.erase(c->id);
+  // Freed once the current batch of events, which may still name it, has
+  // been handled.
+  self->loop->closed.push_back(c);
+}
+
+// Replaces whatever was going on with a reply of the proxy's own.
+static void reply(Connection* c, const char* status) {
+  close_fd(&c->upstream);
+  c->upstream_events = 0;
+  c->to_client.data = std::string("HTTP/1.1 ") + status +
+                      "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  c->to_client.sent = 0;
+  c->state = ConnectionState::kReplying;
+}
+
+// Sends what it can of |outbox|. Returns false on a hard error.
+static bool flush(int fd, Outbox* outbox) {
+  while (!outbox->empty()) {
+    ssize_t n = send(fd, outbox->data.data() + outbox->sent,
+                     outbox->data.size() - outbox->sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      outbox->sent += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return n < 0 && errno == EAGAIN;
+    }
+  }
+  outbox->data.clear();
+  outbox->sent = 0;
+  return true;
+}
+
+static bool start_relay(Relay* relay, int from, int to) {
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+    return false;
+  }
+  relay->pipe_read = fds[0];
+  relay->pipe_write = fds[1];
+  relay->from = from;
+  relay->to = to;
+  relay->active = true;
+  return true;
+}
+
+// Moves what it can through |relay|. Returns false on a hard error.
+static bool pump_relay(FilterProxy* self, Relay* relay) {
+  while (true) {
+    bool moved = false;
+    if (relay->buffered == 0 && !relay->eof) {
+      ssize_t n = splice(relay->from, nullptr, relay->pipe_write, nullptr,
+                         kSpliceBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n > 0) {
+        relay->buffered = n;
+        moved = true;
+      } else if (n == 0) {
+        relay->eof = true;
+      } else if (errno != EAGAIN && errno != EINTR) {
+        return false;
+      }
+    }
+    if (relay->buffered > 0) {
+      ssize_t n = splice(relay->pipe_read, nullptr, relay->to, nullptr,
+                         relay->buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n > 0) {
+        relay->buffered -= n;
+        self->shared->spliced_bytes += n;
+        moved = true;
+      } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return false;
+      }
+    }
+    if (!moved) {
+      return true;
+    }
+  }
+}
+
+static bool relay_finished(const Relay& relay) {
+  return relay.eof && relay.buffered == 0;
+}
+
+// Reads the request head. Returns false once the connection has moved on
+// or closed, true if more is needed.
+static bool read_request_head(FilterProxy* self, Connection* c) {
+  char chunk[16 * 1024];
+  while (true) {
+    ssize_t n = recv(c->client, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      return true;
+    }
+    if (n <= 0) {
+      close_connection(self, c);
+      return false;
+    }
+    size_t scan_from = c->request.size() < 3 ? 0 : c->request.size() - 3;
+    c->request.append(chunk, n);
+    size_t end = c->request.find("\r\n\r\n", scan_from);
+    if (end != std::string::npos) {
+      c->request_head_length = end + 4;
+      return false;
+    }
+    if (c->request.size() > kMaxHeadBytes) {
+      reply(c, "431 Request Header Fields Too Large");
+      return false;
+    }
+  }
+}
+
+static void resolve_worker(gpointer data, gpointer user_data) {
+  ResolveJob* job = static_cast<ResolveJob*>(data);
+  FilterProxy* self = FILTER_PROXY(user_data);
+
+  Resolution resolution;
+  resolution.connection_id = job->connection_id;
+  resolution.key = job->host + ":" + job->port;
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG;
+  addrinfo* results = nullptr;
+  if (getaddrinfo(job->host.c_str(), job->port.c_str(), &hints, &results) ==
+      0) {
+    for (addrinfo* ai = results; ai != nullptr; ai = ai->ai_next) {
+      sockaddr_storage address = {};
+      memcpy(&address, ai->ai_addr, ai->ai_addrlen);
+      resolution.addresses.push_back(address);
+    }
+    freeaddrinfo(results);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(self->shared->resolved_mutex);
+    self->shared->resolved.push_back(std::move(resolution));
+  }
+  uint64_t one = 1;
+  if (write(self->wake, &one, sizeof(one)) < 0) {
+    g_debug("Filter proxy wakeup failed: %s", g_strerror(errno));
+  }
+}
+
+static void resolve_job_free(gpointer data) {
+  delete static_cast<ResolveJob*>(data);
+}
+
+static socklen_t address_length(const sockaddr_storage& address) {
+  return address.ss_family == AF_INET6 ? sizeof(sockaddr_in6)
+                                       : sizeof(sockaddr_in);
+}
+
+static void start_forwarding(FilterProxy* self, Connection* c);
+static void drive(FilterProxy* self, Connection* c);
+
+// Tries the remaining addresses until a connect is under way.
+static void connect_next(FilterProxy* self, Connection* c) {
+  while (c->next_address < c->addresses.size()) {
+    const sockaddr_storage& address = c->addresses[c->next_address++];
+    int fd = socket(address.ss_family,
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                address_length(address)) == 0) {
+      c->upstream = fd;
+      start_forwarding(self, c);
+      return;
+    }
+    if (errno == EINPROGRESS) {
+      c->upstream = fd;
+      c->state = ConnectionState::kConnecting;
+      return;
+    }
+    close(fd);
+  }
+  self->shared->failed++;
+  reply(c, "502 Bad Gateway");
+}
+
+static void finish_connect(FilterProxy* self, Connection* c) {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (getsockopt(c->upstream, SOL_SOCKET, SO_ERROR, &error, &length) != 0 ||
+      error != 0) {
+    epoll_ctl(self->epoll, EPOLL_CTL_DEL, c->upstream, nullptr);
+    close_fd(&c->upstream);
+    c->upstream_events = 0;
+    connect_next(self, c);
+    return;
+  }
+  start_forwarding(self, c);
+}
+
+static void resolve(FilterProxy* self, Connection* c) {
+  c->state = ConnectionState::kResolving;
+
+  // Literal addresses need no lookup.
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+  addrinfo* results = nullptr;
+  if (getaddrinfo(c->host.c_str(), c->port.c_str(), &hints, &results) == 0) {
+    for (addrinfo* ai = results; ai != nullptr; ai = ai->ai_next) {
+      sockaddr_storage address = {};
+      memcpy(&address, ai->ai_addr, ai->ai_addrlen);
+      c->addresses.push_back(address);
+    }
+    freeaddrinfo(results);
+    connect_next(self, c);
+    return;
+  }
+
+  auto cached = self->loop->resolve_cache.find(c->host + ":" + c->port);
+  if (cached != self->loop->resolve_cache.end() &&
+      cached->second.expiry > g_get_monotonic_time()) {
+    c->addresses = cached->second.addresses;
+    connect_next(self, c);
+    return;
+  }
+
+  g_thread_pool_push(self->resolver, new ResolveJob{c->id, c->host, c->port},
+                     nullptr);
+}
+
+static void handle_resolutions(FilterProxy* self) {
+  uint64_t count;
+  if (read(self->wake, &count, sizeof(count)) < 0) {
+    return;
+  }
+  std::vector<Resolution> resolved;
+  {
+    std::lock_guard<std::mutex> lock(self->shared->resolved_mutex);
+    resolved.swap(self->shared->resolved);
+  }
+  gint64 expiry = g_get_monotonic_time() + kResolveCacheUs;
+  for (Resolution& resolution : resolved) {
+    if (!resolution.addresses.empty()) {
+      self->loop->resolve_cache[resolution.key] =
+          ResolvedAddresses{resolution.addresses, expiry};
+    }
+    auto it = self->loop->connections.find(resolution.connection_id);
+    if (it == self->loop->connections.end() ||
+        it->second->state != ConnectionState::kResolving) {
+      continue;
+    }
+    Connection* c = it->second;
+    c->addresses = std::move(resolution.addresses);
+    connect_next(self, c);
+    drive(self, c);
+  }
+}
+
+// Decides the request in |c->request| and starts resolving its origin.
+static void handle_request(FilterProxy* self, Connection* c) {
+  std::string_view head(c->request.data(), c->request_head_length - 4);
+  std::string_view line;
+  std::vector<Header> headers;
+  if (!parse_head(head, &line, &headers)) {
+    reply(c, "400 Bad Request");
+    return;
+  }
+  size_t method_end = line.find(' ');
+  size_t target_end = line.rfind(' ');
+  if (method_end == std::string_view::npos || target_end <= method_end) {
+    reply(c, "400 Bad Request");
+    return;
+  }
+  std::string_view method = line.substr(0, method_end);
+  std::string_view target =
+      line.substr(method_end + 1, target_end - method_end - 1);
+  std::string_view version = line.substr(target_end + 1);
+
+  std::string url;
+  std::string_view path;
+  if (method == "CONNECT") {
+    c->tunnel = true;
+    if (!parse_authority(target, "443", &c->host, &c->port)) {
+      reply(c, "400 Bad Request");
+      return;
+    }
+    url = "https://" + (c->port == "443" ? c->host : std::string(target)) +
+          "/";
+    self->shared->tunnels++;
+  } else {
+    // Only proxy requests, which name the origin in the target, are served.
+    if (!ascii_has_prefix(target, "http://")) {
+      reply(c, "400 Bad Request");
+      return;
+    }
+    std::string_view rest = target.substr(7);
+    size_t authority_end = rest.find_first_of("/?#");
+    if (!parse_authority(rest.substr(0, authority_end), "80", &c->host,
+                         &c->port)) {
+      reply(c, "400 Bad Request");
+      return;
+    }
+    path = authority_end == std::string_view::npos
+               ? std::string_view("/")
+               : rest.substr(authority_end);
+    url = std::string(target);
+    c->head_request = method == "HEAD";
+    c->strip_encoding = path.substr(0, kPrunedPathPrefix.size()) ==
+                        kPrunedPathPrefix;
+    self->shared->requests++;
+  }
+
+  if (self->should_block(url.c_str(), url.size(), self->user_data)) {
+    self->shared->blocked++;
+    reply(c, "403 Forbidden");
+    return;
+  }
+
+  if (!c->tunnel) {
+    // Forwarded in origin form, with the hop-by-hop headers replaced.
+    std::string forwarded;
+    forwarded.reserve(c->request.size() + 32);
+    forwarded.append(method).append(" ").append(path).append(" ");
+    forwarded.append(version).append("\r\n");
+    for (const Header& header : headers) {
+      if (is_hop_by_hop(header.name) ||
+          (c->strip_encoding && ascii_equal(header.name, "Accept-Encoding"))) {
+        continue;
+      }
+      forwarded.append(header.name).append(": ");
+      forwarded.append(header.value).append("\r\n");
+    }
+    forwarded.append("Connection: close\r\n\r\n");
+    forwarded.append(c->request, c->request_head_length);
+    c->request = std::move(forwarded);
+    c->request_head_length = 0;
+  }
+  resolve(self, c);
+}
+
+static void start_forwarding(FilterProxy* self, Connection* c) {
+  c->state = ConnectionState::kForwarding;
+  if (c->tunnel) {
+    c->to_client.data = kTunnelEstablished;
+    // Anything the client sent after CONNECT belongs to the tunnel.
+    c->to_upstream.data = c->request.substr(c->request_head_length);
+  } else {
+    c->to_upstream.data = std::move(c->request);
+  }
+  c->request.clear();
+  c->request.shrink_to_fit();
+
+  if (!start_relay(&c->up, c->client, c->upstream) ||
+      (c->tunnel && !start_relay(&c->down, c->upstream, c->client))) {
+    self->shared->failed++;
+    reply(c, "502 Bad Gateway");
+  }
+}
+
+// Handles a complete response head in |c->response|.
+static void handle_response_head(FilterProxy* self, Connection* c) {
+  std::string_view head(c->response.data(), c->response_head_length - 4);
+  std::string_view line;
+  std::vector<Header> headers;
+  if (!parse_head(head, &line, &headers)) {
+    self->shared->failed++;
+    reply(c, "502 Bad Gateway");
+    return;
+  }
+  c->response_head_done = true;
+
+  std::string_view length_value = find_header(headers, "Content-Length");
+  std::string_view encoding = find_header(headers, "Content-Encoding");
+  guint64 length = 0;
+  bool has_length = !length_value.empty() &&
+                    g_ascii_string_to_unsigned(
+                        std::string(length_value).c_str(), 10, 0,
+                        kMaxPrunedBodyBytes, &length, nullptr);
+  size_t status_start = line.find(' ');
+  c->pruning = !c->head_request && has_length &&
+               status_start != std::string_view::npos &&
+               line.substr(status_start + 1, 4) == "200 " &&
+               ascii_contains(find_header(headers, "Content-Type"), "json") &&
+               (encoding.empty() || ascii_equal(encoding, "identity")) &&
+               find_header(headers, "Transfer-Encoding").empty();
+  c->body_length = length;
+
+  std::string rewritten;
+  rewritten.append(line).append("\r\n");
+  for (const Header& header : headers) {
+    if (is_hop_by_hop(header.name) ||
+        (c->pruning && ascii_equal(header.name, "Content-Length"))) {
+      continue;
+    }
+    rewritten.append(header.name).append(": ");
+    rewritten.append(header.value).append("\r\n");
+  }
+  rewritten.append("Connection: close\r\n");
+
+  if (c->pruning) {
+    // The head is sent with the pruned body, once its length is known.
+    c->response.replace(0, c->response_head_length, rewritten);
+    c->response_head_length = rewritten.size();
+    c->response.reserve(c->response_head_length + c->body_length);
+    return;
+  }
+
+  rewritten.append("\r\n");
+  rewritten.append(c->response, c->response_head_length);
+  c->to_client.data = std::move(rewritten);
+  c->response.clear();
+  c->response.shrink_to_fit();
+  if (!start_relay(&c->down, c->upstream, c->client)) {
+    self->shared->failed++;
+    close_connection(self, c);
+  }
+}
+
+static void finish_pruned_response(FilterProxy* self, Connection* c) {
+  char* body = &c->response[c->response_head_length];
+  size_t length = c->response.size() - c->response_head_length;
+  if (length > c->body_length) {
+    length = c->body_length;
+  }
+  if (json_prune_needed(body, length)) {
+    int64_t pruned = json_prune(body, length, body, nullptr);
+    if (pruned >= 0) {
+      self->shared->pruned++;
+      self->shared->pruned_bytes += length - pruned;
+      length = pruned;
+    }
+  }
+  std::string& out = c->to_client.data;
+  out.reserve(c->response_head_length + length + 32);
+  out.assign(c->response, 0, c->response_head_length);
+  out.append("Content-Length: ").append(std::to_string(length));
+  out.append("\r\n\r\n");
+  out.append(body, length);
+  c->response.clear();
+  c->response.shrink_to_fit();
+  c->response_done = true;
+}
+
+// Reads the response head, or the body of a response being pruned.
+// Returns false if the connection was closed or replied to.
+static bool read_response(FilterProxy* self, Connection* c) {
+  char chunk[16 * 1024];
+  while (!c->response_done && (!c->response_head_done || c->pruning)) {
+    ssize_t n = recv(c->upstream, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      return true;
+    }
+    if (n < 0 || (n == 0 && !c->response_head_done)) {
+      self->shared->failed++;
+      reply(c, "502 Bad Gateway");
+      return false;
+    }
+    if (n == 0) {
+      // The origin closed before the promised length; pass on what came.
+      finish_pruned_response(self, c);
+      return true;
+    }
+    if (!c->response_head_done) {
+      size_t scan_from = c->response.size() < 3 ? 0 : c->response.size() - 3;
+      c->response.append(chunk, n);
+      size_t end = c->response.find("\r\n\r\n", scan_from);
+      if (end == std::string::npos) {
+        if (c->response.size() > kMaxHeadBytes) {
+          self->shared->failed++;
+          reply(c, "502 Bad Gateway");
+          return false;
+        }
+        continue;
+      }
+      c->response_head_length = end + 4;
+      handle_response_head(self, c);
+      if (c->closed || c->state != ConnectionState::kForwarding) {
+        return false;
+      }
+    } else {
+      c->response.append(chunk, n);
+    }
+    if (c->pruning &&
+        c->response.size() - c->response_head_length >= c->body_length) {
+      finish_pruned_response(self, c);
+    }
+  }
+  return true;
+}
+
+static void update_connection_interest(FilterProxy* self, Connection* c) {
+  uint32_t client_events = 0;
+  uint32_t upstream_events = 0;
+  switch (c->state) {
+    case ConnectionState::kRequestHead:
+      client_events = EPOLLIN;
+      break;
+    case ConnectionState::kResolving:
+      break;
+    case ConnectionState::kConnecting:
+      upstream_events = EPOLLOUT;
+      break;
+    case ConnectionState::kReplying:
+      client_events = EPOLLOUT;
+      break;
+    case ConnectionState::kForwarding:
+      if (!c->to_upstream.empty() || c->up.buffered > 0) {
+        upstream_events |= EPOLLOUT;
+      } else if (c->up.active && !c->up.eof) {
+        client_events |= EPOLLIN;
+      }
+      if (!c->to_client.empty() || c->down.buffered > 0) {
+        client_events |= EPOLLOUT;
+      } else if (!c->response_done &&
+                 (c->tunnel ? !c->down.eof
+                            : (!c->response_head_done || c->pruning ||
+                               (c->down.active && !c->down.eof)))) {
+        upstream_events |= EPOLLIN;
+      }
+      break;
+  }
+  update_interest(self, c->client, &c->client_end, &c->client_events,
+                  client_events);
+  update_interest(self, c->upstream, &c->upstream_end, &c->upstream_events,
+                  upstream_events);
+}
+
+static void forward(FilterProxy* self, Connection* c) {
+  // Client to origin: queued bytes first, then the rest spliced.
+  if (!flush(c->upstream, &c->to_upstream)) {
+    close_connection(self, c);
+    return;
+  }
+  if (c->to_upstream.empty() && c->up.active && !relay_finished(c->up)) {
+    if (!pump_relay(self, &c->up)) {
+      close_connection(self, c);
+      return;
+    }
+    if (relay_finished(c->up)) {
+      shutdown(c->upstream, SHUT_WR);
+    }
+  }
+
+  // Origin to client.
+  if (!c->tunnel && !read_response(self, c)) {
+    return;
+  }
+  if (!flush(c->client, &c->to_client)) {
+    close_connection(self, c);
+    return;
+  }
+  if (c->to_client.empty() && c->down.active && !relay_finished(c->down)) {
+    if (!pump_relay(self, &c->down)) {
+      close_connection(self, c);
+      return;
+    }
+    if (relay_finished(c->down)) {
+      if (c->tunnel) {
+        shutdown(c->client, SHUT_WR);
+      } else {
+        c->response_done = true;
+      }
+    }
+  }
+
+  bool finished = c->tunnel ? relay_finished(c->up) && relay_finished(c->down)
+                            : c->response_done;
+  if (finished && c->to_client.empty() && c->to_upstream.empty()) {
+    close_connection(self, c);
+  }
+}
+
+// Runs each state of |c| until it has to wait, then updates its interest.
+static void drive(FilterProxy* self, Connection* c) {
+  ConnectionState before;
+  do {
+    before = c->state;
+    switch (c->state) {
+      case ConnectionState::kRequestHead:
+        if (!read_request_head(self, c) && !c->closed &&
+            c->state == ConnectionState::kRequestHead) {
+          handle_request(self, c);
+        }
+        break;
+      case ConnectionState::kResolving:
+      case ConnectionState::kConnecting:
+        break;
+      case ConnectionState::kForwarding:
+        forward(self, c);
+        break;
+      case ConnectionState::kReplying:
+        if (!flush(c->client, &c->to_client) || c->to_client.empty()) {
+          close_connection(self, c);
+        }
+        break;
+    }
+  } while (!c->closed && c->state != before);
+
+  if (!c->closed) {
+    update_connection_interest(self, c);
+  }
+}
+
+static void handle_event(FilterProxy* self, Endpoint* endpoint,
+                         uint32_t events) {
+  Connection* c = endpoint->connection;
+  if (c->closed) {
+    return;
+  }
+  if (endpoint->upstream && c->state == ConnectionState::kConnecting) {
+    finish_connect(self, c);
+  } else if (events & EPOLLERR) {
+    close_connection(self, c);
+    return;
+  }
+  drive(self, c);
+}
+
+static void accept_clients(FilterProxy* self) {
+  while (true) {
+    int fd = accept4(self->listener, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        g_debug("Filter proxy accept failed: %s", g_strerror(errno));
+      }
+      return;
+    }
+    if (self->loop->connections.size() >= kMaxConnections) {
+      close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Connection* c = new Connection();
+    c->id = self->loop->next_id++;
+    c->client = fd;
+    self->loop->connections[c->id] = c;
+    self->shared->connections++;
+    update_connection_interest(self, c);
+  }
+}
+
+static void free_closed(FilterProxy* self) {
+  for (Connection* c : self->loop->closed) {
+    delete c;
+  }
+  self->loop->closed.clear();
+}
+
+static gpointer proxy_thread_main(gpointer data) {
+  FilterProxy* self = FILTER_PROXY(data);
+
+  // A splice to a peer that has gone raises SIGPIPE; EPIPE is enough.
+  sigset_t pipe_signal;
+  sigemptyset(&pipe_signal);
+  sigaddset(&pipe_signal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_signal, nullptr);
+
+  epoll_event events[kMaxEvents];
+  while (!self->shared->stopping) {
+    int count = epoll_wait(self->epoll, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      g_warning("Filter proxy stopped: %s", g_strerror(errno));
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      void* tag = events[i].data.ptr;
+      if (tag == &listener_tag) {
+        accept_clients(self);
+      } else if (tag == &wake_tag) {
+        handle_resolutions(self);
+      } else {
+        handle_event(self, static_cast<Endpoint*>(tag), events[i].events);
+      }
+    }
+    free_closed(self);
+  }
+
+  while (!self->loop->connections.empty()) {
+    close_connection(self, self->loop->connections.begin()->second);
+  }
+  free_closed(self);
+  return nullptr;
+}
+
+static void filter_proxy_dispose(GObject* object) {
+  FilterProxy* self = FILTER_PROXY(object);
+
+  if (self->thread != nullptr) {
+    self->shared->stopping = true;
+    uint64_t one = 1;
+    if (write(self->wake, &one, sizeof(one)) < 0) {
+      g_warning("Failed to stop the filter proxy: %s", g_strerror(errno));
+    }
+    g_thread_join(self->thread);
+    self->thread = nullptr;
+  }
+  // After the loop, so no resolution is queued for a dead connection table;
+  // lookups in progress finish, queued ones are dropped.
+  if (self->resolver != nullptr) {
+    g_thread_pool_free(self->resolver, TRUE, TRUE);
+    self->resolver = nullptr;
+  }
+  close_fd(&self->listener);
+  close_fd(&self->epoll);
+  close_fd(&self->wake);
+
+  if (self->destroy != nullptr) {
+    self->destroy(self->user_data);
+    self->destroy = nullptr;
+  }
+  self->user_data = nullptr;
+
+  delete self->loop;
+  self->loop = nullptr;
+  delete self->shared;
+  self->shared = nullptr;
+
+  G_OBJECT_CLASS(filter_proxy_parent_class)->dispose(object);
+}
+
+static void filter_proxy_class_init(FilterProxyClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = filter_proxy_dispose;
+}
+
+static void filter_proxy_init(FilterProxy* self) {
+  self->shared = new ProxyShared();
+  self->loop = new ProxyLoop();
+  self->listener = -1;
+  self->epoll = -1;
+  self->wake = -1;
+}
+
+FilterProxy* filter_proxy_new(FilterProxyBlockFunc should_block,
+                              gpointer user_data, GDestroyNotify destroy) {
+  FilterProxy* self =
+      FILTER_PROXY(g_object_new(filter_proxy_get_type(), nullptr));
+  self->should_block = should_block;
+  self->user_data = user_data;
+  self->destroy = destroy;
+  return self;
+}
+
+// What filter_proxy_new_default() decides on besides the user's lists.
+// Either matcher may be missing if its asset could not be read.
+struct BundledFilters {
+  HostMatcher* hosts;
+  UrlMatcher* rules;
+};
+
+static gboolean default_should_block(const gchar* url, gsize length,
+                                     gpointer user_data) {
+  // The same precedence as UrlBlocker.shouldBlock: an exception rule in
+  // the user's lists overrides everything.
+  int32_t decision =
+      filter_engine_match(url, length, kPageHost, FILTER_REQUEST_OTHER);
+  if (decision < 0) {
+    return FALSE;
+  }
+  const BundledFilters* filters = static_cast<BundledFilters*>(user_data);
+  return decision > 0 ||
+         (filters->hosts != nullptr &&
+          host_matcher_match_url(filters->hosts, url, length) >= 0) ||
+         (filters->rules != nullptr &&
+          url_matcher_match(filters->rules, url, length) >= 0);
+}
+
+static void free_filters(gpointer data) {
+  BundledFilters* filters = static_cast<BundledFilters*>(data);
+  if (filters->hosts != nullptr) {
+    host_matcher_free(filters->hosts);
+  }
+  if (filters->rules != nullptr) {
+    url_matcher_free(filters->rules);
+  }
+  g_free(filters);
+}
+
+// Reads |name| from the Flutter bundle next to the executable.
+static gchar* read_bundled(const gchar* name, gsize* length) {
+  g_autofree gchar* executable = g_file_read_link("/proc/self/exe", nullptr);
+  g_autofree gchar* bundle =
+      executable != nullptr ? g_path_get_dirname(executable) : g_strdup(".");
+  g_autofree gchar* path = g_build_filename(bundle, name, nullptr);
+
+  gchar* contents = nullptr;
+  g_autoptr(GError) error = nullptr;
+  if (!g_file_get_contents(path, &contents, length, &error)) {
+    g_warning("Filter proxy is missing %s: %s", name, error->message);
+  }
+  return contents;
+}
+
+FilterProxy* filter_proxy_new_default() {
+  BundledFilters* filters = g_new0(BundledFilters, 1);
+  gsize length = 0;
+  g_autofree gchar* hosts = read_bundled(kBundledHosts, &length);
+  if (hosts != nullptr) {
+    filters->hosts = host_matcher_new(hosts, length);
+  }
+  g_autofree gchar* rules = read_bundled(kBundledRules, &length);
+  if (rules != nullptr) {
+    filters->rules = url_matcher_new(rules, length);
+  }
+  return filter_proxy_new(default_should_block, filters, free_filters);
+}
+
+gboolean filter_proxy_listen(FilterProxy* self, guint16 port,
+                             GError** error) {
+  g_return_val_if_fail(FILTER_IS_PROXY(self), FALSE);
+
+  if (self->listener >= 0) {
+    return TRUE;
+  }
+
+  self->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);
+  int one = 1;
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  socklen_t length = sizeof(address);
+  if (self->listener < 0 ||
+      setsockopt(self->listener, SOL_SOCKET, SO_REUSEADDR, &one,
+                 sizeof(one)) != 0 ||
+      bind(self->listener, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(self->listener, SOMAXCONN) != 0 ||
+      getsockname(self->listener, reinterpret_cast<sockaddr*>(&address),
+                  &length) != 0) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Cannot listen on 127.0.0.1:%u: %s", port, g_strerror(saved));
+    close_fd(&self->listener);
+    return FALSE;
+  }
+  self->port = ntohs(address.sin_port);
+
+  self->epoll = epoll_create1(EPOLL_CLOEXEC);
+  self->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->epoll < 0 || self->wake < 0) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Cannot start the filter proxy: %s", g_strerror(saved));
+    close_fd(&self->listener);
+    self->port = 0;
+    close_fd(&self->epoll);
+    close_fd(&self->wake);
+    return FALSE;
+  }
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.ptr = &listener_tag;
+  epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->listener, &event);
+  event.data.ptr = &wake_tag;
+  epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->wake, &event);
+  return TRUE;
+}
+
+gboolean filter_proxy_start(FilterProxy* self, guint16 port,
+                            GError** error) {
+  g_return_val_if_fail(FILTER_IS_PROXY(self), FALSE);
+
+  if (self->thread != nullptr) {
+    return TRUE;
+  }
+  if (!filter_proxy_listen(self, port, error)) {
+    return FALSE;
+  }
+
+  self->resolver = g_thread_pool_new_full(resolve_worker, self,
+                                          resolve_job_free, kResolverThreads,
+                                          FALSE, nullptr);
+  self->thread = g_thread_new("filter-proxy", proxy_thread_main, self);
+  return TRUE;
+}
+
+guint16 filter_proxy_get_port(FilterProxy* self) {
+  g_return_val_if_fail(FILTER_IS_PROXY(self), 0);
+  return self->port;
+}
+
+void filter_proxy_get_stats(FilterProxy* self, FilterProxyStats* stats) {
+  g_return_if_fail(FILTER_IS_PROXY(self));
+  const ProxyShared* shared = self->shared;
+  stats->connections = shared->connections;
+  stats->requests = shared->requests;
+  stats->tunnels = shared->tunnels;
+  stats->blocked = shared->blocked;
+  stats->failed = shared->failed;
+  stats->pruned = shared->pruned;
+  stats->spliced_bytes = shared->spliced_bytes;
+  stats->pruned_bytes = shared->pruned_bytes;
+}
@@ -0,0 +1,117 @@
+#ifndef RUNNER_FILTER_PROXY_H_
+#define RUNNER_FILTER_PROXY_H_
+
+#include <gio/gio.h>
+
+// A loopback HTTP proxy that the WebView's network process is pointed at,
+// so requests are filtered before they leave the machine instead of on the
+// UI isolate or the page's main thread. It runs a single epoll loop on its
+// own thread; only name resolution is handed to a small worker pool.
+//
+// Plain HTTP requests are decided on their full URL, and JSON responses
+// have their ad data removed with json_prune before they are passed on.
+// HTTPS goes through CONNECT tunnels, which are decided on their host and
+// otherwise relayed with splice(2) without being looked into. Everything
+// relayed unchanged is moved socket to pipe to socket, never copied
+// through user space.
+
+G_BEGIN_DECLS
+
+#define FILTER_TYPE_PROXY filter_proxy_get_type()
+G_DECLARE_FINAL_TYPE(FilterProxy, filter_proxy, FILTER, PROXY, GObject)
+
+/**
+ * FilterProxyBlockFunc:
+ * @url: the request URL, https://host/ for a CONNECT tunnel.
+ * @length: length of @url in bytes; @url is also NUL-terminated.
+ * @user_data: data passed to filter_proxy_new().
+ *
+ * Called on the proxy thread for every request.
+ *
+ * Returns: whether to refuse the request.
+ */
+typedef gboolean (*FilterProxyBlockFunc)(const gchar* url, gsize length,
+                                         gpointer user_data);
+
+typedef struct {
+  guint64 connections;
+  guint64 requests;
+  guint64 tunnels;
+  guint64 blocked;
+  guint64 failed;
+  guint64 pruned;
+  // Bytes relayed by splice, in both directions.
+  guint64 spliced_bytes;
+  // Bytes json_prune removed from responses.
+  guint64 pruned_bytes;
+} FilterProxyStats;
+
+/**
+ * filter_proxy_new:
+ * @should_block: decides each request.
+ * @user_data: data for @should_block.
+ * @destroy: (nullable): frees @user_data once the proxy has stopped.
+ *
+ * Returns: a new #FilterProxy, not yet listening.
+ */
+FilterProxy* filter_proxy_new(FilterProxyBlockFunc should_block,
+                              gpointer user_data, GDestroyNotify destroy);
+
+/**
+ * filter_proxy_new_default:
+ *
+ * Creates a proxy that blocks what the bundled blocked hosts and network
+ * block patterns, or the user's filter lists (see filter_engine_match()),
+ * block.
+ *
+ * Returns: a new #FilterProxy, not yet listening.
+ */
+FilterProxy* filter_proxy_new_default();
+
+/**
+ * filter_proxy_listen:
+ * @self: a #FilterProxy.
+ * @port: the loopback port to listen on, or 0 to pick a free one.
+ * @error: return location for a #GError.
+ *
+ * Binds 127.0.0.1:@port and sets up the event loop without starting any
+ * thread, so that the port can be published, in the environment say,
+ * before other threads run. Connections wait in the backlog until
+ * filter_proxy_start(). Does nothing if already listening.
+ *
+ * Returns: %TRUE if the proxy is listening.
+ */
+gboolean filter_proxy_listen(FilterProxy* self, guint16 port, GError** error);
+
+/**
+ * filter_proxy_start:
+ * @self: a #FilterProxy.
+ * @port: the port to listen on if filter_proxy_listen() was not called,
+ *   or 0 to pick a free one.
+ * @error: return location for a #GError.
+ *
+ * Listens if needed, then starts the proxy thread and its resolvers,
+ * which cannot fail. The proxy stops when it is disposed.
+ *
+ * Returns: %TRUE if the proxy is running.
+ */
+gboolean filter_proxy_start(FilterProxy* self, guint16 port, GError** error);
+
+/**
+ * filter_proxy_get_port:
+ * @self: a #FilterProxy.
+ *
+ * Returns: the port the proxy listens on, or 0 before it listens.
+ */
+guint16 filter_proxy_get_port(FilterProxy* self);
+
+/**
+ * filter_proxy_get_stats:
+ * @self: a #FilterProxy.
+ * @stats: (out): counters since the proxy started. Thread-safe.
+ */
+void filter_proxy_get_stats(FilterProxy* self, FilterProxyStats* stats);
+
+G_END_DECLS
+
+#endif  // RUNNER_FILTER_PROXY_H_
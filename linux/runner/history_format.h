@@ -0,0 +1,99 @@
+#ifndef RUNNER_HISTORY_FORMAT_H_
+#define RUNNER_HISTORY_FORMAT_H_
+
+#include <stdint.h>
+
+#include <type_traits>
+
+// On-disk layout of the listening history kept by ListeningHistory, in
+// three files of one directory. Like the filter index, every structure is
+// a plain little-endian POD used in place through a mapping, at 4-byte
+// aligned offsets.
+//
+//   plays.log     HistoryLogHeader, then HistoryRecord[capacity]. Records
+//                 are appended in order of their start time; only the
+//                 first record_count are valid.
+//   strings.log   HistoryStringsHeader, then the distinct titles, artists
+//                 and albums, each a uint32_t length, the bytes and a NUL,
+//                 padded to 4 bytes. A string's id is its offset in the
+//                 file; only offsets below used_bytes are valid.
+//   artists.idx   HistoryIndexHeader, HistoryArtistEntry[artist_count]
+//                 sorted by artist id, then uint32_t postings[record_count]
+//                 holding each artist's record numbers in order. Covers the
+//                 first record_count records of plays.log and is rewritten
+//                 whole; later records are indexed in memory on open.
+//
+// Both logs are preallocated and grown in chunks, and a count is only
+// advanced past data that has been written, so a crash leaves at worst a
+// record or string that was never counted. Bump kHistoryVersion on any
+// change; logs of another version are refused rather than overwritten,
+// while an index of another version is just rebuilt.
+
+constexpr char kHistoryLogMagic[8] = {'Y', 'T', 'M', 'U', 'P', 'L', 'Y', 0};
+constexpr char kHistoryStringsMagic[8] = {'Y', 'T', 'M', 'U', 'S', 'T', 'R',
+                                          0};
+constexpr char kHistoryIndexMagic[8] = {'Y', 'T', 'M', 'U', 'A', 'R', 'T', 0};
+constexpr uint32_t kHistoryVersion = 1;
+
+struct HistoryLogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t record_count;
+  uint64_t reserved[5];
+};
+
+struct HistoryRecord {
+  // Wall-clock time the play started, in microseconds since the epoch.
+  // Never less than the previous record's.
+  int64_t started_at_us;
+  // Time actually spent playing, excluding pauses.
+  uint32_t listened_ms;
+  // The track's length, or 0 if it was never known.
+  uint32_t length_ms;
+  // String ids.
+  uint32_t title;
+  uint32_t artist;
+  uint32_t album;
+  uint32_t reserved;
+};
+
+struct HistoryStringsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t string_count;
+  // End of the last string, from the start of the file.
+  uint64_t used_bytes;
+  uint64_t reserved[5];
+};
+
+struct HistoryIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t artist_count;
+  uint64_t record_count;
+  // used_bytes of strings.log when the index was written; every artist id
+  // in the index is below it.
+  uint64_t strings_bytes;
+};
+
+struct HistoryArtistEntry {
+  uint32_t artist;
+  // Range of the artist's record numbers in postings.
+  uint32_t first;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<HistoryLogHeader>::value &&
+                  sizeof(HistoryLogHeader) == 64,
+              "HistoryLogHeader layout changed");
+static_assert(sizeof(HistoryRecord) == 32, "HistoryRecord layout changed");
+static_assert(sizeof(HistoryStringsHeader) == 64,
+              "HistoryStringsHeader layout changed");
+static_assert(sizeof(HistoryIndexHeader) == 32,
+              "HistoryIndexHeader layout changed");
+static_assert(sizeof(HistoryArtistEntry) == 16,
+              "HistoryArtistEntry layout changed");
+
+#endif  // RUNNER_HISTORY_FORMAT_H_
@@ -0,0 +1,145 @@
+#include "history_recorder.h"
+
+#include <utility>
+
+#include "now_playing_block.h"
+#include "play_tracker.h"
+
+// Shorter plays were skipped past and are not recorded.
+static constexpr gint64 kMinListenedUs = 5 * G_USEC_PER_SEC;
+
+// Appends are flushed this long after the first unflushed one, or once
+// this many are waiting, whichever comes first.
+static constexpr guint kFlushDelaySeconds = 60;
+static constexpr size_t kFlushBatch = 16;
+
+struct _HistoryRecorder {
+  GObject parent_instance;
+
+  ListeningHistory* history;
+  PlayTracker* tracker;
+  guint flush_source;
+  gboolean observing;
+  HistoryPlayHandler play_handler;
+  gpointer play_handler_data;
+};
+
+G_DEFINE_TYPE(HistoryRecorder, history_recorder, G_TYPE_OBJECT)
+
+static void flush_history(HistoryRecorder* self) {
+  if (self->flush_source != 0) {
+    g_source_remove(self->flush_source);
+    self->flush_source = 0;
+  }
+  g_autoptr(GError) error = nullptr;
+  if (!self->history->Flush(&error)) {
+    g_warning("Listening history: %s", error->message);
+  }
+}
+
+static gboolean flush_cb(gpointer user_data) {
+  HistoryRecorder* self = HISTORY_RECORDER(user_data);
+  self->flush_source = 0;
+  flush_history(self);
+  return G_SOURCE_REMOVE;
+}
+
+// Records |play| if it lasted.
+static void record_play(HistoryRecorder* self, const TrackedPlay& play) {
+  if (play.listened_us < kMinListenedUs) {
+    return;
+  }
+
+  HistoryPlay record = {};
+  record.started_at_us = play.started_at_us;
+  record.listened_ms =
+      MIN(play.listened_us / 1000, static_cast<gint64>(G_MAXUINT32));
+  record.length_ms =
+      CLAMP(play.length_us / 1000, 0, static_cast<gint64>(G_MAXUINT32));
+  record.title = play.title.c_str();
+  record.artist = play.artist.c_str();
+  record.album = play.album.c_str();
+  g_autoptr(GError) error = nullptr;
+  if (!self->history->Append(record, &error)) {
+    g_warning("Listening history: %s", error->message);
+    return;
+  }
+  if (self->play_handler != nullptr) {
+    self->play_handler(record, self->play_handler_data);
+  }
+
+  if (self->history->unflushed() >= kFlushBatch) {
+    flush_history(self);
+  } else if (self->flush_source == 0) {
+    self->flush_source =
+        g_timeout_add_seconds(kFlushDelaySeconds, flush_cb, self);
+  }
+}
+
+static void on_block_written(void* data) {
+  HistoryRecorder* self = HISTORY_RECORDER(data);
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block)) {
+    return;
+  }
+  TrackedPlay finished;
+  if (self->tracker->Update(block, g_get_monotonic_time(), &finished)) {
+    record_play(self, finished);
+  }
+}
+
+static void history_recorder_dispose(GObject* object) {
+  HistoryRecorder* self = HISTORY_RECORDER(object);
+
+  if (self->observing) {
+    now_playing_block_remove_observer(on_block_written, self);
+    self->observing = FALSE;
+  }
+  if (self->history != nullptr) {
+    TrackedPlay finished;
+    if (self->tracker->Finish(g_get_monotonic_time(), &finished)) {
+      record_play(self, finished);
+    }
+    flush_history(self);
+    // Writes the artist index, so the next start need not rebuild it.
+    delete self->history;
+    self->history = nullptr;
+  }
+  delete self->tracker;
+  self->tracker = nullptr;
+
+  G_OBJECT_CLASS(history_recorder_parent_class)->dispose(object);
+}
+
+static void history_recorder_class_init(HistoryRecorderClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = history_recorder_dispose;
+}
+
+static void history_recorder_init(HistoryRecorder* self) {
+  self->tracker = new PlayTracker();
+}
+
+HistoryRecorder* history_recorder_new(
+    std::unique_ptr<ListeningHistory> history) {
+  g_return_val_if_fail(history != nullptr, nullptr);
+
+  HistoryRecorder* self =
+      HISTORY_RECORDER(g_object_new(history_recorder_get_type(), nullptr));
+  self->history = history.release();
+  now_playing_block_add_observer(on_block_written, self);
+  self->observing = TRUE;
+  return self;
+}
+
+ListeningHistory* history_recorder_get_history(HistoryRecorder* self) {
+  g_return_val_if_fail(HISTORY_IS_RECORDER(self), nullptr);
+  return self->history;
+}
+
+void history_recorder_set_play_handler(HistoryRecorder* self,
+                                       HistoryPlayHandler handler,
+                                       gpointer user_data) {
+  g_return_if_fail(HISTORY_IS_RECORDER(self));
+  self->play_handler = handler;
+  self->play_handler_data = user_data;
+}
@@ -0,0 +1,53 @@
+#ifndef RUNNER_HISTORY_RECORDER_H_
+#define RUNNER_HISTORY_RECORDER_H_
+
+#include <gio/gio.h>
+
+#include <memory>
+
+#include "listening_history.h"
+
+// Turns writes of the now-playing block into plays in the listening
+// history, as delimited by a PlayTracker.
+
+G_BEGIN_DECLS
+
+#define HISTORY_TYPE_RECORDER history_recorder_get_type()
+G_DECLARE_FINAL_TYPE(HistoryRecorder, history_recorder, HISTORY, RECORDER,
+                     GObject)
+
+G_END_DECLS
+
+typedef void (*HistoryPlayHandler)(const HistoryPlay& play,
+                                   gpointer user_data);
+
+/**
+ * history_recorder_new:
+ * @history: the history to append to, which the recorder takes over.
+ *
+ * Starts recording from the next write of the now-playing block. Must be
+ * used, and disposed, on the thread that calls now_playing_block_notify().
+ * Disposing records the play in progress and flushes the history.
+ *
+ * Returns: a new #HistoryRecorder.
+ */
+HistoryRecorder* history_recorder_new(
+    std::unique_ptr<ListeningHistory> history);
+
+/**
+ * history_recorder_get_history:
+ *
+ * Returns: (transfer none): the history being recorded to, for queries
+ *   on the same thread.
+ */
+ListeningHistory* history_recorder_get_history(HistoryRecorder* self);
+
+/**
+ * history_recorder_set_play_handler:
+ * @handler: (nullable): called with each play once it is appended.
+ */
+void history_recorder_set_play_handler(HistoryRecorder* self,
+                                       HistoryPlayHandler handler,
+                                       gpointer user_data);
+
+#endif  // RUNNER_HISTORY_RECORDER_H_
@@ -0,0 +1,168 @@
+#include "host_matcher.h"
+
+#include <strings.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "host_trie.h"
+
+// Names hosts files map to loopback or multicast for the system itself.
+constexpr const char* kSystemNames[] = {
+    "localhost",     "localhost.localdomain", "local",
+    "broadcasthost", "ip6-localhost",         "ip6-loopback",
+    "ip6-localnet",  "ip6-mcastprefix",       "ip6-allnodes",
+    "ip6-allrouters", "ip6-allhosts",
+};
+
+struct HostMatcher {
+  // The trie's storage, 4-byte aligned for HostTrie.
+  std::unique_ptr<uint32_t[]> storage;
+  HostTrie trie;
+  uint32_t domain_count;
+};
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_host_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_';
+}
+
+// Addresses in the first column: IPv4, or IPv6 with its colons.
+static bool is_address(const char* field, size_t length) {
+  bool digits_and_dots = true;
+  for (size_t i = 0; i < length; i++) {
+    if (field[i] == ':') {
+      return true;
+    }
+    if (!(field[i] == '.' || (field[i] >= '0' && field[i] <= '9'))) {
+      digits_and_dots = false;
+    }
+  }
+  return digits_and_dots;
+}
+
+static bool is_system_name(const char* host, size_t length) {
+  for (const char* name : kSystemNames) {
+    if (strlen(name) == length && strncasecmp(name, host, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void add_host(HostTrieBuilder* builder, uint32_t* count,
+                     const char* host, size_t length) {
+  if (length == 0 || host[0] == '.' || is_address(host, length) ||
+      is_system_name(host, length)) {
+    return;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (!is_host_char(host[i])) {
+      return;
+    }
+  }
+  if (builder->Add(host, length, *count)) {
+    (*count)++;
+  }
+}
+
+static void add_line(HostTrieBuilder* builder, uint32_t* count,
+                     const char* line, size_t length) {
+  const void* comment = memchr(line, '#', length);
+  if (comment != nullptr) {
+    length = static_cast<const char*>(comment) - line;
+  }
+
+  std::vector<std::pair<const char*, size_t>> fields;
+  for (size_t i = 0; i < length;) {
+    if (is_space(line[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < length && !is_space(line[i])) {
+      i++;
+    }
+    fields.emplace_back(line + start, i - start);
+  }
+  if (fields.empty() || fields[0].first[0] == '!') {
+    return;
+  }
+
+  if (is_address(fields[0].first, fields[0].second)) {
+    for (size_t i = 1; i < fields.size(); i++) {
+      add_host(builder, count, fields[i].first, fields[i].second);
+    }
+    return;
+  }
+  if (fields.size() != 1) {
+    return;
+  }
+  const char* host = fields[0].first;
+  size_t host_length = fields[0].second;
+  if (host_length > 3 && strncmp(host, "||", 2) == 0 &&
+      host[host_length - 1] == '^') {
+    host += 2;
+    host_length -= 3;
+  }
+  add_host(builder, count, host, host_length);
+}
+
+HostMatcher* host_matcher_new(const char* list, size_t length) {
+  HostTrieBuilder builder;
+  uint32_t count = 0;
+  const char* end = list + length;
+  for (const char* line = list; line < end;) {
+    const char* line_end =
+        static_cast<const char*>(memchr(line, '\n', end - line));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    add_line(&builder, &count, line, line_end - line);
+    line = line_end + 1;
+  }
+
+  const std::string trie = builder.Build();
+  auto* matcher = new HostMatcher();
+  matcher->storage.reset(new uint32_t[trie.size() / sizeof(uint32_t)]);
+  memcpy(matcher->storage.get(), trie.data(), trie.size());
+  matcher->trie.Attach(matcher->storage.get(), trie.size());
+  matcher->domain_count = count;
+  return matcher;
+}
+
+void host_matcher_free(HostMatcher* matcher) {
+  delete matcher;
+}
+
+uint32_t host_matcher_domain_count(const HostMatcher* matcher) {
+  return matcher->domain_count;
+}
+
+size_t host_matcher_memory_size(const HostMatcher* matcher) {
+  return matcher->trie.size();
+}
+
+int32_t host_matcher_match_host(const HostMatcher* matcher, const char* host,
+                                size_t length) {
+  const uint32_t entry = matcher->trie.Match(host, length);
+  return entry == HostTrie::kNoMatch ? -1 : static_cast<int32_t>(entry);
+}
+
+int32_t host_matcher_match_url(const HostMatcher* matcher, const char* url,
+                               size_t length) {
+  size_t host_start;
+  size_t host_end;
+  HostTrie::FindHost(url, length, &host_start, &host_end);
+  if (host_end <= host_start) {
+    return -1;
+  }
+  return host_matcher_match_host(matcher, url + host_start,
+                                 host_end - host_start);
+}
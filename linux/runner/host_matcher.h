@@ -0,0 +1,59 @@
+#ifndef RUNNER_HOST_MATCHER_H_
+#define RUNNER_HOST_MATCHER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blocks whole domains, and their subdomains, from hosts-file style lists
+// of any size; see host_trie.h for the structure. Exported for
+// lib/services/url_blocker.dart, which reaches it through dart:ffi, and
+// used by the filter proxy.
+//
+// One entry per line; blank lines and lines starting with '#' or '!' are
+// comments, as is anything after a '#' within a line. A line is either
+//
+//   0.0.0.0 host [host...]   an address followed by hosts, as in
+//                            /etc/hosts; the address is ignored
+//   host                     a bare domain
+//   ||host^                  an adblock-style domain rule
+//
+// Names such as "localhost" that hosts files map for the system's own use
+// are skipped. Entry ids count the accepted domains from zero.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostMatcher HostMatcher;
+
+#define HOST_MATCHER_EXPORT __attribute__((visibility("default")))
+
+// Builds a matcher from |length| bytes of list text. Never returns NULL.
+HOST_MATCHER_EXPORT HostMatcher* host_matcher_new(const char* list,
+                                                  size_t length);
+
+HOST_MATCHER_EXPORT void host_matcher_free(HostMatcher* matcher);
+
+// The number of domains accepted from the list.
+HOST_MATCHER_EXPORT uint32_t
+host_matcher_domain_count(const HostMatcher* matcher);
+
+// Bytes taken by the packed trie.
+HOST_MATCHER_EXPORT size_t host_matcher_memory_size(const HostMatcher* matcher);
+
+// Returns the id of the entry blocking the |length| bytes at |host|, or
+// -1. Safe to call from several threads.
+HOST_MATCHER_EXPORT int32_t host_matcher_match_host(const HostMatcher* matcher,
+                                                    const char* host,
+                                                    size_t length);
+
+// As host_matcher_match_host for the host of |url|.
+HOST_MATCHER_EXPORT int32_t host_matcher_match_url(const HostMatcher* matcher,
+                                                   const char* url,
+                                                   size_t length);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_HOST_MATCHER_H_
@@ -0,0 +1,362 @@
+#include "host_trie.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Children are searched linearly up to this many, by bisection beyond.
+constexpr uint32_t kLinearChildren = 8;
+
+constexpr size_t kMaxLabelLength = 255;
+
+static inline char to_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// FNV-1a over the lower-cased label.
+static uint32_t label_hash(const char* label, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(to_lower(label[i]));
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool equals_lower(const uint8_t* stored, const char* label,
+                         size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (stored[i] != static_cast<uint8_t>(to_lower(label[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint32_t next_power_of_two(uint64_t value) {
+  uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+bool HostTrie::Attach(const void* data, size_t size) {
+  header_ = nullptr;
+  size_ = 0;
+  if (data == nullptr || reinterpret_cast<uintptr_t>(data) % 4 != 0 ||
+      size < sizeof(HostTrieHeader)) {
+    return false;
+  }
+  const auto* header = static_cast<const HostTrieHeader*>(data);
+  const uint64_t words = (uint64_t{header->node_count} + 31) / 32;
+  const uint64_t expected = sizeof(HostTrieHeader) +
+                            uint64_t{header->label_bytes} +
+                            4 * (uint64_t{header->slot_count} +
+                                 2 * uint64_t{header->node_count} + 1 +
+                                 2 * words + header->terminal_count);
+  if (header->node_count == 0 || header->label_bytes % 4 != 0 ||
+      header->slot_count == 0 ||
+      (header->slot_count & (header->slot_count - 1)) != 0 ||
+      expected != size) {
+    return false;
+  }
+
+  const uint8_t* cursor =
+      static_cast<const uint8_t*>(data) + sizeof(HostTrieHeader);
+  auto take = [&cursor](uint64_t count) {
+    const uint32_t* array = reinterpret_cast<const uint32_t*>(cursor);
+    cursor += count * sizeof(uint32_t);
+    return array;
+  };
+  labels_ = cursor;
+  cursor += header->label_bytes;
+  slots_ = take(header->slot_count);
+  child_begin_ = take(uint64_t{header->node_count} + 1);
+  node_labels_ = take(header->node_count);
+  terminals_ = take(words);
+  ranks_ = take(words);
+  values_ = take(header->terminal_count);
+  header_ = header;
+  size_ = size;
+  return true;
+}
+
+// Returns the pool offset of |label|, or kNoMatch if no domain has it.
+uint32_t HostTrie::FindLabel(const char* label, size_t length) const {
+  if (length > kMaxLabelLength) {
+    return kNoMatch;
+  }
+  const uint32_t mask = header_->slot_count - 1;
+  uint32_t slot = label_hash(label, length) & mask;
+  for (uint32_t probe = 0; probe <= mask; probe++) {
+    const uint32_t entry = slots_[slot];
+    if (entry == 0) {
+      return kNoMatch;
+    }
+    const uint32_t offset = entry - 1;
+    if (offset < header_->label_bytes && labels_[offset] == length &&
+        length < header_->label_bytes - offset &&
+        equals_lower(labels_ + offset + 1, label, length)) {
+      return offset;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return kNoMatch;
+}
+
+// Returns the child of |node| with |label|, or kNoMatch.
+uint32_t HostTrie::FindChild(uint32_t node, uint32_t label) const {
+  const uint32_t begin = child_begin_[node];
+  const uint32_t end = child_begin_[node + 1];
+  if (begin > end || end > header_->node_count) {
+    return kNoMatch;
+  }
+  if (end - begin <= kLinearChildren) {
+    for (uint32_t child = begin; child < end; child++) {
+      if (node_labels_[child] == label) {
+        return child;
+      }
+    }
+    return kNoMatch;
+  }
+  const uint32_t* found =
+      std::lower_bound(node_labels_ + begin, node_labels_ + end, label);
+  return found != node_labels_ + end && *found == label
+             ? static_cast<uint32_t>(found - node_labels_)
+             : kNoMatch;
+}
+
+uint32_t HostTrie::Match(const char* host, size_t length) const {
+  if (header_ == nullptr) {
+    return kNoMatch;
+  }
+  if (length > 0 && host[length - 1] == '.') {
+    length--;
+  }
+
+  uint32_t node = 0;
+  size_t label_end = length;
+  while (label_end > 0) {
+    size_t label_start = label_end;
+    while (label_start > 0 && host[label_start - 1] != '.') {
+      label_start--;
+    }
+    if (label_start == label_end) {
+      return kNoMatch;
+    }
+    const uint32_t label =
+        FindLabel(host + label_start, label_end - label_start);
+    if (label == kNoMatch) {
+      return kNoMatch;
+    }
+    node = FindChild(node, label);
+    if (node == kNoMatch) {
+      return kNoMatch;
+    }
+
+    const uint32_t word = node / 32;
+    const uint32_t bit = 1u << (node % 32);
+    if (terminals_[word] & bit) {
+      const uint32_t rank = ranks_[word] + static_cast<uint32_t>(
+                                               __builtin_popcount(
+                                                   terminals_[word] &
+                                                   (bit - 1)));
+      return rank < header_->terminal_count ? values_[rank] : kNoMatch;
+    }
+
+    if (label_start == 0) {
+      break;
+    }
+    label_end = label_start - 1;
+  }
+  return kNoMatch;
+}
+
+void HostTrie::FindHost(const char* url, size_t length, size_t* host_start,
+                        size_t* host_end) {
+  *host_start = *host_end = 0;
+  const char* scheme_end = static_cast<const char*>(
+      memmem(url, length, "://", 3));
+  if (scheme_end == nullptr) {
+    return;
+  }
+  size_t start = scheme_end - url + 3;
+  size_t end = start;
+  while (end < length && url[end] != '/' && url[end] != '?' &&
+         url[end] != '#') {
+    end++;
+  }
+  const void* at = memchr(url + start, '@', end - start);
+  if (at != nullptr) {
+    start = static_cast<const char*>(at) - url + 1;
+  }
+  const void* colon = memchr(url + start, ':', end - start);
+  if (colon != nullptr) {
+    end = static_cast<const char*>(colon) - url;
+  }
+  *host_start = start;
+  *host_end = end;
+}
+
+bool HostTrieBuilder::Add(const char* domain, size_t length, uint32_t value) {
+  if (length > 0 && domain[length - 1] == '.') {
+    length--;
+  }
+  if (length == 0) {
+    return false;
+  }
+
+  // Split first, so a bad label leaves nothing behind.
+  std::vector<std::pair<size_t, size_t>> labels;
+  size_t label_end = length;
+  while (true) {
+    size_t label_start = label_end;
+    while (label_start > 0 && domain[label_start - 1] != '.') {
+      label_start--;
+    }
+    const size_t label_length = label_end - label_start;
+    if (label_length == 0 || label_length > kMaxLabelLength) {
+      return false;
+    }
+    labels.emplace_back(label_start, label_length);
+    if (label_start == 0) {
+      break;
+    }
+    label_end = label_start - 1;
+  }
+
+  const uint32_t begin = static_cast<uint32_t>(sequences_.size());
+  for (const auto& label : labels) {
+    std::string text(domain + label.first, label.second);
+    for (char& c : text) {
+      c = to_lower(c);
+    }
+    auto inserted = label_ids_.emplace(
+        text, static_cast<uint32_t>(label_text_.size()));
+    if (inserted.second) {
+      label_text_.push_back(std::move(text));
+    }
+    sequences_.push_back(inserted.first->second);
+  }
+  entries_.push_back(
+      Entry{begin, static_cast<uint32_t>(labels.size()), value});
+  return true;
+}
+
+std::string HostTrieBuilder::Build() const {
+  // Sorting the label sequences groups every node's subtree, and puts a
+  // domain before its subdomains and a duplicate's lowest value first.
+  std::vector<uint32_t> order(entries_.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  const uint32_t* sequences = sequences_.data();
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    const Entry& x = entries_[a];
+    const Entry& y = entries_[b];
+    const uint32_t* p = sequences + x.begin;
+    const uint32_t* q = sequences + y.begin;
+    if (std::lexicographical_compare(p, p + x.length, q, q + y.length)) {
+      return true;
+    }
+    if (std::lexicographical_compare(q, q + y.length, p, p + x.length)) {
+      return false;
+    }
+    return x.value < y.value;
+  });
+
+  // Pooled in id order, so offsets sort like ids and the sorted children
+  // below need no re-sorting.
+  std::string labels;
+  std::vector<uint32_t> offsets(label_text_.size());
+  for (size_t id = 0; id < label_text_.size(); id++) {
+    offsets[id] = static_cast<uint32_t>(labels.size());
+    labels.push_back(static_cast<char>(label_text_[id].size()));
+    labels += label_text_[id];
+  }
+  labels.resize((labels.size() + 3) & ~static_cast<size_t>(3), '\0');
+
+  std::vector<uint32_t> slots(
+      next_power_of_two(uint64_t{label_text_.size()} * 4 / 3 + 1), 0);
+  const uint32_t mask = static_cast<uint32_t>(slots.size() - 1);
+  for (size_t id = 0; id < label_text_.size(); id++) {
+    const std::string& text = label_text_[id];
+    uint32_t slot = label_hash(text.data(), text.size()) & mask;
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = offsets[id] + 1;
+  }
+
+  // Breadth-first, each node covering the sorted entries [low, high) that
+  // share its first |depth| labels. A listed domain ends its branch.
+  struct Pending {
+    uint32_t low;
+    uint32_t high;
+    uint32_t depth;
+  };
+  std::vector<Pending> nodes = {{0, static_cast<uint32_t>(order.size()), 0}};
+  std::vector<uint32_t> child_begin;
+  std::vector<uint32_t> node_labels = {0};
+  std::vector<bool> terminal = {false};
+  std::vector<uint32_t> values;
+  for (size_t head = 0; head < nodes.size(); head++) {
+    const Pending node = nodes[head];
+    child_begin.push_back(static_cast<uint32_t>(nodes.size()));
+    if (node.low == node.high) {
+      continue;
+    }
+    const Entry& first = entries_[order[node.low]];
+    if (head != 0 && first.length == node.depth) {
+      terminal[head] = true;
+      values.push_back(first.value);
+      continue;
+    }
+    for (uint32_t low = node.low; low < node.high;) {
+      const uint32_t label =
+          sequences[entries_[order[low]].begin + node.depth];
+      uint32_t high = low + 1;
+      while (high < node.high &&
+             sequences[entries_[order[high]].begin + node.depth] == label) {
+        high++;
+      }
+      nodes.push_back(Pending{low, high, node.depth + 1});
+      node_labels.push_back(offsets[label]);
+      terminal.push_back(false);
+      low = high;
+    }
+  }
+  const uint32_t node_count = static_cast<uint32_t>(nodes.size());
+  child_begin.push_back(node_count);
+
+  const size_t words = (node_count + 31) / 32;
+  std::vector<uint32_t> terminals(words, 0);
+  std::vector<uint32_t> ranks(words, 0);
+  uint32_t rank = 0;
+  for (uint32_t node = 0; node < node_count; node++) {
+    if (node % 32 == 0) {
+      ranks[node / 32] = rank;
+    }
+    if (terminal[node]) {
+      terminals[node / 32] |= 1u << (node % 32);
+      rank++;
+    }
+  }
+
+  HostTrieHeader header = {node_count, static_cast<uint32_t>(values.size()),
+                           static_cast<uint32_t>(slots.size()),
+                           static_cast<uint32_t>(labels.size())};
+  std::string trie(reinterpret_cast<const char*>(&header), sizeof(header));
+  auto append = [&trie](const std::vector<uint32_t>& array) {
+    trie.append(reinterpret_cast<const char*>(array.data()),
+                array.size() * sizeof(uint32_t));
+  };
+  trie += labels;
+  append(slots);
+  append(child_begin);
+  append(node_labels);
+  append(terminals);
+  append(ranks);
+  append(values);
+  return trie;
+}
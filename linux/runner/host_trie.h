@@ -0,0 +1,121 @@
+#ifndef RUNNER_HOST_TRIE_H_
+#define RUNNER_HOST_TRIE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A set of domains, each blocking itself and its subdomains, packed into
+// one flat block of uint32_t arrays that is searched in place. Built once
+// from a list by HostTrieBuilder; the block can be kept in memory or
+// written into a file and mapped, as the filter index does.
+//
+// Every distinct label is stored once, in a pool that an open-addressing
+// table indexes by hash, and is identified by its offset in the pool. The
+// trie over reversed labels is laid out breadth-first, so a node is its
+// position: a node costs one label id and one child offset, 8 bytes, plus
+// a bit saying whether it ends a domain. A lookup hashes each label of the
+// host once, from the top-level domain down, and searches the sorted ids
+// of the current node's children; a host with a label no listed domain
+// has is rejected on that label's hash probe.
+//
+// Layout, all 4-byte aligned and little-endian:
+//
+//   HostTrieHeader
+//   uint8_t  labels[label_bytes]       length byte, then the label
+//   uint32_t slots[slot_count]         pool offset + 1, or 0 when empty
+//   uint32_t child_begin[node_count + 1]
+//   uint32_t node_labels[node_count]   pool offsets; the root's is unused
+//   uint32_t terminals[words]          bit per node, words = nodes / 32
+//   uint32_t ranks[words]              terminals set in the words before
+//   uint32_t values[terminal_count]    by rank of the terminal node
+
+struct HostTrieHeader {
+  uint32_t node_count;
+  uint32_t terminal_count;
+  // A power of two.
+  uint32_t slot_count;
+  // A multiple of 4.
+  uint32_t label_bytes;
+};
+
+class HostTrie {
+ public:
+  static constexpr uint32_t kNoMatch = UINT32_MAX;
+
+  HostTrie() = default;
+
+  // Uses the trie at |data|, which must be 4-byte aligned and outlive the
+  // HostTrie. Returns false if the header and array sizes do not add up;
+  // offsets within the arrays are checked as lookups use them, so a
+  // damaged trie can only fail lookups.
+  bool Attach(const void* data, size_t size);
+
+  // Returns the value of the listed domain that |host| is or is a
+  // subdomain of, or kNoMatch. |host| may be in any case and may end in a
+  // dot. When a domain and one of its subdomains are both listed, the
+  // domain decides. Thread-safe.
+  uint32_t Match(const char* host, size_t length) const;
+
+  // Locates the host in |url|: after "://", up to the path, and without
+  // any user info or port. Sets both offsets to 0 if there is none.
+  static void FindHost(const char* url, size_t length, size_t* host_start,
+                       size_t* host_end);
+
+  uint32_t node_count() const { return header_ ? header_->node_count : 0; }
+  uint32_t domain_count() const {
+    return header_ ? header_->terminal_count : 0;
+  }
+  size_t size() const { return size_; }
+
+ private:
+  uint32_t FindLabel(const char* label, size_t length) const;
+  uint32_t FindChild(uint32_t node, uint32_t label) const;
+
+  const HostTrieHeader* header_ = nullptr;
+  size_t size_ = 0;
+  const uint8_t* labels_ = nullptr;
+  const uint32_t* slots_ = nullptr;
+  const uint32_t* child_begin_ = nullptr;
+  const uint32_t* node_labels_ = nullptr;
+  const uint32_t* terminals_ = nullptr;
+  const uint32_t* ranks_ = nullptr;
+  const uint32_t* values_ = nullptr;
+};
+
+class HostTrieBuilder {
+ public:
+  HostTrieBuilder() = default;
+  HostTrieBuilder(const HostTrieBuilder&) = delete;
+  HostTrieBuilder& operator=(const HostTrieBuilder&) = delete;
+
+  // Adds |domain| with |value|; a domain added twice keeps the lower
+  // value. Returns false, adding nothing, if |domain| has an empty label
+  // or one longer than 255 bytes. ASCII case is ignored.
+  bool Add(const char* domain, size_t length, uint32_t value);
+
+  // Returns the trie, ready for HostTrie::Attach once copied to 4-byte
+  // aligned memory.
+  std::string Build() const;
+
+  size_t domain_count() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    // Labels, top-level domain first, in |sequences_|.
+    uint32_t begin;
+    uint32_t length;
+    uint32_t value;
+  };
+
+  // Label text to its id, assigned in order of first appearance.
+  std::unordered_map<std::string, uint32_t> label_ids_;
+  std::vector<std::string> label_text_;
+  std::vector<uint32_t> sequences_;
+  std::vector<Entry> entries_;
+};
+
+#endif  // RUNNER_HOST_TRIE_H_
@@ -0,0 +1,260 @@
+#include "http_client.h"
+
+#include <cstdio>
+#include <cstring>
+
+static constexpr guint kTimeoutSeconds = 10;
+static constexpr gint kMaxRedirects = 3;
+
+struct HttpResponse {
+  guint status = 0;
+  gchar* location = nullptr;
+  gint64 content_length = -1;
+};
+
+static gboolean parse_url(const gchar* url, gboolean* tls, gchar** host,
+                          guint16* port, gchar** target, GError** error) {
+  g_autoptr(GUri) uri = g_uri_parse(url, G_URI_FLAGS_ENCODED, error);
+  if (uri == nullptr) {
+    return FALSE;
+  }
+
+  const gchar* scheme = g_uri_get_scheme(uri);
+  if (g_strcmp0(scheme, "https") == 0) {
+    *tls = TRUE;
+  } else if (g_strcmp0(scheme, "http") == 0) {
+    *tls = FALSE;
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Unsupported URL scheme '%s'", scheme);
+    return FALSE;
+  }
+
+  if (g_uri_get_host(uri) == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                "URL has no host");
+    return FALSE;
+  }
+
+  gint uri_port = g_uri_get_port(uri);
+  *host = g_strdup(g_uri_get_host(uri));
+  *port = uri_port > 0 ? uri_port : (*tls ? 443 : 80);
+
+  const gchar* path = g_uri_get_path(uri);
+  const gchar* query = g_uri_get_query(uri);
+  *target = g_strconcat(path != nullptr && *path != '\0' ? path : "/",
+                        query != nullptr ? "?" : "",
+                        query != nullptr ? query : "",
+                        nullptr);
+  return TRUE;
+}
+
+static gboolean read_headers(GDataInputStream* input, HttpResponse* response,
+                             GError** error) {
+  g_autofree gchar* status_line = g_data_input_stream_read_line(
+      input, nullptr, nullptr, error);
+  if (status_line == nullptr) {
+    if (error != nullptr && *error == nullptr) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                  "Connection closed before the status line");
+    }
+    return FALSE;
+  }
+
+  // "HTTP/1.x NNN Reason"
+  if (!g_str_has_prefix(status_line, "HTTP/") ||
+      sscanf(status_line, "HTTP/%*s %u", &response->status) != 1) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Malformed status line");
+    return FALSE;
+  }
+
+  while (TRUE) {
+    g_autofree gchar* line = g_data_input_stream_read_line(
+        input, nullptr, nullptr, error);
+    if (line == nullptr) {
+      return error == nullptr || *error == nullptr;
+    }
+    g_strchomp(line);
+    if (*line == '\0') {
+      return TRUE;
+    }
+
+    gchar* colon = strchr(line, ':');
+    if (colon == nullptr) {
+      continue;
+    }
+    *colon = '\0';
+    const gchar* value = g_strstrip(colon + 1);
+
+    if (g_ascii_strcasecmp(line, "Location") == 0) {
+      g_free(response->location);
+      response->location = g_strdup(value);
+    } else if (g_ascii_strcasecmp(line, "Content-Length") == 0) {
+      response->content_length = g_ascii_strtoll(value, nullptr, 10);
+    }
+  }
+}
+
+static GBytes* read_body(GInputStream* input, const HttpResponse& response,
+                         gsize max_size, GCancellable* cancellable,
+                         GError** error) {
+  if (response.content_length > static_cast<gint64>(max_size)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                "Response too large");
+    return nullptr;
+  }
+
+  g_autoptr(GByteArray) body = g_byte_array_new();
+  guint8 buffer[16 * 1024];
+  while (TRUE) {
+    gssize n = g_input_stream_read(input, buffer, sizeof(buffer),
+                                   cancellable, error);
+    if (n < 0) {
+      return nullptr;
+    }
+    if (n == 0) {
+      break;
+    }
+    if (body->len + static_cast<gsize>(n) > max_size) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                  "Response too large");
+      return nullptr;
+    }
+    g_byte_array_append(body, buffer, n);
+  }
+
+  if (response.content_length >= 0 &&
+      body->len != static_cast<guint>(response.content_length)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                "Truncated response body");
+    return nullptr;
+  }
+
+  return g_byte_array_free_to_bytes(
+      static_cast<GByteArray*>(g_steal_pointer(&body)));
+}
+
+// Sends one request and reads the status and headers. A |body|, if any, is
+// sent as |content_type|.
+static GSocketConnection* send_request(const gchar* method, const gchar* url,
+                                       const gchar* content_type,
+                                       GBytes* body,
+                                       GCancellable* cancellable,
+                                       GDataInputStream** input,
+                                       HttpResponse* response,
+                                       GError** error) {
+  gboolean tls;
+  g_autofree gchar* host = nullptr;
+  guint16 port;
+  g_autofree gchar* target = nullptr;
+  if (!parse_url(url, &tls, &host, &port, &target, error)) {
+    return nullptr;
+  }
+
+  g_autoptr(GSocketClient) client = g_socket_client_new();
+  g_socket_client_set_tls(client, tls);
+  g_socket_client_set_timeout(client, kTimeoutSeconds);
+
+  g_autoptr(GSocketConnection) connection = g_socket_client_connect_to_host(
+      client, host, port, cancellable, error);
+  if (connection == nullptr) {
+    return nullptr;
+  }
+
+  // HTTP/1.0 keeps the reader simple: no chunked encoding, and the server
+  // closes the connection after the body.
+  g_autoptr(GString) request = g_string_new(nullptr);
+  g_string_append_printf(request,
+                         "%s %s HTTP/1.0\r\n"
+                         "Host: %s\r\n"
+                         "User-Agent: youtube_music_unbound\r\n"
+                         "Accept: */*\r\n"
+                         "Connection: close\r\n",
+                         method, target, host);
+  if (body != nullptr) {
+    g_string_append_printf(request,
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %" G_GSIZE_FORMAT "\r\n",
+                           content_type, g_bytes_get_size(body));
+  }
+  g_string_append(request, "\r\n");
+  if (body != nullptr) {
+    gsize size;
+    const gchar* data =
+        static_cast<const gchar*>(g_bytes_get_data(body, &size));
+    g_string_append_len(request, data, size);
+  }
+  GOutputStream* output =
+      g_io_stream_get_output_stream(G_IO_STREAM(connection));
+  if (!g_output_stream_write_all(output, request->str, request->len, nullptr,
+                                 cancellable, error)) {
+    return nullptr;
+  }
+
+  *input = g_data_input_stream_new(
+      g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+  g_data_input_stream_set_newline_type(*input,
+                                       G_DATA_STREAM_NEWLINE_TYPE_ANY);
+  if (!read_headers(*input, response, error)) {
+    g_clear_object(input);
+    return nullptr;
+  }
+  return static_cast<GSocketConnection*>(g_steal_pointer(&connection));
+}
+
+static GBytes* get(const gchar* url, gsize max_size, gint redirects_left,
+                   GError** error) {
+  HttpResponse response;
+  g_autoptr(GDataInputStream) input = nullptr;
+  g_autoptr(GSocketConnection) connection = send_request(
+      "GET", url, nullptr, nullptr, nullptr, &input, &response, error);
+  g_autofree gchar* location = response.location;
+  if (connection == nullptr) {
+    return nullptr;
+  }
+
+  if (response.status >= 300 && response.status < 400 &&
+      location != nullptr) {
+    if (redirects_left == 0) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Too many redirects");
+      return nullptr;
+    }
+    g_autofree gchar* next = g_uri_resolve_relative(
+        url, location, G_URI_FLAGS_ENCODED, error);
+    if (next == nullptr) {
+      return nullptr;
+    }
+    return get(next, max_size, redirects_left - 1, error);
+  }
+
+  if (response.status < 200 || response.status >= 300) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP status %u",
+                response.status);
+    return nullptr;
+  }
+
+  return read_body(G_INPUT_STREAM(input), response, max_size, nullptr,
+                   error);
+}
+
+GBytes* http_client_get(const gchar* url, gsize max_size, GError** error) {
+  return get(url, max_size, kMaxRedirects, error);
+}
+
+GBytes* http_client_post(const gchar* url, const gchar* content_type,
+                         GBytes* body, gsize max_size, guint* status,
+                         GCancellable* cancellable, GError** error) {
+  HttpResponse response;
+  g_autoptr(GDataInputStream) input = nullptr;
+  g_autoptr(GSocketConnection) connection =
+      send_request("POST", url, content_type, body, cancellable, &input,
+                   &response, error);
+  g_free(response.location);
+  if (connection == nullptr) {
+    return nullptr;
+  }
+  *status = response.status;
+  return read_body(G_INPUT_STREAM(input), response, max_size, cancellable,
+                   error);
+}
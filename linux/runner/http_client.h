@@ -0,0 +1,43 @@
+#ifndef RUNNER_HTTP_CLIENT_H_
+#define RUNNER_HTTP_CLIENT_H_
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * http_client_get:
+ * @url: an http:// or https:// URL.
+ * @max_size: largest body accepted, in bytes.
+ * @error: (optional): return location for a #GError.
+ *
+ * Fetches @url with a blocking HTTP/1.0 request, following up to three
+ * redirects. Intended for worker threads; never call it on a main loop.
+ *
+ * Returns: the response body, or %NULL on failure or a non-2xx status.
+ */
+GBytes* http_client_get(const gchar* url, gsize max_size, GError** error);
+
+/**
+ * http_client_post:
+ * @url: an http:// or https:// URL.
+ * @content_type: the type of @body.
+ * @body: the request body.
+ * @max_size: largest response body accepted, in bytes.
+ * @status: (out): the response status, set once one was read.
+ * @cancellable: (nullable): cancels the request from another thread.
+ * @error: (optional): return location for a #GError.
+ *
+ * Sends @body with a blocking HTTP/1.0 POST. Redirects are not followed.
+ * Like http_client_get(), for worker threads only.
+ *
+ * Returns: the response body whatever the status, or %NULL if no complete
+ *   response was read.
+ */
+GBytes* http_client_post(const gchar* url, const gchar* content_type,
+                         GBytes* body, gsize max_size, guint* status,
+                         GCancellable* cancellable, GError** error);
+
+G_END_DECLS
+
+#endif  // RUNNER_HTTP_CLIENT_H_
@@ -0,0 +1,314 @@
+#include "json_pruner.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A member is found by its key: an unescaped quote, the key, a quote and a
+// colon. In well-formed JSON that sequence cannot occur inside a string,
+// because a quote inside a string is escaped and the unescaped quote that
+// ends one is never followed by a letter. So only the text around each
+// candidate needs looking at, and only the value of a removed member is
+// scanned structurally. Everything else is copied in bulk.
+
+struct PrunedKey {
+  const char* name;
+  size_t length;
+};
+
+static constexpr PrunedKey kPrunedKeys[] = {
+    {"adPlacements", 12},
+    {"adSlots", 7},
+    {"adBreakHeartbeatParams", 22},
+    {"playerAds", 9},
+    {"serverAbrStreamingUrl", 21},
+};
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// The first letters of the pruned keys.
+static inline bool is_key_start(char c) {
+  return c == 'a' || c == 'p' || c == 's';
+}
+
+static inline bool is_structural(char c) {
+  return c == '"' || c == '{' || c == '}' || c == '[' || c == ']';
+}
+
+static const char* skip_space(const char* p, const char* end) {
+  while (p < end && is_space(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#if defined(__SSE2__)
+
+static inline const char* first_set(const char* block, int mask) {
+  return block + __builtin_ctz(static_cast<unsigned>(mask));
+}
+
+// Returns the first quote in [p, end) followed by the first letter of a
+// pruned key, or end.
+static const char* find_candidate(const char* p, const char* end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i a = _mm_set1_epi8('a');
+  const __m128i pl = _mm_set1_epi8('p');
+  const __m128i s = _mm_set1_epi8('s');
+  for (; end - p > 16; p += 16) {
+    __m128i here = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    __m128i starts = _mm_or_si128(
+        _mm_cmpeq_epi8(next, a),
+        _mm_or_si128(_mm_cmpeq_epi8(next, pl), _mm_cmpeq_epi8(next, s)));
+    int mask =
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, quote), starts));
+    if (mask != 0) {
+      return first_set(p, mask);
+    }
+  }
+  for (; p + 1 < end; p++) {
+    if (*p == '"' && is_key_start(p[1])) {
+      return p;
+    }
+  }
+  return end;
+}
+
+// Returns the first quote or backslash in [p, end), or end.
+static const char* find_quote_or_escape(const char* p, const char* end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; end - p >= 16; p += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)));
+    if (mask != 0) {
+      return first_set(p, mask);
+    }
+  }
+  while (p < end && *p != '"' && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+// Returns the first quote or bracket in [p, end), or end.
+static const char* find_structural(const char* p, const char* end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i open_brace = _mm_set1_epi8('{');
+  const __m128i close_brace = _mm_set1_epi8('}');
+  const __m128i open_bracket = _mm_set1_epi8('[');
+  const __m128i close_bracket = _mm_set1_epi8(']');
+  for (; end - p >= 16; p += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                     _mm_cmpeq_epi8(block, open_brace)),
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, close_brace),
+                         _mm_cmpeq_epi8(block, open_bracket)),
+            _mm_cmpeq_epi8(block, close_bracket)));
+    int mask = _mm_movemask_epi8(hits);
+    if (mask != 0) {
+      return first_set(p, mask);
+    }
+  }
+  while (p < end && !is_structural(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#else
+
+static const char* find_candidate(const char* p, const char* end) {
+  for (; p + 1 < end; p++) {
+    p = static_cast<const char*>(memchr(p, '"', end - p));
+    if (p == nullptr) {
+      return end;
+    }
+    if (p + 1 < end && is_key_start(p[1])) {
+      return p;
+    }
+  }
+  return end;
+}
+
+static const char* find_quote_or_escape(const char* p, const char* end) {
+  while (p < end && *p != '"' && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+static const char* find_structural(const char* p, const char* end) {
+  while (p < end && !is_structural(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#endif  // defined(__SSE2__)
+
+// |p| is just past an opening quote. Returns the position just past the
+// closing quote, or nullptr if the string is unterminated.
+static const char* skip_string(const char* p, const char* end) {
+  while (true) {
+    p = find_quote_or_escape(p, end);
+    if (p == end) {
+      return nullptr;
+    }
+    if (*p == '"') {
+      return p + 1;
+    }
+    // A backslash escapes the next byte; \uXXXX needs no special case.
+    p += 2;
+    if (p > end) {
+      return nullptr;
+    }
+  }
+}
+
+// Returns the position just past the value starting at |p|, or nullptr if
+// it is truncated or unbalanced.
+static const char* skip_value(const char* p, const char* end) {
+  if (p == end) {
+    return nullptr;
+  }
+  if (*p == '"') {
+    return skip_string(p + 1, end);
+  }
+  if (*p != '{' && *p != '[') {
+    // A number, true, false or null. A member's value is always followed
+    // by at least its object's closing brace, so one that runs to the end
+    // of the input is truncated.
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_space(*p)) {
+      p++;
+    }
+    return p > start && p < end ? p : nullptr;
+  }
+
+  // Brackets of either kind are only counted; a mismatch inside a removed
+  // value does not matter as long as the value ends where it should.
+  size_t depth = 0;
+  while (true) {
+    p = find_structural(p, end);
+    if (p == end) {
+      return nullptr;
+    }
+    switch (*p) {
+      case '"':
+        p = skip_string(p + 1, end);
+        if (p == nullptr) {
+          return nullptr;
+        }
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      default:
+        if (--depth == 0) {
+          return p + 1;
+        }
+        break;
+    }
+    p++;
+  }
+}
+
+// If a pruned key starts at the quote |p|, returns the position of its
+// value; otherwise nullptr.
+static const char* match_key(const char* input, const char* p,
+                             const char* end) {
+  if (p > input && p[-1] == '\\') {
+    return nullptr;
+  }
+  for (const PrunedKey& key : kPrunedKeys) {
+    const char* name_end = p + 1 + key.length;
+    if (name_end < end && *name_end == '"' &&
+        memcmp(p + 1, key.name, key.length) == 0) {
+      const char* colon = skip_space(name_end + 1, end);
+      if (colon < end && *colon == ':') {
+        return skip_space(colon + 1, end);
+      }
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+int64_t json_prune(const char* input, size_t length, char* output,
+                   uint32_t* removed) {
+  const char* end = input + length;
+  // Input before |copied| has been dealt with; output before |out| is
+  // final apart from a trailing comma, which a removed last member takes
+  // with it.
+  const char* copied = input;
+  char* out = output;
+  uint32_t count = 0;
+
+  const char* p = input;
+  while ((p = find_candidate(p, end)) < end) {
+    const char* value = match_key(input, p, end);
+    if (value == nullptr) {
+      p++;
+      continue;
+    }
+    const char* value_end = skip_value(value, end);
+    if (value_end == nullptr) {
+      return -1;
+    }
+
+    size_t kept = p - copied;
+    if (out != copied) {
+      memmove(out, copied, kept);
+    }
+    out += kept;
+
+    const char* after = skip_space(value_end, end);
+    if (after < end && *after == ',') {
+      // Not the last member: drop the comma after it.
+      after++;
+    } else {
+      after = value_end;
+      // The last member: drop the comma before it, if any.
+      char* last = out;
+      while (last > output && is_space(last[-1])) {
+        last--;
+      }
+      if (last > output && last[-1] == ',') {
+        out = last - 1;
+      }
+    }
+    copied = after;
+    p = after;
+    count++;
+  }
+
+  size_t kept = end - copied;
+  if (out != copied) {
+    memmove(out, copied, kept);
+  }
+  out += kept;
+  if (removed != nullptr) {
+    *removed = count;
+  }
+  return out - output;
+}
+
+int32_t json_prune_needed(const char* input, size_t length) {
+  const char* end = input + length;
+  for (const char* p = input; (p = find_candidate(p, end)) < end; p++) {
+    if (match_key(input, p, end) != nullptr) {
+      return 1;
+    }
+  }
+  return 0;
+}
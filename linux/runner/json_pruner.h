@@ -0,0 +1,37 @@
+#ifndef RUNNER_JSON_PRUNER_H_
+#define RUNNER_JSON_PRUNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Strips ad data from YouTube's player, next and browse responses in one
+// pass over the text, without parsing it into a tree. The filter proxy
+// runs it on plain HTTP JSON responses before they reach the page
+// (filter_proxy.h).
+//
+// Removed are the object members named adPlacements, adSlots, playerAds,
+// adBreakHeartbeatParams and serverAbrStreamingUrl, at any depth, together
+// with the comma that separated them from a neighbour.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copies the |length| bytes of JSON at |input| to |output| without the
+// pruned members. |output| must have room for |length| bytes and may be
+// |input| itself. Returns the length written, or -1 if the value of a
+// member to be removed is not well-formed, in which case the contents of
+// |output| are unspecified. The number of members removed is stored in
+// |removed| unless it is NULL.
+int64_t json_prune(const char* input, size_t length, char* output,
+                   uint32_t* removed);
+
+// Returns whether |input| names any pruned member, without copying. Much
+// cheaper than json_prune when most responses carry no ads.
+int32_t json_prune_needed(const char* input, size_t length);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_JSON_PRUNER_H_
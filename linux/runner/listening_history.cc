@@ -0,0 +1,534 @@
+#include "listening_history.h"
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+static constexpr char kLogName[] = "plays.log";
+static constexpr char kStringsName[] = "strings.log";
+static constexpr char kIndexName[] = "artists.idx";
+
+// A new log holds this many records, about two months of steady
+// listening, and a new string table this many bytes.
+static constexpr size_t kInitialRecords = 2048;
+static constexpr size_t kInitialStringBytes = 64 * 1024;
+
+// Logs double until they are this large, then grow by this much at a time.
+static constexpr size_t kMaxGrowthBytes = 1024 * 1024;
+
+static inline size_t align4(size_t size) {
+  return (size + 3) & ~static_cast<size_t>(3);
+}
+
+static void set_errno_error(GError** error, int saved_errno,
+                            const char* action, const std::string& path) {
+  g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+              "Failed to %s %s: %s", action, path.c_str(),
+              g_strerror(saved_errno));
+}
+
+ListeningHistory::ListeningHistory(std::string directory)
+    : directory_(std::move(directory)) {}
+
+ListeningHistory::~ListeningHistory() {
+  if (log_.data != nullptr && strings_.data != nullptr) {
+    g_autoptr(GError) error = nullptr;
+    if (!Flush(&error) || !WriteIndex(&error)) {
+      g_warning("Listening history: %s", error->message);
+    }
+  }
+  UnmapIndex();
+  for (Segment* segment : {&log_, &strings_}) {
+    if (segment->data != nullptr) {
+      munmap(segment->data, segment->size);
+    }
+    if (segment->fd >= 0) {
+      close(segment->fd);
+    }
+  }
+}
+
+std::unique_ptr<ListeningHistory> ListeningHistory::Open(
+    const gchar* directory, GError** error) {
+  g_autofree gchar* default_directory = nullptr;
+  if (directory == nullptr) {
+    default_directory = g_build_filename(
+        g_get_user_data_dir(), "youtube_music_unbound", "history", nullptr);
+    directory = default_directory;
+  }
+  if (g_mkdir_with_parents(directory, 0700) != 0) {
+    set_errno_error(error, errno, "create", directory);
+    return nullptr;
+  }
+
+  std::unique_ptr<ListeningHistory> history(new ListeningHistory(directory));
+  const std::string base = history->directory_ + G_DIR_SEPARATOR_S;
+  if (!OpenSegment(base + kLogName, kHistoryLogMagic,
+                   sizeof(HistoryLogHeader) +
+                       kInitialRecords * sizeof(HistoryRecord),
+                   &history->log_, error) ||
+      !OpenSegment(base + kStringsName, kHistoryStringsMagic,
+                   kInitialStringBytes, &history->strings_, error) ||
+      !history->Recover(error)) {
+    return nullptr;
+  }
+  history->LoadIndex();
+  history->IndexTail();
+  return history;
+}
+
+// Maps |path| read-write, creating it with |initial_size| bytes and a
+// header carrying |magic| if it is new. Both header types start with the
+// magic and the version, and are the same size.
+bool ListeningHistory::OpenSegment(const std::string& path, const char* magic,
+                                   size_t initial_size, Segment* segment,
+                                   GError** error) {
+  static_assert(sizeof(HistoryLogHeader) == sizeof(HistoryStringsHeader),
+                "Segments share their header handling");
+  segment->fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  struct stat info;
+  if (segment->fd < 0 || fstat(segment->fd, &info) != 0) {
+    set_errno_error(error, errno, "open", path);
+    return false;
+  }
+
+  const bool created = info.st_size == 0;
+  size_t size = info.st_size;
+  if (created) {
+    // Reserves the blocks now, so that a write through the mapping can
+    // never fault for want of disk space.
+    int result = posix_fallocate(segment->fd, 0, initial_size);
+    if (result != 0) {
+      set_errno_error(error, result, "allocate", path);
+      return false;
+    }
+    size = initial_size;
+  } else if (size < sizeof(HistoryLogHeader)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is truncated", path.c_str());
+    return false;
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    segment->fd, 0);
+  if (data == MAP_FAILED) {
+    set_errno_error(error, errno, "map", path);
+    return false;
+  }
+  segment->data = static_cast<uint8_t*>(data);
+  segment->size = size;
+
+  HistoryLogHeader* header = reinterpret_cast<HistoryLogHeader*>(data);
+  if (created) {
+    memcpy(header->magic, magic, sizeof(header->magic));
+    header->version = kHistoryVersion;
+  } else if (memcmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+             header->version != kHistoryVersion) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a listening history of version %u", path.c_str(),
+                kHistoryVersion);
+    return false;
+  }
+  return true;
+}
+
+// Makes |segment| at least |needed| bytes, doubling it while that is
+// cheap. The mapping moves, so every pointer into it is invalidated.
+bool ListeningHistory::GrowSegment(Segment* segment, size_t needed,
+                                   GError** error) {
+  size_t size = segment->size + std::min(segment->size, kMaxGrowthBytes);
+  size = std::max(size, needed);
+  int result = posix_fallocate(segment->fd, 0, size);
+  if (result != 0) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(result),
+                "Failed to grow the listening history: %s",
+                g_strerror(result));
+    return false;
+  }
+  void* data = mremap(segment->data, segment->size, size, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to map the grown listening history: %s",
+                g_strerror(saved_errno));
+    return false;
+  }
+  segment->data = static_cast<uint8_t*>(data);
+  segment->size = size;
+  return true;
+}
+
+// Initializes new logs, and drops the trailing records a crash left naming
+// strings that never made it to disk.
+bool ListeningHistory::Recover(GError** error) {
+  HistoryLogHeader* log = log_header();
+  if (log->record_size == 0) {
+    log->record_size = sizeof(HistoryRecord);
+  } else if (log->record_size != sizeof(HistoryRecord)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Listening history records are %u bytes, not %zu",
+                log->record_size, sizeof(HistoryRecord));
+    return false;
+  }
+  HistoryStringsHeader* strings = strings_header();
+  if (strings->used_bytes == 0) {
+    strings->used_bytes = sizeof(HistoryStringsHeader);
+  } else if (strings->used_bytes < sizeof(HistoryStringsHeader) ||
+             strings->used_bytes > strings_.size) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "The listening history string table is damaged");
+    return false;
+  }
+
+  size_t count = std::min<size_t>(log->record_count, record_capacity());
+  const uint64_t used = strings->used_bytes;
+  while (count > 0) {
+    const HistoryRecord& last = records()[count - 1];
+    if (last.title < used && last.artist < used && last.album < used &&
+        (count == 1 ||
+         last.started_at_us >= records()[count - 2].started_at_us)) {
+      break;
+    }
+    count--;
+  }
+  if (count != log->record_count) {
+    g_warning("Listening history: dropped %" G_GUINT64_FORMAT
+              " records a crash left incomplete",
+              static_cast<guint64>(log->record_count - count));
+    log->record_count = count;
+  }
+  return true;
+}
+
+void ListeningHistory::LoadIndex() {
+  const std::string path = directory_ + G_DIR_SEPARATOR_S + kIndexName;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &info) == 0 &&
+      info.st_size >= static_cast<off_t>(sizeof(HistoryIndexHeader))) {
+    data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return;
+  }
+  index_data_ = static_cast<const uint8_t*>(data);
+  index_size_ = info.st_size;
+
+  // Anything that does not add up, including an index ahead of a log that
+  // lost records, just means indexing every record in memory instead.
+  const HistoryIndexHeader* header =
+      reinterpret_cast<const HistoryIndexHeader*>(index_data_);
+  const uint64_t artists_bytes =
+      static_cast<uint64_t>(header->artist_count) * sizeof(HistoryArtistEntry);
+  if (memcmp(header->magic, kHistoryIndexMagic, sizeof(header->magic)) != 0 ||
+      header->version != kHistoryVersion ||
+      header->record_count > record_count() ||
+      header->strings_bytes > strings_header()->used_bytes ||
+      index_size_ != sizeof(HistoryIndexHeader) + artists_bytes +
+                         header->record_count * sizeof(uint32_t)) {
+    UnmapIndex();
+    return;
+  }
+  index_artists_ = reinterpret_cast<const HistoryArtistEntry*>(
+      index_data_ + sizeof(HistoryIndexHeader));
+  index_artist_count_ = header->artist_count;
+  index_postings_ = reinterpret_cast<const uint32_t*>(
+      index_data_ + sizeof(HistoryIndexHeader) + artists_bytes);
+  index_records_ = header->record_count;
+}
+
+void ListeningHistory::UnmapIndex() {
+  if (index_data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(index_data_), index_size_);
+  }
+  index_data_ = nullptr;
+  index_size_ = 0;
+  index_artists_ = nullptr;
+  index_artist_count_ = 0;
+  index_postings_ = nullptr;
+  index_records_ = 0;
+}
+
+void ListeningHistory::IndexTail() {
+  tail_.clear();
+  const HistoryRecord* all = records();
+  for (size_t i = index_records_; i < record_count(); i++) {
+    tail_[all[i].artist].push_back(i);
+  }
+}
+
+// Reads every string's id once, before the first one is interned.
+bool ListeningHistory::EnsureStrings(GError** error) {
+  if (strings_loaded_) {
+    return true;
+  }
+  const uint64_t used = strings_header()->used_bytes;
+  string_ids_.reserve(strings_header()->string_count);
+  uint64_t offset = sizeof(HistoryStringsHeader);
+  while (offset + sizeof(uint32_t) <= used) {
+    uint32_t length;
+    memcpy(&length, strings_.data + offset, sizeof(length));
+    if (offset + sizeof(uint32_t) + length + 1 > used) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                  "The listening history string table is damaged");
+      return false;
+    }
+    string_ids_.emplace(
+        std::string(reinterpret_cast<const char*>(strings_.data + offset +
+                                                  sizeof(uint32_t)),
+                    length),
+        static_cast<uint32_t>(offset));
+    offset += align4(sizeof(uint32_t) + length + 1);
+  }
+  strings_loaded_ = true;
+  return true;
+}
+
+uint32_t ListeningHistory::Intern(const char* text, GError** error) {
+  if (!EnsureStrings(error)) {
+    return kNoString;
+  }
+  const std::string key(text != nullptr ? text : "");
+  auto found = string_ids_.find(key);
+  if (found != string_ids_.end()) {
+    return found->second;
+  }
+
+  HistoryStringsHeader* header = strings_header();
+  const uint64_t offset = header->used_bytes;
+  const size_t entry_size = align4(sizeof(uint32_t) + key.size() + 1);
+  if (offset + entry_size > UINT32_MAX) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                "The listening history string table is full");
+    return kNoString;
+  }
+  if (offset + entry_size > strings_.size) {
+    if (!GrowSegment(&strings_, offset + entry_size, error)) {
+      return kNoString;
+    }
+    header = strings_header();
+  }
+
+  uint8_t* entry = strings_.data + offset;
+  const uint32_t length = key.size();
+  memcpy(entry, &length, sizeof(length));
+  memcpy(entry + sizeof(length), key.data(), length);
+  memset(entry + sizeof(length) + length, 0,
+         entry_size - sizeof(length) - length);
+  header->string_count++;
+  // The string is complete before the table claims it.
+  __atomic_store_n(&header->used_bytes, offset + entry_size, __ATOMIC_RELEASE);
+
+  string_ids_.emplace(key, static_cast<uint32_t>(offset));
+  return offset;
+}
+
+bool ListeningHistory::Append(const HistoryPlay& play, GError** error) {
+  const uint32_t title = Intern(play.title, error);
+  const uint32_t artist =
+      title == kNoString ? kNoString : Intern(play.artist, error);
+  const uint32_t album =
+      artist == kNoString ? kNoString : Intern(play.album, error);
+  if (album == kNoString) {
+    return false;
+  }
+
+  const size_t count = record_count();
+  if (count == record_capacity() &&
+      !GrowSegment(&log_, log_.size + sizeof(HistoryRecord), error)) {
+    return false;
+  }
+
+  HistoryRecord* record = records() + count;
+  record->started_at_us = play.started_at_us;
+  if (count > 0 && play.started_at_us < records()[count - 1].started_at_us) {
+    record->started_at_us = records()[count - 1].started_at_us;
+  }
+  record->listened_ms = play.listened_ms;
+  record->length_ms = play.length_ms;
+  record->title = title;
+  record->artist = artist;
+  record->album = album;
+  record->reserved = 0;
+  __atomic_store_n(&log_header()->record_count, count + 1, __ATOMIC_RELEASE);
+
+  tail_[artist].push_back(count);
+  unflushed_++;
+  return true;
+}
+
+bool ListeningHistory::Flush(GError** error) {
+  if (unflushed_ == 0) {
+    return true;
+  }
+  // Strings first, so the records naming them never reach the disk alone.
+  // Only dirty pages are written, however much is passed.
+  if (msync(strings_.data, strings_header()->used_bytes, MS_SYNC) != 0 ||
+      msync(log_.data,
+            sizeof(HistoryLogHeader) + record_count() * sizeof(HistoryRecord),
+            MS_SYNC) != 0) {
+    set_errno_error(error, errno, "write", directory_);
+    return false;
+  }
+  unflushed_ = 0;
+  return true;
+}
+
+bool ListeningHistory::WriteIndex(GError** error) {
+  const size_t count = record_count();
+  if (index_data_ != nullptr && index_records_ == count) {
+    return true;
+  }
+
+  // Counting sort by artist: postings stay in record order within each.
+  const HistoryRecord* all = records();
+  std::unordered_map<uint32_t, uint32_t> counts;
+  for (size_t i = 0; i < count; i++) {
+    counts[all[i].artist]++;
+  }
+  std::vector<HistoryArtistEntry> artists;
+  artists.reserve(counts.size());
+  for (const auto& artist : counts) {
+    artists.push_back({artist.first, 0, artist.second, 0});
+  }
+  std::sort(artists.begin(), artists.end(),
+            [](const HistoryArtistEntry& a, const HistoryArtistEntry& b) {
+              return a.artist < b.artist;
+            });
+  std::unordered_map<uint32_t, uint32_t> next;
+  uint32_t first = 0;
+  for (HistoryArtistEntry& artist : artists) {
+    artist.first = first;
+    next[artist.artist] = first;
+    first += artist.count;
+  }
+
+  HistoryIndexHeader header = {};
+  memcpy(header.magic, kHistoryIndexMagic, sizeof(header.magic));
+  header.version = kHistoryVersion;
+  header.artist_count = artists.size();
+  header.record_count = count;
+  header.strings_bytes = strings_header()->used_bytes;
+
+  std::string file(sizeof(header) +
+                       artists.size() * sizeof(HistoryArtistEntry) +
+                       count * sizeof(uint32_t),
+                   '\0');
+  memcpy(&file[0], &header, sizeof(header));
+  memcpy(&file[sizeof(header)], artists.data(),
+         artists.size() * sizeof(HistoryArtistEntry));
+  uint32_t* postings = reinterpret_cast<uint32_t*>(
+      &file[sizeof(header) + artists.size() * sizeof(HistoryArtistEntry)]);
+  for (size_t i = 0; i < count; i++) {
+    postings[next[all[i].artist]++] = i;
+  }
+
+  const std::string path = directory_ + G_DIR_SEPARATOR_S + kIndexName;
+  if (!g_file_set_contents(path.c_str(), file.data(), file.size(), error)) {
+    return false;
+  }
+  UnmapIndex();
+  LoadIndex();
+  IndexTail();
+  return true;
+}
+
+const char* ListeningHistory::String(uint32_t id) const {
+  const uint64_t used = strings_header()->used_bytes;
+  if (id < sizeof(HistoryStringsHeader) || id % 4 != 0 ||
+      id + sizeof(uint32_t) > used) {
+    return "";
+  }
+  uint32_t length;
+  memcpy(&length, strings_.data + id, sizeof(length));
+  if (id + sizeof(uint32_t) + length + 1 > used) {
+    return "";
+  }
+  return reinterpret_cast<const char*>(strings_.data + id + sizeof(uint32_t));
+}
+
+void ListeningHistory::TimeRange(int64_t from_us, int64_t to_us,
+                                 size_t* first, size_t* last) const {
+  const HistoryRecord* begin = records();
+  const HistoryRecord* end = begin + record_count();
+  const auto before = [](const HistoryRecord& record, int64_t time) {
+    return record.started_at_us < time;
+  };
+  const HistoryRecord* from = std::lower_bound(begin, end, from_us, before);
+  const HistoryRecord* to =
+      std::lower_bound(from, end, std::max(from_us, to_us), before);
+  *first = from - begin;
+  *last = to - begin;
+}
+
+uint32_t ListeningHistory::FindArtist(const char* name) const {
+  // Artists are far fewer than strings, so comparing against each one in
+  // place beats reading the whole string table on a cold open.
+  for (uint32_t i = 0; i < index_artist_count_; i++) {
+    if (strcmp(String(index_artists_[i].artist), name) == 0) {
+      return index_artists_[i].artist;
+    }
+  }
+  for (const auto& artist : tail_) {
+    if (strcmp(String(artist.first), name) == 0) {
+      return artist.first;
+    }
+  }
+  return kNoString;
+}
+
+void ListeningHistory::AppendPostings(const uint32_t* postings, size_t count,
+                                      int64_t from_us, int64_t to_us,
+                                      std::vector<uint32_t>* out) const {
+  // A damaged posting past the records can only end the range early.
+  const HistoryRecord* all = records();
+  const size_t size = record_count();
+  const uint32_t* end = postings + count;
+  const uint32_t* it = std::lower_bound(
+      postings, end, from_us, [all, size](uint32_t record, int64_t time) {
+        return record < size && all[record].started_at_us < time;
+      });
+  for (; it != end && *it < size && all[*it].started_at_us < to_us; ++it) {
+    out->push_back(*it);
+  }
+}
+
+void ListeningHistory::ArtistPlays(uint32_t artist, int64_t from_us,
+                                   int64_t to_us,
+                                   std::vector<uint32_t>* out) const {
+  const HistoryArtistEntry* end = index_artists_ + index_artist_count_;
+  const HistoryArtistEntry* entry = std::lower_bound(
+      index_artists_, end, artist,
+      [](const HistoryArtistEntry& entry, uint32_t artist) {
+        return entry.artist < artist;
+      });
+  // Entries are checked as they are used, so that opening the index only
+  // touches its header.
+  if (entry != end && entry->artist == artist &&
+      entry->first <= index_records_ &&
+      entry->count <= index_records_ - entry->first) {
+    AppendPostings(index_postings_ + entry->first, entry->count, from_us,
+                   to_us, out);
+  }
+  auto tail = tail_.find(artist);
+  if (tail != tail_.end()) {
+    AppendPostings(tail->second.data(), tail->second.size(), from_us, to_us,
+                   out);
+  }
+}
+
+uint64_t ListeningHistory::disk_bytes() const {
+  return log_.size + strings_.size + index_size_;
+}
@@ -0,0 +1,148 @@
+#ifndef RUNNER_LISTENING_HISTORY_H_
+#define RUNNER_LISTENING_HISTORY_H_
+
+#include <glib.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "history_format.h"
+
+// A play to append: what played, when it started and for how long.
+struct HistoryPlay {
+  int64_t started_at_us;
+  uint32_t listened_ms;
+  uint32_t length_ms;
+  const char* title;
+  const char* artist;
+  const char* album;
+};
+
+// The local listening history (see history_format.h): an append-only log of
+// fixed-size play records, the distinct strings they name, and an index of
+// each artist's plays. Both logs are mapped and written in place, so an
+// append is a copy into the mapping; Flush() makes what was appended
+// durable, and is meant to be called for a batch of appends rather than
+// each. Years of plays take a few MB and open in one mmap per file.
+//
+// Not thread-safe. Pointers returned by String() and record() are valid
+// until the next Append().
+class ListeningHistory {
+ public:
+  static constexpr uint32_t kNoString = UINT32_MAX;
+
+  // Opens the history in |directory|, or in
+  // $XDG_DATA_HOME/youtube_music_unbound/history if nullptr, creating it
+  // if needed. Returns nullptr with |error| set if a log is unreadable or
+  // of another version.
+  static std::unique_ptr<ListeningHistory> Open(const gchar* directory,
+                                                GError** error);
+
+  // Flushes, and writes the index if records were appended since it was.
+  ~ListeningHistory();
+  ListeningHistory(const ListeningHistory&) = delete;
+  ListeningHistory& operator=(const ListeningHistory&) = delete;
+
+  // Appends |play|, interning its strings; a start time earlier than the
+  // last record's is moved up to it. Returns false with |error| set if a
+  // log could not grow.
+  bool Append(const HistoryPlay& play, GError** error);
+
+  // Writes what was appended since the last flush to disk.
+  bool Flush(GError** error);
+
+  // Rewrites artists.idx to cover every record, so the next Open() does
+  // not have to index any.
+  bool WriteIndex(GError** error);
+
+  size_t size() const { return record_count(); }
+  const HistoryRecord& record(size_t index) const { return records()[index]; }
+  size_t unflushed() const { return unflushed_; }
+
+  // Returns the string with |id|, or "" if there is none.
+  const char* String(uint32_t id) const;
+
+  // Returns the records started in [from_us, to_us) as the range
+  // [*first, *last) of record numbers.
+  void TimeRange(int64_t from_us, int64_t to_us, size_t* first,
+                 size_t* last) const;
+
+  // Returns the id of the artist called exactly |name| if they have a
+  // play, or kNoString.
+  uint32_t FindArtist(const char* name) const;
+
+  // Appends to |out| the numbers of |artist|'s records started in
+  // [from_us, to_us), oldest first.
+  void ArtistPlays(uint32_t artist, int64_t from_us, int64_t to_us,
+                   std::vector<uint32_t>* out) const;
+
+  // Space the three files take, preallocation included.
+  uint64_t disk_bytes() const;
+
+ private:
+  // A log file mapped read-write in full.
+  struct Segment {
+    int fd = -1;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+
+  explicit ListeningHistory(std::string directory);
+
+  static bool OpenSegment(const std::string& path, const char* magic,
+                          size_t initial_size, Segment* segment,
+                          GError** error);
+  static bool GrowSegment(Segment* segment, size_t needed, GError** error);
+
+  bool Recover(GError** error);
+  void LoadIndex();
+  void UnmapIndex();
+  void IndexTail();
+  bool EnsureStrings(GError** error);
+  uint32_t Intern(const char* text, GError** error);
+
+  HistoryLogHeader* log_header() const {
+    return reinterpret_cast<HistoryLogHeader*>(log_.data);
+  }
+  HistoryStringsHeader* strings_header() const {
+    return reinterpret_cast<HistoryStringsHeader*>(strings_.data);
+  }
+  HistoryRecord* records() const {
+    return reinterpret_cast<HistoryRecord*>(log_.data +
+                                            sizeof(HistoryLogHeader));
+  }
+  size_t record_count() const { return log_header()->record_count; }
+  size_t record_capacity() const {
+    return (log_.size - sizeof(HistoryLogHeader)) / sizeof(HistoryRecord);
+  }
+
+  // Appends the postings of |records| in [from_us, to_us) to |out|.
+  void AppendPostings(const uint32_t* postings, size_t count, int64_t from_us,
+                      int64_t to_us, std::vector<uint32_t>* out) const;
+
+  std::string directory_;
+  Segment log_;
+  Segment strings_;
+
+  // artists.idx, mapped read-only, covering the first index_records_.
+  const uint8_t* index_data_ = nullptr;
+  size_t index_size_ = 0;
+  const HistoryArtistEntry* index_artists_ = nullptr;
+  uint32_t index_artist_count_ = 0;
+  const uint32_t* index_postings_ = nullptr;
+  size_t index_records_ = 0;
+
+  // Record numbers past index_records_, by artist id.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> tail_;
+
+  // Every string's id by content, read from strings.log before the first
+  // append needs it.
+  std::unordered_map<std::string, uint32_t> string_ids_;
+  bool strings_loaded_ = false;
+
+  size_t unflushed_ = 0;
+};
+
+#endif  // RUNNER_LISTENING_HISTORY_H_
@@ -1,21 +1,45 @@
-#ifndef RUNNER_MPRIS_PLUGIN_H_
-#define RUNNER_MPRIS_PLUGIN_H_
-
-#include <flutter_linux/flutter_linux.h>
-#include <gio/gio.h>
-
-#include <memory>
-#include <string>
-
-G_BEGIN_DECLS
-
-#define MPRIS_TYPE_PLUGIN mpris_plugin_get_type()
-G_DECLARE_FINAL_TYPE(MprisPlugin, mpris_plugin, MPRIS, PLUGIN, GObject)
-
-MprisPlugin* mpris_plugin_new(FlPluginRegistrar* registrar);
-
-void mpris_plugin_register_with_registrar(FlPluginRegistrar* registrar);
-
-G_END_DECLS
-
-#endif  // RUNNER_MPRIS_PLUGIN_H_
+#ifndef RUNNER_MPRIS_PLUGIN_H_
+#define RUNNER_MPRIS_PLUGIN_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <gio/gio.h>
+
+#include "mpris_server.h"
+
+G_BEGIN_DECLS
+
+#define MPRIS_TYPE_PLUGIN mpris_plugin_get_type()
+G_DECLARE_FINAL_TYPE(MprisPlugin, mpris_plugin, MPRIS, PLUGIN, GObject)
+
+/**
+ * mpris_plugin_new:
+ * @registrar: the registrar to serve the channel through.
+ *
+ * Serves youtube_music_unbound/mpris until the returned plugin, which the
+ * caller owns, is disposed.
+ *
+ * Returns: a new #MprisPlugin.
+ */
+MprisPlugin* mpris_plugin_new(FlPluginRegistrar* registrar);
+
+/**
+ * mpris_plugin_set_start_deferred:
+ * @deferred: whether to hold the server back.
+ *
+ * While @deferred, Dart's "initialize" is acknowledged but the server, its
+ * D-Bus thread and the bus name wait; clearing it starts them if Dart
+ * asked. Keeps MPRIS off the path to the first frame.
+ */
+void mpris_plugin_set_start_deferred(MprisPlugin* self, gboolean deferred);
+
+G_END_DECLS
+
+/**
+ * mpris_plugin_send_command:
+ *
+ * Forwards @command to Dart as if an MPRIS client had sent it, for
+ * commands arriving some other way, such as a second invocation.
+ */
+void mpris_plugin_send_command(MprisPlugin* self, const MprisCommand& command);
+
+#endif  // RUNNER_MPRIS_PLUGIN_H_
@@ -0,0 +1,1521 @@
+#include "mpris_server.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "artwork_cache.h"
+#include "now_playing_block.h"
+#include "spsc_queue.h"
+#include "startup_trace.h"
+
+static constexpr char kBusName[] = "org.mpris.MediaPlayer2.YouTubeMusicUnbound";
+static constexpr char kObjectPath[] = "/org/mpris/MediaPlayer2";
+
+static constexpr char kMprisInterface[] = 
+    "org.mpris.MediaPlayer2";
+static constexpr char kMprisPlayerInterface[] = 
+    "org.mpris.MediaPlayer2.Player";
+static constexpr char kPropertiesInterface[] =
+    "org.freedesktop.DBus.Properties";
+
+// Reported positions within this distance of the extrapolated position are
+// treated as ordinary drift rather than a seek (microseconds).
+static constexpr gint64 kSeekToleranceUs = 2 * G_USEC_PER_SEC;
+
+static constexpr gdouble kMinimumRate = 0.25;
+static constexpr gdouble kMaximumRate = 2.0;
+
+static constexpr char kTrackId[] = "/org/mpris/MediaPlayer2/Track/1";
+
+// Default PropertiesChanged coalescing window. Zero flushes on the next
+// main-loop idle.
+static constexpr guint kDefaultCoalesceMs = 0;
+
+// Repeats of the same transport command within this window are dropped, so
+// a held or bouncing media key does not queue up toggles (microseconds).
+static constexpr gint64 kCommandDebounceUs = 150 * G_TIME_SPAN_MILLISECOND;
+
+static constexpr size_t kUpdateQueueCapacity = 64;
+
+// Shared between the owner thread and the D-Bus thread.
+struct MprisShared {
+  SpscQueue<MprisUpdate, kUpdateQueueCapacity> updates;
+  // Updates pushed while the ring was full, newer than all of those in it.
+  // While any are waiting the owner thread appends here rather than to the
+  // ring, and the D-Bus thread takes them once the ring is empty.
+  std::mutex overflow_mutex;
+  std::vector<MprisUpdate> overflow;
+  std::atomic<bool> overflow_pending{false};
+  std::atomic<bool> drain_scheduled{false};
+  std::atomic<guint64> metadata_version{0};
+  std::atomic<guint64> snapshot_builds{0};
+  std::atomic<guint64> rebuilds_avoided{0};
+};
+
+struct _MprisServer {
+  GObject parent_instance;
+
+  // Owner thread, the one that created the server.
+  GMainContext* main_context;
+  MprisCommandHandler command_handler;
+  gpointer command_handler_data;
+  MprisShared* shared;
+
+  // The D-Bus server runs on |dbus_thread| with its own |dbus_context| so
+  // a busy UI thread cannot delay media keys or property reads. Everything
+  // below is owned by that thread once it has started.
+  GThread* dbus_thread;
+  GMainContext* dbus_context;
+  GMainLoop* dbus_loop;
+
+  GDBusConnection* connection;
+  guint bus_id;
+  // When the bus name was requested, for the startup trace.
+  gint64 own_name_time;
+  guint registration_ids[2];
+  GDBusNodeInfo* introspection_data;
+
+  gchar* playback_status;
+  GHashTable* metadata;
+  gint64 duration;
+
+  // Position anchor: |anchor_position| was current at the monotonic time
+  // |anchor_time| and advances at |rate| while Playing.
+  gint64 anchor_position;
+  gint64 anchor_time;
+  gdouble rate;
+  gdouble volume;
+
+  // Immutable a{sv} built from |metadata|, shared by Get, GetAll and
+  // PropertiesChanged until the next change bumps the metadata version.
+  GVariant* metadata_snapshot;
+  // Prebuilt (a{sv}) GetAll replies, indexed by MprisInterfaceIndex.
+  GVariant* get_all_replies[2];
+
+  // Player properties marked dirty since the last flush, and the values
+  // last sent in PropertiesChanged, used to emit only real deltas.
+  GHashTable* dirty_properties;
+  GHashTable* sent_properties;
+  GSource* flush_source;
+  guint coalesce_ms;
+
+  gint last_command_type;
+  gint64 last_command_time;
+
+  // The shared now-playing block as last applied, plus a scratch copy for
+  // the next read. D-Bus thread.
+  NowPlayingBlock* block_snapshot;
+  NowPlayingBlock* block_scratch;
+
+  // Remote artwork is published as a local file:// URL once cached, so
+  // every desktop client does not download and decode it separately.
+  ArtworkCache* artwork_cache;
+  // The remote URL of the current track's artwork. D-Bus thread.
+  gchar* remote_art_url;
+};
+
+enum MprisInterfaceIndex {
+  kRootInterfaceIndex = 0,
+  kPlayerInterfaceIndex = 1,
+};
+
+G_DEFINE_TYPE(MprisServer, mpris_server, G_TYPE_OBJECT)
+
+static void dispatch_command(MprisServer* self, const MprisCommand& command);
+static void stop_dbus_thread(MprisServer* self);
+static void sync_from_block(MprisServer* self);
+static void mark_property_dirty(MprisServer* self, const gchar* name);
+static void emit_seeked(MprisServer* self, gint64 position);
+
+static void mpris_server_dispose(GObject* object) {
+  MprisServer* self = MPRIS_SERVER(object);
+
+  if (self->dbus_thread != nullptr) {
+    stop_dbus_thread(self);
+  }
+
+  // After the D-Bus thread is gone, so pending artwork callbacks are
+  // dropped with |dbus_context| instead of being dispatched.
+  g_clear_object(&self->artwork_cache);
+  g_clear_pointer(&self->remote_art_url, g_free);
+
+  g_clear_pointer(&self->dbus_loop, g_main_loop_unref);
+  g_clear_pointer(&self->dbus_context, g_main_context_unref);
+  g_clear_pointer(&self->main_context, g_main_context_unref);
+  g_clear_pointer(&self->introspection_data, g_dbus_node_info_unref);
+  g_clear_pointer(&self->playback_status, g_free);
+  g_clear_pointer(&self->metadata, g_hash_table_unref);
+  g_clear_pointer(&self->metadata_snapshot, g_variant_unref);
+  g_clear_pointer(&self->get_all_replies[kRootInterfaceIndex],
+                  g_variant_unref);
+  g_clear_pointer(&self->get_all_replies[kPlayerInterfaceIndex],
+                  g_variant_unref);
+  g_clear_pointer(&self->dirty_properties, g_hash_table_unref);
+  g_clear_pointer(&self->sent_properties, g_hash_table_unref);
+  g_clear_pointer(&self->block_snapshot, g_free);
+  g_clear_pointer(&self->block_scratch, g_free);
+
+  if (self->shared != nullptr) {
+    g_debug("MPRIS snapshot cache: %" G_GUINT64_FORMAT " builds, %"
+            G_GUINT64_FORMAT " rebuilds avoided",
+            static_cast<guint64>(self->shared->snapshot_builds),
+            static_cast<guint64>(self->shared->rebuilds_avoided));
+    delete self->shared;
+    self->shared = nullptr;
+  }
+
+  G_OBJECT_CLASS(mpris_server_parent_class)->dispose(object);
+}
+
+static void mpris_server_class_init(MprisServerClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = mpris_server_dispose;
+}
+
+static void mpris_server_init(MprisServer* self) {
+  self->main_context = g_main_context_ref_thread_default();
+  self->shared = new MprisShared();
+  self->dbus_context = g_main_context_new();
+  self->dbus_loop = g_main_loop_new(self->dbus_context, FALSE);
+  self->playback_status = g_strdup("Stopped");
+  self->metadata = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, 
+                                         (GDestroyNotify)g_variant_unref);
+  self->duration = 0;
+  self->anchor_position = 0;
+  self->anchor_time = g_get_monotonic_time();
+  self->rate = 1.0;
+  self->volume = 1.0;
+  self->metadata_snapshot = nullptr;
+  self->get_all_replies[kRootInterfaceIndex] = nullptr;
+  self->get_all_replies[kPlayerInterfaceIndex] = nullptr;
+  self->dirty_properties = g_hash_table_new(g_str_hash, g_str_equal);
+  self->sent_properties = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+  self->flush_source = nullptr;
+  self->coalesce_ms = kDefaultCoalesceMs;
+  self->last_command_type = -1;
+  self->last_command_time = 0;
+  self->block_snapshot = g_new0(NowPlayingBlock, 1);
+  self->block_scratch = g_new0(NowPlayingBlock, 1);
+  self->artwork_cache = artwork_cache_new(nullptr);
+  self->remote_art_url = nullptr;
+}
+
+static gboolean is_playing(MprisServer* self) {
+  return g_strcmp0(self->playback_status, "Playing") == 0;
+}
+
+// Extrapolates the playback position from the anchor.
+static gint64 current_position(MprisServer* self) {
+  gint64 position = self->anchor_position;
+  if (is_playing(self)) {
+    gint64 elapsed = g_get_monotonic_time() - self->anchor_time;
+    position += static_cast<gint64>(elapsed * self->rate);
+  }
+
+  if (self->duration > 0 && position > self->duration) {
+    position = self->duration;
+  }
+  return MAX(position, 0);
+}
+
+static void set_anchor(MprisServer* self, gint64 position) {
+  self->anchor_position = position;
+  self->anchor_time = g_get_monotonic_time();
+}
+
+static GVariant* build_metadata_snapshot(MprisServer* self) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->metadata);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    g_variant_builder_add(&builder, "{sv}", 
+                        (const gchar*)key, 
+                        (GVariant*)value);
+  }
+
+  return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+// Returns the current Metadata snapshot. The server keeps ownership.
+static GVariant* get_metadata_snapshot(MprisServer* self) {
+  if (self->metadata_snapshot != nullptr) {
+    self->shared->rebuilds_avoided++;
+    return self->metadata_snapshot;
+  }
+
+  self->metadata_snapshot = build_metadata_snapshot(self);
+  self->shared->metadata_version++;
+  self->shared->snapshot_builds++;
+  return self->metadata_snapshot;
+}
+
+static void invalidate_get_all_reply(MprisServer* self,
+                                     MprisInterfaceIndex index) {
+  g_clear_pointer(&self->get_all_replies[index], g_variant_unref);
+}
+
+static void invalidate_metadata_snapshot(MprisServer* self) {
+  g_clear_pointer(&self->metadata_snapshot, g_variant_unref);
+  invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+}
+
+// Moves the anchor to |position| and tells clients right away, before the
+// WebView has acted on the command.
+static void seek_locally(MprisServer* self, gint64 position) {
+  set_anchor(self, position);
+  invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+  emit_seeked(self, position);
+}
+
+static void set_rate(MprisServer* self, gdouble rate) {
+  rate = CLAMP(rate, kMinimumRate, kMaximumRate);
+  if (rate == self->rate) {
+    return;
+  }
+
+  // Re-anchor so time already played is not rescaled by the new rate.
+  set_anchor(self, current_position(self));
+  self->rate = rate;
+  invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+  mark_property_dirty(self, "Rate");
+  dispatch_command(self, {MprisCommandType::kSetRate, 0, rate});
+}
+
+static void set_volume(MprisServer* self, gdouble volume) {
+  volume = CLAMP(volume, 0.0, 1.0);
+  if (volume == self->volume) {
+    return;
+  }
+
+  self->volume = volume;
+  invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+  mark_property_dirty(self, "Volume");
+  dispatch_command(self, {MprisCommandType::kSetVolume, 0, volume});
+}
+
+// The spec asks players to treat a zero rate as Pause.
+static void set_rate_or_pause(MprisServer* self, gdouble rate) {
+  if (rate == 0.0) {
+    dispatch_command(self, {MprisCommandType::kPause, 0, 0});
+  } else {
+    set_rate(self, rate);
+  }
+}
+
+static void handle_seek(MprisServer* self, GVariant* parameters) {
+  gint64 offset;
+  g_variant_get(parameters, "(x)", &offset);
+
+  gint64 position = MAX(current_position(self) + offset, 0);
+  if (self->duration > 0 && position > self->duration) {
+    dispatch_command(self, {MprisCommandType::kNext, 0, 0});
+    return;
+  }
+
+  seek_locally(self, position);
+  dispatch_command(self, {MprisCommandType::kSeek, offset, 0});
+}
+
+static void handle_set_position(MprisServer* self, GVariant* parameters) {
+  const gchar* track_id;
+  gint64 position;
+  g_variant_get(parameters, "(&ox)", &track_id, &position);
+
+  // Stale track ids and out-of-range positions are ignored per the spec.
+  if (g_strcmp0(track_id, kTrackId) != 0 || position < 0 ||
+      (self->duration > 0 && position > self->duration)) {
+    return;
+  }
+
+  seek_locally(self, position);
+  dispatch_command(self, {MprisCommandType::kSetPosition, position, 0});
+}
+
+using MprisGetter = GVariant* (*)(MprisServer* self);
+using MprisSetter = void (*)(MprisServer* self, GVariant* value);
+using MprisMethodHandler = void (*)(MprisServer* self, GVariant* parameters);
+
+enum MprisPropertyFlags : guint {
+  kPropertyNone = 0,
+  // Changes continuously; never sent in PropertiesChanged and recomputed
+  // when served from a cached GetAll reply.
+  kPropertyVolatile = 1 << 0,
+};
+
+struct MprisArg {
+  const char* name;
+  const char* signature;
+};
+
+struct MprisMethod {
+  const char* name;
+  const MprisArg* args;
+  size_t n_args;
+  // nullptr for methods that are accepted but do nothing.
+  MprisMethodHandler handler;
+};
+
+struct MprisSignal {
+  const char* name;
+  const MprisArg* args;
+  size_t n_args;
+};
+
+struct MprisProperty {
+  const char* name;
+  const char* signature;
+  MprisGetter getter;
+  // nullptr for read-only properties.
+  MprisSetter setter;
+  guint flags;
+};
+
+struct MprisInterface {
+  const char* name;
+  const MprisMethod* methods;
+  size_t n_methods;
+  const MprisSignal* signals;
+  size_t n_signals;
+  const MprisProperty* properties;
+  size_t n_properties;
+};
+
+static constexpr int compare_names(const char* a, const char* b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+template <typename T, size_t N>
+static constexpr bool is_sorted_by_name(const T (&items)[N]) {
+  for (size_t i = 1; i < N; i++) {
+    if (compare_names(items[i - 1].name, items[i].name) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Binary search over a registry table sorted by name.
+template <typename T>
+static const T* find_by_name(const T* items, size_t count, const gchar* name) {
+  if (name == nullptr) {
+    return nullptr;
+  }
+
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int order = strcmp(items[mid].name, name);
+    if (order == 0) {
+      return &items[mid];
+    }
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return nullptr;
+}
+
+static GVariant* new_true(MprisServer* self) {
+  return g_variant_new_boolean(TRUE);
+}
+
+static GVariant* new_false(MprisServer* self) {
+  return g_variant_new_boolean(FALSE);
+}
+
+static GVariant* new_empty_strv(MprisServer* self) {
+  return g_variant_new_strv(nullptr, 0);
+}
+
+// The MPRIS object model. Every table is sorted by name, which
+// find_by_name relies on and the static_asserts below enforce. The
+// introspection XML, method dispatch, Get/Set and GetAll are all driven
+// from here.
+
+static constexpr MprisMethod kRootMethods[] = {
+  {"Quit", nullptr, 0, nullptr},
+  {"Raise", nullptr, 0, nullptr},
+};
+
+static constexpr MprisProperty kRootProperties[] = {
+  {"CanQuit", "b", new_true, nullptr, kPropertyNone},
+  {"CanRaise", "b", new_true, nullptr, kPropertyNone},
+  {"HasTrackList", "b", new_false, nullptr, kPropertyNone},
+  {"Identity", "s",
+   [](MprisServer* self) {
+     return g_variant_new_string("YouTube Music Unbound");
+   },
+   nullptr, kPropertyNone},
+  {"SupportedMimeTypes", "as", new_empty_strv, nullptr, kPropertyNone},
+  {"SupportedUriSchemes", "as", new_empty_strv, nullptr, kPropertyNone},
+};
+
+static constexpr MprisArg kSeekArgs[] = {
+  {"Offset", "x"},
+};
+
+static constexpr MprisArg kSetPositionArgs[] = {
+  {"TrackId", "o"},
+  {"Position", "x"},
+};
+
+static constexpr MprisArg kSeekedArgs[] = {
+  {"Position", "x"},
+};
+
+static constexpr MprisMethod kPlayerMethods[] = {
+  {"Next", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kNext, 0, 0});
+   }},
+  {"Pause", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kPause, 0, 0});
+   }},
+  {"Play", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kPlay, 0, 0});
+   }},
+  {"PlayPause", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kPlayPause, 0, 0});
+   }},
+  {"Previous", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kPrevious, 0, 0});
+   }},
+  {"Seek", kSeekArgs, G_N_ELEMENTS(kSeekArgs), handle_seek},
+  {"SetPosition", kSetPositionArgs, G_N_ELEMENTS(kSetPositionArgs),
+   handle_set_position},
+  {"Stop", nullptr, 0,
+   [](MprisServer* self, GVariant* parameters) {
+     dispatch_command(self, {MprisCommandType::kStop, 0, 0});
+   }},
+};
+
+static constexpr MprisSignal kPlayerSignals[] = {
+  {"Seeked", kSeekedArgs, G_N_ELEMENTS(kSeekedArgs)},
+};
+
+static constexpr MprisProperty kPlayerProperties[] = {
+  {"CanControl", "b", new_true, nullptr, kPropertyNone},
+  {"CanGoNext", "b", new_true, nullptr, kPropertyNone},
+  {"CanGoPrevious", "b", new_true, nullptr, kPropertyNone},
+  {"CanPause", "b", new_true, nullptr, kPropertyNone},
+  {"CanPlay", "b", new_true, nullptr, kPropertyNone},
+  {"CanSeek", "b", new_true, nullptr, kPropertyNone},
+  {"MaximumRate", "d",
+   [](MprisServer* self) { return g_variant_new_double(kMaximumRate); },
+   nullptr, kPropertyNone},
+  {"Metadata", "a{sv}",
+   [](MprisServer* self) { return g_variant_ref(get_metadata_snapshot(self)); },
+   nullptr, kPropertyNone},
+  {"MinimumRate", "d",
+   [](MprisServer* self) { return g_variant_new_double(kMinimumRate); },
+   nullptr, kPropertyNone},
+  {"PlaybackStatus", "s",
+   [](MprisServer* self) {
+     return g_variant_new_string(self->playback_status);
+   },
+   nullptr, kPropertyNone},
+  {"Position", "x",
+   [](MprisServer* self) {
+     return g_variant_new_int64(current_position(self));
+   },
+   nullptr, kPropertyVolatile},
+  {"Rate", "d",
+   [](MprisServer* self) { return g_variant_new_double(self->rate); },
+   [](MprisServer* self, GVariant* value) {
+     set_rate_or_pause(self, g_variant_get_double(value));
+   },
+   kPropertyNone},
+  {"Volume", "d",
+   [](MprisServer* self) { return g_variant_new_double(self->volume); },
+   [](MprisServer* self, GVariant* value) {
+     set_volume(self, g_variant_get_double(value));
+   },
+   kPropertyNone},
+};
+
+// Indexed by MprisInterfaceIndex.
+static constexpr MprisInterface kInterfaces[] = {
+  {kMprisInterface,
+   kRootMethods, G_N_ELEMENTS(kRootMethods),
+   nullptr, 0,
+   kRootProperties, G_N_ELEMENTS(kRootProperties)},
+  {kMprisPlayerInterface,
+   kPlayerMethods, G_N_ELEMENTS(kPlayerMethods),
+   kPlayerSignals, G_N_ELEMENTS(kPlayerSignals),
+   kPlayerProperties, G_N_ELEMENTS(kPlayerProperties)},
+};
+
+static_assert(is_sorted_by_name(kRootMethods), "kRootMethods must be sorted");
+static_assert(is_sorted_by_name(kRootProperties),
+              "kRootProperties must be sorted");
+static_assert(is_sorted_by_name(kPlayerMethods),
+              "kPlayerMethods must be sorted");
+static_assert(is_sorted_by_name(kPlayerProperties),
+              "kPlayerProperties must be sorted");
+static_assert(is_sorted_by_name(kInterfaces), "kInterfaces must be sorted");
+static_assert(G_N_ELEMENTS(kInterfaces) ==
+              sizeof(MprisServer::get_all_replies) / sizeof(GVariant*),
+              "one cached GetAll reply per interface");
+
+static const MprisInterface* find_interface(const gchar* name) {
+  return find_by_name(kInterfaces, G_N_ELEMENTS(kInterfaces), name);
+}
+
+static const MprisProperty* find_property(const MprisInterface* interface,
+                                          const gchar* name) {
+  return find_by_name(interface->properties, interface->n_properties, name);
+}
+
+static MprisInterfaceIndex interface_index(const MprisInterface* interface) {
+  return static_cast<MprisInterfaceIndex>(interface - kInterfaces);
+}
+
+static void append_args_xml(GString* xml, const MprisArg* args, size_t n_args,
+                            const char* direction) {
+  for (size_t i = 0; i < n_args; i++) {
+    g_string_append_printf(xml, "<arg name='%s' type='%s'%s%s%s/>",
+                           args[i].name, args[i].signature,
+                           direction != nullptr ? " direction='" : "",
+                           direction != nullptr ? direction : "",
+                           direction != nullptr ? "'" : "");
+  }
+}
+
+// Renders the registry as D-Bus introspection XML.
+static gchar* build_introspection_xml() {
+  GString* xml = g_string_new("<node>");
+
+  for (const MprisInterface& interface : kInterfaces) {
+    g_string_append_printf(xml, "<interface name='%s'>", interface.name);
+
+    for (size_t i = 0; i < interface.n_methods; i++) {
+      const MprisMethod& method = interface.methods[i];
+      g_string_append_printf(xml, "<method name='%s'>", method.name);
+      append_args_xml(xml, method.args, method.n_args, "in");
+      g_string_append(xml, "</method>");
+    }
+
+    for (size_t i = 0; i < interface.n_signals; i++) {
+      const MprisSignal& signal = interface.signals[i];
+      g_string_append_printf(xml, "<signal name='%s'>", signal.name);
+      append_args_xml(xml, signal.args, signal.n_args, nullptr);
+      g_string_append(xml, "</signal>");
+    }
+
+    for (size_t i = 0; i < interface.n_properties; i++) {
+      const MprisProperty& property = interface.properties[i];
+      g_string_append_printf(xml,
+                             "<property name='%s' type='%s' access='%s'/>",
+                             property.name, property.signature,
+                             property.setter != nullptr ? "readwrite" : "read");
+    }
+
+    g_string_append(xml, "</interface>");
+  }
+
+  g_string_append(xml, "</node>");
+  return g_string_free(xml, FALSE);
+}
+
+// Returns a new (possibly floating) reference to the property value.
+static GVariant* get_property_value(MprisServer* self,
+                                    const gchar* interface_name,
+                                    const gchar* property_name,
+                                    GError** error) {
+  const MprisInterface* interface = find_interface(interface_name);
+  const MprisProperty* property =
+      interface != nullptr ? find_property(interface, property_name) : nullptr;
+  if (property == nullptr) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                "No such property %s", property_name);
+    return nullptr;
+  }
+
+  return property->getter(self);
+}
+
+static gboolean set_property_value(MprisServer* self,
+                                   const gchar* interface_name,
+                                   const gchar* property_name,
+                                   GVariant* value,
+                                   GError** error) {
+  const MprisInterface* interface = find_interface(interface_name);
+  const MprisProperty* property =
+      interface != nullptr ? find_property(interface, property_name) : nullptr;
+  if (property == nullptr) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                "No such property %s", property_name);
+    return FALSE;
+  }
+  if (property->setter == nullptr) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+                "Property %s is read-only", property_name);
+    return FALSE;
+  }
+
+  if (!g_variant_is_of_type(value, G_VARIANT_TYPE(property->signature))) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                "Expected type '%s'", property->signature);
+    return FALSE;
+  }
+
+  property->setter(self, value);
+  return TRUE;
+}
+
+static GVariant* build_get_all_reply(MprisServer* self,
+                                    const MprisInterface* interface) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  for (size_t i = 0; i < interface->n_properties; i++) {
+    const MprisProperty& property = interface->properties[i];
+    g_autoptr(GVariant) value = g_variant_take_ref(property.getter(self));
+    g_variant_builder_add(&builder, "{sv}", property.name, value);
+  }
+
+  return g_variant_ref_sink(g_variant_new("(a{sv})", &builder));
+}
+
+// Returns the cached GetAll reply for |interface|. The server keeps
+// ownership.
+static GVariant* get_all_reply(MprisServer* self,
+                               const MprisInterface* interface) {
+  MprisInterfaceIndex index = interface_index(interface);
+  if (self->get_all_replies[index] != nullptr) {
+    self->shared->rebuilds_avoided++;
+  } else {
+    self->get_all_replies[index] = build_get_all_reply(self, interface);
+    self->shared->snapshot_builds++;
+  }
+  return self->get_all_replies[index];
+}
+
+// While Playing a cached reply holds stale volatile values such as
+// Position; copy its entries and recompute those. Returns a floating reply.
+static GVariant* splice_volatile_properties(MprisServer* self,
+                                            const MprisInterface* interface,
+                                            GVariant* reply) {
+  g_autoptr(GVariant) properties = g_variant_get_child_value(reply, 0);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+  GVariantIter iter;
+  g_variant_iter_init(&iter, properties);
+  GVariant* entry;
+  while ((entry = g_variant_iter_next_value(&iter)) != nullptr) {
+    const gchar* name;
+    g_variant_get_child(entry, 0, "&s", &name);
+    const MprisProperty* property = find_property(interface, name);
+    if (property != nullptr && (property->flags & kPropertyVolatile)) {
+      g_variant_builder_add(&builder, "{sv}", name, property->getter(self));
+    } else {
+      g_variant_builder_add_value(&builder, entry);
+    }
+    g_variant_unref(entry);
+  }
+
+  return g_variant_new("(a{sv})", &builder);
+}
+
+// Get, GetAll and Set are routed here because the vtable leaves
+// get_property and set_property unset, which lets GetAll be answered from
+// the prebuilt reply.
+static void handle_properties_call(MprisServer* self,
+                                   const gchar* method_name,
+                                   GVariant* parameters,
+                                   GDBusMethodInvocation* invocation) {
+  if (g_strcmp0(method_name, "Get") == 0) {
+    const gchar* interface_name;
+    const gchar* property_name;
+    g_variant_get(parameters, "(&s&s)", &interface_name, &property_name);
+
+    GError* error = nullptr;
+    g_autoptr(GVariant) value = g_variant_take_ref(
+        get_property_value(self, interface_name, property_name, &error));
+    if (value == nullptr) {
+      g_dbus_method_invocation_take_error(invocation, error);
+      return;
+    }
+
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(v)", value));
+  } else if (g_strcmp0(method_name, "GetAll") == 0) {
+    const gchar* interface_name;
+    g_variant_get(parameters, "(&s)", &interface_name);
+
+    const MprisInterface* interface = find_interface(interface_name);
+    if (interface == nullptr) {
+      g_dbus_method_invocation_return_error(
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_INTERFACE,
+          "Unknown interface");
+      return;
+    }
+
+    GVariant* reply = get_all_reply(self, interface);
+    if (is_playing(self)) {
+      reply = splice_volatile_properties(self, interface, reply);
+    }
+    g_dbus_method_invocation_return_value(invocation, reply);
+  } else if (g_strcmp0(method_name, "Set") == 0) {
+    const gchar* interface_name;
+    const gchar* property_name;
+    g_autoptr(GVariant) value = nullptr;
+    g_variant_get(parameters, "(&s&sv)", &interface_name, &property_name,
+                  &value);
+
+    GError* error = nullptr;
+    if (!set_property_value(self, interface_name, property_name, value,
+                            &error)) {
+      g_dbus_method_invocation_take_error(invocation, error);
+      return;
+    }
+
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+  } else {
+    g_dbus_method_invocation_return_error(
+        invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+        "Unknown method");
+  }
+}
+
+static void handle_mpris_method_call(
+    GDBusConnection* connection,
+    const gchar* sender,
+    const gchar* object_path,
+    const gchar* interface_name,
+    const gchar* method_name,
+    GVariant* parameters,
+    GDBusMethodInvocation* invocation,
+    gpointer user_data) {
+
+  MprisServer* self = MPRIS_SERVER(user_data);
+
+  // Property reads and relative seeks must see what Dart last wrote, even
+  // if its doorbell has not arrived yet.
+  sync_from_block(self);
+
+  if (g_strcmp0(interface_name, kPropertiesInterface) == 0) {
+    handle_properties_call(self, method_name, parameters, invocation);
+    return;
+  }
+
+  // GDBus has already checked the arguments against the introspection
+  // data generated from the same registry.
+  const MprisInterface* interface = find_interface(interface_name);
+  const MprisMethod* method = interface != nullptr ?
+      find_by_name(interface->methods, interface->n_methods, method_name) :
+      nullptr;
+  if (method == nullptr) {
+    g_dbus_method_invocation_return_error(
+        invocation, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+        "Method not supported");
+    return;
+  }
+
+  if (method->handler != nullptr) {
+    method->handler(self, parameters);
+  }
+  g_dbus_method_invocation_return_value(invocation, nullptr);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+  handle_mpris_method_call,
+  nullptr,
+  nullptr
+};
+
+static void on_bus_acquired(GDBusConnection* connection,
+                           const gchar* name,
+                           gpointer user_data) {
+  MprisServer* self = MPRIS_SERVER(user_data);
+  GError* error = nullptr;
+  startup_trace_span("bus acquisition", self->own_name_time);
+  const gint64 begin = startup_trace_now();
+
+  self->connection = G_DBUS_CONNECTION(g_object_ref(connection));
+
+  // Registered from the D-Bus thread, so method calls and property reads
+  // are dispatched on |dbus_context|.
+  for (guint i = 0; i < G_N_ELEMENTS(self->registration_ids); i++) {
+    self->registration_ids[i] = g_dbus_connection_register_object(
+        connection,
+        kObjectPath,
+        self->introspection_data->interfaces[i],
+        &interface_vtable,
+        self,
+        nullptr,
+        &error);
+
+    if (self->registration_ids[i] == 0) {
+      g_warning("Failed to register MPRIS interface: %s", error->message);
+      g_clear_error(&error);
+      return;
+    }
+  }
+  startup_trace_span("on_bus_acquired", begin);
+}
+
+static void on_name_acquired(GDBusConnection* connection,
+                             const gchar* name,
+                             gpointer user_data) {
+  startup_trace_instant("MPRIS name acquired");
+}
+
+const gchar* mpris_command_name(MprisCommandType type) {
+  switch (type) {
+    case MprisCommandType::kPlay:
+      return "play";
+    case MprisCommandType::kPause:
+      return "pause";
+    case MprisCommandType::kPlayPause:
+      return "playPause";
+    case MprisCommandType::kNext:
+      return "next";
+    case MprisCommandType::kPrevious:
+      return "previous";
+    case MprisCommandType::kStop:
+      return "stop";
+    case MprisCommandType::kSeek:
+      return "seek";
+    case MprisCommandType::kSetPosition:
+      return "setPosition";
+    case MprisCommandType::kSetVolume:
+      return "setVolume";
+    case MprisCommandType::kSetRate:
+      return "setRate";
+    case MprisCommandType::kOpenUri:
+      return "openUri";
+  }
+  return nullptr;
+}
+
+// Carries a command from the D-Bus thread to the owner thread.
+struct CommandDelivery {
+  MprisServer* self;
+  MprisCommand command;
+};
+
+static gboolean deliver_command(gpointer user_data) {
+  CommandDelivery* delivery = static_cast<CommandDelivery*>(user_data);
+  MprisServer* self = delivery->self;
+  if (self->command_handler != nullptr) {
+    self->command_handler(delivery->command, self->command_handler_data);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void free_command_delivery(gpointer user_data) {
+  CommandDelivery* delivery = static_cast<CommandDelivery*>(user_data);
+  g_object_unref(delivery->self);
+  delete delivery;
+}
+
+static gboolean is_transport_command(MprisCommandType type) {
+  switch (type) {
+    case MprisCommandType::kPlay:
+    case MprisCommandType::kPause:
+    case MprisCommandType::kPlayPause:
+    case MprisCommandType::kNext:
+    case MprisCommandType::kPrevious:
+    case MprisCommandType::kStop:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+// Runs on the D-Bus thread. Handlers are usually not thread-safe (the
+// Flutter channel is not), so the command is handed to the owner thread.
+static void dispatch_command(MprisServer* self, const MprisCommand& command) {
+  if (is_transport_command(command.type)) {
+    gint64 now = g_get_monotonic_time();
+    if (self->last_command_type == static_cast<gint>(command.type) &&
+        now - self->last_command_time < kCommandDebounceUs) {
+      return;
+    }
+    self->last_command_type = static_cast<gint>(command.type);
+    self->last_command_time = now;
+  }
+
+  CommandDelivery* delivery = new CommandDelivery{
+      MPRIS_SERVER(g_object_ref(self)), command};
+  g_main_context_invoke_full(self->main_context, G_PRIORITY_DEFAULT,
+                             deliver_command, delivery,
+                             free_command_delivery);
+}
+
+static gpointer dbus_thread_main(gpointer user_data) {
+  MprisServer* self = MPRIS_SERVER(user_data);
+
+  g_main_context_push_thread_default(self->dbus_context);
+
+  // Owning the name here binds the bus callbacks, and through them every
+  // registered object, to |dbus_context|.
+  self->own_name_time = startup_trace_now();
+  self->bus_id = g_bus_own_name(
+      G_BUS_TYPE_SESSION,
+      kBusName,
+      G_BUS_NAME_OWNER_FLAGS_NONE,
+      on_bus_acquired,
+      on_name_acquired,
+      nullptr,
+      self,
+      nullptr);
+
+  g_main_loop_run(self->dbus_loop);
+
+  for (guint i = 0; i < G_N_ELEMENTS(self->registration_ids); i++) {
+    if (self->registration_ids[i] > 0) {
+      g_dbus_connection_unregister_object(self->connection,
+                                          self->registration_ids[i]);
+      self->registration_ids[i] = 0;
+    }
+  }
+
+  if (self->bus_id > 0) {
+    g_bus_unown_name(self->bus_id);
+    self->bus_id = 0;
+  }
+
+  if (self->flush_source != nullptr) {
+    g_source_destroy(self->flush_source);
+    g_clear_pointer(&self->flush_source, g_source_unref);
+  }
+
+  g_clear_object(&self->connection);
+  g_main_context_pop_thread_default(self->dbus_context);
+  return nullptr;
+}
+
+static gboolean on_quit_dbus_loop(gpointer user_data) {
+  g_main_loop_quit(static_cast<GMainLoop*>(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+// Queued as a source rather than calling g_main_loop_quit directly so a
+// quit that races the thread start is not lost before the loop runs.
+static void stop_dbus_thread(MprisServer* self) {
+  GSource* source = g_idle_source_new();
+  g_source_set_callback(source, on_quit_dbus_loop,
+                        g_main_loop_ref(self->dbus_loop),
+                        (GDestroyNotify)g_main_loop_unref);
+  g_source_attach(source, self->dbus_context);
+  g_source_unref(source);
+
+  g_thread_join(self->dbus_thread);
+  self->dbus_thread = nullptr;
+}
+
+gboolean mpris_server_start(MprisServer* self) {
+  g_return_val_if_fail(MPRIS_IS_SERVER(self), FALSE);
+
+  if (self->dbus_thread != nullptr) {
+    return TRUE;
+  }
+
+  GError* error = nullptr;
+
+  g_autofree gchar* xml = build_introspection_xml();
+  self->introspection_data = g_dbus_node_info_new_for_xml(xml, &error);
+
+  if (error != nullptr) {
+    g_warning("Failed to parse introspection XML: %s", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  self->dbus_thread = g_thread_new("mpris-dbus", dbus_thread_main, self);
+  return TRUE;
+}
+
+// Emits a single PropertiesChanged carrying only the dirty properties whose
+// value differs from what was last sent.
+static void flush_properties_changed(MprisServer* self) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  gboolean changed = FALSE;
+
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, self->dirty_properties);
+  while (g_hash_table_iter_next(&iter, &key, nullptr)) {
+    const gchar* name = static_cast<const gchar*>(key);
+    g_autoptr(GVariant) value = g_variant_take_ref(
+        get_property_value(self, kMprisPlayerInterface, name, nullptr));
+    if (value == nullptr) {
+      continue;
+    }
+
+    GVariant* sent = static_cast<GVariant*>(
+        g_hash_table_lookup(self->sent_properties, name));
+    if (sent != nullptr && g_variant_equal(sent, value)) {
+      continue;
+    }
+
+    g_hash_table_insert(self->sent_properties, g_strdup(name),
+                        g_variant_ref(value));
+    g_variant_builder_add(&builder, "{sv}", name, value);
+    changed = TRUE;
+  }
+  g_hash_table_remove_all(self->dirty_properties);
+
+  if (!changed || self->connection == nullptr) {
+    g_variant_builder_clear(&builder);
+    return;
+  }
+
+  g_dbus_connection_emit_signal(
+      self->connection,
+      nullptr,
+      kObjectPath,
+      kPropertiesInterface,
+      "PropertiesChanged",
+      g_variant_new("(sa{sv}as)", kMprisPlayerInterface, &builder, nullptr),
+      nullptr);
+}
+
+static gboolean on_flush_properties(gpointer user_data) {
+  MprisServer* self = MPRIS_SERVER(user_data);
+  g_clear_pointer(&self->flush_source, g_source_unref);
+  flush_properties_changed(self);
+  return G_SOURCE_REMOVE;
+}
+
+// |name| must be a static string; the dirty set does not copy it.
+static void mark_property_dirty(MprisServer* self, const gchar* name) {
+  g_hash_table_add(self->dirty_properties, const_cast<gchar*>(name));
+
+  if (self->flush_source != nullptr) {
+    return;
+  }
+
+  self->flush_source = self->coalesce_ms == 0 ?
+      g_idle_source_new() : g_timeout_source_new(self->coalesce_ms);
+  g_source_set_callback(self->flush_source, on_flush_properties, self,
+                        nullptr);
+  g_source_attach(self->flush_source, self->dbus_context);
+}
+
+static gboolean metadata_equal(GHashTable* a, GHashTable* b) {
+  if (g_hash_table_size(a) != g_hash_table_size(b)) {
+    return FALSE;
+  }
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, a);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    GVariant* other = static_cast<GVariant*>(g_hash_table_lookup(b, key));
+    if (other == nullptr ||
+        !g_variant_equal(static_cast<GVariant*>(value), other)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+// Sets |key| to a string, or removes it when |value| is empty.
+static void put_metadata_string(GHashTable* metadata, const gchar* key,
+                                const std::string& value) {
+  if (value.empty()) {
+    g_hash_table_remove(metadata, key);
+    return;
+  }
+  g_hash_table_insert(metadata, g_strdup(key),
+                      g_variant_ref_sink(g_variant_new_string(
+                          value.c_str())));
+}
+
+static gboolean metadata_entry_equal(GHashTable* a, GHashTable* b,
+                                     const gchar* key) {
+  GVariant* left = static_cast<GVariant*>(g_hash_table_lookup(a, key));
+  GVariant* right = static_cast<GVariant*>(g_hash_table_lookup(b, key));
+  if (left == nullptr || right == nullptr) {
+    return left == right;
+  }
+  return g_variant_equal(left, right);
+}
+
+static void on_artwork_ready(const gchar* url, const gchar* path,
+                             gpointer user_data) {
+  MprisServer* self = MPRIS_SERVER(user_data);
+  if (g_strcmp0(url, self->remote_art_url) != 0) {
+    return;
+  }
+
+  // Fall back to the remote URL if the image could not be cached.
+  g_autofree gchar* uri = path != nullptr ?
+      g_filename_to_uri(path, nullptr, nullptr) : g_strdup(url);
+  put_metadata_string(self->metadata, "mpris:artUrl", uri != nullptr ?
+                      uri : url);
+  invalidate_metadata_snapshot(self);
+  mark_property_dirty(self, "Metadata");
+}
+
+// Returns the artUrl to publish for |url| now: a cached file:// URL, the
+// URL itself if it is not remote, or "" while the image is being fetched.
+static std::string resolve_art_url(MprisServer* self, const std::string& url) {
+  g_free(self->remote_art_url);
+  self->remote_art_url = nullptr;
+
+  if (!g_str_has_prefix(url.c_str(), "http://") &&
+      !g_str_has_prefix(url.c_str(), "https://")) {
+    return url;
+  }
+
+  self->remote_art_url = g_strdup(url.c_str());
+  g_autofree gchar* path = artwork_cache_lookup(self->artwork_cache,
+                                                url.c_str());
+  if (path != nullptr) {
+    g_autofree gchar* uri = g_filename_to_uri(path, nullptr, nullptr);
+    if (uri != nullptr) {
+      return uri;
+    }
+  }
+
+  artwork_cache_fetch(self->artwork_cache, url.c_str(), self->dbus_context,
+                      on_artwork_ready, self);
+  return "";
+}
+
+// Merges the flagged track fields over the current metadata.
+static void apply_metadata(MprisServer* self, const MprisUpdate& update) {
+  g_autoptr(GHashTable) metadata = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->metadata);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    g_hash_table_insert(metadata, g_strdup(static_cast<gchar*>(key)),
+                        g_variant_ref(static_cast<GVariant*>(value)));
+  }
+
+  if (update.flags & kUpdateTitle) {
+    g_hash_table_insert(metadata,
+                       g_strdup("xesam:title"),
+                       g_variant_ref_sink(g_variant_new_string(
+                           update.title.c_str())));
+  }
+
+  if (update.flags & kUpdateArtist) {
+    const gchar* artists[] = {update.artist.c_str(), nullptr};
+    g_hash_table_insert(metadata,
+                       g_strdup("xesam:artist"),
+                       g_variant_ref_sink(g_variant_new_strv(artists, 1)));
+  }
+
+  if (update.flags & kUpdateAlbum) {
+    put_metadata_string(metadata, "xesam:album", update.album);
+  }
+
+  if (update.flags & kUpdateArtUrl) {
+    put_metadata_string(metadata, "mpris:artUrl",
+                        resolve_art_url(self, update.art_url));
+  }
+
+  g_hash_table_insert(metadata,
+                     g_strdup("mpris:trackid"),
+                     g_variant_ref_sink(g_variant_new_object_path(kTrackId)));
+
+  if (metadata_equal(metadata, self->metadata)) {
+    return;
+  }
+
+  gboolean new_track =
+      !metadata_entry_equal(metadata, self->metadata, "xesam:title") ||
+      !metadata_entry_equal(metadata, self->metadata, "xesam:artist");
+
+  g_hash_table_unref(self->metadata);
+  self->metadata = static_cast<GHashTable*>(g_steal_pointer(&metadata));
+  invalidate_metadata_snapshot(self);
+  mark_property_dirty(self, "Metadata");
+
+  // A new track starts from zero; clients re-read Position on Metadata
+  // changes, so this is not a seek. A position in the same update wins.
+  if (new_track) {
+    set_anchor(self, 0);
+  }
+}
+
+static void apply_playback_state(MprisServer* self,
+                                 const MprisUpdate& update) {
+  const gchar* status;
+
+  if (update.state == "playing") {
+    status = "Playing";
+  } else if (update.state == "paused") {
+    status = "Paused";
+  } else {
+    status = "Stopped";
+  }
+
+  if (g_strcmp0(status, self->playback_status) == 0) {
+    return;
+  }
+
+  // Freeze or resume extrapolation from the position at the transition.
+  set_anchor(self, current_position(self));
+
+  g_free(self->playback_status);
+  self->playback_status = g_strdup(status);
+  invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+  mark_property_dirty(self, "PlaybackStatus");
+}
+
+static void emit_seeked(MprisServer* self, gint64 position) {
+  if (self->connection == nullptr) {
+    return;
+  }
+
+  g_dbus_connection_emit_signal(
+      self->connection,
+      nullptr,
+      kObjectPath,
+      kMprisPlayerInterface,
+      "Seeked",
+      g_variant_new("(x)", position),
+      nullptr);
+}
+
+static void apply_playback_position(MprisServer* self,
+                                    const MprisUpdate& update) {
+  if (update.flags & kUpdatePosition) {
+    gint64 drift = update.position - current_position(self);
+    set_anchor(self, update.position);
+    invalidate_get_all_reply(self, kPlayerInterfaceIndex);
+
+    if (ABS(drift) > kSeekToleranceUs) {
+      emit_seeked(self, update.position);
+    }
+  }
+
+  if (update.flags & kUpdateDuration) {
+    self->duration = update.duration;
+
+    GVariant* length = static_cast<GVariant*>(
+        g_hash_table_lookup(self->metadata, "mpris:length"));
+    if (length != nullptr && g_variant_get_int64(length) == self->duration) {
+      return;
+    }
+
+    g_hash_table_insert(self->metadata,
+                       g_strdup("mpris:length"),
+                       g_variant_ref_sink(g_variant_new_int64(self->duration)));
+    invalidate_metadata_snapshot(self);
+    mark_property_dirty(self, "Metadata");
+  }
+}
+
+static void apply_update(MprisServer* self, const MprisUpdate& update) {
+  if (update.flags & kUpdateMetadata) {
+    apply_metadata(self, update);
+  }
+  if (update.flags & kUpdateState) {
+    apply_playback_state(self, update);
+  }
+  if (update.flags & (kUpdatePosition | kUpdateDuration)) {
+    apply_playback_position(self, update);
+  }
+}
+
+static const gchar* block_state_name(uint32_t state) {
+  switch (state) {
+    case NOW_PLAYING_PLAYING:
+      return "playing";
+    case NOW_PLAYING_PAUSED:
+      return "paused";
+    default:
+      return "stopped";
+  }
+}
+
+// Applies the fields Dart changed in the shared now-playing block since the
+// last sync. Costs one atomic load when nothing changed.
+static void sync_from_block(MprisServer* self) {
+  NowPlayingBlock* block = now_playing_block_get();
+  if (now_playing_block_generation(block) ==
+      self->block_snapshot->generation) {
+    return;
+  }
+
+  NowPlayingBlock* next = self->block_scratch;
+  NowPlayingBlock* last = self->block_snapshot;
+  if (!now_playing_block_read(block, next)) {
+    return;
+  }
+
+  MprisUpdate update;
+  if (strcmp(next->title, last->title) != 0) {
+    update.title = next->title;
+    update.flags |= kUpdateTitle;
+  }
+  if (strcmp(next->artist, last->artist) != 0) {
+    update.artist = next->artist;
+    update.flags |= kUpdateArtist;
+  }
+  if (strcmp(next->album, last->album) != 0) {
+    update.album = next->album;
+    update.flags |= kUpdateAlbum;
+  }
+  if (strcmp(next->art_url, last->art_url) != 0) {
+    update.art_url = next->art_url;
+    update.flags |= kUpdateArtUrl;
+  }
+  if (next->state != last->state) {
+    update.state = block_state_name(next->state);
+    update.flags |= kUpdateState;
+  }
+  if (next->position_time_us != last->position_time_us) {
+    // The block may be read well after Dart wrote it; carry the position
+    // forward to now.
+    update.position = next->position_us;
+    if (next->state == NOW_PLAYING_PLAYING) {
+      gint64 elapsed = g_get_monotonic_time() - next->position_time_us;
+      update.position += static_cast<gint64>(elapsed * self->rate);
+    }
+    update.flags |= kUpdatePosition;
+  }
+  if (next->duration_us != last->duration_us) {
+    update.duration = next->duration_us;
+    update.flags |= kUpdateDuration;
+  }
+
+  self->block_snapshot = next;
+  self->block_scratch = last;
+
+  if (update.flags != 0) {
+    apply_update(self, update);
+  }
+}
+
+// Runs on the D-Bus thread.
+static void drain_updates(MprisServer* self) {
+  // Cleared before popping so a push that lands mid-drain schedules
+  // another pass instead of being stranded.
+  self->shared->drain_scheduled.store(false, std::memory_order_release);
+
+  MprisShared* shared = self->shared;
+  MprisUpdate update;
+  std::vector<MprisUpdate> overflow;
+  for (;;) {
+    while (shared->updates.Pop(&update)) {
+      apply_update(self, update);
+    }
+    if (!shared->overflow_pending.load(std::memory_order_acquire)) {
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> lock(shared->overflow_mutex);
+      overflow.swap(shared->overflow);
+      shared->overflow_pending.store(false, std::memory_order_release);
+    }
+    // Ahead of anything pushed to the ring from here on.
+    for (const MprisUpdate& pending : overflow) {
+      apply_update(self, pending);
+    }
+    overflow.clear();
+  }
+  sync_from_block(self);
+}
+
+static gboolean on_drain_updates(gpointer user_data) {
+  drain_updates(MPRIS_SERVER(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static void schedule_drain(MprisServer* self) {
+  if (self->shared->drain_scheduled.exchange(true,
+                                             std::memory_order_acq_rel)) {
+    return;
+  }
+
+  GSource* source = g_idle_source_new();
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, on_drain_updates, self, nullptr);
+  g_source_attach(source, self->dbus_context);
+  g_source_unref(source);
+}
+
+void mpris_server_push_update(MprisServer* self, MprisUpdate&& update) {
+  g_return_if_fail(MPRIS_IS_SERVER(self));
+
+  // Before start there is no D-Bus thread; apply in place.
+  if (self->dbus_thread == nullptr) {
+    apply_update(self, update);
+    return;
+  }
+
+  // Order is kept by not touching the ring again until the D-Bus thread
+  // has taken the overflow, which it does only once the ring is empty.
+  MprisShared* shared = self->shared;
+  if (shared->overflow_pending.load(std::memory_order_acquire) ||
+      !shared->updates.Push(std::move(update))) {
+    std::lock_guard<std::mutex> lock(shared->overflow_mutex);
+    shared->overflow.push_back(std::move(update));
+    shared->overflow_pending.store(true, std::memory_order_release);
+  }
+
+  schedule_drain(self);
+}
+
+void mpris_server_sync_block(MprisServer* self) {
+  g_return_if_fail(MPRIS_IS_SERVER(self));
+
+  if (self->dbus_thread == nullptr) {
+    sync_from_block(self);
+    return;
+  }
+  schedule_drain(self);
+}
+
+MprisServer* mpris_server_new() {
+  return MPRIS_SERVER(g_object_new(mpris_server_get_type(), nullptr));
+}
+
+void mpris_server_set_command_handler(MprisServer* self,
+                                      MprisCommandHandler handler,
+                                      gpointer user_data) {
+  g_return_if_fail(MPRIS_IS_SERVER(self));
+
+  self->command_handler = handler;
+  self->command_handler_data = user_data;
+}
+
+void mpris_server_set_coalesce_ms(MprisServer* self, guint coalesce_ms) {
+  g_return_if_fail(MPRIS_IS_SERVER(self));
+
+  // Read by the D-Bus thread, so only honoured before it starts.
+  if (self->dbus_thread == nullptr) {
+    self->coalesce_ms = MIN(coalesce_ms, 1000);
+  }
+}
+
+void mpris_server_get_stats(MprisServer* self, MprisServerStats* stats) {
+  g_return_if_fail(MPRIS_IS_SERVER(self));
+
+  stats->metadata_version = self->shared->metadata_version;
+  stats->snapshot_builds = self->shared->snapshot_builds;
+  stats->rebuilds_avoided = self->shared->rebuilds_avoided;
+  artwork_cache_get_stats(self->artwork_cache, &stats->artwork_hits,
+                          &stats->artwork_misses, &stats->artwork_failures);
+}
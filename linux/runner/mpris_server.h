@@ -0,0 +1,147 @@
+#ifndef RUNNER_MPRIS_SERVER_H_
+#define RUNNER_MPRIS_SERVER_H_
+
+#include <gio/gio.h>
+
+#include <string>
+
+// The MPRIS D-Bus server, independent of Flutter. It owns
+// org.mpris.MediaPlayer2.YouTubeMusicUnbound on the session bus from a
+// dedicated thread; mpris_plugin.cc adapts it to the platform channel.
+
+G_BEGIN_DECLS
+
+#define MPRIS_TYPE_SERVER mpris_server_get_type()
+G_DECLARE_FINAL_TYPE(MprisServer, mpris_server, MPRIS, SERVER, GObject)
+
+G_END_DECLS
+
+// Fields present in an MprisUpdate.
+enum MprisUpdateFlags : guint {
+  kUpdateTitle = 1 << 0,
+  kUpdateArtist = 1 << 1,
+  kUpdateAlbum = 1 << 2,
+  kUpdateArtUrl = 1 << 3,
+  kUpdateState = 1 << 4,
+  kUpdatePosition = 1 << 5,
+  kUpdateDuration = 1 << 6,
+  kUpdateMetadata = kUpdateTitle | kUpdateArtist | kUpdateAlbum |
+                    kUpdateArtUrl,
+};
+
+// A session change, applied on the D-Bus thread as one transaction. Only
+// fields flagged in |flags| are set; an empty album or art URL clears it.
+// |state| is "playing", "paused" or "stopped"; times are microseconds.
+struct MprisUpdate {
+  guint flags = 0;
+  std::string title;
+  std::string artist;
+  std::string album;
+  std::string art_url;
+  std::string state;
+  gint64 position = 0;
+  gint64 duration = 0;
+};
+
+// Commands received from MPRIS clients, and kOpenUri from the shell search
+// provider. Names returned by mpris_command_name must match the
+// MediaCommand enum in lib/models/media_command.dart.
+enum class MprisCommandType {
+  kPlay,
+  kPause,
+  kPlayPause,
+  kNext,
+  kPrevious,
+  kStop,
+  kSeek,
+  kSetPosition,
+  kSetVolume,
+  kSetRate,
+  kOpenUri,
+};
+
+struct MprisCommand {
+  MprisCommandType type;
+  // Seek offset or SetPosition target, in microseconds.
+  gint64 time_us;
+  // SetVolume or SetRate value.
+  gdouble value;
+  // OpenUri target, a music.youtube.com page.
+  std::string uri;
+};
+
+struct MprisServerStats {
+  guint64 metadata_version;
+  guint64 snapshot_builds;
+  guint64 rebuilds_avoided;
+  guint64 artwork_hits;
+  guint64 artwork_misses;
+  guint64 artwork_failures;
+};
+
+typedef void (*MprisCommandHandler)(const MprisCommand& command,
+                                    gpointer user_data);
+
+/**
+ * mpris_server_new:
+ *
+ * Creates a stopped server. The calling thread becomes its owner thread:
+ * commands are delivered on its thread-default main context, and the
+ * update functions below must only be called from it.
+ *
+ * Returns: a new #MprisServer.
+ */
+MprisServer* mpris_server_new();
+
+/**
+ * mpris_server_set_command_handler:
+ * @handler: (nullable): called on the owner thread for each command.
+ *
+ * Pass %NULL before dropping whatever @user_data points at; commands
+ * already queued are then discarded.
+ */
+void mpris_server_set_command_handler(MprisServer* self,
+                                      MprisCommandHandler handler,
+                                      gpointer user_data);
+
+/**
+ * mpris_server_set_coalesce_ms:
+ *
+ * Sets the PropertiesChanged coalescing window, capped at one second.
+ * Ignored once the server has started.
+ */
+void mpris_server_set_coalesce_ms(MprisServer* self, guint coalesce_ms);
+
+/**
+ * mpris_server_start:
+ *
+ * Starts the D-Bus thread and requests the bus name. Does nothing if
+ * already started.
+ *
+ * Returns: %FALSE if the server could not be set up.
+ */
+gboolean mpris_server_start(MprisServer* self);
+
+/**
+ * mpris_server_push_update:
+ *
+ * Queues @update for the D-Bus thread, or applies it in place before the
+ * server has started. Updates are applied in the order pushed. Only when
+ * the queue has filled up does a push take a lock, which the D-Bus thread
+ * holds just long enough to take what overflowed.
+ */
+void mpris_server_push_update(MprisServer* self, MprisUpdate&& update);
+
+/**
+ * mpris_server_sync_block:
+ *
+ * Applies whatever was written to the shared now-playing block since the
+ * last sync.
+ */
+void mpris_server_sync_block(MprisServer* self);
+
+void mpris_server_get_stats(MprisServer* self, MprisServerStats* stats);
+
+const gchar* mpris_command_name(MprisCommandType type);
+
+#endif  // RUNNER_MPRIS_SERVER_H_
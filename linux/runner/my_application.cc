@@ -1,151 +1,664 @@
-#include "my_application.h"
-
-#include <flutter_linux/flutter_linux.h>
-#ifdef GDK_WINDOWING_X11
-#include <gdk/gdkx.h>
-#endif
-
-#include "flutter/generated_plugin_registrant.h"
-#include "mpris_plugin.h"
-
-struct _MyApplication {
-  GtkApplication parent_instance;
-  char** dart_entrypoint_arguments;
-};
-
-G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
-
-// Called when first Flutter frame received.
-static void first_frame_cb(MyApplication* self, FlView *view)
-{
-  gtk_widget_show(gtk_widget_get_toplevel(GTK_WIDGET(view)));
-}
-
-// Implements GApplication::activate.
-static void my_application_activate(GApplication* application) {
-  MyApplication* self = MY_APPLICATION(application);
-  GtkWindow* window =
-      GTK_WINDOW(gtk_application_window_new(GTK_APPLICATION(application)));
-
-  // Use a header bar when running in GNOME as this is the common style used
-  // by applications and is the setup most users will be using (e.g. Ubuntu
-  // desktop).
-  // If running on X and not using GNOME then just use a traditional title bar
-  // in case the window manager does more exotic layout, e.g. tiling.
-  // If running on Wayland assume the header bar will work (may need changing
-  // if future cases occur).
-  gboolean use_header_bar = TRUE;
-#ifdef GDK_WINDOWING_X11
-  GdkScreen* screen = gtk_window_get_screen(window);
-  if (GDK_IS_X11_SCREEN(screen)) {
-    const gchar* wm_name = gdk_x11_screen_get_window_manager_name(screen);
-    if (g_strcmp0(wm_name, "GNOME Shell") != 0) {
-      use_header_bar = FALSE;
-    }
-  }
-#endif
-  if (use_header_bar) {
-    GtkHeaderBar* header_bar = GTK_HEADER_BAR(gtk_header_bar_new());
-    gtk_widget_show(GTK_WIDGET(header_bar));
-    gtk_header_bar_set_title(header_bar, "youtube_music_unbound");
-    gtk_header_bar_set_show_close_button(header_bar, TRUE);
-    gtk_window_set_titlebar(window, GTK_WIDGET(header_bar));
-  } else {
-    gtk_window_set_title(window, "youtube_music_unbound");
-  }
-
-  gtk_window_set_default_size(window, 1280, 720);
-
-  g_autoptr(FlDartProject) project = fl_dart_project_new();
-  fl_dart_project_set_dart_entrypoint_arguments(project, self->dart_entrypoint_arguments);
-
-  FlView* view = fl_view_new(project);
-  GdkRGBA background_color;
-  // Background defaults to black, override it here if necessary, e.g. #00000000 for transparent.
-  gdk_rgba_parse(&background_color, "#000000");
-  fl_view_set_background_color(view, &background_color);
-  gtk_widget_show(GTK_WIDGET(view));
-  gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(view));
-
-  // Show the window when Flutter renders.
-  // Requires the view to be realized so we can start rendering.
-  g_signal_connect_swapped(view, "first-frame", G_CALLBACK(first_frame_cb), self);
-  gtk_widget_realize(GTK_WIDGET(view));
-
-  fl_register_plugins(FL_PLUGIN_REGISTRY(view));
-
-  // Register MPRIS plugin
-  g_autoptr(FlPluginRegistrar) mpris_registrar =
-      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
-                                                  "MprisPlugin");
-  mpris_plugin_register_with_registrar(mpris_registrar);
-
-  gtk_widget_grab_focus(GTK_WIDGET(view));
-}
-
-// Implements GApplication::local_command_line.
-static gboolean my_application_local_command_line(GApplication* application, gchar*** arguments, int* exit_status) {
-  MyApplication* self = MY_APPLICATION(application);
-  // Strip out the first argument as it is the binary name.
-  self->dart_entrypoint_arguments = g_strdupv(*arguments + 1);
-
-  g_autoptr(GError) error = nullptr;
-  if (!g_application_register(application, nullptr, &error)) {
-     g_warning("Failed to register: %s", error->message);
-     *exit_status = 1;
-     return TRUE;
-  }
-
-  g_application_activate(application);
-  *exit_status = 0;
-
-  return TRUE;
-}
-
-// Implements GApplication::startup.
-static void my_application_startup(GApplication* application) {
-  //MyApplication* self = MY_APPLICATION(object);
-
-  // Perform any actions required at application startup.
-
-  G_APPLICATION_CLASS(my_application_parent_class)->startup(application);
-}
-
-// Implements GApplication::shutdown.
-static void my_application_shutdown(GApplication* application) {
-  //MyApplication* self = MY_APPLICATION(object);
-
-  // Perform any actions required at application shutdown.
-
-  G_APPLICATION_CLASS(my_application_parent_class)->shutdown(application);
-}
-
-// Implements GObject::dispose.
-static void my_application_dispose(GObject* object) {
-  MyApplication* self = MY_APPLICATION(object);
-  g_clear_pointer(&self->dart_entrypoint_arguments, g_strfreev);
-  G_OBJECT_CLASS(my_application_parent_class)->dispose(object);
-}
-
-static void my_application_class_init(MyApplicationClass* klass) {
-  G_APPLICATION_CLASS(klass)->activate = my_application_activate;
-  G_APPLICATION_CLASS(klass)->local_command_line = my_application_local_command_line;
-  G_APPLICATION_CLASS(klass)->startup = my_application_startup;
-  G_APPLICATION_CLASS(klass)->shutdown = my_application_shutdown;
-  G_OBJECT_CLASS(klass)->dispose = my_application_dispose;
-}
-
-static void my_application_init(MyApplication* self) {}
-
-MyApplication* my_application_new() {
-  // Set the program name to the application ID, which helps various systems
-  // like GTK and desktop environments map this running application to its
-  // corresponding .desktop file. This ensures better integration by allowing
-  // the application to be recognized beyond its binary name.
-  g_set_prgname(APPLICATION_ID);
-
-  return MY_APPLICATION(g_object_new(my_application_get_type(),
-                                     "application-id", APPLICATION_ID,
-                                     "flags", G_APPLICATION_NON_UNIQUE,
-                                     nullptr));
-}
+#include "my_application.h"
+
+#include <flutter_linux/flutter_linux.h>
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#endif
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "control_socket.h"
+#include "discord_ipc.h"
+#include "filter_engine.h"
+#include "filter_proxy.h"
+#include "flutter/generated_plugin_registrant.h"
+#include "history_recorder.h"
+#include "mpris_plugin.h"
+#include "now_playing_block.h"
+#include "now_playing_publisher.h"
+#include "scrobble_client.h"
+#include "search_provider.h"
+#include "startup_trace.h"
+#include "track_search_index.h"
+
+struct _MyApplication {
+  GtkApplication parent_instance;
+  char** dart_entrypoint_arguments;
+  // Serves the user's filter lists to lib/services/filter_lists.dart.
+  FilterEngine* filter_engine;
+  // Filters the WebView's traffic when YTMU_FILTER_PROXY is set.
+  FilterProxy* filter_proxy;
+  // Receives the playback commands of later invocations and of the control
+  // socket.
+  MprisPlugin* mpris_plugin;
+  // Serves status bars on $XDG_RUNTIME_DIR/ytmu.sock.
+  ControlSocket* control_socket;
+  // Mirrors the now-playing block into $XDG_RUNTIME_DIR/ytmu-now-playing.
+  NowPlayingPublisher* now_playing_publisher;
+  // Keeps the listening history in $XDG_DATA_HOME.
+  HistoryRecorder* history_recorder;
+  // Scrobbles plays when scrobble.ini is set up.
+  ScrobbleClient* scrobble_client;
+  // Answers GNOME Shell searches from the listening history.
+  SearchProvider* search_provider;
+  // Publishes Discord Rich Presence while Dart has it turned on.
+  DiscordIpc* discord_ipc;
+  // Takes Dart's spans when YTMU_STARTUP_TRACE is set.
+  FlMethodChannel* trace_channel;
+  // When activation started, for the span up to the first frame.
+  gint64 activate_time;
+  // Registers the generated plugins once the first frame is on screen,
+  // and answers youtube_music_unbound/plugins calls waiting for that.
+  FlView* view;
+  FlMethodChannel* plugins_channel;
+  GPtrArray* plugin_waits;
+  gboolean plugins_registered;
+};
+
+// Options a later invocation forwards to the running instance. Other
+// options are rejected; the arguments that are not options, and all of
+// those after "--", are passed to Dart on the first invocation.
+static const GOptionEntry kOptions[] = {
+    {"play-pause", 0, 0, G_OPTION_ARG_NONE, nullptr,
+     "Toggle playback in the running instance", nullptr},
+    {"next", 0, 0, G_OPTION_ARG_NONE, nullptr, "Skip to the next track",
+     nullptr},
+    {"previous", 0, 0, G_OPTION_ARG_NONE, nullptr,
+     "Go back to the previous track", nullptr},
+    {"show", 0, 0, G_OPTION_ARG_NONE, nullptr,
+     "Show the window, starting the app if needed", nullptr},
+    {"status", 0, 0, G_OPTION_ARG_NONE, nullptr,
+     "Print what is playing", nullptr},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, nullptr, nullptr,
+     "[ARGUMENTS...]"},
+    {nullptr},
+};
+
+// Where a search provider result or search opens.
+static constexpr char kSearchUrl[] = "https://music.youtube.com/search?q=";
+
+G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
+
+static void control_command_cb(const MprisCommand& command,
+                               gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(user_data);
+  mpris_plugin_send_command(self->mpris_plugin, command);
+}
+
+// The history keeps no video ids, so a track is opened as a search for
+// its title and artist, whose first result is the track.
+static void search_open_cb(const gchar* query, guint32 timestamp,
+                           gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(user_data);
+  GtkWindow* window = gtk_application_get_active_window(GTK_APPLICATION(self));
+  if (window != nullptr) {
+    gtk_window_present_with_time(window, timestamp);
+  }
+  g_autofree gchar* escaped = g_uri_escape_string(query, nullptr, TRUE);
+  MprisCommand command = {MprisCommandType::kOpenUri, 0, 0};
+  command.uri = std::string(kSearchUrl) + escaped;
+  mpris_plugin_send_command(self->mpris_plugin, command);
+}
+
+static void history_play_cb(const HistoryPlay& play, gpointer user_data) {
+  search_provider_add_play(SEARCH_PROVIDER(user_data), play);
+}
+
+// Returns the object path named in the search-providers .ini file the
+// build installs: the application id as a path.
+static gchar* search_provider_object_path() {
+  g_autofree gchar* id = g_strdup(APPLICATION_ID);
+  g_strdelimit(id, ".", '/');
+  g_strdelimit(id, "-", '_');
+  return g_strconcat("/", id, "/SearchProvider", nullptr);
+}
+
+// Serves the shell's searches over |tracks|, the history's, and keeps the
+// index up to date with the plays recorded from now on. The provider
+// builds the index on its own thread, and exports itself once it has.
+static void start_search_provider(MyApplication* self,
+                                  std::vector<SearchTrack> tracks) {
+  self->search_provider = search_provider_new(std::move(tracks));
+  search_provider_set_open_handler(self->search_provider, search_open_cb,
+                                   self);
+  g_autofree gchar* object_path = search_provider_object_path();
+  if (!search_provider_start(self->search_provider, object_path)) {
+    g_clear_object(&self->search_provider);
+    return;
+  }
+  history_recorder_set_play_handler(self->history_recorder, history_play_cb,
+                                    self->search_provider);
+}
+
+// What open_history_thread() hands back: the history, and the tracks in
+// it for the search provider.
+struct OpenedHistory {
+  std::unique_ptr<ListeningHistory> history;
+  std::vector<SearchTrack> tracks;
+};
+
+static void opened_history_free(gpointer opened) {
+  delete static_cast<OpenedHistory*>(opened);
+}
+
+// Maps the listening history, indexes the plays artists.idx does not
+// cover yet, and gathers its distinct tracks, off the main thread. The
+// history is not touched anywhere else until it is handed back.
+static void open_history_thread(GTask* task, gpointer source_object,
+                                gpointer task_data,
+                                GCancellable* cancellable) {
+  gint64 phase = startup_trace_now();
+  GError* error = nullptr;
+  std::unique_ptr<ListeningHistory> history =
+      ListeningHistory::Open(nullptr, &error);
+  startup_trace_span("listening_history_open", phase);
+  if (history == nullptr) {
+    g_task_return_error(task, error);
+    return;
+  }
+
+  phase = startup_trace_now();
+  OpenedHistory* opened = new OpenedHistory;
+  opened->tracks = TrackSearchIndex::CollectTracks(*history);
+  opened->history = std::move(history);
+  startup_trace_span("search_tracks_collect", phase);
+  g_task_return_pointer(task, opened, opened_history_free);
+}
+
+// Starts recording to the history open_history_thread() opened, and
+// serving searches over it.
+static void history_opened_cb(GObject* source_object, GAsyncResult* result,
+                              gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(source_object);
+  g_autoptr(GError) error = nullptr;
+  std::unique_ptr<OpenedHistory> opened(static_cast<OpenedHistory*>(
+      g_task_propagate_pointer(G_TASK(result), &error)));
+  if (opened == nullptr) {
+    g_warning("Listening history disabled: %s", error->message);
+    return;
+  }
+  self->history_recorder = history_recorder_new(std::move(opened->history));
+
+  const gint64 phase = startup_trace_now();
+  start_search_provider(self, std::move(opened->tracks));
+  startup_trace_span("search_provider_start", phase);
+}
+
+// Starts what Dart does not wait for: the control socket, the now-playing
+// snapshot, scrobbling, and the listening history, which is opened on a
+// worker. Runs after register_deferred_plugins_cb() has answered Dart.
+static gboolean start_services_cb(gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(user_data);
+
+  gint64 phase = startup_trace_now();
+  self->control_socket = control_socket_new();
+  control_socket_set_command_handler(self->control_socket, control_command_cb,
+                                     self);
+  g_autoptr(GError) error = nullptr;
+  if (!control_socket_start(self->control_socket, nullptr, &error)) {
+    g_warning("Control socket disabled: %s", error->message);
+    g_clear_error(&error);
+    g_clear_object(&self->control_socket);
+  }
+  startup_trace_span("control_socket_start", phase);
+
+  phase = startup_trace_now();
+  self->now_playing_publisher = now_playing_publisher_new();
+  if (!now_playing_publisher_start(self->now_playing_publisher, nullptr,
+                                   &error)) {
+    g_warning("Now-playing snapshot disabled: %s", error->message);
+    g_clear_error(&error);
+    g_clear_object(&self->now_playing_publisher);
+  }
+  startup_trace_span("now_playing_publisher_start", phase);
+
+  g_autoptr(GTask) task = g_task_new(self, nullptr, history_opened_cb,
+                                     nullptr);
+  g_task_run_in_thread(task, open_history_thread);
+
+  phase = startup_trace_now();
+  self->scrobble_client = scrobble_client_new(nullptr, nullptr, &error);
+  if (self->scrobble_client == nullptr) {
+    // Scrobbling is opt-in; only a broken setup is worth a warning.
+    if (g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_debug("Scrobbling off: %s", error->message);
+    } else {
+      g_warning("Scrobbling disabled: %s", error->message);
+    }
+    g_clear_error(&error);
+  }
+  startup_trace_span("scrobble_client_start", phase);
+  return G_SOURCE_REMOVE;
+}
+
+// Registers the plugins the first frame did not need: the generated ones
+// (window_manager, the tray and their dependencies) and the MPRIS server's
+// bus name. Dart holds its calls to them until this has run, so it answers
+// those waiting before anything else is started.
+static gboolean register_deferred_plugins_cb(gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(user_data);
+
+  const gint64 phase = startup_trace_now();
+  fl_register_plugins(FL_PLUGIN_REGISTRY(self->view));
+  startup_trace_span("fl_register_plugins", phase);
+
+  mpris_plugin_set_start_deferred(self->mpris_plugin, FALSE);
+
+  self->plugins_registered = TRUE;
+  for (guint i = 0; i < self->plugin_waits->len; i++) {
+    FlMethodCall* call =
+        FL_METHOD_CALL(g_ptr_array_index(self->plugin_waits, i));
+    fl_method_call_respond_success(call, nullptr, nullptr);
+  }
+  g_ptr_array_set_size(self->plugin_waits, 0);
+
+  g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, start_services_cb,
+                  g_object_ref(self), g_object_unref);
+  return G_SOURCE_REMOVE;
+}
+
+// Called when first Flutter frame received.
+static void first_frame_cb(MyApplication* self, FlView *view)
+{
+  startup_trace_span("activate to first frame", self->activate_time);
+  gtk_widget_show(gtk_widget_get_toplevel(GTK_WIDGET(view)));
+
+  if (!self->plugins_registered) {
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, register_deferred_plugins_cb,
+                    g_object_ref(self), g_object_unref);
+  }
+}
+
+// Turns the Discord client on for the application ID in |args|, a string,
+// or off for anything else, and answers whether it is on. Here rather than
+// through dart:ffi because the client is main thread only.
+static void set_discord_presence(MyApplication* self, FlMethodCall* method_call,
+                                 FlValue* args) {
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_STRING) {
+    if (self->discord_ipc == nullptr) {
+      self->discord_ipc = discord_ipc_new(fl_value_get_string(args));
+    }
+  } else {
+    g_clear_pointer(&self->discord_ipc, discord_ipc_free);
+  }
+  g_autoptr(FlValue) result = fl_value_new_bool(self->discord_ipc != nullptr);
+  fl_method_call_respond_success(method_call, result, nullptr);
+}
+
+// Handles youtube_music_unbound/plugins: "waitUntilReady" answers once the
+// deferred plugins are registered, and "setDiscordPresence" turns the
+// runner's Discord client on or off.
+static void plugins_method_call_cb(FlMethodChannel* channel,
+                                   FlMethodCall* method_call,
+                                   gpointer user_data) {
+  MyApplication* self = MY_APPLICATION(user_data);
+  const gchar* method = fl_method_call_get_name(method_call);
+
+  if (g_strcmp0(method, "setDiscordPresence") == 0) {
+    set_discord_presence(self, method_call,
+                         fl_method_call_get_args(method_call));
+  } else if (g_strcmp0(method, "waitUntilReady") != 0) {
+    fl_method_call_respond_not_implemented(method_call, nullptr);
+  } else if (self->plugins_registered) {
+    fl_method_call_respond_success(method_call, nullptr, nullptr);
+  } else {
+    g_ptr_array_add(self->plugin_waits, g_object_ref(method_call));
+  }
+}
+
+// Handles youtube_music_unbound/startup_trace: "event" records a span or
+// instant Dart timed with Timeline.now, and "write" writes the trace so
+// far.
+static void trace_method_call_cb(FlMethodChannel* channel,
+                                 FlMethodCall* method_call,
+                                 gpointer user_data) {
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (g_strcmp0(method, "event") == 0 && args != nullptr &&
+      fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* name = fl_value_lookup_string(args, "name");
+    FlValue* begin = fl_value_lookup_string(args, "begin");
+    FlValue* end = fl_value_lookup_string(args, "end");
+    if (name != nullptr && fl_value_get_type(name) == FL_VALUE_TYPE_STRING &&
+        begin != nullptr && fl_value_get_type(begin) == FL_VALUE_TYPE_INT) {
+      const gint64 begin_us = fl_value_get_int(begin);
+      startup_trace_add_dart_event(
+          fl_value_get_string(name), begin_us,
+          end != nullptr && fl_value_get_type(end) == FL_VALUE_TYPE_INT
+              ? fl_value_get_int(end)
+              : begin_us);
+    }
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  } else if (g_strcmp0(method, "write") == 0) {
+    g_autoptr(GError) error = nullptr;
+    if (startup_trace_write(&error)) {
+      response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+    } else {
+      response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "WRITE_FAILED", error != nullptr ? error->message : nullptr,
+          nullptr));
+    }
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+  fl_method_call_respond(method_call, response, nullptr);
+}
+
+// Binds the filter proxy if YTMU_FILTER_PROXY is set, on the port it names
+// or else a free one, and points the WebView's network process at it
+// through the proxy environment variables. setenv() is undefined while
+// another thread may read the environment, so this runs from
+// my_application_new(), before g_application_run() starts GLib's, GDBus's
+// and GTK's threads; the proxy's own threads wait for activate.
+// flutter_inappwebview keeps its WebKitWebContext to itself, so WebKit's
+// network proxy settings cannot be used instead.
+static FilterProxy* listen_filter_proxy() {
+  const gchar* setting = g_getenv("YTMU_FILTER_PROXY");
+  if (setting == nullptr || *setting == '\0') {
+    return nullptr;
+  }
+  guint64 port = 0;
+  g_ascii_string_to_unsigned(setting, 10, 1024, G_MAXUINT16, &port, nullptr);
+
+  FilterProxy* proxy = filter_proxy_new_default();
+  g_autoptr(GError) error = nullptr;
+  if (!filter_proxy_listen(proxy, port, &error)) {
+    g_warning("Filter proxy disabled: %s", error->message);
+    g_object_unref(proxy);
+    return nullptr;
+  }
+  g_autofree gchar* url =
+      g_strdup_printf("http://127.0.0.1:%u", filter_proxy_get_port(proxy));
+  g_setenv("http_proxy", url, TRUE);
+  g_setenv("https_proxy", url, TRUE);
+  return proxy;
+}
+
+// Implements GApplication::activate.
+static void my_application_activate(GApplication* application) {
+  MyApplication* self = MY_APPLICATION(application);
+  GtkWindow* existing =
+      gtk_application_get_active_window(GTK_APPLICATION(application));
+  if (existing != nullptr) {
+    gtk_window_present(existing);
+    return;
+  }
+
+  self->activate_time = startup_trace_now();
+
+  // Only the primary instance serves the port it published. Cannot fail
+  // once listening.
+  if (self->filter_proxy != nullptr) {
+    filter_proxy_start(self->filter_proxy, 0, nullptr);
+  }
+
+  gint64 phase = startup_trace_now();
+  GtkWindow* window =
+      GTK_WINDOW(gtk_application_window_new(GTK_APPLICATION(application)));
+
+  // Use a header bar when running in GNOME as this is the common style used
+  // by applications and is the setup most users will be using (e.g. Ubuntu
+  // desktop).
+  // If running on X and not using GNOME then just use a traditional title bar
+  // in case the window manager does more exotic layout, e.g. tiling.
+  // If running on Wayland assume the header bar will work (may need changing
+  // if future cases occur).
+  gboolean use_header_bar = TRUE;
+#ifdef GDK_WINDOWING_X11
+  GdkScreen* screen = gtk_window_get_screen(window);
+  if (GDK_IS_X11_SCREEN(screen)) {
+    const gchar* wm_name = gdk_x11_screen_get_window_manager_name(screen);
+    if (g_strcmp0(wm_name, "GNOME Shell") != 0) {
+      use_header_bar = FALSE;
+    }
+  }
+#endif
+  if (use_header_bar) {
+    GtkHeaderBar* header_bar = GTK_HEADER_BAR(gtk_header_bar_new());
+    gtk_widget_show(GTK_WIDGET(header_bar));
+    gtk_header_bar_set_title(header_bar, "youtube_music_unbound");
+    gtk_header_bar_set_show_close_button(header_bar, TRUE);
+    gtk_window_set_titlebar(window, GTK_WIDGET(header_bar));
+  } else {
+    gtk_window_set_title(window, "youtube_music_unbound");
+  }
+
+  gtk_window_set_default_size(window, 1280, 720);
+  startup_trace_span("window", phase);
+
+  phase = startup_trace_now();
+  g_autoptr(FlDartProject) project = fl_dart_project_new();
+  fl_dart_project_set_dart_entrypoint_arguments(project, self->dart_entrypoint_arguments);
+  startup_trace_span("fl_dart_project_new", phase);
+
+  phase = startup_trace_now();
+  FlView* view = fl_view_new(project);
+  startup_trace_span("fl_view_new", phase);
+  self->view = view;
+  GdkRGBA background_color;
+  // Background defaults to black, override it here if necessary, e.g. #00000000 for transparent.
+  gdk_rgba_parse(&background_color, "#000000");
+  fl_view_set_background_color(view, &background_color);
+  gtk_widget_show(GTK_WIDGET(view));
+  gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(view));
+
+  // Show the window when Flutter renders.
+  // Requires the view to be realized so we can start rendering.
+  g_signal_connect_swapped(view, "first-frame", G_CALLBACK(first_frame_cb), self);
+  phase = startup_trace_now();
+  gtk_widget_realize(GTK_WIDGET(view));
+  startup_trace_span("gtk_widget_realize", phase);
+
+  // Only channels go in before the first frame; the generated plugins and
+  // the MPRIS server follow it, in register_deferred_plugins_cb().
+  g_autoptr(FlPluginRegistrar) plugins_registrar =
+      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                  "DeferredPlugins");
+  g_autoptr(FlStandardMethodCodec) plugins_codec =
+      fl_standard_method_codec_new();
+  self->plugins_channel = fl_method_channel_new(
+      fl_plugin_registrar_get_messenger(plugins_registrar),
+      "youtube_music_unbound/plugins", FL_METHOD_CODEC(plugins_codec));
+  fl_method_channel_set_method_call_handler(
+      self->plugins_channel, plugins_method_call_cb, self, nullptr);
+
+  phase = startup_trace_now();
+  g_autoptr(FlPluginRegistrar) mpris_registrar =
+      fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                  "MprisPlugin");
+  self->mpris_plugin = mpris_plugin_new(mpris_registrar);
+  mpris_plugin_set_start_deferred(self->mpris_plugin, TRUE);
+  startup_trace_span("mpris_plugin_new", phase);
+
+  if (startup_trace_enabled()) {
+    g_autoptr(FlPluginRegistrar) trace_registrar =
+        fl_plugin_registry_get_registrar_for_plugin(FL_PLUGIN_REGISTRY(view),
+                                                    "StartupTrace");
+    g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+    self->trace_channel = fl_method_channel_new(
+        fl_plugin_registrar_get_messenger(trace_registrar),
+        "youtube_music_unbound/startup_trace", FL_METHOD_CODEC(codec));
+    fl_method_channel_set_method_call_handler(
+        self->trace_channel, trace_method_call_cb, nullptr, nullptr);
+  }
+
+  gtk_widget_grab_focus(GTK_WIDGET(view));
+  startup_trace_span("activate", self->activate_time);
+}
+
+// Prints the now-playing block for --status.
+static void print_status(GApplicationCommandLine* command_line) {
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block)) {
+    g_application_command_line_printerr(command_line, "Status unavailable\n");
+    return;
+  }
+  const gchar* state = "stopped";
+  gint64 position_us = block.position_us;
+  if (block.state == NOW_PLAYING_PLAYING) {
+    state = "playing";
+    if (block.position_time_us > 0) {
+      position_us += g_get_monotonic_time() - block.position_time_us;
+    }
+  } else if (block.state == NOW_PLAYING_PAUSED) {
+    state = "paused";
+  }
+  g_application_command_line_print(
+      command_line,
+      "state: %s\ntitle: %s\nartist: %s\nalbum: %s\n"
+      "position: %.1f\nlength: %.1f\n",
+      state, block.title, block.artist, block.album,
+      MAX(position_us, 0) / 1e6, MAX(block.duration_us, 0) / 1e6);
+}
+
+// Implements GApplication::command_line. Runs in the primary instance for
+// its own command line and for every later invocation's, which GApplication
+// forwards over D-Bus; the later invocation exits with the status returned
+// here without starting GTK or the engine.
+static int my_application_command_line(GApplication* application,
+                                       GApplicationCommandLine* command_line) {
+  MyApplication* self = MY_APPLICATION(application);
+  GVariantDict* options =
+      g_application_command_line_get_options_dict(command_line);
+  const gboolean running =
+      gtk_application_get_active_window(GTK_APPLICATION(application)) !=
+      nullptr;
+
+  static const struct {
+    const gchar* option;
+    MprisCommandType type;
+  } kCommands[] = {
+      {"play-pause", MprisCommandType::kPlayPause},
+      {"next", MprisCommandType::kNext},
+      {"previous", MprisCommandType::kPrevious},
+  };
+  gboolean controlled = g_variant_dict_contains(options, "status");
+  for (const auto& command : kCommands) {
+    controlled |= g_variant_dict_contains(options, command.option);
+  }
+  if (controlled && !running) {
+    g_application_command_line_printerr(command_line,
+                                        "%s is not running\n",
+                                        g_get_prgname());
+    return 1;
+  }
+
+  if (g_variant_dict_contains(options, "status")) {
+    print_status(command_line);
+  }
+  for (const auto& command : kCommands) {
+    if (g_variant_dict_contains(options, command.option) &&
+        self->mpris_plugin != nullptr) {
+      mpris_plugin_send_command(self->mpris_plugin, {command.type, 0, 0});
+    }
+  }
+
+  if (!running) {
+    // The first invocation. Only what GOption left over goes to Dart; the
+    // raw arguments still hold the binary name and the options above.
+    g_autofree const gchar** remaining = nullptr;
+    if (g_variant_dict_lookup(options, G_OPTION_REMAINING, "^a&s",
+                              &remaining)) {
+      self->dart_entrypoint_arguments =
+          g_strdupv(const_cast<gchar**>(remaining));
+    } else {
+      self->dart_entrypoint_arguments = g_new0(gchar*, 1);
+    }
+    g_application_activate(application);
+  } else if (g_variant_dict_contains(options, "show") ||
+             !controlled) {
+    // A plain relaunch, from a launcher say, raises the window instead of
+    // starting a second engine.
+    g_application_activate(application);
+  }
+  return 0;
+}
+
+// Implements GApplication::startup.
+static void my_application_startup(GApplication* application) {
+  MyApplication* self = MY_APPLICATION(application);
+
+  // Only the primary instance starts up; a launch that forwards its
+  // command line must not replace its trace.
+  startup_trace_write_at_exit();
+
+  // Perform any actions required at application startup.
+  gint64 phase = startup_trace_now();
+  self->filter_engine = filter_engine_new_default();
+  startup_trace_span("filter_engine_new_default", phase);
+
+  // Initialises GTK.
+  phase = startup_trace_now();
+  G_APPLICATION_CLASS(my_application_parent_class)->startup(application);
+  startup_trace_span("gtk startup", phase);
+}
+
+// Implements GApplication::shutdown.
+static void my_application_shutdown(GApplication* application) {
+  MyApplication* self = MY_APPLICATION(application);
+
+  // Perform any actions required at application shutdown.
+  g_clear_object(&self->filter_engine);
+
+  G_APPLICATION_CLASS(my_application_parent_class)->shutdown(application);
+}
+
+// Implements GObject::dispose.
+static void my_application_dispose(GObject* object) {
+  MyApplication* self = MY_APPLICATION(object);
+  g_clear_pointer(&self->dart_entrypoint_arguments, g_strfreev);
+  g_clear_object(&self->filter_proxy);
+  g_clear_pointer(&self->discord_ipc, discord_ipc_free);
+  if (self->control_socket != nullptr) {
+    control_socket_set_command_handler(self->control_socket, nullptr, nullptr);
+    g_clear_object(&self->control_socket);
+  }
+  g_clear_object(&self->now_playing_publisher);
+  // Before the search provider, which takes the recorder's last play.
+  g_clear_object(&self->history_recorder);
+  if (self->search_provider != nullptr) {
+    search_provider_set_open_handler(self->search_provider, nullptr, nullptr);
+    g_clear_object(&self->search_provider);
+  }
+  g_clear_object(&self->scrobble_client);
+  g_clear_object(&self->mpris_plugin);
+  g_clear_object(&self->trace_channel);
+  g_clear_object(&self->plugins_channel);
+  g_clear_pointer(&self->plugin_waits, g_ptr_array_unref);
+  G_OBJECT_CLASS(my_application_parent_class)->dispose(object);
+}
+
+static void my_application_class_init(MyApplicationClass* klass) {
+  G_APPLICATION_CLASS(klass)->activate = my_application_activate;
+  G_APPLICATION_CLASS(klass)->command_line = my_application_command_line;
+  G_APPLICATION_CLASS(klass)->startup = my_application_startup;
+  G_APPLICATION_CLASS(klass)->shutdown = my_application_shutdown;
+  G_OBJECT_CLASS(klass)->dispose = my_application_dispose;
+}
+
+static void my_application_init(MyApplication* self) {
+  self->plugin_waits = g_ptr_array_new_with_free_func(g_object_unref);
+  g_application_add_main_option_entries(G_APPLICATION(self), kOptions);
+}
+
+MyApplication* my_application_new() {
+  // Set the program name to the application ID, which helps various systems
+  // like GTK and desktop environments map this running application to its
+  // corresponding .desktop file. This ensures better integration by allowing
+  // the application to be recognized beyond its binary name.
+  g_set_prgname(APPLICATION_ID);
+
+  // A unique application: a second launch hands its command line to the
+  // running instance and exits, instead of starting another engine and
+  // WebView.
+  MyApplication* self = MY_APPLICATION(
+      g_object_new(my_application_get_type(), "application-id", APPLICATION_ID,
+                   "flags", G_APPLICATION_HANDLES_COMMAND_LINE, nullptr));
+  // While main() is still the only thread.
+  self->filter_proxy = listen_filter_proxy();
+  return self;
+}
@@ -0,0 +1,92 @@
+#include "now_playing_block.h"
+
+#include <glib.h>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// A reader gives up after this many torn copies rather than spin on a
+// writer that was descheduled mid-write.
+static constexpr int kMaxReadAttempts = 64;
+
+static NowPlayingBlock now_playing_block;
+
+static std::vector<std::pair<NowPlayingObserver, void*>> observers;
+
+NowPlayingBlock* now_playing_block_get(void) {
+  return &now_playing_block;
+}
+
+void now_playing_block_begin_write(NowPlayingBlock* block) {
+  uint32_t sequence = __atomic_load_n(&block->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELAXED);
+  // Orders the odd sequence before any of the field writes that follow.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void now_playing_block_end_write(NowPlayingBlock* block) {
+  __atomic_store_n(&block->generation, block->generation + 1,
+                   __ATOMIC_RELAXED);
+  uint32_t sequence = __atomic_load_n(&block->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void now_playing_block_set_position(NowPlayingBlock* block,
+                                    int64_t position_us) {
+  block->position_us = position_us;
+  block->position_time_us = g_get_monotonic_time();
+}
+
+uint64_t now_playing_block_generation(const NowPlayingBlock* block) {
+  return __atomic_load_n(&block->generation, __ATOMIC_ACQUIRE);
+}
+
+int now_playing_block_read(const NowPlayingBlock* block,
+                           NowPlayingBlock* out) {
+  for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+    uint32_t before = __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      g_thread_yield();
+      continue;
+    }
+
+    memcpy(out, block, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    uint32_t after = __atomic_load_n(&block->sequence, __ATOMIC_RELAXED);
+    if (before == after) {
+      // Strings were copied byte-wise and may be unterminated if the
+      // writer misbehaved; never hand those on.
+      out->title[NOW_PLAYING_TEXT_SIZE - 1] = '\0';
+      out->artist[NOW_PLAYING_TEXT_SIZE - 1] = '\0';
+      out->album[NOW_PLAYING_TEXT_SIZE - 1] = '\0';
+      out->art_url[NOW_PLAYING_URL_SIZE - 1] = '\0';
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void now_playing_block_add_observer(NowPlayingObserver observer,
+                                    void* user_data) {
+  observers.emplace_back(observer, user_data);
+}
+
+void now_playing_block_remove_observer(NowPlayingObserver observer,
+                                       void* user_data) {
+  for (auto it = observers.begin(); it != observers.end(); ++it) {
+    if (it->first == observer && it->second == user_data) {
+      observers.erase(it);
+      return;
+    }
+  }
+}
+
+void now_playing_block_notify(void) {
+  // A copy, so an observer may remove itself.
+  const auto current = observers;
+  for (const auto& observer : current) {
+    observer.first(observer.second);
+  }
+}
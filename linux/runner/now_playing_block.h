@@ -0,0 +1,81 @@
+#ifndef RUNNER_NOW_PLAYING_BLOCK_H_
+#define RUNNER_NOW_PLAYING_BLOCK_H_
+
+#include <stdint.h>
+
+// Now-playing state shared between Dart (through dart:ffi) and the native
+// runner without going through the platform channel. Plain C so other
+// readers can include it.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOW_PLAYING_TEXT_SIZE 512
+#define NOW_PLAYING_URL_SIZE 1024
+
+typedef enum {
+  NOW_PLAYING_STOPPED = 0,
+  NOW_PLAYING_PLAYING = 1,
+  NOW_PLAYING_PAUSED = 2,
+} NowPlayingState;
+
+// Layout mirrored by lib/services/now_playing_block.dart; keep in sync.
+// Strings are NUL-terminated UTF-8, truncated to fit their slot.
+typedef struct {
+  // Seqlock counter, odd while a write is in progress.
+  uint32_t sequence;
+  // A NowPlayingState value.
+  uint32_t state;
+  // Incremented by every completed write.
+  uint64_t generation;
+  int64_t position_us;
+  // Monotonic time (g_get_monotonic_time) at which |position_us| was
+  // current; set by now_playing_block_set_position.
+  int64_t position_time_us;
+  int64_t duration_us;
+  char title[NOW_PLAYING_TEXT_SIZE];
+  char artist[NOW_PLAYING_TEXT_SIZE];
+  char album[NOW_PLAYING_TEXT_SIZE];
+  char art_url[NOW_PLAYING_URL_SIZE];
+} NowPlayingBlock;
+
+#define NOW_PLAYING_EXPORT __attribute__((visibility("default")))
+
+// Returns the process-wide block. Exported for DynamicLibrary.process().
+NOW_PLAYING_EXPORT NowPlayingBlock* now_playing_block_get(void);
+
+// Brackets a write. There must be a single writer; readers never block it.
+NOW_PLAYING_EXPORT void now_playing_block_begin_write(NowPlayingBlock* block);
+NOW_PLAYING_EXPORT void now_playing_block_end_write(NowPlayingBlock* block);
+
+// Sets the position and stamps it with the current monotonic time. Only
+// valid between begin_write and end_write.
+NOW_PLAYING_EXPORT void now_playing_block_set_position(NowPlayingBlock* block,
+                                                       int64_t position_us);
+
+// Returns the generation of the last completed write.
+uint64_t now_playing_block_generation(const NowPlayingBlock* block);
+
+// Copies a consistent snapshot of |block| into |out|. Returns 0 if a write
+// kept racing the copy, in which case |out| is unspecified.
+int now_playing_block_read(const NowPlayingBlock* block, NowPlayingBlock* out);
+
+typedef void (*NowPlayingObserver)(void* user_data);
+
+// Has |observer| called with |user_data| by every now_playing_block_notify,
+// for native consumers of the block other than the MPRIS server. Main
+// thread only, like the calls below.
+void now_playing_block_add_observer(NowPlayingObserver observer,
+                                    void* user_data);
+void now_playing_block_remove_observer(NowPlayingObserver observer,
+                                       void* user_data);
+
+// Tells the observers that Dart has written the block.
+void now_playing_block_notify(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_NOW_PLAYING_BLOCK_H_
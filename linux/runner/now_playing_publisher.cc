@@ -0,0 +1,177 @@
+#include "now_playing_publisher.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "now_playing_block.h"
+#include "now_playing_snapshot.h"
+
+static_assert(NOW_PLAYING_SNAPSHOT_TEXT_SIZE == NOW_PLAYING_TEXT_SIZE,
+              "Snapshot strings are copied from the block as they are");
+static_assert(NOW_PLAYING_SNAPSHOT_STOPPED == NOW_PLAYING_STOPPED &&
+                  NOW_PLAYING_SNAPSHOT_PLAYING == NOW_PLAYING_PLAYING &&
+                  NOW_PLAYING_SNAPSHOT_PAUSED == NOW_PLAYING_PAUSED,
+              "Snapshot states are copied from the block as they are");
+
+struct _NowPlayingPublisher {
+  GObject parent_instance;
+
+  // The shared mapping of the snapshot file, or nullptr before the start.
+  NowPlayingSnapshot* snapshot;
+  // The block generation last published.
+  guint64 published;
+  guint64 writes;
+  gboolean observing;
+};
+
+G_DEFINE_TYPE(NowPlayingPublisher, now_playing_publisher, G_TYPE_OBJECT)
+
+// Brackets a write like now_playing_block_begin_write, except that a
+// sequence left odd by a writer that crashed mid-write is closed rather
+// than flipped.
+static void begin_write(NowPlayingSnapshot* snapshot) {
+  uint32_t sequence = __atomic_load_n(&snapshot->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshot->sequence, sequence | 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(NowPlayingSnapshot* snapshot) {
+  __atomic_store_n(&snapshot->generation, snapshot->generation + 1,
+                   __ATOMIC_RELAXED);
+  uint32_t sequence = __atomic_load_n(&snapshot->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&snapshot->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void publish(NowPlayingPublisher* self) {
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block) ||
+      block.generation == self->published) {
+    return;
+  }
+  self->published = block.generation;
+
+  NowPlayingSnapshot* snapshot = self->snapshot;
+  begin_write(snapshot);
+  snapshot->state = block.state;
+  snapshot->position_us = block.position_us;
+  // g_get_monotonic_time() is CLOCK_MONOTONIC on Linux, which is what
+  // readers extrapolate with.
+  snapshot->position_time_us = block.position_time_us;
+  snapshot->duration_us = block.duration_us;
+  memcpy(snapshot->title, block.title, sizeof(snapshot->title));
+  memcpy(snapshot->artist, block.artist, sizeof(snapshot->artist));
+  memcpy(snapshot->album, block.album, sizeof(snapshot->album));
+  end_write(snapshot);
+  self->writes++;
+}
+
+static void on_block_written(void* data) {
+  publish(NOW_PLAYING_PUBLISHER(data));
+}
+
+static void now_playing_publisher_dispose(GObject* object) {
+  NowPlayingPublisher* self = NOW_PLAYING_PUBLISHER(object);
+
+  if (self->observing) {
+    now_playing_block_remove_observer(on_block_written, self);
+    self->observing = FALSE;
+  }
+  if (self->snapshot != nullptr) {
+    // Left in place for readers that keep their mapping, but no longer
+    // claiming to play.
+    NowPlayingSnapshot* snapshot = self->snapshot;
+    begin_write(snapshot);
+    snapshot->state = NOW_PLAYING_SNAPSHOT_STOPPED;
+    end_write(snapshot);
+    munmap(snapshot, sizeof(*snapshot));
+    self->snapshot = nullptr;
+  }
+
+  G_OBJECT_CLASS(now_playing_publisher_parent_class)->dispose(object);
+}
+
+static void now_playing_publisher_class_init(NowPlayingPublisherClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = now_playing_publisher_dispose;
+}
+
+static void now_playing_publisher_init(NowPlayingPublisher* self) {}
+
+NowPlayingPublisher* now_playing_publisher_new() {
+  return NOW_PLAYING_PUBLISHER(
+      g_object_new(now_playing_publisher_get_type(), nullptr));
+}
+
+gboolean now_playing_publisher_start(NowPlayingPublisher* self,
+                                     const gchar* path, GError** error) {
+  g_return_val_if_fail(NOW_PLAYING_IS_PUBLISHER(self), FALSE);
+  g_return_val_if_fail(self->snapshot == nullptr, FALSE);
+
+  g_autofree gchar* default_path = nullptr;
+  if (path == nullptr) {
+    default_path = g_build_filename(g_get_user_runtime_dir(),
+                                    NOW_PLAYING_SNAPSHOT_NAME, nullptr);
+    path = default_path;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  struct stat status;
+  void* mapping = MAP_FAILED;
+  if (fd >= 0 && fstat(fd, &status) == 0) {
+    // Only ever grown: shrinking the file under a reader's mapping would
+    // turn its next read into a SIGBUS.
+    if (status.st_size >= static_cast<off_t>(sizeof(NowPlayingSnapshot)) ||
+        ftruncate(fd, sizeof(NowPlayingSnapshot)) == 0) {
+      mapping = mmap(nullptr, sizeof(NowPlayingSnapshot),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+  }
+  if (mapping == MAP_FAILED) {
+    int saved = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved),
+                "Cannot publish the now-playing snapshot at %s: %s", path,
+                g_strerror(saved));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return FALSE;
+  }
+  close(fd);
+
+  NowPlayingSnapshot* snapshot = static_cast<NowPlayingSnapshot*>(mapping);
+  begin_write(snapshot);
+  if (snapshot->magic != NOW_PLAYING_SNAPSHOT_MAGIC ||
+      snapshot->version != NOW_PLAYING_SNAPSHOT_VERSION ||
+      snapshot->size != sizeof(NowPlayingSnapshot)) {
+    // A new file, or one from another version: start over, but keep the
+    // sequence moving so a reader mid-copy still sees the change.
+    const uint32_t sequence = snapshot->sequence;
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->sequence = sequence;
+    snapshot->magic = NOW_PLAYING_SNAPSHOT_MAGIC;
+    snapshot->version = NOW_PLAYING_SNAPSHOT_VERSION;
+    snapshot->size = sizeof(NowPlayingSnapshot);
+  }
+  // The generation carries on from the previous run, so a reader that only
+  // compares generations notices the restart.
+  snapshot->pid = static_cast<uint32_t>(getpid());
+  snapshot->state = NOW_PLAYING_SNAPSHOT_STOPPED;
+  end_write(snapshot);
+  self->snapshot = snapshot;
+
+  // Forces the first publish even when the block has not been written yet.
+  self->published = G_MAXUINT64;
+  publish(self);
+  now_playing_block_add_observer(on_block_written, self);
+  self->observing = TRUE;
+  return TRUE;
+}
+
+guint64 now_playing_publisher_get_writes(NowPlayingPublisher* self) {
+  g_return_val_if_fail(NOW_PLAYING_IS_PUBLISHER(self), 0);
+  return self->writes;
+}
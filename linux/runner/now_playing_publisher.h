@@ -0,0 +1,51 @@
+#ifndef RUNNER_NOW_PLAYING_PUBLISHER_H_
+#define RUNNER_NOW_PLAYING_PUBLISHER_H_
+
+#include <gio/gio.h>
+
+// Mirrors the now-playing block into the file described by
+// now_playing_snapshot.h, so local readers can map it once and then poll
+// what is playing without a system call, a socket or D-Bus.
+
+G_BEGIN_DECLS
+
+#define NOW_PLAYING_TYPE_PUBLISHER now_playing_publisher_get_type()
+G_DECLARE_FINAL_TYPE(NowPlayingPublisher, now_playing_publisher, NOW_PLAYING,
+                     PUBLISHER, GObject)
+
+G_END_DECLS
+
+/**
+ * now_playing_publisher_new:
+ *
+ * Creates a publisher that has not opened its file yet. It must be used,
+ * and disposed, on the thread that calls now_playing_block_notify().
+ *
+ * Returns: a new #NowPlayingPublisher.
+ */
+NowPlayingPublisher* now_playing_publisher_new();
+
+/**
+ * now_playing_publisher_start:
+ * @path: (nullable): the snapshot file, or %NULL for
+ *   %NOW_PLAYING_SNAPSHOT_NAME in $XDG_RUNTIME_DIR.
+ * @error: return location for a #GError.
+ *
+ * Maps @path, creating it if needed, publishes the current block and then
+ * every write of the block. The file is updated in place and never
+ * truncated or removed, so readers can keep their mapping across restarts;
+ * disposing the publisher only marks it stopped.
+ *
+ * Returns: %TRUE if the snapshot is being published.
+ */
+gboolean now_playing_publisher_start(NowPlayingPublisher* self,
+                                     const gchar* path, GError** error);
+
+/**
+ * now_playing_publisher_get_writes:
+ *
+ * Returns: how many snapshots have been published since the start.
+ */
+guint64 now_playing_publisher_get_writes(NowPlayingPublisher* self);
+
+#endif  // RUNNER_NOW_PLAYING_PUBLISHER_H_
@@ -0,0 +1,119 @@
+// For O_CLOEXEC and clock_gettime under -std=c11.
+#define _POSIX_C_SOURCE 200809L
+
+#include "now_playing_snapshot.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// A reader gives up after this many torn copies rather than spin on a
+// writer that was descheduled mid-write.
+enum { kMaxReadAttempts = 64 };
+
+const NowPlayingSnapshot* now_playing_snapshot_open(const char* path) {
+  char default_path[4096];
+  if (path == NULL) {
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL || *runtime_dir == '\0') {
+      return NULL;
+    }
+    int length = snprintf(default_path, sizeof(default_path), "%s/%s",
+                          runtime_dir, NOW_PLAYING_SNAPSHOT_NAME);
+    if (length < 0 || (size_t)length >= sizeof(default_path)) {
+      return NULL;
+    }
+    path = default_path;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &status) == 0 &&
+      status.st_size >= (off_t)sizeof(NowPlayingSnapshot)) {
+    mapping = mmap(NULL, sizeof(NowPlayingSnapshot), PROT_READ, MAP_SHARED,
+                   fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  const NowPlayingSnapshot* snapshot = (const NowPlayingSnapshot*)mapping;
+  if (snapshot->magic != NOW_PLAYING_SNAPSHOT_MAGIC ||
+      snapshot->version != NOW_PLAYING_SNAPSHOT_VERSION ||
+      snapshot->size != sizeof(NowPlayingSnapshot)) {
+    munmap(mapping, sizeof(NowPlayingSnapshot));
+    return NULL;
+  }
+  return snapshot;
+}
+
+void now_playing_snapshot_close(const NowPlayingSnapshot* snapshot) {
+  if (snapshot != NULL) {
+    munmap((void*)snapshot, sizeof(NowPlayingSnapshot));
+  }
+}
+
+// The writer updates these fields with atomic operations; they are plain
+// integers in the struct so that the header stays usable from C++ too.
+static uint32_t load_sequence(const NowPlayingSnapshot* snapshot,
+                              memory_order order) {
+  return atomic_load_explicit(
+      (const _Atomic uint32_t*)&snapshot->sequence, order);
+}
+
+int now_playing_snapshot_read(const NowPlayingSnapshot* snapshot,
+                              NowPlayingSnapshot* out) {
+  for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+    uint32_t before = load_sequence(snapshot, memory_order_acquire);
+    if (before & 1) {
+      sched_yield();
+      continue;
+    }
+
+    memcpy(out, snapshot, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+
+    uint32_t after = load_sequence(snapshot, memory_order_relaxed);
+    if (before == after) {
+      // Never hand on an unterminated string, whatever the writer did.
+      out->title[NOW_PLAYING_SNAPSHOT_TEXT_SIZE - 1] = '\0';
+      out->artist[NOW_PLAYING_SNAPSHOT_TEXT_SIZE - 1] = '\0';
+      out->album[NOW_PLAYING_SNAPSHOT_TEXT_SIZE - 1] = '\0';
+      return 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t now_playing_snapshot_generation(const NowPlayingSnapshot* snapshot) {
+  return atomic_load_explicit(
+      (const _Atomic uint64_t*)&snapshot->generation, memory_order_acquire);
+}
+
+int64_t now_playing_snapshot_position(const NowPlayingSnapshot* copy) {
+  int64_t position = copy->position_us;
+  if (copy->state == NOW_PLAYING_SNAPSHOT_PLAYING &&
+      copy->position_time_us > 0) {
+    // Served from the vDSO, so still no system call.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    position += (int64_t)now.tv_sec * 1000000 +
+                now.tv_nsec / 1000 - copy->position_time_us;
+  }
+  if (copy->duration_us > 0 && position > copy->duration_us) {
+    position = copy->duration_us;
+  }
+  return position < 0 ? 0 : position;
+}
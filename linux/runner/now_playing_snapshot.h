@@ -0,0 +1,83 @@
+#ifndef RUNNER_NOW_PLAYING_SNAPSHOT_H_
+#define RUNNER_NOW_PLAYING_SNAPSHOT_H_
+
+#include <stdint.h>
+
+// What is playing, published by the running app as a fixed-layout file in
+// $XDG_RUNTIME_DIR for status bars and other local readers. A reader maps
+// the file once and from then on reads it with plain loads, without a
+// system call or waking the app. The reader is C11 with no dependencies
+// beyond libc; copy this header and now_playing_snapshot.c into a reader,
+// or link now_playing_reader.
+//
+// The app rewrites the file in place under a seqlock whenever its
+// now-playing state changes, and never truncates or replaces it, so a
+// mapping stays valid across restarts of the app.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The file's name in $XDG_RUNTIME_DIR.
+#define NOW_PLAYING_SNAPSHOT_NAME "ytmu-now-playing"
+
+#define NOW_PLAYING_SNAPSHOT_MAGIC 0x554d5459u  // "YTMU", little-endian.
+#define NOW_PLAYING_SNAPSHOT_VERSION 1
+#define NOW_PLAYING_SNAPSHOT_TEXT_SIZE 512
+
+// Values of |state|.
+#define NOW_PLAYING_SNAPSHOT_STOPPED 0
+#define NOW_PLAYING_SNAPSHOT_PLAYING 1
+#define NOW_PLAYING_SNAPSHOT_PAUSED 2
+
+// Strings are NUL-terminated UTF-8, truncated to fit their slot. Times are
+// microseconds.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  // sizeof(NowPlayingSnapshot) for this version.
+  uint32_t size;
+  // Seqlock counter, odd while a write is in progress.
+  uint32_t sequence;
+  // Incremented by every completed write; a reader that only wants to know
+  // whether anything changed can compare this alone.
+  uint64_t generation;
+  // The writing process, which leaves |state| stopped when it exits
+  // cleanly.
+  uint32_t pid;
+  uint32_t state;
+  // The position as of |position_time_us| on CLOCK_MONOTONIC; while
+  // playing, it advances with that clock.
+  int64_t position_us;
+  int64_t position_time_us;
+  int64_t duration_us;
+  char title[NOW_PLAYING_SNAPSHOT_TEXT_SIZE];
+  char artist[NOW_PLAYING_SNAPSHOT_TEXT_SIZE];
+  char album[NOW_PLAYING_SNAPSHOT_TEXT_SIZE];
+} NowPlayingSnapshot;
+
+// Maps the snapshot at |path|, or at NOW_PLAYING_SNAPSHOT_NAME in
+// $XDG_RUNTIME_DIR if NULL. Returns NULL if it does not exist or is not a
+// snapshot this header can read.
+const NowPlayingSnapshot* now_playing_snapshot_open(const char* path);
+
+void now_playing_snapshot_close(const NowPlayingSnapshot* snapshot);
+
+// Copies a consistent snapshot into |out| without a system call. Returns 0
+// if writes kept racing the copy, in which case |out| is unspecified.
+int now_playing_snapshot_read(const NowPlayingSnapshot* snapshot,
+                              NowPlayingSnapshot* out);
+
+// Returns the generation of the last completed write, to skip reads when
+// nothing changed.
+uint64_t now_playing_snapshot_generation(const NowPlayingSnapshot* snapshot);
+
+// Returns |copy|'s position extrapolated to now if it is playing, capped at
+// its duration when that is known.
+int64_t now_playing_snapshot_position(const NowPlayingSnapshot* copy);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_NOW_PLAYING_SNAPSHOT_H_
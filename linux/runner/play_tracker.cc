@@ -0,0 +1,74 @@
+#include "play_tracker.h"
+
+#include <utility>
+
+// A track that jumps back to within kRestartUs of its start after playing
+// past kReplayUs is being played again, not sought in.
+static constexpr gint64 kRestartUs = 3 * G_USEC_PER_SEC;
+static constexpr gint64 kReplayUs = 30 * G_USEC_PER_SEC;
+
+bool PlayTracker::Restarted(const NowPlayingBlock& block, gint64 now) const {
+  if (block.position_time_us == position_time_us_ ||
+      block.position_us >= kRestartUs) {
+    return false;
+  }
+  gint64 previous = position_us_;
+  if (playing_since_ != 0) {
+    previous += now - position_time_us_;
+  }
+  return previous >= kReplayUs;
+}
+
+gint64 PlayTracker::ListenedUs(gint64 now) const {
+  if (!active_) {
+    return 0;
+  }
+  return current_.listened_us +
+         (playing_since_ != 0 ? now - playing_since_ : 0);
+}
+
+bool PlayTracker::Finish(gint64 now, TrackedPlay* finished) {
+  if (!active_) {
+    return false;
+  }
+  current_.listened_us = ListenedUs(now);
+  active_ = false;
+  playing_since_ = 0;
+  *finished = std::move(current_);
+  current_ = TrackedPlay();
+  return true;
+}
+
+bool PlayTracker::Update(const NowPlayingBlock& block, gint64 now,
+                         TrackedPlay* finished) {
+  const bool active =
+      block.state != NOW_PLAYING_STOPPED && block.title[0] != '\0';
+  bool ended = false;
+  if (active_ &&
+      (!active || current_.title != block.title ||
+       current_.artist != block.artist || current_.album != block.album ||
+       Restarted(block, now))) {
+    ended = Finish(now, finished);
+  }
+  if (!active) {
+    return ended;
+  }
+
+  if (!active_) {
+    active_ = true;
+    play_number_++;
+    current_.started_at_us = g_get_real_time();
+    current_.title = block.title;
+    current_.artist = block.artist;
+    current_.album = block.album;
+  } else {
+    current_.listened_us = ListenedUs(now);
+  }
+  playing_since_ = block.state == NOW_PLAYING_PLAYING ? now : 0;
+  if (block.duration_us > 0) {
+    current_.length_us = block.duration_us;
+  }
+  position_us_ = block.position_us;
+  position_time_us_ = block.position_time_us;
+  return ended;
+}
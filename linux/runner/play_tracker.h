@@ -0,0 +1,61 @@
+#ifndef RUNNER_PLAY_TRACKER_H_
+#define RUNNER_PLAY_TRACKER_H_
+
+#include <glib.h>
+
+#include <string>
+
+#include "now_playing_block.h"
+
+// A play of one track, as followed through writes of the now-playing
+// block.
+struct TrackedPlay {
+  // Wall-clock time the play started, in microseconds since the epoch.
+  gint64 started_at_us = 0;
+  // Time spent playing, excluding pauses, as of the last update.
+  gint64 listened_us = 0;
+  // The track's length, or 0 while it is unknown.
+  gint64 length_us = 0;
+  std::string title;
+  std::string artist;
+  std::string album;
+};
+
+// Follows the now-playing block from play to play for the listening
+// history and the scrobbler. A play ends when the track changes, playback
+// stops, or the track starts over after being played well into, and lasts
+// for the time it spent playing by the monotonic clock.
+class PlayTracker {
+ public:
+  // Feeds a write of |block| seen at monotonic time |now|. Returns true,
+  // with the play it ended moved into |finished|, if the write ended one.
+  bool Update(const NowPlayingBlock& block, gint64 now, TrackedPlay* finished);
+
+  // Ends the play in progress, if any, as of |now|.
+  bool Finish(gint64 now, TrackedPlay* finished);
+
+  // The play in progress, or nullptr.
+  const TrackedPlay* current() const { return active_ ? &current_ : nullptr; }
+
+  // Counts the plays started, so a consumer can tell them apart.
+  guint64 play_number() const { return play_number_; }
+
+  // Time the play in progress has spent playing as of |now|.
+  gint64 ListenedUs(gint64 now) const;
+
+  bool playing() const { return active_ && playing_since_ != 0; }
+
+ private:
+  bool Restarted(const NowPlayingBlock& block, gint64 now) const;
+
+  bool active_ = false;
+  TrackedPlay current_;
+  guint64 play_number_ = 0;
+  // Monotonic time playback last resumed, or 0 while it is paused.
+  gint64 playing_since_ = 0;
+  // The block's position anchor as last seen.
+  gint64 position_us_ = 0;
+  gint64 position_time_us_ = 0;
+};
+
+#endif  // RUNNER_PLAY_TRACKER_H_
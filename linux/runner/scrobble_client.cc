@@ -0,0 +1,555 @@
+#include "scrobble_client.h"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "http_client.h"
+#include "now_playing_block.h"
+#include "play_tracker.h"
+
+static constexpr char kSettingsGroup[] = "scrobble";
+static constexpr char kDefaultUrl[] = "https://ws.audioscrobbler.com/2.0/";
+static constexpr gint64 kDefaultRetryMinMs = 5000;
+static constexpr gint64 kDefaultRetryMaxMs = 15 * 60 * 1000;
+
+// The most scrobbles track.scrobble takes in one request.
+static constexpr size_t kBatchSize = 50;
+static constexpr gsize kMaxResponseSize = 64 * 1024;
+
+// A play is scrobbled after half its length or kMaxThresholdUs, and never
+// if the track lasts kMinLengthUs or less. Tracks of unknown length wait
+// the full kMaxThresholdUs.
+static constexpr gint64 kMaxThresholdUs = 4 * 60 * G_USEC_PER_SEC;
+static constexpr gint64 kMinLengthUs = 30 * G_USEC_PER_SEC;
+
+typedef enum {
+  SUBMIT_ACCEPTED,
+  // The server is down, busy or unreachable; try the batch again later.
+  SUBMIT_RETRY,
+  // The credentials were refused; nothing will go through until they
+  // are fixed.
+  SUBMIT_UNAUTHORIZED,
+  // The batch itself was refused; sending it again would not help.
+  SUBMIT_REJECTED,
+} SubmitResult;
+
+struct _ScrobbleClient {
+  GObject parent_instance;
+
+  // Fixed before the worker starts.
+  gchar* url;
+  gchar* api_key;
+  gchar* api_secret;
+  gchar* session_key;
+  gint64 retry_min_us;
+  gint64 retry_max_us;
+
+  // Owned by the worker while it runs.
+  ScrobbleQueue* queue;
+  GRand* rand;
+
+  GThread* worker;
+  GCancellable* cancellable;
+  GMutex mutex;
+  GCond cond;
+  // Guarded by |mutex|: plays not yet on disk, and the counters.
+  std::vector<ScrobbleEntry>* inbox;
+  gboolean stopping;
+  ScrobbleClientStats stats;
+
+  // Main thread only.
+  PlayTracker* tracker;
+  guint64 scrobbled_play;
+  guint timer_source;
+  gboolean observing;
+};
+
+G_DEFINE_TYPE(ScrobbleClient, scrobble_client, G_TYPE_OBJECT)
+
+// Builds the signed track.scrobble form for |batch|. The signature is the
+// MD5 of every parameter's name and value, sorted by name, followed by
+// the secret; "format" is left out of it, as the API requires.
+static GBytes* build_request(ScrobbleClient* self,
+                             const std::vector<ScrobbleEntry>& batch) {
+  std::map<std::string, std::string> params;
+  params["method"] = "track.scrobble";
+  params["api_key"] = self->api_key;
+  params["sk"] = self->session_key;
+  for (size_t i = 0; i < batch.size(); i++) {
+    const ScrobbleEntry& entry = batch[i];
+    g_autofree gchar* suffix = g_strdup_printf("[%zu]", i);
+    params[std::string("artist") + suffix] = entry.artist;
+    params[std::string("track") + suffix] = entry.track;
+    g_autofree gchar* timestamp =
+        g_strdup_printf("%" G_GINT64_FORMAT, entry.timestamp);
+    params[std::string("timestamp") + suffix] = timestamp;
+    if (!entry.album.empty()) {
+      params[std::string("album") + suffix] = entry.album;
+    }
+    if (entry.duration > 0) {
+      params[std::string("duration") + suffix] =
+          std::to_string(entry.duration);
+    }
+  }
+
+  std::string signed_text;
+  for (const auto& param : params) {
+    signed_text += param.first;
+    signed_text += param.second;
+  }
+  signed_text += self->api_secret;
+  g_autofree gchar* signature = g_compute_checksum_for_string(
+      G_CHECKSUM_MD5, signed_text.c_str(), signed_text.size());
+  params["api_sig"] = signature;
+
+  std::string form;
+  for (const auto& param : params) {
+    g_autofree gchar* value =
+        g_uri_escape_string(param.second.c_str(), nullptr, FALSE);
+    form += param.first;
+    form += '=';
+    form += value;
+    form += '&';
+  }
+  form += "format=json";
+  return g_bytes_new(form.data(), form.size());
+}
+
+// Returns the code of the "error" member of a JSON response, or 0 if it
+// has none. A scan is enough: error responses carry nothing else that
+// could be mistaken for the key.
+static gint64 response_error(GBytes* response) {
+  gsize size;
+  const gchar* data =
+      static_cast<const gchar*>(g_bytes_get_data(response, &size));
+  const std::string text(data != nullptr ? data : "", size);
+  size_t at = text.find("\"error\"");
+  if (at == std::string::npos) {
+    return 0;
+  }
+  at += strlen("\"error\"");
+  while (at < text.size() && g_ascii_isspace(text[at])) {
+    at++;
+  }
+  if (at == text.size() || text[at] != ':') {
+    return 0;
+  }
+  return g_ascii_strtoll(text.c_str() + at + 1, nullptr, 10);
+}
+
+static SubmitResult classify_response(guint status, GBytes* response) {
+  switch (response_error(response)) {
+    case 0:
+      break;
+    // Operation failed, service offline, temporarily unavailable, rate
+    // limit exceeded.
+    case 8:
+    case 11:
+    case 16:
+    case 29:
+      return SUBMIT_RETRY;
+    // Authentication failed, invalid session key, invalid API key,
+    // unauthorized token, suspended API key.
+    case 4:
+    case 9:
+    case 10:
+    case 14:
+    case 26:
+      return SUBMIT_UNAUTHORIZED;
+    default:
+      return SUBMIT_REJECTED;
+  }
+  if (status >= 200 && status < 300) {
+    return SUBMIT_ACCEPTED;
+  }
+  if (status >= 500 || status == 429 || status == 408) {
+    return SUBMIT_RETRY;
+  }
+  if (status == 401 || status == 403) {
+    return SUBMIT_UNAUTHORIZED;
+  }
+  return SUBMIT_REJECTED;
+}
+
+// Writes the plays handed over by scrobble_client_enqueue() to the queue.
+static void store_arrived(ScrobbleClient* self,
+                          std::vector<ScrobbleEntry>* arrived) {
+  guint64 queued = 0;
+  guint64 dropped = 0;
+  for (const ScrobbleEntry& entry : *arrived) {
+    g_autoptr(GError) error = nullptr;
+    if (self->queue->Append(entry, &error)) {
+      queued++;
+    } else {
+      g_warning("Scrobble of \"%s\" lost: %s", entry.track.c_str(),
+                error->message);
+      dropped++;
+    }
+  }
+  arrived->clear();
+
+  g_mutex_lock(&self->mutex);
+  self->stats.queued += queued;
+  self->stats.dropped += dropped;
+  self->stats.pending = self->queue->size();
+  g_mutex_unlock(&self->mutex);
+}
+
+// Waits up to the retry limit, with jitter so that clients that went
+// offline together do not all come back at once.
+static gint64 retry_delay(ScrobbleClient* self, guint failures) {
+  gint64 delay = self->retry_min_us;
+  for (guint i = 1; i < failures && delay < self->retry_max_us; i++) {
+    delay *= 2;
+  }
+  delay = MIN(delay, self->retry_max_us);
+  return delay * g_rand_double_range(self->rand, 0.5, 1.0);
+}
+
+static gpointer worker_main(gpointer data) {
+  ScrobbleClient* self = SCROBBLE_CLIENT(data);
+  std::vector<ScrobbleEntry> arrived;
+  std::vector<ScrobbleEntry> batch;
+  guint failures = 0;
+  gint64 retry_at = 0;
+  gboolean paused = FALSE;
+
+  while (TRUE) {
+    g_mutex_lock(&self->mutex);
+    while (self->inbox->empty() && !self->stopping &&
+           (paused || self->queue->size() == 0 ||
+            g_get_monotonic_time() < retry_at)) {
+      if (!paused && self->queue->size() > 0) {
+        g_cond_wait_until(&self->cond, &self->mutex, retry_at);
+      } else {
+        g_cond_wait(&self->cond, &self->mutex);
+      }
+    }
+    arrived.swap(*self->inbox);
+    const gboolean stopping = self->stopping;
+    g_mutex_unlock(&self->mutex);
+
+    // Plays are stored even when stopping, so none is lost on exit.
+    if (!arrived.empty()) {
+      store_arrived(self, &arrived);
+    }
+    if (stopping) {
+      break;
+    }
+    if (paused || self->queue->size() == 0 ||
+        g_get_monotonic_time() < retry_at) {
+      continue;
+    }
+
+    batch.clear();
+    self->queue->Peek(kBatchSize, &batch);
+    g_autoptr(GBytes) request = build_request(self, batch);
+    guint status = 0;
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GBytes) response = http_client_post(
+        self->url, "application/x-www-form-urlencoded", request,
+        kMaxResponseSize, &status, self->cancellable, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      // The batch stays queued for the next start.
+      continue;
+    }
+
+    SubmitResult result =
+        response != nullptr ? classify_response(status, response)
+                            : SUBMIT_RETRY;
+    guint64 submitted = 0;
+    guint64 dropped = 0;
+    switch (result) {
+      case SUBMIT_ACCEPTED:
+        submitted = batch.size();
+        break;
+      case SUBMIT_REJECTED:
+        g_warning("Scrobble server refused %zu scrobbles (HTTP %u)",
+                  batch.size(), status);
+        dropped = batch.size();
+        break;
+      case SUBMIT_RETRY:
+        failures++;
+        retry_at = g_get_monotonic_time() + retry_delay(self, failures);
+        g_debug("Scrobbling failed (%s), retry %u",
+                error != nullptr ? error->message : "server busy", failures);
+        break;
+      case SUBMIT_UNAUTHORIZED:
+        g_warning("Scrobbling paused until restart: the server refused the "
+                  "session key (HTTP %u)",
+                  status);
+        paused = TRUE;
+        break;
+    }
+    if (submitted > 0 || dropped > 0) {
+      failures = 0;
+      retry_at = 0;
+      g_autoptr(GError) remove_error = nullptr;
+      if (!self->queue->Remove(batch.size(), &remove_error)) {
+        // They will be sent again after a restart, which the server
+        // ignores as duplicates.
+        g_warning("Scrobble queue: %s", remove_error->message);
+      }
+    }
+
+    g_mutex_lock(&self->mutex);
+    self->stats.submitted += submitted;
+    self->stats.dropped += dropped;
+    if (result == SUBMIT_ACCEPTED) {
+      self->stats.batches++;
+    } else if (result == SUBMIT_RETRY) {
+      self->stats.failures++;
+    }
+    self->stats.pending = self->queue->size();
+    g_mutex_unlock(&self->mutex);
+  }
+  return nullptr;
+}
+
+// How long |play| must play before it is scrobbled, or -1 if never.
+static gint64 threshold_us(const TrackedPlay& play) {
+  if (play.length_us == 0) {
+    return kMaxThresholdUs;
+  }
+  if (play.length_us <= kMinLengthUs) {
+    return -1;
+  }
+  return MIN(play.length_us / 2, kMaxThresholdUs);
+}
+
+static void scrobble_play(ScrobbleClient* self, const TrackedPlay& play) {
+  if (play.artist.empty() || play.title.empty()) {
+    return;
+  }
+  ScrobbleEntry entry;
+  entry.timestamp = play.started_at_us / G_USEC_PER_SEC;
+  entry.duration = MIN(play.length_us / G_USEC_PER_SEC,
+                       static_cast<gint64>(G_MAXUINT));
+  entry.artist = play.artist;
+  entry.track = play.title;
+  entry.album = play.album;
+  scrobble_client_enqueue(self, entry);
+}
+
+static void check_current_play(ScrobbleClient* self, gint64 now);
+
+static gboolean threshold_cb(gpointer user_data) {
+  ScrobbleClient* self = SCROBBLE_CLIENT(user_data);
+  self->timer_source = 0;
+  check_current_play(self, g_get_monotonic_time());
+  return G_SOURCE_REMOVE;
+}
+
+// Scrobbles the play in progress once it has lasted long enough, or arms
+// a timer for when it will have if it is playing.
+static void check_current_play(ScrobbleClient* self, gint64 now) {
+  if (self->timer_source != 0) {
+    g_source_remove(self->timer_source);
+    self->timer_source = 0;
+  }
+  const TrackedPlay* play = self->tracker->current();
+  if (play == nullptr ||
+      self->scrobbled_play == self->tracker->play_number()) {
+    return;
+  }
+  const gint64 threshold = threshold_us(*play);
+  if (threshold < 0) {
+    return;
+  }
+  const gint64 remaining = threshold - self->tracker->ListenedUs(now);
+  if (remaining <= 0) {
+    self->scrobbled_play = self->tracker->play_number();
+    scrobble_play(self, *play);
+  } else if (self->tracker->playing()) {
+    self->timer_source =
+        g_timeout_add(remaining / 1000 + 1, threshold_cb, self);
+  }
+}
+
+static void on_block_written(void* data) {
+  ScrobbleClient* self = SCROBBLE_CLIENT(data);
+  NowPlayingBlock block;
+  if (!now_playing_block_read(now_playing_block_get(), &block)) {
+    return;
+  }
+  const gint64 now = g_get_monotonic_time();
+  const guint64 play_number = self->tracker->play_number();
+  TrackedPlay finished;
+  // The timer can lose the race with a track change.
+  if (self->tracker->Update(block, now, &finished) &&
+      self->scrobbled_play != play_number) {
+    const gint64 threshold = threshold_us(finished);
+    if (threshold >= 0 && finished.listened_us >= threshold) {
+      self->scrobbled_play = play_number;
+      scrobble_play(self, finished);
+    }
+  }
+  check_current_play(self, now);
+}
+
+static void scrobble_client_dispose(GObject* object) {
+  ScrobbleClient* self = SCROBBLE_CLIENT(object);
+
+  if (self->observing) {
+    now_playing_block_remove_observer(on_block_written, self);
+    self->observing = FALSE;
+  }
+  if (self->timer_source != 0) {
+    g_source_remove(self->timer_source);
+    self->timer_source = 0;
+  }
+  if (self->worker != nullptr) {
+    g_mutex_lock(&self->mutex);
+    self->stopping = TRUE;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->mutex);
+    g_cancellable_cancel(self->cancellable);
+    g_thread_join(self->worker);
+    self->worker = nullptr;
+  }
+  delete self->queue;
+  self->queue = nullptr;
+  g_clear_object(&self->cancellable);
+
+  G_OBJECT_CLASS(scrobble_client_parent_class)->dispose(object);
+}
+
+static void scrobble_client_finalize(GObject* object) {
+  ScrobbleClient* self = SCROBBLE_CLIENT(object);
+
+  g_free(self->url);
+  g_free(self->api_key);
+  g_free(self->api_secret);
+  g_free(self->session_key);
+  g_rand_free(self->rand);
+  delete self->inbox;
+  delete self->tracker;
+  g_mutex_clear(&self->mutex);
+  g_cond_clear(&self->cond);
+
+  G_OBJECT_CLASS(scrobble_client_parent_class)->finalize(object);
+}
+
+static void scrobble_client_class_init(ScrobbleClientClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = scrobble_client_dispose;
+  G_OBJECT_CLASS(klass)->finalize = scrobble_client_finalize;
+}
+
+static void scrobble_client_init(ScrobbleClient* self) {
+  g_mutex_init(&self->mutex);
+  g_cond_init(&self->cond);
+  self->inbox = new std::vector<ScrobbleEntry>();
+  self->tracker = new PlayTracker();
+  self->rand = g_rand_new();
+  self->cancellable = g_cancellable_new();
+}
+
+static gchar* get_required_setting(GKeyFile* settings, const gchar* key,
+                                   GError** error) {
+  g_autofree gchar* value =
+      g_key_file_get_string(settings, kSettingsGroup, key, error);
+  if (value == nullptr) {
+    return nullptr;
+  }
+  g_strstrip(value);
+  if (*value == '\0') {
+    g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                "Scrobble setting \"%s\" is empty", key);
+    return nullptr;
+  }
+  return static_cast<gchar*>(g_steal_pointer(&value));
+}
+
+static gint64 get_ms_setting(GKeyFile* settings, const gchar* key,
+                             gint64 fallback) {
+  g_autoptr(GError) error = nullptr;
+  gint64 value = g_key_file_get_int64(settings, kSettingsGroup, key, &error);
+  return error == nullptr && value > 0 ? value : fallback;
+}
+
+ScrobbleClient* scrobble_client_new(const gchar* directory,
+                                    GKeyFile* settings, GError** error) {
+  g_autoptr(GKeyFile) loaded = nullptr;
+  if (settings == nullptr) {
+    loaded = g_key_file_new();
+    g_autofree gchar* path =
+        g_build_filename(g_get_user_config_dir(), "youtube_music_unbound",
+                         "scrobble.ini", nullptr);
+    if (!g_key_file_load_from_file(loaded, path, G_KEY_FILE_NONE, error)) {
+      return nullptr;
+    }
+    settings = loaded;
+  }
+
+  g_autofree gchar* api_key =
+      get_required_setting(settings, "api_key", error);
+  if (api_key == nullptr) {
+    return nullptr;
+  }
+  g_autofree gchar* api_secret =
+      get_required_setting(settings, "api_secret", error);
+  if (api_secret == nullptr) {
+    return nullptr;
+  }
+  g_autofree gchar* session_key =
+      get_required_setting(settings, "session_key", error);
+  if (session_key == nullptr) {
+    return nullptr;
+  }
+  g_autofree gchar* url =
+      g_key_file_get_string(settings, kSettingsGroup, "url", nullptr);
+  const gint64 retry_min_ms =
+      get_ms_setting(settings, "retry_min_ms", kDefaultRetryMinMs);
+  const gint64 retry_max_ms = MAX(
+      retry_min_ms,
+      get_ms_setting(settings, "retry_max_ms", kDefaultRetryMaxMs));
+
+  g_autofree gchar* default_directory = nullptr;
+  if (directory == nullptr) {
+    default_directory = g_build_filename(
+        g_get_user_data_dir(), "youtube_music_unbound", "scrobble", nullptr);
+    directory = default_directory;
+  }
+  std::unique_ptr<ScrobbleQueue> queue = ScrobbleQueue::Open(directory, error);
+  if (queue == nullptr) {
+    return nullptr;
+  }
+
+  ScrobbleClient* self =
+      SCROBBLE_CLIENT(g_object_new(scrobble_client_get_type(), nullptr));
+  self->url = url != nullptr ? static_cast<gchar*>(g_steal_pointer(&url))
+                             : g_strdup(kDefaultUrl);
+  self->api_key = static_cast<gchar*>(g_steal_pointer(&api_key));
+  self->api_secret = static_cast<gchar*>(g_steal_pointer(&api_secret));
+  self->session_key = static_cast<gchar*>(g_steal_pointer(&session_key));
+  self->retry_min_us = retry_min_ms * 1000;
+  self->retry_max_us = retry_max_ms * 1000;
+  self->stats.pending = queue->size();
+  self->queue = queue.release();
+  self->worker = g_thread_new("scrobbler", worker_main, self);
+  now_playing_block_add_observer(on_block_written, self);
+  self->observing = TRUE;
+  return self;
+}
+
+void scrobble_client_enqueue(ScrobbleClient* self,
+                             const ScrobbleEntry& entry) {
+  g_return_if_fail(SCROBBLE_IS_CLIENT(self));
+
+  g_mutex_lock(&self->mutex);
+  self->inbox->push_back(entry);
+  g_cond_signal(&self->cond);
+  g_mutex_unlock(&self->mutex);
+}
+
+void scrobble_client_get_stats(ScrobbleClient* self,
+                               ScrobbleClientStats* stats) {
+  g_return_if_fail(SCROBBLE_IS_CLIENT(self));
+
+  g_mutex_lock(&self->mutex);
+  *stats = self->stats;
+  g_mutex_unlock(&self->mutex);
+}
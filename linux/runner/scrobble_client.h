@@ -0,0 +1,74 @@
+#ifndef RUNNER_SCROBBLE_CLIENT_H_
+#define RUNNER_SCROBBLE_CLIENT_H_
+
+#include <gio/gio.h>
+
+#include "scrobble_queue.h"
+
+// Scrobbles plays to a Last.fm-compatible endpoint. Plays are taken from
+// writes of the now-playing block, queued on disk, and submitted in
+// batches by a worker thread that retries with backoff while offline.
+
+G_BEGIN_DECLS
+
+G_DECLARE_FINAL_TYPE(ScrobbleClient, scrobble_client, SCROBBLE, CLIENT, GObject)
+
+G_END_DECLS
+
+typedef struct {
+  // Plays written to the queue.
+  guint64 queued;
+  // Scrobbles the server accepted.
+  guint64 submitted;
+  // Requests the server accepted.
+  guint64 batches;
+  // Requests that failed and will be retried.
+  guint64 failures;
+  // Scrobbles the server rejected, or that could not be queued.
+  guint64 dropped;
+  // Scrobbles waiting in the queue.
+  guint64 pending;
+} ScrobbleClientStats;
+
+/**
+ * scrobble_client_new:
+ * @directory: (nullable): where to keep the queue, or %NULL for
+ *   $XDG_DATA_HOME/youtube_music_unbound/scrobble.
+ * @settings: (nullable): the [scrobble] settings, or %NULL to load them
+ *   from $XDG_CONFIG_HOME/youtube_music_unbound/scrobble.ini.
+ * @error: return location for a #GError.
+ *
+ * Opens the queue, starts submitting what it holds, and starts following
+ * the now-playing block. The settings need `api_key`, `api_secret` and
+ * `session_key`; `url`, `retry_min_ms` and `retry_max_ms` are optional.
+ * Must be used, and disposed, on the thread that calls
+ * now_playing_block_notify().
+ *
+ * A play is scrobbled once it has played for half its length or four
+ * minutes, whichever comes first; tracks of 30 seconds or less never are.
+ *
+ * Returns: a new #ScrobbleClient, or %NULL with @error set if the
+ *   settings are missing or the queue cannot be opened.
+ */
+ScrobbleClient* scrobble_client_new(const gchar* directory,
+                                    GKeyFile* settings, GError** error);
+
+/**
+ * scrobble_client_enqueue:
+ * @self: a #ScrobbleClient.
+ * @entry: the play to scrobble.
+ *
+ * Hands @entry to the worker, which queues it on disk and submits it.
+ * Never blocks on the disk or the network.
+ */
+void scrobble_client_enqueue(ScrobbleClient* self, const ScrobbleEntry& entry);
+
+/**
+ * scrobble_client_get_stats:
+ * @self: a #ScrobbleClient.
+ * @stats: (out): the counters so far. Thread-safe.
+ */
+void scrobble_client_get_stats(ScrobbleClient* self,
+                               ScrobbleClientStats* stats);
+
+#endif  // RUNNER_SCROBBLE_CLIENT_H_
@@ -0,0 +1,241 @@
+#include "scrobble_queue.h"
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+static constexpr char kLogName[] = "queue";
+static constexpr char kHeadName[] = "head";
+
+// Each line is "<checksum>\t<timestamp>\t<duration>\t<artist>\t<track>\t
+// <album>\n", the checksum being the FNV-1a hash, in hex, of everything
+// after the first tab and before the newline.
+static constexpr int kFieldCount = 6;
+
+static guint32 checksum(const char* data, size_t length) {
+  guint32 hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<guint8>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Fields are tab-separated, so tabs and line breaks in names become spaces.
+static void append_field(std::string* line, const std::string& value) {
+  line->push_back('\t');
+  for (char c : value) {
+    line->push_back(c == '\t' || c == '\n' || c == '\r' ? ' ' : c);
+  }
+}
+
+// Parses the line in [begin, end), without its newline.
+static bool parse_line(const char* begin, const char* end,
+                       ScrobbleEntry* entry) {
+  const char* fields[kFieldCount];
+  size_t lengths[kFieldCount];
+  const char* field = begin;
+  for (int i = 0; i < kFieldCount; i++) {
+    const char* tab = static_cast<const char*>(
+        memchr(field, '\t', end - field));
+    if (i < kFieldCount - 1 && tab == nullptr) {
+      return false;
+    }
+    const char* field_end = i < kFieldCount - 1 ? tab : end;
+    if (i == kFieldCount - 1 && tab != nullptr) {
+      return false;
+    }
+    fields[i] = field;
+    lengths[i] = field_end - field;
+    field = field_end + 1;
+  }
+
+  const char* payload = fields[1];
+  const std::string stored(fields[0], lengths[0]);
+  g_autofree gchar* expected = g_strdup_printf(
+      "%08x", checksum(payload, end - payload));
+  if (stored != expected) {
+    return false;
+  }
+
+  const std::string timestamp(fields[1], lengths[1]);
+  const std::string duration(fields[2], lengths[2]);
+  entry->timestamp = g_ascii_strtoll(timestamp.c_str(), nullptr, 10);
+  entry->duration = g_ascii_strtoull(duration.c_str(), nullptr, 10);
+  entry->artist.assign(fields[3], lengths[3]);
+  entry->track.assign(fields[4], lengths[4]);
+  entry->album.assign(fields[5], lengths[5]);
+  return true;
+}
+
+ScrobbleQueue::ScrobbleQueue(std::string log_path, std::string head_path)
+    : log_path_(std::move(log_path)), head_path_(std::move(head_path)) {}
+
+ScrobbleQueue::~ScrobbleQueue() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::unique_ptr<ScrobbleQueue> ScrobbleQueue::Open(const gchar* directory,
+                                                   GError** error) {
+  if (g_mkdir_with_parents(directory, 0700) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to create %s: %s", directory,
+                g_strerror(saved_errno));
+    return nullptr;
+  }
+  g_autofree gchar* log_path = g_build_filename(directory, kLogName, nullptr);
+  g_autofree gchar* head_path =
+      g_build_filename(directory, kHeadName, nullptr);
+  std::unique_ptr<ScrobbleQueue> queue(new ScrobbleQueue(log_path, head_path));
+  if (!queue->Load(error)) {
+    return nullptr;
+  }
+  return queue;
+}
+
+bool ScrobbleQueue::Load(GError** error) {
+  fd_ = open(log_path_.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+             0600);
+  if (fd_ < 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to open %s: %s", log_path_.c_str(),
+                g_strerror(saved_errno));
+    return false;
+  }
+
+  g_autofree gchar* contents = nullptr;
+  gsize size = 0;
+  if (!g_file_get_contents(log_path_.c_str(), &contents, &size, error)) {
+    return false;
+  }
+  guint64 head = 0;
+  g_autofree gchar* head_text = nullptr;
+  if (g_file_get_contents(head_path_.c_str(), &head_text, nullptr, nullptr)) {
+    head = g_ascii_strtoull(head_text, nullptr, 10);
+  }
+  // The log is emptied before the head is reset, so a head past the end
+  // means a crash came between the two.
+  if (head > size) {
+    head = 0;
+  }
+
+  guint64 position = head;
+  size_t damaged = 0;
+  while (position < size) {
+    const char* begin = contents + position;
+    const char* newline =
+        static_cast<const char*>(memchr(begin, '\n', size - position));
+    if (newline == nullptr) {
+      break;
+    }
+    Pending pending;
+    if (parse_line(begin, newline, &pending.entry)) {
+      pending.end = newline + 1 - contents;
+      entries_.push_back(std::move(pending));
+    } else {
+      damaged++;
+    }
+    position = newline + 1 - contents;
+  }
+  if (damaged > 0) {
+    g_warning("Scrobble queue: skipped %zu damaged entries", damaged);
+  }
+
+  // Whatever follows the last newline is a line a crash cut short; it was
+  // never reported as queued.
+  size_ = position;
+  if (position < size &&
+      (ftruncate(fd_, position) != 0 || fdatasync(fd_) != 0)) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to repair %s: %s", log_path_.c_str(),
+                g_strerror(saved_errno));
+    return false;
+  }
+  if (entries_.empty() && size_ > 0) {
+    return Remove(0, error);
+  }
+  return true;
+}
+
+bool ScrobbleQueue::WriteHead(guint64 head, GError** error) {
+  g_autofree gchar* text = g_strdup_printf("%" G_GUINT64_FORMAT "\n", head);
+  return g_file_set_contents_full(
+      head_path_.c_str(), text, -1,
+      static_cast<GFileSetContentsFlags>(G_FILE_SET_CONTENTS_CONSISTENT |
+                                         G_FILE_SET_CONTENTS_DURABLE),
+      0600, error);
+}
+
+bool ScrobbleQueue::Append(const ScrobbleEntry& entry, GError** error) {
+  g_autofree gchar* numbers = g_strdup_printf(
+      "%" G_GINT64_FORMAT "\t%u", entry.timestamp, entry.duration);
+  std::string payload = numbers;
+  append_field(&payload, entry.artist);
+  append_field(&payload, entry.track);
+  append_field(&payload, entry.album);
+  g_autofree gchar* sum = g_strdup_printf(
+      "%08x\t", checksum(payload.data(), payload.size()));
+  const std::string line = sum + payload + "\n";
+
+  size_t written = 0;
+  while (written < line.size()) {
+    ssize_t n = write(fd_, line.data() + written, line.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  if (written < line.size() || fdatasync(fd_) != 0) {
+    int saved_errno = errno;
+    // Leaves no partial line for the next append to run into.
+    if (ftruncate(fd_, size_) != 0) {
+      g_debug("Scrobble queue: cannot undo a failed append: %s",
+              g_strerror(errno));
+    }
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to queue a scrobble: %s", g_strerror(saved_errno));
+    return false;
+  }
+
+  size_ += line.size();
+  entries_.push_back({entry, size_});
+  return true;
+}
+
+void ScrobbleQueue::Peek(size_t max, std::vector<ScrobbleEntry>* out) const {
+  for (size_t i = 0; i < max && i < entries_.size(); i++) {
+    out->push_back(entries_[i].entry);
+  }
+}
+
+bool ScrobbleQueue::Remove(size_t count, GError** error) {
+  count = MIN(count, entries_.size());
+  const guint64 head = count > 0 ? entries_[count - 1].end : 0;
+  entries_.erase(entries_.begin(), entries_.begin() + count);
+  if (!entries_.empty()) {
+    return WriteHead(head, error);
+  }
+
+  // Everything was submitted: start the log over rather than let it grow.
+  if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to empty %s: %s", log_path_.c_str(),
+                g_strerror(saved_errno));
+    return false;
+  }
+  size_ = 0;
+  return WriteHead(0, error);
+}
@@ -0,0 +1,72 @@
+#ifndef RUNNER_SCROBBLE_QUEUE_H_
+#define RUNNER_SCROBBLE_QUEUE_H_
+
+#include <glib.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ScrobbleEntry {
+  // When the play started, in seconds since the epoch.
+  gint64 timestamp = 0;
+  // The track's length in seconds, or 0 if unknown.
+  guint duration = 0;
+  std::string artist;
+  std::string track;
+  std::string album;
+};
+
+// Scrobbles waiting to be submitted, kept on disk so that neither a crash
+// nor a long time offline loses any. Entries are appended to a text log,
+// one checksummed line each, and synced before Append() returns; the
+// offset of the first entry not yet submitted is kept in a second file,
+// replaced atomically. A line a crash cut short is discarded on open.
+//
+// Delivery is at least once: a crash between the server accepting a batch
+// and Remove() returning sends it again, which Last.fm-compatible servers
+// ignore as a duplicate.
+//
+// Not thread-safe.
+class ScrobbleQueue {
+ public:
+  // Opens the queue in |directory|, creating it if needed.
+  static std::unique_ptr<ScrobbleQueue> Open(const gchar* directory,
+                                             GError** error);
+
+  ~ScrobbleQueue();
+  ScrobbleQueue(const ScrobbleQueue&) = delete;
+  ScrobbleQueue& operator=(const ScrobbleQueue&) = delete;
+
+  // Adds |entry| at the back; it is on disk when this returns true.
+  bool Append(const ScrobbleEntry& entry, GError** error);
+
+  // Copies up to |max| entries from the front into |out|.
+  void Peek(size_t max, std::vector<ScrobbleEntry>* out) const;
+
+  // Drops |count| entries from the front once they have been submitted.
+  bool Remove(size_t count, GError** error);
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Pending {
+    ScrobbleEntry entry;
+    // Offset just past the entry's line.
+    guint64 end;
+  };
+
+  ScrobbleQueue(std::string log_path, std::string head_path);
+
+  bool Load(GError** error);
+  bool WriteHead(guint64 head, GError** error);
+
+  std::string log_path_;
+  std::string head_path_;
+  int fd_ = -1;
+  guint64 size_ = 0;
+  std::deque<Pending> entries_;
+};
+
+#endif  // RUNNER_SCROBBLE_QUEUE_H_
@@ -0,0 +1,364 @@
+#include "search_provider.h"
+
+#include <string>
+#include <utility>
+
+#include "startup_trace.h"
+
+// The shell shows a handful of results per provider; more are only worth
+// sending when it expands the list.
+static constexpr size_t kMaxResults = 20;
+
+static constexpr char kIntrospectionXml[] =
+    "<node>"
+    "  <interface name='org.gnome.Shell.SearchProvider2'>"
+    "    <method name='GetInitialResultSet'>"
+    "      <arg type='as' name='terms' direction='in'/>"
+    "      <arg type='as' name='results' direction='out'/>"
+    "    </method>"
+    "    <method name='GetSubsearchResultSet'>"
+    "      <arg type='as' name='previous_results' direction='in'/>"
+    "      <arg type='as' name='terms' direction='in'/>"
+    "      <arg type='as' name='results' direction='out'/>"
+    "    </method>"
+    "    <method name='GetResultMetas'>"
+    "      <arg type='as' name='identifiers' direction='in'/>"
+    "      <arg type='aa{sv}' name='metas' direction='out'/>"
+    "    </method>"
+    "    <method name='ActivateResult'>"
+    "      <arg type='s' name='identifier' direction='in'/>"
+    "      <arg type='as' name='terms' direction='in'/>"
+    "      <arg type='u' name='timestamp' direction='in'/>"
+    "    </method>"
+    "    <method name='LaunchSearch'>"
+    "      <arg type='as' name='terms' direction='in'/>"
+    "      <arg type='u' name='timestamp' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+struct _SearchProvider {
+  GObject parent_instance;
+
+  // Owner thread, the one that created the provider.
+  GMainContext* main_context;
+  SearchOpenHandler open_handler;
+  gpointer open_handler_data;
+
+  // Searches run on |dbus_thread| with its own |dbus_context|, so a busy
+  // UI thread cannot hold up the shell. Everything below is owned by that
+  // thread once it has started.
+  GThread* dbus_thread;
+  GMainContext* dbus_context;
+  GMainLoop* dbus_loop;
+  gchar* object_path;
+  GDBusNodeInfo* introspection_data;
+  GDBusConnection* connection;
+  guint registration_id;
+
+  // Handed to the index when the thread starts.
+  std::vector<SearchTrack>* tracks;
+  TrackSearchIndex* index;
+};
+
+G_DEFINE_TYPE(SearchProvider, search_provider, G_TYPE_OBJECT)
+
+static void stop_dbus_thread(SearchProvider* self);
+
+static void search_provider_dispose(GObject* object) {
+  SearchProvider* self = SEARCH_PROVIDER(object);
+
+  if (self->dbus_thread != nullptr) {
+    stop_dbus_thread(self);
+  }
+  // Plays still queued are dropped with |dbus_context|.
+  g_clear_pointer(&self->dbus_loop, g_main_loop_unref);
+  g_clear_pointer(&self->dbus_context, g_main_context_unref);
+  g_clear_pointer(&self->main_context, g_main_context_unref);
+  g_clear_pointer(&self->introspection_data, g_dbus_node_info_unref);
+  g_clear_pointer(&self->object_path, g_free);
+  delete self->tracks;
+  self->tracks = nullptr;
+  delete self->index;
+  self->index = nullptr;
+
+  G_OBJECT_CLASS(search_provider_parent_class)->dispose(object);
+}
+
+static void search_provider_class_init(SearchProviderClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = search_provider_dispose;
+}
+
+static void search_provider_init(SearchProvider* self) {
+  self->main_context = g_main_context_ref_thread_default();
+  self->dbus_context = g_main_context_new();
+  self->dbus_loop = g_main_loop_new(self->dbus_context, FALSE);
+}
+
+SearchProvider* search_provider_new(std::vector<SearchTrack> tracks) {
+  SearchProvider* self =
+      SEARCH_PROVIDER(g_object_new(search_provider_get_type(), nullptr));
+  self->tracks = new std::vector<SearchTrack>(std::move(tracks));
+  return self;
+}
+
+void search_provider_set_open_handler(SearchProvider* self,
+                                      SearchOpenHandler handler,
+                                      gpointer user_data) {
+  g_return_if_fail(SEARCH_IS_PROVIDER(self));
+  self->open_handler = handler;
+  self->open_handler_data = user_data;
+}
+
+// Carries an activation from the D-Bus thread to the owner thread.
+struct OpenDelivery {
+  SearchProvider* self;
+  std::string query;
+  guint32 timestamp;
+};
+
+static gboolean deliver_open(gpointer user_data) {
+  OpenDelivery* delivery = static_cast<OpenDelivery*>(user_data);
+  SearchProvider* self = delivery->self;
+  if (self->open_handler != nullptr) {
+    self->open_handler(delivery->query.c_str(), delivery->timestamp,
+                       self->open_handler_data);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void free_open_delivery(gpointer user_data) {
+  OpenDelivery* delivery = static_cast<OpenDelivery*>(user_data);
+  g_object_unref(delivery->self);
+  delete delivery;
+}
+
+static void dispatch_open(SearchProvider* self, std::string query,
+                          guint32 timestamp) {
+  OpenDelivery* delivery = new OpenDelivery{
+      SEARCH_PROVIDER(g_object_ref(self)), std::move(query), timestamp};
+  g_main_context_invoke_full(self->main_context, G_PRIORITY_DEFAULT,
+                             deliver_open, delivery, free_open_delivery);
+}
+
+// Returns the result set for |terms| in the form the shell expects.
+static GVariant* search(SearchProvider* self, const gchar* const* terms) {
+  std::vector<uint32_t> ids;
+  self->index->Search(terms, kMaxResults, g_get_real_time(), &ids);
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+  for (uint32_t id : ids) {
+    g_autofree gchar* identifier = g_strdup_printf("%u", id);
+    g_variant_builder_add(&builder, "s", identifier);
+  }
+  return g_variant_new("(as)", &builder);
+}
+
+// Returns the track a result identifier names, or nullptr.
+static const SearchTrack* lookup_result(SearchProvider* self,
+                                        const gchar* identifier) {
+  guint64 id;
+  if (!g_ascii_string_to_unsigned(identifier, 10, 0, G_MAXUINT32, &id,
+                                  nullptr)) {
+    return nullptr;
+  }
+  return self->index->track(static_cast<uint32_t>(id));
+}
+
+static GVariant* result_metas(SearchProvider* self,
+                              const gchar* const* identifiers) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+  for (const gchar* const* identifier = identifiers; *identifier != nullptr;
+       identifier++) {
+    const SearchTrack* track = lookup_result(self, *identifier);
+    if (track == nullptr) {
+      continue;
+    }
+    std::string description = track->artist;
+    if (!track->album.empty()) {
+      description += description.empty() ? "" : " — ";
+      description += track->album;
+    }
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "id",
+                          g_variant_new_string(*identifier));
+    g_variant_builder_add(&builder, "{sv}", "name",
+                          g_variant_new_string(track->title.c_str()));
+    g_variant_builder_add(&builder, "{sv}", "description",
+                          g_variant_new_string(description.c_str()));
+    g_variant_builder_close(&builder);
+  }
+  return g_variant_new("(aa{sv})", &builder);
+}
+
+static void handle_method_call(GDBusConnection* connection,
+                               const gchar* sender,
+                               const gchar* object_path,
+                               const gchar* interface_name,
+                               const gchar* method_name,
+                               GVariant* parameters,
+                               GDBusMethodInvocation* invocation,
+                               gpointer user_data) {
+  SearchProvider* self = SEARCH_PROVIDER(user_data);
+
+  // GDBus has already checked the arguments against the introspection
+  // data.
+  if (g_strcmp0(method_name, "GetInitialResultSet") == 0) {
+    g_autofree const gchar** terms = nullptr;
+    g_variant_get(parameters, "(^a&s)", &terms);
+    g_dbus_method_invocation_return_value(invocation, search(self, terms));
+  } else if (g_strcmp0(method_name, "GetSubsearchResultSet") == 0) {
+    // Searched afresh rather than by narrowing the previous results:
+    // those were cut off at kMaxResults, and a search is cheap.
+    g_autofree const gchar** terms = nullptr;
+    g_variant_get(parameters, "(^a&s^a&s)", nullptr, &terms);
+    g_dbus_method_invocation_return_value(invocation, search(self, terms));
+  } else if (g_strcmp0(method_name, "GetResultMetas") == 0) {
+    g_autofree const gchar** identifiers = nullptr;
+    g_variant_get(parameters, "(^a&s)", &identifiers);
+    g_dbus_method_invocation_return_value(invocation,
+                                          result_metas(self, identifiers));
+  } else if (g_strcmp0(method_name, "ActivateResult") == 0) {
+    const gchar* identifier;
+    guint32 timestamp;
+    g_variant_get(parameters, "(&sasu)", &identifier, nullptr, &timestamp);
+    const SearchTrack* track = lookup_result(self, identifier);
+    if (track != nullptr) {
+      dispatch_open(self, track->title + " " + track->artist, timestamp);
+    }
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+  } else if (g_strcmp0(method_name, "LaunchSearch") == 0) {
+    g_autofree const gchar** terms = nullptr;
+    guint32 timestamp;
+    g_variant_get(parameters, "(^a&su)", &terms, &timestamp);
+    g_autofree gchar* query = g_strjoinv(" ", const_cast<gchar**>(terms));
+    dispatch_open(self, query, timestamp);
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+  } else {
+    g_dbus_method_invocation_return_error(
+        invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+        "Unknown method %s", method_name);
+  }
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    handle_method_call,
+    nullptr,
+    nullptr,
+};
+
+static gpointer dbus_thread_main(gpointer user_data) {
+  SearchProvider* self = SEARCH_PROVIDER(user_data);
+
+  g_main_context_push_thread_default(self->dbus_context);
+
+  gint64 begin = startup_trace_now();
+  self->index = new TrackSearchIndex(std::move(*self->tracks));
+  delete self->tracks;
+  self->tracks = nullptr;
+  startup_trace_span("search_index_build", begin);
+
+  // Registered from this thread, so method calls are dispatched on
+  // |dbus_context|.
+  g_autoptr(GError) error = nullptr;
+  self->connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
+  if (self->connection != nullptr) {
+    self->registration_id = g_dbus_connection_register_object(
+        self->connection, self->object_path,
+        self->introspection_data->interfaces[0], &interface_vtable, self,
+        nullptr, &error);
+  }
+  if (self->registration_id == 0) {
+    g_warning("Failed to export the search provider: %s", error->message);
+  }
+
+  g_main_loop_run(self->dbus_loop);
+
+  if (self->registration_id > 0) {
+    g_dbus_connection_unregister_object(self->connection,
+                                        self->registration_id);
+    self->registration_id = 0;
+  }
+  g_clear_object(&self->connection);
+  g_main_context_pop_thread_default(self->dbus_context);
+  return nullptr;
+}
+
+static gboolean on_quit_dbus_loop(gpointer user_data) {
+  g_main_loop_quit(static_cast<GMainLoop*>(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+// Queued as a source rather than calling g_main_loop_quit directly so a
+// quit that races the thread start is not lost before the loop runs.
+static void stop_dbus_thread(SearchProvider* self) {
+  GSource* source = g_idle_source_new();
+  g_source_set_callback(source, on_quit_dbus_loop,
+                        g_main_loop_ref(self->dbus_loop),
+                        (GDestroyNotify)g_main_loop_unref);
+  g_source_attach(source, self->dbus_context);
+  g_source_unref(source);
+
+  g_thread_join(self->dbus_thread);
+  self->dbus_thread = nullptr;
+}
+
+gboolean search_provider_start(SearchProvider* self,
+                               const gchar* object_path) {
+  g_return_val_if_fail(SEARCH_IS_PROVIDER(self), FALSE);
+  g_return_val_if_fail(g_variant_is_object_path(object_path), FALSE);
+
+  if (self->dbus_thread != nullptr) {
+    return TRUE;
+  }
+
+  g_autoptr(GError) error = nullptr;
+  self->introspection_data =
+      g_dbus_node_info_new_for_xml(kIntrospectionXml, &error);
+  if (self->introspection_data == nullptr) {
+    g_warning("Failed to parse introspection XML: %s", error->message);
+    return FALSE;
+  }
+
+  self->object_path = g_strdup(object_path);
+  self->dbus_thread = g_thread_new("search-dbus", dbus_thread_main, self);
+  return TRUE;
+}
+
+// Carries a play from the owner thread to the D-Bus thread.
+struct PlayDelivery {
+  SearchProvider* self;
+  std::string title;
+  std::string artist;
+  std::string album;
+  gint64 started_at_us;
+};
+
+static gboolean deliver_play(gpointer user_data) {
+  PlayDelivery* delivery = static_cast<PlayDelivery*>(user_data);
+  delivery->self->index->AddPlay(
+      delivery->title.c_str(), delivery->artist.c_str(),
+      delivery->album.c_str(), delivery->started_at_us);
+  return G_SOURCE_REMOVE;
+}
+
+static void free_play_delivery(gpointer user_data) {
+  delete static_cast<PlayDelivery*>(user_data);
+}
+
+void search_provider_add_play(SearchProvider* self, const HistoryPlay& play) {
+  g_return_if_fail(SEARCH_IS_PROVIDER(self));
+
+  // Holds no reference: a play still queued when the provider goes away
+  // is freed with |dbus_context|, before the index it was meant for. Only
+  // ever dispatched by the D-Bus thread, after it has built the index.
+  PlayDelivery* delivery = new PlayDelivery{
+      self, play.title, play.artist, play.album, play.started_at_us};
+  GSource* source = g_idle_source_new();
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, deliver_play, delivery, free_play_delivery);
+  g_source_attach(source, self->dbus_context);
+  g_source_unref(source);
+}
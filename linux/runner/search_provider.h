@@ -0,0 +1,74 @@
+#ifndef RUNNER_SEARCH_PROVIDER_H_
+#define RUNNER_SEARCH_PROVIDER_H_
+
+#include <gio/gio.h>
+
+#include <vector>
+
+#include "listening_history.h"
+#include "track_search_index.h"
+
+// A GNOME Shell search provider (org.gnome.Shell.SearchProvider2) over the
+// tracks in the listening history. Like the MPRIS server it answers D-Bus
+// calls from a dedicated thread, which owns the TrackSearchIndex, on the
+// same session bus connection, so the shell reaches it through any name
+// the application owns.
+
+G_BEGIN_DECLS
+
+#define SEARCH_TYPE_PROVIDER search_provider_get_type()
+G_DECLARE_FINAL_TYPE(SearchProvider, search_provider, SEARCH, PROVIDER,
+                     GObject)
+
+G_END_DECLS
+
+// Asks for |query| to be looked up on YouTube Music: a result's title and
+// artist, or the terms typed, when the shell launches a search.
+// |timestamp| is that of the event that caused it, for focus stealing
+// prevention.
+typedef void (*SearchOpenHandler)(const gchar* query, guint32 timestamp,
+                                  gpointer user_data);
+
+/**
+ * search_provider_new:
+ * @tracks: the tracks to index, from TrackSearchIndex::CollectTracks().
+ *
+ * Creates a stopped provider. The calling thread becomes its owner
+ * thread, on whose thread-default main context the open handler is
+ * called. The index is built on the D-Bus thread once started.
+ *
+ * Returns: a new #SearchProvider.
+ */
+SearchProvider* search_provider_new(std::vector<SearchTrack> tracks);
+
+/**
+ * search_provider_set_open_handler:
+ * @handler: (nullable): called on the owner thread for each activation.
+ *
+ * Pass %NULL before dropping whatever @user_data points at.
+ */
+void search_provider_set_open_handler(SearchProvider* self,
+                                      SearchOpenHandler handler,
+                                      gpointer user_data);
+
+/**
+ * search_provider_start:
+ * @object_path: where to export the provider, as named in its
+ *   search-providers .ini file.
+ *
+ * Starts the D-Bus thread, which builds the index and exports the
+ * provider on the session bus. Does nothing if already started.
+ *
+ * Returns: %FALSE if the provider could not be set up.
+ */
+gboolean search_provider_start(SearchProvider* self,
+                               const gchar* object_path);
+
+/**
+ * search_provider_add_play:
+ *
+ * Queues @play for the index without blocking; the strings are copied.
+ */
+void search_provider_add_play(SearchProvider* self, const HistoryPlay& play);
+
+#endif  // RUNNER_SEARCH_PROVIDER_H_
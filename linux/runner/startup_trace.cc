@@ -0,0 +1,228 @@
+#include "startup_trace.h"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static constexpr char kEnvironmentVariable[] = "YTMU_STARTUP_TRACE";
+static constexpr char kDefaultFileName[] = "startup-trace.json";
+// The Dart track, a thread id no real thread has.
+static constexpr gint64 kDartTrack = -1;
+
+struct TraceEvent {
+  std::string name;
+  // 'X' for a span, 'i' for an instant.
+  char phase;
+  gint64 time_us;
+  gint64 duration_us;
+  gint64 track;
+};
+
+// Set before any other thread exists and not changed afterwards, so it is
+// read without the lock.
+static gboolean enabled = FALSE;
+static std::string path;
+// The monotonic time the process started at; timestamps are relative to it.
+static gint64 origin_us = 0;
+
+static std::mutex mutex;
+static std::vector<TraceEvent> events;
+static std::map<gint64, std::string> track_names;
+
+static gint64 current_thread_id() {
+  return syscall(SYS_gettid);
+}
+
+// Names the calling thread's track the first time it records something.
+// Called with |mutex| held.
+static void name_track(gint64 track) {
+  if (track_names.count(track) != 0) {
+    return;
+  }
+  char name[16] = "";
+  if (track == getpid()) {
+    g_strlcpy(name, "main", sizeof(name));
+  } else {
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+  }
+  track_names[track] = name;
+}
+
+static void record(const gchar* name, char phase, gint64 time_us,
+                   gint64 duration_us, gint64 track) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (track != kDartTrack) {
+    name_track(track);
+  }
+  events.push_back({name, phase, time_us, duration_us, track});
+}
+
+// When the process was exec'd, on the monotonic clock. /proc gives it in
+// clock ticks since boot, counting suspend, as CLOCK_BOOTTIME does.
+static gint64 read_process_start() {
+  g_autofree gchar* stat = nullptr;
+  if (!g_file_get_contents("/proc/self/stat", &stat, nullptr, nullptr)) {
+    return 0;
+  }
+  // Fields after the parenthesised command name, which may hold spaces;
+  // starttime is field 22, the 20th of these.
+  const gchar* fields = strrchr(stat, ')');
+  if (fields == nullptr) {
+    return 0;
+  }
+  g_auto(GStrv) parts = g_strsplit(fields + 2, " ", 21);
+  if (g_strv_length(parts) < 21) {
+    return 0;
+  }
+  const gint64 ticks = g_ascii_strtoll(parts[19], nullptr, 10);
+  const gint64 ticks_per_second = sysconf(_SC_CLK_TCK);
+  struct timespec boot;
+  clock_gettime(CLOCK_BOOTTIME, &boot);
+  const gint64 boot_us = boot.tv_sec * G_USEC_PER_SEC + boot.tv_nsec / 1000;
+  const gint64 started_us = ticks * G_USEC_PER_SEC / ticks_per_second;
+  return g_get_monotonic_time() - (boot_us - started_us);
+}
+
+static void write_at_exit() {
+  g_autoptr(GError) error = nullptr;
+  if (!startup_trace_write(&error)) {
+    g_printerr("Startup trace not written: %s\n", error->message);
+  }
+}
+
+void startup_trace_init(void) {
+  const gchar* setting = g_getenv(kEnvironmentVariable);
+  if (setting == nullptr || *setting == '\0' || enabled) {
+    return;
+  }
+  if (g_strcmp0(setting, "1") == 0) {
+    g_autofree gchar* file = g_build_filename(
+        g_get_user_cache_dir(), "youtube_music_unbound", kDefaultFileName,
+        nullptr);
+    path = file;
+  } else {
+    path = setting;
+  }
+  enabled = TRUE;
+
+  const gint64 now = g_get_monotonic_time();
+  const gint64 started = read_process_start();
+  origin_us = started > 0 && started <= now ? started : now;
+  record("exec", 'i', origin_us, 0, getpid());
+  record("main", 'i', now, 0, getpid());
+}
+
+void startup_trace_write_at_exit(void) {
+  static gboolean registered = FALSE;
+  if (enabled && !registered) {
+    registered = TRUE;
+    atexit(write_at_exit);
+  }
+}
+
+gboolean startup_trace_enabled(void) {
+  return enabled;
+}
+
+gint64 startup_trace_now(void) {
+  return enabled ? g_get_monotonic_time() : 0;
+}
+
+void startup_trace_span(const gchar* name, gint64 begin_us) {
+  if (!enabled || begin_us == 0) {
+    return;
+  }
+  record(name, 'X', begin_us, g_get_monotonic_time() - begin_us,
+         current_thread_id());
+}
+
+void startup_trace_instant(const gchar* name) {
+  if (!enabled) {
+    return;
+  }
+  record(name, 'i', g_get_monotonic_time(), 0, current_thread_id());
+}
+
+void startup_trace_add_dart_event(const gchar* name,
+                                  gint64 begin_us,
+                                  gint64 end_us) {
+  if (!enabled) {
+    return;
+  }
+  if (end_us > begin_us) {
+    record(name, 'X', begin_us, end_us - begin_us, kDartTrack);
+  } else {
+    record(name, 'i', begin_us, 0, kDartTrack);
+  }
+}
+
+static void append_json_string(GString* out, const std::string& value) {
+  g_string_append_c(out, '"');
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      g_string_append_c(out, '\\');
+      g_string_append_c(out, c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      g_string_append_printf(out, "\\u%04x", c);
+    } else {
+      g_string_append_c(out, c);
+    }
+  }
+  g_string_append_c(out, '"');
+}
+
+gboolean startup_trace_write(GError** error) {
+  if (!enabled) {
+    return FALSE;
+  }
+  const gint64 pid = getpid();
+  g_autoptr(GString) json = g_string_new("{\"traceEvents\":[\n");
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& track : track_names) {
+      g_string_append_printf(
+          json,
+          "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%" G_GINT64_FORMAT
+          ",\"tid\":%" G_GINT64_FORMAT ",\"args\":{\"name\":",
+          pid, track.first);
+      append_json_string(json, track.second);
+      g_string_append(json, "}},\n");
+    }
+    g_string_append_printf(
+        json,
+        "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%" G_GINT64_FORMAT
+        ",\"tid\":%" G_GINT64_FORMAT ",\"args\":{\"name\":\"Dart\"}}",
+        pid, kDartTrack);
+    for (const TraceEvent& event : events) {
+      g_string_append(json, ",\n{\"name\":");
+      append_json_string(json, event.name);
+      g_string_append_printf(
+          json,
+          ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+          ",\"pid\":%" G_GINT64_FORMAT ",\"tid\":%" G_GINT64_FORMAT,
+          event.track == kDartTrack ? "dart" : "runner", event.phase,
+          event.time_us - origin_us, pid, event.track);
+      if (event.phase == 'X') {
+        g_string_append_printf(json, ",\"dur\":%" G_GINT64_FORMAT,
+                               event.duration_us);
+      } else {
+        g_string_append(json, ",\"s\":\"t\"");
+      }
+      g_string_append_c(json, '}');
+    }
+  }
+  g_string_append(json, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  g_autofree gchar* directory = g_path_get_dirname(path.c_str());
+  g_mkdir_with_parents(directory, 0700);
+  return g_file_set_contents(path.c_str(), json->str, json->len, error);
+}
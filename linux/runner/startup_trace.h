@@ -0,0 +1,83 @@
+#ifndef RUNNER_STARTUP_TRACE_H_
+#define RUNNER_STARTUP_TRACE_H_
+
+#include <glib.h>
+
+// Opt-in tracing of the launch, written as Chrome trace_event JSON for
+// chrome://tracing or Perfetto. Spans are recorded per thread on the
+// monotonic clock; Dart adds its own on a track of their own through the
+// youtube_music_unbound/startup_trace channel.
+
+G_BEGIN_DECLS
+
+/**
+ * startup_trace_init:
+ *
+ * Starts tracing if YTMU_STARTUP_TRACE is set, to the file it names, or
+ * to startup-trace.json in $XDG_CACHE_HOME/youtube_music_unbound if it is
+ * "1". Records when the process was started and when main() was reached.
+ * Call first in main(), before any other thread exists.
+ */
+void startup_trace_init(void);
+
+gboolean startup_trace_enabled(void);
+
+/**
+ * startup_trace_now:
+ *
+ * Returns: the time to begin a span at, or 0 if tracing is off.
+ */
+gint64 startup_trace_now(void);
+
+/**
+ * startup_trace_span:
+ * @name: the span's name.
+ * @begin_us: the span's start, from startup_trace_now().
+ *
+ * Records a span on the calling thread ending now. Thread-safe, and a
+ * no-op if tracing is off.
+ */
+void startup_trace_span(const gchar* name, gint64 begin_us);
+
+/**
+ * startup_trace_instant:
+ *
+ * Records that the calling thread reached @name now.
+ */
+void startup_trace_instant(const gchar* name);
+
+/**
+ * startup_trace_add_dart_event:
+ * @begin_us: when the event started, in Dart's Timeline.now() clock, which
+ *   on Linux is the same monotonic clock.
+ * @end_us: when it ended, or @begin_us for an instant.
+ *
+ * Records an event on the Dart track.
+ */
+void startup_trace_add_dart_event(const gchar* name,
+                                  gint64 begin_us,
+                                  gint64 end_us);
+
+/**
+ * startup_trace_write:
+ * @error: (optional): return location for a #GError.
+ *
+ * Writes everything recorded so far, replacing an earlier write. Thread-safe.
+ *
+ * Returns: %FALSE if tracing is off, or if the file could not be written,
+ * in which case @error is set.
+ */
+gboolean startup_trace_write(GError** error);
+
+/**
+ * startup_trace_write_at_exit:
+ *
+ * Arranges for the trace to be written when the process exits. Called once
+ * the launch is known to be the primary instance, so one that only
+ * forwards its command line does not replace the running instance's trace.
+ */
+void startup_trace_write_at_exit(void);
+
+G_END_DECLS
+
+#endif  // RUNNER_STARTUP_TRACE_H_
@@ -0,0 +1,522 @@
+#include "track_search_index.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+// Posting list buckets: one per leading byte of a word, one per leading
+// byte pair, then trigrams hashed into 2^kTrigramBits buckets. A hash
+// collision only adds candidates, which are verified against the text.
+static constexpr uint32_t kPrefixPairBase = 256;
+static constexpr uint32_t kTrigramBase = kPrefixPairBase + 65536;
+static constexpr int kTrigramBits = 18;
+static constexpr uint32_t kBuckets = kTrigramBase + (1u << kTrigramBits);
+
+// Tracks added or played again since the last build are scanned rather
+// than looked up; this many trigger a rebuild.
+static constexpr size_t kMaxUnindexed = 256;
+
+// Ranking: a term matching in the title counts for more than one matching
+// in the artist, and so on; matching at the start of a word adds to that.
+// Each doubling of the play count, and a play in the last month, week or
+// day, add a little on top.
+static constexpr int kFieldScores[3] = {40, 30, 10};
+static constexpr int kWordStartScore = 10;
+static constexpr int kPlayScore = 6;
+static constexpr int kMaxPlayScore = 60;
+static constexpr int kRecentScore = 4;
+static constexpr int64_t kRecentWindowsUs[3] = {
+    30 * G_TIME_SPAN_DAY, 7 * G_TIME_SPAN_DAY, G_TIME_SPAN_DAY};
+
+struct TrackKey {
+  uint32_t title;
+  uint32_t artist;
+  uint32_t album;
+
+  bool operator==(const TrackKey& other) const {
+    return title == other.title && artist == other.artist &&
+           album == other.album;
+  }
+};
+
+struct TrackKeyHash {
+  size_t operator()(const TrackKey& key) const {
+    const uint64_t mixed =
+        ((static_cast<uint64_t>(key.title) << 32) | key.artist) ^
+        (static_cast<uint64_t>(key.album) * 0x9e3779b97f4a7c15u);
+    return std::hash<uint64_t>()(mixed);
+  }
+};
+
+// Bytes of non-ASCII characters count as word characters, so words in
+// other scripts are not split up.
+static inline bool is_word_byte(unsigned char c) {
+  return c >= 0x80 || g_ascii_isalnum(c);
+}
+
+static inline bool is_word_start(std::string_view text, size_t at) {
+  return is_word_byte(text[at]) && (at == 0 || !is_word_byte(text[at - 1]));
+}
+
+// Maps a word's first byte to a bit of Entry::word_masks: exactly for
+// ASCII letters and digits, shared by everything else.
+static inline uint64_t word_bit(unsigned char c) {
+  if (c >= 'a' && c <= 'z') {
+    return G_GUINT64_CONSTANT(1) << (c - 'a');
+  }
+  if (c >= '0' && c <= '9') {
+    return G_GUINT64_CONSTANT(1) << (26 + c - '0');
+  }
+  return G_GUINT64_CONSTANT(1) << (36 + c % 28);
+}
+
+static inline uint32_t trigram_bucket(unsigned char a, unsigned char b,
+                                      unsigned char c) {
+  const uint32_t trigram = (a << 16) | (b << 8) | c;
+  return kTrigramBase + ((trigram * 2654435761u) >> (32 - kTrigramBits));
+}
+
+static int popularity_score(uint32_t plays, int64_t last_played_us,
+                            int64_t now_us) {
+  int score = MIN(kPlayScore * static_cast<int>(g_bit_storage(plays)),
+                  kMaxPlayScore);
+  for (int64_t window : kRecentWindowsUs) {
+    if (now_us - last_played_us < window) {
+      score += kRecentScore;
+    }
+  }
+  return score;
+}
+
+static inline char fold_ascii(char c) {
+  if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f) {
+    return ' ';
+  }
+  return g_ascii_tolower(c);
+}
+
+// Appends |text| to |out| case-folded and without accents, so that
+// "beyonce" finds "Beyoncé". Control characters become spaces.
+static void fold_append(const char* text, std::string* out) {
+  const char* p = text;
+  while (*p != '\0' && static_cast<unsigned char>(*p) < 0x80) {
+    p++;
+  }
+  if (*p == '\0') {
+    for (p = text; *p != '\0'; p++) {
+      out->push_back(fold_ascii(*p));
+    }
+    return;
+  }
+
+  g_autofree gchar* valid = g_utf8_make_valid(text, -1);
+  g_autofree gchar* folded = g_utf8_casefold(valid, -1);
+  g_autofree gchar* decomposed =
+      g_utf8_normalize(folded, -1, G_NORMALIZE_ALL);
+  for (const gchar* c = decomposed; *c != '\0'; c = g_utf8_next_char(c)) {
+    if (static_cast<unsigned char>(*c) < 0x80) {
+      out->push_back(fold_ascii(*c));
+    } else if (!g_unichar_ismark(g_utf8_get_char(c))) {
+      out->append(c, g_utf8_next_char(c) - c);
+    }
+  }
+}
+
+std::vector<SearchTrack> TrackSearchIndex::CollectTracks(
+    const ListeningHistory& history) {
+  std::vector<SearchTrack> tracks;
+  std::unordered_map<TrackKey, uint32_t, TrackKeyHash> seen;
+  for (size_t i = 0; i < history.size(); i++) {
+    const HistoryRecord& record = history.record(i);
+    const TrackKey key = {record.title, record.artist, record.album};
+    auto inserted = seen.emplace(key, static_cast<uint32_t>(tracks.size()));
+    if (inserted.second) {
+      SearchTrack track;
+      track.title = history.String(record.title);
+      track.artist = history.String(record.artist);
+      track.album = history.String(record.album);
+      tracks.push_back(std::move(track));
+    }
+    SearchTrack& track = tracks[inserted.first->second];
+    track.plays++;
+    track.last_played_us = record.started_at_us;
+  }
+  return tracks;
+}
+
+TrackSearchIndex::TrackSearchIndex(std::vector<SearchTrack> tracks) {
+  tracks_.reserve(tracks.size());
+  entries_.reserve(tracks.size());
+  for (SearchTrack& track : tracks) {
+    AddTrack(std::move(track));
+  }
+  Rebuild();
+}
+
+uint32_t TrackSearchIndex::AddPlay(const char* title, const char* artist,
+                                   const char* album, int64_t played_at_us) {
+  std::string key = std::string(title) + '\n' + artist + '\n' + album;
+  auto found = ids_.find(key);
+  if (found != ids_.end()) {
+    SearchTrack& track = tracks_[found->second];
+    track.plays++;
+    track.last_played_us = MAX(track.last_played_us, played_at_us);
+    const uint32_t slot = slots_[found->second];
+    Entry& entry = entries_[slot];
+    entry.plays = track.plays;
+    entry.last_played_us = track.last_played_us;
+    if (slot < indexed_ && !entry.raised) {
+      entry.raised = true;
+      raised_.push_back(slot);
+      if (unindexed() + raised_.size() >= kMaxUnindexed) {
+        Rebuild();
+      }
+    }
+    return found->second;
+  }
+
+  SearchTrack track;
+  track.title = title;
+  track.artist = artist;
+  track.album = album;
+  track.plays = 1;
+  track.last_played_us = played_at_us;
+  const uint32_t id = static_cast<uint32_t>(tracks_.size());
+  AddTrack(std::move(track));
+  if (unindexed() + raised_.size() >= kMaxUnindexed) {
+    Rebuild();
+  }
+  return id;
+}
+
+// A track listed twice is merged into its first entry. Only called
+// before the first build, or for a new track.
+void TrackSearchIndex::AddTrack(SearchTrack track) {
+  auto inserted = ids_.emplace(
+      track.title + '\n' + track.artist + '\n' + track.album,
+      static_cast<uint32_t>(tracks_.size()));
+  if (!inserted.second) {
+    SearchTrack& existing = tracks_[inserted.first->second];
+    existing.plays += track.plays;
+    existing.last_played_us =
+        MAX(existing.last_played_us, track.last_played_us);
+    Entry& entry = entries_[slots_[inserted.first->second]];
+    entry.plays = existing.plays;
+    entry.last_played_us = existing.last_played_us;
+    return;
+  }
+
+  Entry entry;
+  const std::string* fields[] = {&track.title, &track.artist, &track.album};
+  for (int f = 0; f < 3; f++) {
+    entry.field_at[f] = static_cast<uint32_t>(text_.size());
+    fold_append(fields[f]->c_str(), &text_);
+    text_.push_back('\n');
+  }
+  entry.field_at[3] = static_cast<uint32_t>(text_.size());
+  for (int f = 0; f < 3; f++) {
+    const std::string_view field = Field(entry, f);
+    entry.word_masks[f] = 0;
+    for (size_t i = 0; i < field.size(); i++) {
+      if (is_word_start(field, i)) {
+        entry.word_masks[f] |= word_bit(field[i]);
+      }
+    }
+  }
+  entry.last_played_us = track.last_played_us;
+  entry.plays = track.plays;
+  entry.id = static_cast<uint32_t>(tracks_.size());
+  entry.built_score = 0;
+  entry.raised = false;
+  slots_.push_back(static_cast<uint32_t>(entries_.size()));
+  entries_.push_back(entry);
+  tracks_.push_back(std::move(track));
+}
+
+// Calls |visit| with every bucket |entry| is listed in, possibly more
+// than once.
+template <typename Visit>
+void TrackSearchIndex::ForEachBucket(const Entry& entry, Visit visit) const {
+  for (int f = 0; f < 3; f++) {
+    const std::string_view field = Field(entry, f);
+    const size_t n = field.size();
+    for (size_t i = 0; i < n; i++) {
+      const unsigned char c = field[i];
+      if (is_word_start(field, i)) {
+        visit(c);
+        if (i + 1 < n && field[i + 1] != ' ') {
+          visit(kPrefixPairBase +
+                ((c << 8) | static_cast<unsigned char>(field[i + 1])));
+        }
+      }
+      // Terms never hold a space, so neither do the trigrams worth
+      // listing.
+      if (i + 2 < n && c != ' ' && field[i + 1] != ' ' &&
+          field[i + 2] != ' ') {
+        visit(trigram_bucket(c, field[i + 1], field[i + 2]));
+      }
+    }
+  }
+}
+
+// Orders the entries, and their text, by popularity as of the last play,
+// then counts each bucket's postings and places them in slot order, so
+// every list comes out sorted without a sort.
+void TrackSearchIndex::Rebuild() {
+  const uint32_t count = static_cast<uint32_t>(entries_.size());
+  built_at_us_ = 0;
+  for (const Entry& entry : entries_) {
+    built_at_us_ = MAX(built_at_us_, entry.last_played_us);
+  }
+  std::vector<uint32_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  for (Entry& entry : entries_) {
+    entry.built_score = popularity_score(entry.plays, entry.last_played_us,
+                                         built_at_us_);
+    entry.raised = false;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return entries_[a].built_score > entries_[b].built_score;
+  });
+
+  std::vector<Entry> entries;
+  entries.reserve(entries_.capacity());
+  std::string text;
+  text.reserve(text_.capacity());
+  for (uint32_t slot = 0; slot < count; slot++) {
+    Entry entry = entries_[order[slot]];
+    const uint32_t from = entry.field_at[0];
+    const uint32_t to = static_cast<uint32_t>(text.size());
+    text.append(text_, from, entry.field_at[3] - from);
+    for (uint32_t& at : entry.field_at) {
+      at = at - from + to;
+    }
+    slots_[entry.id] = slot;
+    entries.push_back(entry);
+  }
+  entries_ = std::move(entries);
+  text_ = std::move(text);
+  raised_.clear();
+
+  offsets_.assign(kBuckets + 1, 0);
+  std::vector<uint32_t> last_slots(kBuckets, UINT32_MAX);
+  for (uint32_t slot = 0; slot < count; slot++) {
+    ForEachBucket(entries_[slot], [&](uint32_t bucket) {
+      if (last_slots[bucket] != slot) {
+        last_slots[bucket] = slot;
+        offsets_[bucket + 1]++;
+      }
+    });
+  }
+  std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+
+  postings_.resize(offsets_.back());
+  postings_.shrink_to_fit();
+  std::vector<uint32_t> cursors(offsets_.begin(), offsets_.end() - 1);
+  std::fill(last_slots.begin(), last_slots.end(), UINT32_MAX);
+  for (uint32_t slot = 0; slot < count; slot++) {
+    ForEachBucket(entries_[slot], [&](uint32_t bucket) {
+      if (last_slots[bucket] != slot) {
+        last_slots[bucket] = slot;
+        postings_[cursors[bucket]++] = slot;
+      }
+    });
+  }
+  indexed_ = count;
+}
+
+// Returns what |token| adds to |entry|'s score, or -1 if it does not
+// match. The first field holding it counts.
+int TrackSearchIndex::MatchToken(const Entry& entry,
+                                 const Token& token) const {
+  const unsigned char first = token.text[0];
+  for (int f = 0; f < 3; f++) {
+    if (token.prefix) {
+      if ((entry.word_masks[f] & word_bit(first)) == 0) {
+        continue;
+      }
+      if (token.text.size() == 1 && g_ascii_isalnum(first)) {
+        return kFieldScores[f] + kWordStartScore;
+      }
+    }
+
+    const std::string_view field = Field(entry, f);
+    size_t at = field.find(token.text);
+    if (at == std::string_view::npos) {
+      continue;
+    }
+    for (; at != std::string_view::npos; at = field.find(token.text, at + 1)) {
+      if (is_word_start(field, at)) {
+        return kFieldScores[f] + kWordStartScore;
+      }
+    }
+    if (!token.prefix) {
+      return kFieldScores[f];
+    }
+  }
+  return -1;
+}
+
+void TrackSearchIndex::Search(const gchar* const* terms, size_t max,
+                              int64_t now_us,
+                              std::vector<uint32_t>* out) const {
+  out->clear();
+  if (terms == nullptr || max == 0) {
+    return;
+  }
+
+  // The shell splits what was typed into terms on whitespace; other
+  // callers may not, and folding can make spaces.
+  std::vector<Token> tokens;
+  std::string folded;
+  for (const gchar* const* term = terms; *term != nullptr; term++) {
+    folded.clear();
+    fold_append(*term, &folded);
+    size_t start = 0;
+    while (start < folded.size()) {
+      size_t end = folded.find(' ', start);
+      if (end == std::string::npos) {
+        end = folded.size();
+      }
+      if (end > start) {
+        Token token;
+        token.text = folded.substr(start, end - start);
+        token.prefix = token.text.size() < 3;
+        // A word cannot start with anything else.
+        if (token.prefix && !is_word_byte(token.text[0])) {
+          return;
+        }
+        tokens.push_back(std::move(token));
+      }
+      start = end + 1;
+    }
+  }
+  if (tokens.empty()) {
+    return;
+  }
+
+  // Every bucket a match must be listed in, shortest list first.
+  std::vector<std::pair<const uint32_t*, const uint32_t*>> lists;
+  for (const Token& token : tokens) {
+    const auto* text = reinterpret_cast<const unsigned char*>(
+        token.text.data());
+    std::vector<uint32_t> buckets;
+    if (token.prefix) {
+      buckets.push_back(token.text.size() == 1
+                            ? text[0]
+                            : kPrefixPairBase + ((text[0] << 8) | text[1]));
+    }
+    for (size_t i = 0; !token.prefix && i + 2 < token.text.size(); i++) {
+      buckets.push_back(trigram_bucket(text[i], text[i + 1], text[i + 2]));
+    }
+    for (uint32_t bucket : buckets) {
+      lists.emplace_back(postings_.data() + offsets_[bucket],
+                         postings_.data() + offsets_[bucket + 1]);
+    }
+  }
+  std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+    return a.second - a.first < b.second - b.first;
+  });
+
+  std::vector<uint32_t> candidates(lists[0].first, lists[0].second);
+  for (size_t l = 1; l < lists.size() && !candidates.empty(); l++) {
+    const uint32_t* from = lists[l].first;
+    const uint32_t* const end = lists[l].second;
+    size_t kept = 0;
+    for (uint32_t slot : candidates) {
+      from = std::lower_bound(from, end, slot);
+      if (from == end) {
+        break;
+      }
+      if (*from == slot) {
+        candidates[kept++] = slot;
+      }
+    }
+    candidates.resize(kept);
+  }
+
+  // The best |max| so far, in a heap with the worst on top.
+  struct Ranked {
+    int score;
+    int64_t last_played_us;
+    uint32_t id;
+  };
+  auto better = [](const Ranked& a, const Ranked& b) {
+    if (a.score != b.score) {
+      return a.score > b.score;
+    }
+    if (a.last_played_us != b.last_played_us) {
+      return a.last_played_us > b.last_played_us;
+    }
+    return a.id < b.id;
+  };
+  std::vector<Ranked> best;
+  best.reserve(MIN(max, candidates.size() + raised_.size() + unindexed()));
+  const int max_match_score =
+      static_cast<int>(tokens.size()) * (kFieldScores[0] + kWordStartScore);
+
+  auto consider = [&](const Entry& entry) {
+    int score = popularity_score(entry.plays, entry.last_played_us, now_us);
+    // Not worth matching if even the best match would not make the cut.
+    if (best.size() == max && score + max_match_score < best.front().score) {
+      return;
+    }
+    for (const Token& token : tokens) {
+      const int match = MatchToken(entry, token);
+      if (match < 0) {
+        return;
+      }
+      score += match;
+    }
+
+    const Ranked ranked = {score, entry.last_played_us, entry.id};
+    if (best.size() < max) {
+      best.push_back(ranked);
+      std::push_heap(best.begin(), best.end(), better);
+    } else if (better(ranked, best.front())) {
+      std::pop_heap(best.begin(), best.end(), better);
+      best.back() = ranked;
+      std::push_heap(best.begin(), best.end(), better);
+    }
+  };
+  // Built scores only fall as time passes, and fall in slot order, so once
+  // one cannot make the cut neither can any later slot. Raised slots
+  // were played since, and a clock set back undoes the first.
+  const bool can_stop = now_us >= built_at_us_;
+  for (uint32_t slot : candidates) {
+    const Entry& entry = entries_[slot];
+    if (entry.raised) {
+      continue;
+    }
+    if (can_stop && best.size() == max &&
+        entry.built_score + max_match_score < best.front().score) {
+      break;
+    }
+    consider(entry);
+  }
+  for (uint32_t slot : raised_) {
+    consider(entries_[slot]);
+  }
+  for (size_t slot = indexed_; slot < entries_.size(); slot++) {
+    consider(entries_[slot]);
+  }
+
+  std::sort_heap(best.begin(), best.end(), better);
+  out->reserve(best.size());
+  for (const Ranked& ranked : best) {
+    out->push_back(ranked.id);
+  }
+}
+
+size_t TrackSearchIndex::memory_bytes() const {
+  size_t bytes = tracks_.capacity() * sizeof(SearchTrack) +
+                 entries_.capacity() * sizeof(Entry) + text_.capacity() +
+                 (slots_.capacity() + offsets_.capacity() +
+                  postings_.capacity() + raised_.capacity()) *
+                     sizeof(uint32_t);
+  for (const SearchTrack& track : tracks_) {
+    bytes += track.title.capacity() + track.artist.capacity() +
+             track.album.capacity();
+  }
+  return bytes;
+}
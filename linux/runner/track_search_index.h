@@ -0,0 +1,130 @@
+#ifndef RUNNER_TRACK_SEARCH_INDEX_H_
+#define RUNNER_TRACK_SEARCH_INDEX_H_
+
+#include <glib.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "listening_history.h"
+
+// A distinct track from the listening history, and how it was played.
+struct SearchTrack {
+  std::string title;
+  std::string artist;
+  std::string album;
+  uint32_t plays = 0;
+  // When its last play started, in microseconds since the epoch.
+  int64_t last_played_us = 0;
+};
+
+// An in-memory index of played tracks by title, artist and album, for the
+// shell search provider. Text is case-folded and stripped of accents.
+// Search terms of three bytes or more match anywhere in a field, through
+// trigram posting lists; shorter ones match the start of a word, through
+// lists of one- and two-byte word prefixes. Posting lists are built in
+// one pass into a flat array; tracks added or played again afterwards are
+// scanned instead, until there are enough of them to rebuild.
+//
+// Track ids are stable for the life of the index. Not thread-safe.
+class TrackSearchIndex {
+ public:
+  // Returns every distinct track in |history| with its play count, in
+  // the order they were first played.
+  static std::vector<SearchTrack> CollectTracks(
+      const ListeningHistory& history);
+
+  explicit TrackSearchIndex(std::vector<SearchTrack> tracks);
+  TrackSearchIndex(const TrackSearchIndex&) = delete;
+  TrackSearchIndex& operator=(const TrackSearchIndex&) = delete;
+
+  // Counts a play started at |played_at_us|, adding the track if it is
+  // new. Returns its id.
+  uint32_t AddPlay(const char* title, const char* artist, const char* album,
+                   int64_t played_at_us);
+
+  // Replaces |out| with the ids of up to |max| tracks matching every one
+  // of |terms|, best first: by where the terms matched, then by how often
+  // and how recently the track was played, as of |now_us|.
+  void Search(const gchar* const* terms, size_t max, int64_t now_us,
+              std::vector<uint32_t>* out) const;
+
+  // Returns the track with |id|, or nullptr if there is none.
+  const SearchTrack* track(uint32_t id) const {
+    return id < tracks_.size() ? &tracks_[id] : nullptr;
+  }
+
+  size_t size() const { return tracks_.size(); }
+  size_t unindexed() const { return tracks_.size() - indexed_; }
+
+  // Heap bytes taken by the tracks, their folded text and the posting
+  // lists.
+  size_t memory_bytes() const;
+
+ private:
+  // What a search reads of a track, kept apart from its strings so that
+  // ranking tens of thousands of candidates stays in cache.
+  struct Entry {
+    // Where the folded title, artist and album start in |text_|, and
+    // where the next track's does. Each is followed by a '\n'.
+    uint32_t field_at[4];
+    // Per field, a bit per first byte of its words (see word_bit()).
+    uint64_t word_masks[3];
+    // Copies of the track's.
+    int64_t last_played_us;
+    uint32_t plays;
+    uint32_t id;
+    // Its popularity and recency score when the index was built, which
+    // it can only have lost since unless |raised|.
+    uint8_t built_score;
+    // Played again since.
+    bool raised;
+  };
+
+  struct Token {
+    std::string text;
+    // Shorter than a trigram, so matched against word starts.
+    bool prefix;
+  };
+
+  std::string_view Field(const Entry& entry, int field) const {
+    return std::string_view(text_).substr(
+        entry.field_at[field],
+        entry.field_at[field + 1] - entry.field_at[field] - 1);
+  }
+  int MatchToken(const Entry& entry, const Token& token) const;
+
+  template <typename Visit>
+  void ForEachBucket(const Entry& entry, Visit visit) const;
+
+  void AddTrack(SearchTrack track);
+  void Rebuild();
+
+  std::vector<SearchTrack> tracks_;
+  // Entries by slot: the indexed ones best built_score first, then the
+  // tail.
+  std::vector<Entry> entries_;
+  // The slot of each track id.
+  std::vector<uint32_t> slots_;
+  // The folded text of every track, one after the other.
+  std::string text_;
+  // Track ids by title, artist and album joined by '\n'.
+  std::unordered_map<std::string, uint32_t> ids_;
+
+  // Posting lists of the first |indexed_| slots: those of bucket b are
+  // postings_[offsets_[b], offsets_[b + 1]), in ascending slot order. So
+  // candidates come out best built_score first, and a search can stop
+  // once the rest could not make the cut.
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> postings_;
+  size_t indexed_ = 0;
+  // The last play the index held when built, which built scores are
+  // relative to.
+  int64_t built_at_us_ = 0;
+  // Indexed slots played again since, which are scanned.
+  std::vector<uint32_t> raised_;
+};
+
+#endif  // RUNNER_TRACK_SEARCH_INDEX_H_
@@ -0,0 +1,369 @@
+#include "url_matcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Rules are split at '*' into literal segments. All segments go into one
+// Aho-Corasick automaton, flattened to a DFA over byte classes, so a URL
+// is scanned once whatever the number of rules. A rule matches when its
+// segments are found in order without overlapping; taking the earliest
+// occurrence of each segment is enough to decide that.
+
+enum RuleAnchor : uint8_t {
+  kAnchorStart = 1 << 0,
+  kAnchorEnd = 1 << 1,
+  kAnchorDomain = 1 << 2,
+};
+
+struct Rule {
+  uint32_t segment_count;
+  uint8_t anchors;
+};
+
+// Reported when the automaton reaches a state where segment |index| of
+// |rule| ends.
+struct SegmentOutput {
+  uint32_t rule;
+  uint32_t index;
+  uint32_t length;
+};
+
+struct UrlMatcher {
+  // Distinguishes matchers in the per-thread scratch below, which must
+  // not be confused by a new matcher reusing a freed address.
+  uint64_t id;
+  std::vector<Rule> rules;
+  std::unique_ptr<std::atomic<uint64_t>[]> hits;
+  bool has_domain_anchors;
+  bool has_multi_segment_rules;
+
+  // ASCII letters share a class with their lower case; bytes that occur
+  // in no rule share class 0.
+  uint8_t byte_class[256];
+  uint32_t class_count;
+  // transitions[state * class_count + class] is the next state.
+  std::vector<uint32_t> transitions;
+  // The outputs of |state|, including those inherited through its failure
+  // links, are outputs[output_begin[state]] up to output_begin[state + 1].
+  std::vector<uint32_t> output_begin;
+  std::vector<SegmentOutput> outputs;
+};
+
+// Progress of multi-segment rules through one URL. Entries whose epoch is
+// not the current one are treated as untouched, so nothing is cleared
+// between URLs.
+struct MatchScratch {
+  uint64_t matcher_id = 0;
+  uint32_t epoch = 0;
+  std::vector<uint32_t> epochs;
+  // Segments matched so far, and the offset just past the last of them.
+  std::vector<uint32_t> matched;
+  std::vector<uint32_t> matched_end;
+};
+
+static std::atomic<uint64_t> next_matcher_id{1};
+static thread_local MatchScratch scratch;
+
+static inline uint8_t fold_case(uint8_t c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Splits |pattern| into |rule| and its lower-cased literal segments.
+static void parse_rule(std::string pattern, Rule* rule,
+                       std::vector<std::string>* segments) {
+  rule->anchors = 0;
+
+  if (pattern.compare(0, 2, "||") == 0) {
+    rule->anchors |= kAnchorDomain;
+    pattern.erase(0, 2);
+  } else if (pattern.compare(0, 1, "|") == 0) {
+    rule->anchors |= kAnchorStart;
+    pattern.erase(0, 1);
+  }
+  if (!pattern.empty() && pattern.back() == '|') {
+    rule->anchors |= kAnchorEnd;
+    pattern.pop_back();
+  }
+  // A wildcard next to an anchor cancels it.
+  if (!pattern.empty() && pattern.front() == '*') {
+    rule->anchors &= ~(kAnchorStart | kAnchorDomain);
+  }
+  if (!pattern.empty() && pattern.back() == '*') {
+    rule->anchors &= ~kAnchorEnd;
+  }
+
+  size_t start = 0;
+  while (start <= pattern.size()) {
+    size_t end = pattern.find('*', start);
+    if (end == std::string::npos) {
+      end = pattern.size();
+    }
+    if (end > start) {
+      std::string segment = pattern.substr(start, end - start);
+      for (char& c : segment) {
+        c = static_cast<char>(fold_case(static_cast<uint8_t>(c)));
+      }
+      segments->push_back(std::move(segment));
+    }
+    start = end + 1;
+  }
+  rule->segment_count = static_cast<uint32_t>(segments->size());
+}
+
+static void build_byte_classes(
+    UrlMatcher* matcher,
+    const std::vector<std::vector<std::string>>& rule_segments) {
+  memset(matcher->byte_class, 0, sizeof(matcher->byte_class));
+  matcher->class_count = 1;
+
+  for (const std::vector<std::string>& segments : rule_segments) {
+    for (const std::string& segment : segments) {
+      for (char c : segment) {
+        uint8_t byte = static_cast<uint8_t>(c);
+        if (matcher->byte_class[byte] == 0) {
+          matcher->byte_class[byte] =
+              static_cast<uint8_t>(matcher->class_count++);
+        }
+      }
+    }
+  }
+  for (int c = 'A'; c <= 'Z'; c++) {
+    matcher->byte_class[c] = matcher->byte_class[fold_case(c)];
+  }
+}
+
+static void build_automaton(
+    UrlMatcher* matcher,
+    const std::vector<std::vector<std::string>>& rule_segments) {
+  const uint32_t classes = matcher->class_count;
+  // State 0 is the root; 0 also marks a missing trie edge while building,
+  // which is unambiguous because no edge leads back to the root.
+  std::vector<uint32_t>& next = matcher->transitions;
+  next.assign(classes, 0);
+  std::vector<std::vector<SegmentOutput>> own_outputs(1);
+
+  for (uint32_t rule = 0; rule < rule_segments.size(); rule++) {
+    const std::vector<std::string>& segments = rule_segments[rule];
+    for (uint32_t index = 0; index < segments.size(); index++) {
+      uint32_t state = 0;
+      for (char c : segments[index]) {
+        uint32_t byte_class = matcher->byte_class[static_cast<uint8_t>(c)];
+        uint32_t& edge = next[state * classes + byte_class];
+        if (edge == 0) {
+          edge = static_cast<uint32_t>(own_outputs.size());
+          own_outputs.emplace_back();
+          // |next| may reallocate, so |edge| is not used past this point.
+          next.resize(next.size() + classes, 0);
+        }
+        state = next[state * classes + byte_class];
+      }
+      own_outputs[state].push_back(SegmentOutput{
+          rule, index, static_cast<uint32_t>(segments[index].size())});
+    }
+  }
+
+  // Breadth-first, filling missing edges from the failure state so every
+  // transition is a single lookup, and appending inherited outputs.
+  const size_t state_count = own_outputs.size();
+  std::vector<uint32_t> fail(state_count, 0);
+  std::vector<uint32_t> queue;
+  queue.reserve(state_count);
+  for (uint32_t c = 0; c < classes; c++) {
+    if (next[c] != 0) {
+      queue.push_back(next[c]);
+    }
+  }
+  for (size_t head = 0; head < queue.size(); head++) {
+    uint32_t state = queue[head];
+    const std::vector<SegmentOutput>& inherited = own_outputs[fail[state]];
+    own_outputs[state].insert(own_outputs[state].end(), inherited.begin(),
+                              inherited.end());
+    for (uint32_t c = 0; c < classes; c++) {
+      uint32_t& edge = next[state * classes + c];
+      uint32_t fallback = next[fail[state] * classes + c];
+      if (edge == 0) {
+        edge = fallback;
+      } else {
+        fail[edge] = fallback;
+        queue.push_back(edge);
+      }
+    }
+  }
+
+  matcher->output_begin.resize(state_count + 1);
+  matcher->outputs.clear();
+  for (size_t state = 0; state < state_count; state++) {
+    matcher->output_begin[state] =
+        static_cast<uint32_t>(matcher->outputs.size());
+    matcher->outputs.insert(matcher->outputs.end(),
+                            own_outputs[state].begin(),
+                            own_outputs[state].end());
+  }
+  matcher->output_begin[state_count] =
+      static_cast<uint32_t>(matcher->outputs.size());
+}
+
+UrlMatcher* url_matcher_new(const char* rules, size_t length) {
+  UrlMatcher* matcher = new UrlMatcher();
+  matcher->id = next_matcher_id++;
+
+  std::vector<std::vector<std::string>> rule_segments;
+  const char* end = rules + length;
+  for (const char* line = rules; line < end;) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line, '\n', end - line));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    const char* first = line;
+    const char* last = line_end;
+    while (first < last && is_space(*first)) {
+      first++;
+    }
+    while (last > first && is_space(last[-1])) {
+      last--;
+    }
+    line = line_end + 1;
+    if (first == last || *first == '#' || *first == '!') {
+      continue;
+    }
+
+    Rule rule;
+    rule_segments.emplace_back();
+    parse_rule(std::string(first, last), &rule, &rule_segments.back());
+    matcher->rules.push_back(rule);
+    if (rule.anchors & kAnchorDomain) {
+      matcher->has_domain_anchors = true;
+    }
+    if (rule.segment_count > 1) {
+      matcher->has_multi_segment_rules = true;
+    }
+  }
+
+  matcher->hits.reset(new std::atomic<uint64_t>[matcher->rules.size()]());
+  build_byte_classes(matcher, rule_segments);
+  build_automaton(matcher, rule_segments);
+  return matcher;
+}
+
+void url_matcher_free(UrlMatcher* matcher) {
+  delete matcher;
+}
+
+uint32_t url_matcher_rule_count(const UrlMatcher* matcher) {
+  return static_cast<uint32_t>(matcher->rules.size());
+}
+
+uint64_t url_matcher_rule_hits(const UrlMatcher* matcher, uint32_t rule) {
+  if (rule >= matcher->rules.size()) {
+    return 0;
+  }
+  return matcher->hits[rule].load(std::memory_order_relaxed);
+}
+
+// Finds the host as the span after "://" up to the next '/', '?' or '#'.
+// Without a scheme there is no host and domain anchors never match.
+static void find_host(const char* url, size_t length, size_t* host_start,
+                      size_t* host_end) {
+  *host_start = *host_end = 0;
+  const char* scheme_end = static_cast<const char*>(
+      memmem(url, length, "://", 3));
+  if (scheme_end == nullptr) {
+    return;
+  }
+  size_t start = scheme_end - url + 3;
+  size_t end = start;
+  while (end < length && url[end] != '/' && url[end] != '?' &&
+         url[end] != '#') {
+    end++;
+  }
+  *host_start = start;
+  *host_end = end;
+}
+
+static void prepare_scratch(const UrlMatcher* matcher) {
+  if (scratch.matcher_id != matcher->id) {
+    scratch.matcher_id = matcher->id;
+    scratch.epoch = 0;
+    scratch.epochs.assign(matcher->rules.size(), 0);
+    scratch.matched.resize(matcher->rules.size());
+    scratch.matched_end.resize(matcher->rules.size());
+  }
+  if (++scratch.epoch == 0) {
+    std::fill(scratch.epochs.begin(), scratch.epochs.end(), 0);
+    scratch.epoch = 1;
+  }
+}
+
+int32_t url_matcher_match(UrlMatcher* matcher, const char* url,
+                          size_t length) {
+  size_t host_start = 0;
+  size_t host_end = 0;
+  if (matcher->has_domain_anchors) {
+    find_host(url, length, &host_start, &host_end);
+  }
+  if (matcher->has_multi_segment_rules) {
+    prepare_scratch(matcher);
+  }
+
+  const uint32_t classes = matcher->class_count;
+  const uint32_t* transitions = matcher->transitions.data();
+  const uint32_t* output_begin = matcher->output_begin.data();
+  const SegmentOutput* outputs = matcher->outputs.data();
+  uint32_t state = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    uint8_t byte_class = matcher->byte_class[static_cast<uint8_t>(url[i])];
+    state = transitions[state * classes + byte_class];
+
+    for (uint32_t o = output_begin[state]; o < output_begin[state + 1];
+         o++) {
+      const SegmentOutput& output = outputs[o];
+      const Rule& rule = matcher->rules[output.rule];
+      size_t start = i + 1 - output.length;
+
+      uint32_t matched = 0;
+      uint32_t matched_end = 0;
+      if (rule.segment_count > 1 &&
+          scratch.epochs[output.rule] == scratch.epoch) {
+        matched = scratch.matched[output.rule];
+        matched_end = scratch.matched_end[output.rule];
+      }
+      if (output.index != matched || start < matched_end) {
+        continue;
+      }
+
+      if (output.index == 0) {
+        if ((rule.anchors & kAnchorStart) && start != 0) {
+          continue;
+        }
+        if ((rule.anchors & kAnchorDomain) &&
+            !(host_end > host_start && start >= host_start &&
+              start < host_end &&
+              (start == host_start || url[start - 1] == '.'))) {
+          continue;
+        }
+      }
+      if (output.index + 1 == rule.segment_count) {
+        if ((rule.anchors & kAnchorEnd) && i + 1 != length) {
+          continue;
+        }
+        matcher->hits[output.rule].fetch_add(1, std::memory_order_relaxed);
+        return static_cast<int32_t>(output.rule);
+      }
+
+      scratch.epochs[output.rule] = scratch.epoch;
+      scratch.matched[output.rule] = output.index + 1;
+      scratch.matched_end[output.rule] = static_cast<uint32_t>(i + 1);
+    }
+  }
+  return -1;
+}
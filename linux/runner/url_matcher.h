@@ -0,0 +1,51 @@
+#ifndef RUNNER_URL_MATCHER_H_
+#define RUNNER_URL_MATCHER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Matches URLs against the network block rules in a single pass. Exported
+// for lib/services/url_blocker.dart, which reaches it through dart:ffi.
+//
+// One rule per line; blank lines and lines starting with '#' or '!' are
+// comments. Within a rule:
+//
+//   *      matches any run of characters, including none
+//   |x     x must start the URL
+//   x|     x must end the URL
+//   ||x    x must start the host or one of its labels
+//
+// Anything else matches literally, ignoring ASCII case. Rule ids count the
+// non-comment lines from zero.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct UrlMatcher UrlMatcher;
+
+#define URL_MATCHER_EXPORT __attribute__((visibility("default")))
+
+// Compiles |length| bytes of rule text. Never returns NULL.
+URL_MATCHER_EXPORT UrlMatcher* url_matcher_new(const char* rules,
+                                               size_t length);
+
+URL_MATCHER_EXPORT void url_matcher_free(UrlMatcher* matcher);
+
+URL_MATCHER_EXPORT uint32_t url_matcher_rule_count(const UrlMatcher* matcher);
+
+// Returns the id of a rule matching the |length| bytes at |url| and counts
+// a hit for it, or -1. When several rules match, the one whose match
+// completes first is reported. Safe to call from several threads.
+URL_MATCHER_EXPORT int32_t url_matcher_match(UrlMatcher* matcher,
+                                             const char* url, size_t length);
+
+// Returns how often url_matcher_match has reported |rule|.
+URL_MATCHER_EXPORT uint64_t url_matcher_rule_hits(const UrlMatcher* matcher,
+                                                  uint32_t rule);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // RUNNER_URL_MATCHER_H_
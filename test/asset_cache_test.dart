@@ -0,0 +1,274 @@
+import 'dart:convert';
+import 'dart:math';
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:flutter_test/flutter_test.dart';
+import 'package:youtube_music_unbound/services/asset_cache.dart';
+
+/// Keeps what the cache stores in memory, in place of the runner's store.
+class _MemoryAssetStore implements AssetStore {
+  final Map<String, CachedAsset> assets = {};
+  int _hits = 0;
+  int _misses = 0;
+
+  @override
+  CachedAsset? lookup(String url) {
+    final asset = assets[url];
+    if (asset == null) {
+      _misses++;
+    } else {
+      _hits++;
+    }
+    return asset;
+  }
+
+  @override
+  void put(String url, Map<String, String> headers, Uint8List body) {
+    assets[url] = CachedAsset(body, headers);
+  }
+
+  @override
+  ({int hits, int misses}) get stats => (hits: _hits, misses: _misses);
+
+  @override
+  void dispose() {}
+}
+
+void main() {
+  group('AssetCache', () {
+    test('should cache only versioned static assets', () {
+      expect(
+        AssetCache.isCacheable(
+          Uri.parse(
+            'https://music.youtube.com/s/_/ytmusic/_/js/k=ytmusic.baseline.en/m=_b',
+          ),
+        ),
+        isTrue,
+      );
+      expect(
+        AssetCache.isCacheable(
+          Uri.parse('https://fonts.gstatic.com/s/roboto/v30/font.woff2'),
+        ),
+        isTrue,
+      );
+      expect(
+        AssetCache.isCacheable(
+          Uri.parse('https://music.youtube.com/youtubei/v1/browse'),
+        ),
+        isFalse,
+      );
+      expect(
+        AssetCache.isCacheable(
+          Uri.parse('https://music.youtube.com/s/player/abc/base.js'),
+          method: 'POST',
+        ),
+        isFalse,
+      );
+      expect(
+        AssetCache.isCacheable(
+          Uri.parse('http://www.gstatic.com/youtube/img/logo.png'),
+        ),
+        isFalse,
+      );
+    });
+
+    test('should store only public, long-lived responses', () {
+      expect(
+        AssetCache.isStorable(200, cacheControl: 'public, max-age=31536000'),
+        isTrue,
+      );
+      expect(AssetCache.isStorable(200, cacheControl: 'max-age=300'), isFalse);
+      expect(
+        AssetCache.isStorable(200, cacheControl: 'private, max-age=31536000'),
+        isFalse,
+      );
+      expect(
+        AssetCache.isStorable(
+          200,
+          cacheControl: 'public, max-age=31536000',
+          setsCookie: true,
+        ),
+        isFalse,
+      );
+      expect(
+        AssetCache.isStorable(206, cacheControl: 'public, max-age=31536000'),
+        isFalse,
+      );
+    });
+
+    test('should round-trip stored headers', () {
+      final headers = {
+        'content-type': 'text/javascript; charset=utf-8',
+        'access-control-allow-origin': '*',
+      };
+
+      expect(
+        AssetCache.parseHeaders(AssetCache.formatHeaders(headers)),
+        headers,
+      );
+
+      final asset = CachedAsset(
+        Uint8List(0),
+        AssetCache.parseHeaders('Content-Type: text/css; charset=utf-8\n'),
+      );
+      expect(asset.contentType, 'text/css');
+      expect(asset.charset, 'utf-8');
+    });
+  });
+
+  group('AssetCache.fill', () {
+    const longLived = 'public, max-age=31536000';
+    const script = 'console.log("cached");';
+    final oversize = Uint8List(AssetCache.maxBodySize + 1);
+
+    late HttpServer server;
+    late _MemoryAssetStore store;
+    late AssetCache cache;
+    final requests = <String>[];
+    String? forwardedCookie;
+    var inFlight = 0;
+    var maxInFlight = 0;
+
+    String url(String path) => 'http://127.0.0.1:${server.port}$path';
+
+    setUp(() async {
+      requests.clear();
+      forwardedCookie = null;
+      inFlight = 0;
+      maxInFlight = 0;
+      store = _MemoryAssetStore();
+      cache = AssetCache(store);
+      server = await HttpServer.bind(InternetAddress.loopbackIPv4, 0);
+      server.listen((request) async {
+        requests.add(request.uri.path);
+        forwardedCookie = request.headers.value('cookie');
+        final response = request.response;
+        response.headers.set('cache-control', longLived);
+        final slow = request.uri.path.startsWith('/s/slow/');
+        if (slow) maxInFlight = max(maxInFlight, ++inFlight);
+        try {
+          switch (request.uri.path) {
+            case '/s/app.js':
+              response.headers
+                ..set('content-type', 'text/javascript; charset=utf-8')
+                ..set('access-control-allow-origin', '*')
+                ..set('x-served-by', 'test');
+              response.write(script);
+            case '/short.js':
+              response.headers.set('cache-control', 'max-age=300');
+              response.write(script);
+            case '/cookie.js':
+              response.headers.set('set-cookie', 'id=1');
+              response.write(script);
+            case '/big.bin':
+              response.contentLength = oversize.length;
+              response.add(oversize);
+            case '/big-chunked.bin':
+              for (var sent = 0; sent < oversize.length; sent += 1 << 20) {
+                response.add(Uint8List(1 << 20));
+                await response.flush();
+              }
+            case final path when path.startsWith('/s/slow/'):
+              await Future<void>.delayed(const Duration(milliseconds: 20));
+              response.write(script);
+            default:
+              response.statusCode = HttpStatus.notFound;
+          }
+          await response.close();
+        } on Object {
+          // The cache hangs up on what it does not store.
+        } finally {
+          if (slow) inFlight--;
+        }
+      });
+    });
+
+    tearDown(() async {
+      cache.dispose();
+      await server.close(force: true);
+    });
+
+    test('should serve a stored response from lookup', () async {
+      final filled = await cache.fill(
+        url('/s/app.js'),
+        requestHeaders: {'Cookie': 'SID=secret', 'User-Agent': 'test'},
+      );
+
+      expect(filled, isNotNull);
+      expect(utf8.decode(filled!.body), script);
+      expect(filled.headers, {
+        'content-type': 'text/javascript; charset=utf-8',
+        'access-control-allow-origin': '*',
+      });
+      expect(forwardedCookie, isNull);
+
+      final hit = cache.lookup(url('/s/app.js'));
+      expect(hit, isNotNull);
+      expect(hit!.body, filled.body);
+      expect(hit.headers, filled.headers);
+      expect(hit.contentType, 'text/javascript');
+      expect(cache.lookup(url('/s/other.js')), isNull);
+      expect(cache.stats, (hits: 1, misses: 1));
+    });
+
+    test('should download each URL once a session', () async {
+      expect(await cache.fill(url('/s/app.js')), isNotNull);
+      expect(await cache.fill(url('/s/app.js')), isNull);
+      expect(await cache.fill(url('/short.js')), isNull);
+      expect(await cache.fill(url('/short.js')), isNull);
+
+      expect(requests, ['/s/app.js', '/short.js']);
+      expect(cache.lookup(url('/s/app.js')), isNotNull);
+    });
+
+    test('should not store responses that may not be stored', () async {
+      expect(await cache.fill(url('/short.js')), isNull);
+      expect(await cache.fill(url('/cookie.js')), isNull);
+      expect(await cache.fill(url('/missing.js')), isNull);
+
+      expect(store.assets, isEmpty);
+    });
+
+    test('should not store bodies over the size limit', () async {
+      expect(await cache.fill(url('/big.bin')), isNull);
+      expect(await cache.fill(url('/big-chunked.bin')), isNull);
+
+      expect(store.assets, isEmpty);
+    });
+
+    test('should hold queued misses until filling starts', () async {
+      for (var i = 0; i < 5; i++) {
+        cache.queueFill(url('/s/slow/$i.js'));
+      }
+      cache.queueFill(url('/s/slow/0.js'));
+      await Future<void>.delayed(const Duration(milliseconds: 50));
+      expect(requests, isEmpty);
+
+      cache.startFilling();
+      while (store.assets.length < 5) {
+        await Future<void>.delayed(const Duration(milliseconds: 10));
+      }
+      expect(requests, hasLength(5));
+      expect(maxInFlight, lessThanOrEqualTo(AssetCache.fillConcurrency));
+      expect(maxInFlight, greaterThan(0));
+
+      cache.queueFill(url('/s/app.js'));
+      while (store.assets.length < 6) {
+        await Future<void>.delayed(const Duration(milliseconds: 10));
+      }
+      expect(cache.lookup(url('/s/app.js')), isNotNull);
+    });
+
+    test('should not fill once disposed', () async {
+      cache.dispose();
+
+      expect(await cache.fill(url('/s/app.js')), isNull);
+      cache
+        ..queueFill(url('/s/slow/0.js'))
+        ..startFilling();
+      await Future<void>.delayed(const Duration(milliseconds: 50));
+      expect(requests, isEmpty);
+    });
+  });
+}
@@ -0,0 +1,146 @@
+import 'package:flutter_test/flutter_test.dart';
+import 'package:youtube_music_unbound/services/filter_lists.dart';
+import 'package:youtube_music_unbound/services/url_blocker.dart';
+
+void main() {
+  group('UrlBlocker', () {
+    test('should skip comments and blank lines', () {
+      final rules = UrlBlocker.parseRules(
+        '# comment\n\n  doubleclick.net  \n! also a comment\n/pagead/\r\n',
+      );
+
+      expect(rules, ['doubleclick.net', '/pagead/']);
+    });
+
+    test('should match substrings ignoring case', () {
+      final blocker = UrlBlocker(['doubleclick.net', '/pagead/']);
+
+      expect(blocker.match('https://googleads.g.DoubleClick.net/x'), 0);
+      expect(blocker.match('https://www.youtube.com/pagead/conversion'), 1);
+      expect(blocker.match('https://music.youtube.com/watch?v=1'), isNull);
+    });
+
+    test('should expand wildcards', () {
+      final blocker = UrlBlocker(['/get_video_info?*=adunit']);
+
+      expect(
+        blocker.shouldBlock('https://x.com/get_video_info?a=1&b=adunit'),
+        isTrue,
+      );
+      expect(
+        blocker.shouldBlock('https://x.com/get_video_info?adunit'),
+        isFalse,
+      );
+    });
+
+    test('should honour anchors', () {
+      final blocker = UrlBlocker([
+        '||ads.example.com',
+        '|https://start.',
+        '.gif|',
+      ]);
+
+      expect(blocker.match('https://ads.example.com/x'), 0);
+      expect(blocker.match('https://cdn.ads.example.com/x'), 0);
+      expect(blocker.match('https://badads.example.com/x'), isNull);
+      expect(blocker.match('https://x.com/?u=ads.example.com'), isNull);
+      expect(blocker.match('https://start.example.com/'), 1);
+      expect(blocker.match('http://x.com/https://start.'), isNull);
+      expect(blocker.match('https://x.com/pixel.gif'), 2);
+      expect(blocker.match('https://x.com/pixel.gif?x=1'), isNull);
+    });
+
+    test('should count hits per rule', () {
+      final blocker = UrlBlocker(['/pagead/', 'doubleclick.net']);
+
+      blocker.match('https://www.youtube.com/pagead/1');
+      blocker.match('https://www.youtube.com/pagead/2');
+      blocker.match('https://music.youtube.com/');
+
+      expect(blocker.hitCounts(), {'/pagead/': 2});
+    });
+
+    test('should parse hosts-file lines', () {
+      final hosts = UrlBlocker.parseHosts(
+        '# comment\n'
+        '0.0.0.0 localhost\n'
+        '127.0.0.1 Ads.Example.com tracker.net # inline\n'
+        '::1 ip6-localhost v6.example\n'
+        'doubleclick.net\r\n'
+        '||adnet.io^\n'
+        '||third.party^\$third-party\n'
+        '! also a comment\n'
+        '*.wild.com\n',
+      );
+
+      expect(hosts, [
+        'ads.example.com',
+        'tracker.net',
+        'v6.example',
+        'doubleclick.net',
+        'adnet.io',
+      ]);
+    });
+
+    test('should block listed domains and their subdomains by host', () {
+      final blocker = UrlBlocker(
+        const [],
+        hosts: ['doubleclick.net', 'g.doubleclick.net', 'ads.example.com'],
+      );
+
+      expect(blocker.matchHost('https://doubleclick.net/x'), 0);
+      expect(blocker.matchHost('https://googleads.G.DoubleClick.net/x'), 0);
+      expect(blocker.matchHost('https://user@ads.example.com:8443/'), 2);
+      expect(blocker.matchHost('https://badads.example.com/'), isNull);
+      expect(blocker.matchHost('https://x.com/?u=doubleclick.net'), isNull);
+      expect(blocker.shouldBlock('https://stats.doubleclick.net/j'), isTrue);
+      expect(blocker.shouldBlock('https://example.com/'), isFalse);
+    });
+
+    test('should inject the domains into scripts', () {
+      final blocker = UrlBlocker(const [], hosts: ['doubleclick.net']);
+
+      expect(
+        blocker.injectInto('const h = ${UrlBlocker.hostsPlaceholder};'),
+        'const h = ["doubleclick.net"];',
+      );
+    });
+
+    test('should inject the rules into scripts', () {
+      final blocker = UrlBlocker(['/pagead/']);
+
+      expect(
+        blocker.injectInto('const p = ${UrlBlocker.scriptPlaceholder};'),
+        'const p = ["/pagead/"];',
+      );
+    });
+
+    test('should inject no selectors without filter lists', () {
+      final blocker = UrlBlocker(['/pagead/']);
+
+      expect(
+        blocker.injectInto('const s = ${UrlBlocker.cosmeticPlaceholder};'),
+        'const s = [];',
+      );
+    });
+
+    test('should infer request types from URLs', () {
+      expect(
+        FilterRequestType.infer('https://x.com/a/b.JS?v=1'),
+        FilterRequestType.script,
+      );
+      expect(
+        FilterRequestType.infer('https://x.com/', isForMainFrame: true),
+        FilterRequestType.document,
+      );
+      expect(
+        FilterRequestType.infer('https://rr1.googlevideo.com/videoplayback'),
+        FilterRequestType.media,
+      );
+      expect(
+        FilterRequestType.infer('https://x.com/youtubei/v1/next'),
+        FilterRequestType.other,
+      );
+    });
+  });
+}